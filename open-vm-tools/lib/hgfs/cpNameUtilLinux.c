@@ -135,7 +135,13 @@ CPNameUtilConvertUtf8FormCAndD(const char *cpNameToConvert,   // IN:
          goto exit;
       }
 
-      if (convertToFormC) {
+      if (CodeSet_IsAscii(begin, len)) {
+         /* ASCII names are the same in both forms. */
+         convertedName = Util_SafeMalloc(len + 1);
+         memcpy(convertedName, begin, len);
+         convertedName[len] = '\0';
+         convertedNameLen = len;
+      } else if (convertToFormC) {
          status = CodeSet_Utf8FormDToUtf8FormC(begin, 
                                                len, 
                                                &convertedName, 
@@ -0,0 +1,1518 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsDirNotifyLinux.c --
+ *
+ *    Directory change notification for the Linux platform, using inotify.
+ *
+ *    Every subscriber watches one directory of a shared folder, or a whole
+ *    tree of them when it is recursive. Each directory is one inotify
+ *    watch, shared by all subscribers referencing it, whose mask is the
+ *    union of what they asked for.
+ *
+ *    A single thread reads the inotify descriptor. Once an event arrives it
+ *    keeps reading until the file system has been quiet for a little while,
+ *    merging events on the same name for the same subscriber, and then
+ *    hands them to the server. Events that do not fit, or that happen while
+ *    the server is check point synchronizing, are reported to the client
+ *    as dropped so that it rereads whatever it cached.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include "vmware.h"
+#include "str.h"
+#include "util.h"
+#include "mutexRankLib.h"
+#include "hgfsServerInt.h"
+#include "hgfsDirNotify.h"
+
+
+/* Buckets of the wd -> watch hash table. */
+#define HGFS_NOTIFY_WATCH_BUCKETS    256
+
+/* Most distinct events queued before the remaining ones are dropped. */
+#define HGFS_NOTIFY_MAX_PENDING      1024
+
+/* Events are collected until quiet for QUIET ms, or for at most MAX ms. */
+#define HGFS_NOTIFY_COALESCE_QUIET   10
+#define HGFS_NOTIFY_COALESCE_MAX     100
+
+#define HGFS_NOTIFY_MODIFY_EVENTS (HGFS_NOTIFY_MODIFY | HGFS_NOTIFY_SIZE |      \
+                                   HGFS_NOTIFY_MTIME)
+#define HGFS_NOTIFY_ATTRIB_EVENTS (HGFS_NOTIFY_ATTRIB | HGFS_NOTIFY_ATIME |     \
+                                   HGFS_NOTIFY_CTIME | HGFS_NOTIFY_CHANGE_EA |  \
+                                   HGFS_NOTIFY_CHANGE_SECURITY)
+
+/*
+ * What each inotify event is reported as, for a file and for a directory.
+ * The same table gives the inotify events needed for an HGFS event filter.
+ */
+static const struct {
+   uint32 inMask;
+   uint32 fileEvents;
+   uint32 dirEvents;
+} hgfsNotifyEventMap[] = {
+   { IN_ACCESS,        HGFS_NOTIFY_ACCESS,
+                       HGFS_NOTIFY_ACCESS },
+   { IN_MODIFY,        HGFS_NOTIFY_MODIFY_EVENTS,
+                       HGFS_NOTIFY_MODIFY_EVENTS },
+   { IN_ATTRIB,        HGFS_NOTIFY_ATTRIB_EVENTS,
+                       HGFS_NOTIFY_ATTRIB_EVENTS },
+   { IN_OPEN,          HGFS_NOTIFY_OPEN,
+                       HGFS_NOTIFY_OPEN },
+   { IN_CLOSE_WRITE,   HGFS_NOTIFY_CLOSE_WRITE,
+                       HGFS_NOTIFY_CLOSE_WRITE },
+   { IN_CLOSE_NOWRITE, HGFS_NOTIFY_CLOSE_NOWRITE,
+                       HGFS_NOTIFY_CLOSE_NOWRITE },
+   { IN_CREATE,        HGFS_NOTIFY_CREATE_FILE | HGFS_NOTIFY_NAME,
+                       HGFS_NOTIFY_CREATE_DIR | HGFS_NOTIFY_NAME },
+   { IN_DELETE,        HGFS_NOTIFY_DELETE_FILE | HGFS_NOTIFY_NAME,
+                       HGFS_NOTIFY_DELETE_DIR | HGFS_NOTIFY_NAME },
+   { IN_MOVED_FROM,    HGFS_NOTIFY_OLD_FILE_NAME | HGFS_NOTIFY_NAME,
+                       HGFS_NOTIFY_OLD_DIR_NAME | HGFS_NOTIFY_NAME },
+   { IN_MOVED_TO,      HGFS_NOTIFY_NEW_FILE_NAME | HGFS_NOTIFY_NAME,
+                       HGFS_NOTIFY_NEW_DIR_NAME | HGFS_NOTIFY_NAME },
+   { IN_DELETE_SELF,   HGFS_NOTIFY_DELETE_SELF | HGFS_NOTIFY_WATCH_DELETED,
+                       HGFS_NOTIFY_DELETE_SELF | HGFS_NOTIFY_WATCH_DELETED },
+   { IN_MOVE_SELF,     HGFS_NOTIFY_MOVE_SELF,
+                       HGFS_NOTIFY_MOVE_SELF },
+};
+
+/* Always reported, whatever the subscriber asked for. */
+#define HGFS_NOTIFY_FORCED_EVENTS (HGFS_NOTIFY_WATCH_DELETED |                 \
+                                   HGFS_NOTIFY_EVENTS_DROPPED)
+
+
+typedef struct HgfsNotifyFolder {
+   DblLnkLst_Links links;           // hgfsNotifyFolders
+   HgfsSharedFolderHandle handle;
+   char *path;                      // Host path of the share root
+   char *shareName;
+   DblLnkLst_Links subscribers;     // HgfsNotifySubscriber.links
+} HgfsNotifyFolder;
+
+typedef struct HgfsNotifySubscriber {
+   DblLnkLst_Links links;           // HgfsNotifyFolder.subscribers
+   HgfsSubscriberHandle handle;
+   HgfsNotifyFolder *folder;
+   char *path;                      // Watched directory, relative to the share
+   uint32 eventFilter;
+   Bool recursive;
+   Bool suspended;                  // Server is check point synchronizing
+   Bool eventsDropped;              // Client must be told events were lost
+   struct HgfsSessionInfo *session;
+   DblLnkLst_Links refs;            // HgfsNotifyWatchRef.subscriberLinks
+} HgfsNotifySubscriber;
+
+typedef struct HgfsNotifyWatch {
+   DblLnkLst_Links links;           // hgfsNotifyWatches bucket
+   int wd;
+   DblLnkLst_Links refs;            // HgfsNotifyWatchRef.watchLinks
+} HgfsNotifyWatch;
+
+/* A directory of a subscriber, and the watch it is reached through. */
+typedef struct HgfsNotifyWatchRef {
+   DblLnkLst_Links watchLinks;
+   DblLnkLst_Links subscriberLinks;
+   HgfsNotifyWatch *watch;
+   HgfsNotifySubscriber *subscriber;
+   char *path;                      // Relative to the share, "" for the root
+} HgfsNotifyWatchRef;
+
+/* An event waiting to be delivered, by the notification thread only. */
+typedef struct HgfsNotifyPending {
+   HgfsSubscriberHandle subscriber;
+   char *name;
+   uint32 mask;
+} HgfsNotifyPending;
+
+
+/*
+ * hgfsNotifyLock protects the folders, subscribers and watches.
+ * hgfsNotifyDispatchLock is held while events are handed to the server, so
+ * that removing the subscribers of a session also waits for any event being
+ * delivered to it. It ranks below the shared folders lock the server takes
+ * when it receives an event, and is never taken with hgfsNotifyLock held.
+ */
+static MXUserExclLock *hgfsNotifyLock;
+static MXUserExclLock *hgfsNotifyDispatchLock;
+static DblLnkLst_Links hgfsNotifyFolders;
+static DblLnkLst_Links hgfsNotifyWatches[HGFS_NOTIFY_WATCH_BUCKETS];
+static HgfsSharedFolderHandle hgfsNotifyNextFolder;
+static HgfsSubscriberHandle hgfsNotifyNextSubscriber;
+
+static const HgfsServerNotifyCallbacks *hgfsNotifyCb;
+static int hgfsNotifyFd = -1;
+static int hgfsNotifyWakePipe[2] = { -1, -1 };
+static pthread_t hgfsNotifyThread;
+static Bool hgfsNotifyExiting;
+
+static HgfsNotifyPending hgfsNotifyPending[HGFS_NOTIFY_MAX_PENDING];
+static uint32 hgfsNotifyNumPending;
+
+static Bool HgfsNotifyWatchTree(HgfsNotifySubscriber *subscriber,
+                                const char *path);
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyJoin --
+ *
+ *    Appends a name to a relative path.
+ *
+ * Results:
+ *    The new path, which the caller frees.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static char *
+HgfsNotifyJoin(const char *path,  // IN: path, may be ""
+               const char *name)  // IN: name
+{
+   if (*path == '\0') {
+      return Util_SafeStrdup(name);
+   }
+   return Str_SafeAsprintf(NULL, "%s/%s", path, name);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyHostPath --
+ *
+ *    Host path of a directory of a subscriber.
+ *
+ * Results:
+ *    The path, which the caller frees.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static char *
+HgfsNotifyHostPath(const HgfsNotifySubscriber *subscriber,  // IN: subscriber
+                   const char *path)                        // IN: relative path
+{
+   if (*path == '\0') {
+      return Util_SafeStrdup(subscriber->folder->path);
+   }
+   return Str_SafeAsprintf(NULL, "%s/%s", subscriber->folder->path, path);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyInMask --
+ *
+ *    The inotify events needed for the directories of a subscriber.
+ *
+ * Results:
+ *    inotify event mask.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsNotifyInMask(const HgfsNotifySubscriber *subscriber)  // IN: subscriber
+{
+   uint32 inMask = IN_DELETE_SELF | IN_MOVE_SELF;
+   size_t i;
+
+   for (i = 0; i < ARRAYSIZE(hgfsNotifyEventMap); i++) {
+      if (subscriber->eventFilter & (hgfsNotifyEventMap[i].fileEvents |
+                                     hgfsNotifyEventMap[i].dirEvents) &
+                                    ~HGFS_NOTIFY_FORCED_EVENTS) {
+         inMask |= hgfsNotifyEventMap[i].inMask;
+      }
+   }
+   if (subscriber->recursive) {
+      /* Directories appearing and leaving the tree. */
+      inMask |= IN_CREATE | IN_MOVED_FROM | IN_MOVED_TO;
+   }
+   return inMask;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyHgfsMask --
+ *
+ *    Converts an inotify event mask.
+ *
+ * Results:
+ *    HGFS event mask.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsNotifyHgfsMask(uint32 inMask)  // IN: inotify event mask
+{
+   uint32 mask = 0;
+   size_t i;
+
+   for (i = 0; i < ARRAYSIZE(hgfsNotifyEventMap); i++) {
+      if (inMask & hgfsNotifyEventMap[i].inMask) {
+         mask |= (inMask & IN_ISDIR) ? hgfsNotifyEventMap[i].dirEvents :
+                                       hgfsNotifyEventMap[i].fileEvents;
+      }
+   }
+   return mask;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyFindWatch --
+ *
+ *    Looks up a watch by its descriptor. Called with hgfsNotifyLock held.
+ *
+ * Results:
+ *    The watch, NULL if none.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsNotifyWatch *
+HgfsNotifyFindWatch(int wd)  // IN: watch descriptor
+{
+   DblLnkLst_Links *bucket = &hgfsNotifyWatches[(uint32)wd % HGFS_NOTIFY_WATCH_BUCKETS];
+   DblLnkLst_Links *link;
+
+   DblLnkLst_ForEach(link, bucket) {
+      HgfsNotifyWatch *watch = DblLnkLst_Container(link, HgfsNotifyWatch, links);
+
+      if (watch->wd == wd) {
+         return watch;
+      }
+   }
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyDropRef --
+ *
+ *    Removes a directory from a subscriber. The watch goes with its last
+ *    reference. Called with hgfsNotifyLock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Removes the inotify watch if asked to and no longer referenced.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyDropRef(HgfsNotifyWatchRef *ref,  // IN: reference
+                  Bool removeWatch)         // IN: watch is still in the kernel
+{
+   HgfsNotifyWatch *watch = ref->watch;
+
+   DblLnkLst_Unlink1(&ref->watchLinks);
+   DblLnkLst_Unlink1(&ref->subscriberLinks);
+   free(ref->path);
+   free(ref);
+
+   if (!DblLnkLst_IsLinked(&watch->refs)) {
+      if (removeWatch) {
+         /* The IN_IGNORED this queues finds no watch and is skipped. */
+         inotify_rm_watch(hgfsNotifyFd, watch->wd);
+      }
+      DblLnkLst_Unlink1(&watch->links);
+      free(watch);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyAddRef --
+ *
+ *    Adds a directory to a subscriber, watching it if it is not already.
+ *    Called with hgfsNotifyLock held.
+ *
+ * Results:
+ *    TRUE if added, FALSE if the directory cannot be watched or the
+ *    subscriber already has it (by another path).
+ *
+ * Side effects:
+ *    Adds or extends an inotify watch.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsNotifyAddRef(HgfsNotifySubscriber *subscriber,  // IN: subscriber
+                 const char *path)                  // IN: relative path
+{
+   char *hostPath = HgfsNotifyHostPath(subscriber, path);
+   uint32 inMask = HgfsNotifyInMask(subscriber) | IN_MASK_ADD | IN_ONLYDIR |
+                   IN_EXCL_UNLINK;
+   HgfsNotifyWatch *watch;
+   HgfsNotifyWatchRef *ref;
+   DblLnkLst_Links *link;
+   int wd;
+
+   if (*path != '\0') {
+      /* Only the subscribed directory itself may be reached by a symlink. */
+      inMask |= IN_DONT_FOLLOW;
+   }
+   wd = inotify_add_watch(hgfsNotifyFd, hostPath, inMask);
+   if (wd < 0) {
+      LOG(4, ("%s: cannot watch \"%s\": %d\n", __FUNCTION__, hostPath, errno));
+      free(hostPath);
+      return FALSE;
+   }
+   free(hostPath);
+
+   watch = HgfsNotifyFindWatch(wd);
+   if (watch == NULL) {
+      watch = Util_SafeMalloc(sizeof *watch);
+      watch->wd = wd;
+      DblLnkLst_Init(&watch->refs);
+      DblLnkLst_Init(&watch->links);
+      DblLnkLst_LinkLast(&hgfsNotifyWatches[(uint32)wd % HGFS_NOTIFY_WATCH_BUCKETS],
+                         &watch->links);
+   } else {
+      DblLnkLst_ForEach(link, &watch->refs) {
+         ref = DblLnkLst_Container(link, HgfsNotifyWatchRef, watchLinks);
+         if (ref->subscriber == subscriber) {
+            return FALSE;
+         }
+      }
+   }
+
+   ref = Util_SafeMalloc(sizeof *ref);
+   ref->watch = watch;
+   ref->subscriber = subscriber;
+   ref->path = Util_SafeStrdup(path);
+   DblLnkLst_Init(&ref->watchLinks);
+   DblLnkLst_Init(&ref->subscriberLinks);
+   DblLnkLst_LinkLast(&watch->refs, &ref->watchLinks);
+   DblLnkLst_LinkLast(&subscriber->refs, &ref->subscriberLinks);
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyWatchTree --
+ *
+ *    Adds the subdirectories below a directory of a recursive subscriber.
+ *    Symlinks are not followed. Called with hgfsNotifyLock held.
+ *
+ * Results:
+ *    FALSE if the directory cannot be read.
+ *
+ * Side effects:
+ *    Adds inotify watches.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsNotifyWatchTree(HgfsNotifySubscriber *subscriber,  // IN: subscriber
+                    const char *path)                  // IN: relative path
+{
+   char *hostPath = HgfsNotifyHostPath(subscriber, path);
+   DIR *dir = opendir(hostPath);
+   struct dirent *ent;
+
+   if (dir == NULL) {
+      LOG(4, ("%s: cannot read \"%s\": %d\n", __FUNCTION__, hostPath, errno));
+      free(hostPath);
+      return FALSE;
+   }
+
+   while ((ent = readdir(dir)) != NULL) {
+      Bool isDir = ent->d_type == DT_DIR;
+      char *childPath;
+
+      if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+         continue;
+      }
+      if (ent->d_type == DT_UNKNOWN) {
+         struct stat st;
+
+         isDir = fstatat(dirfd(dir), ent->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 &&
+                 S_ISDIR(st.st_mode);
+      }
+      if (!isDir) {
+         continue;
+      }
+
+      childPath = HgfsNotifyJoin(path, ent->d_name);
+      if (HgfsNotifyAddRef(subscriber, childPath)) {
+         HgfsNotifyWatchTree(subscriber, childPath);
+      }
+      free(childPath);
+   }
+
+   closedir(dir);
+   free(hostPath);
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyUnwatchTree --
+ *
+ *    Removes a directory and everything below it from a subscriber, when it
+ *    was moved out of the way. Called with hgfsNotifyLock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Removes inotify watches.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyUnwatchTree(HgfsNotifySubscriber *subscriber,  // IN: subscriber
+                      const char *path)                  // IN: relative path
+{
+   size_t pathLen = strlen(path);
+   DblLnkLst_Links *link;
+   DblLnkLst_Links *next;
+
+   DblLnkLst_ForEachSafe(link, next, &subscriber->refs) {
+      HgfsNotifyWatchRef *ref =
+         DblLnkLst_Container(link, HgfsNotifyWatchRef, subscriberLinks);
+
+      if (strncmp(ref->path, path, pathLen) == 0 &&
+          (ref->path[pathLen] == '\0' || ref->path[pathLen] == '/')) {
+         HgfsNotifyDropRef(ref, TRUE);
+      }
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyFreeSubscriber --
+ *
+ *    Removes a subscriber. Called with hgfsNotifyLock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Removes the inotify watches only it used.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyFreeSubscriber(HgfsNotifySubscriber *subscriber)  // IN: subscriber
+{
+   while (DblLnkLst_IsLinked(&subscriber->refs)) {
+      HgfsNotifyDropRef(DblLnkLst_Container(subscriber->refs.next,
+                                            HgfsNotifyWatchRef, subscriberLinks),
+                        TRUE);
+   }
+   DblLnkLst_Unlink1(&subscriber->links);
+   free(subscriber->path);
+   free(subscriber);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyFindSubscriber --
+ *
+ *    Looks up a subscriber. Called with hgfsNotifyLock held.
+ *
+ * Results:
+ *    The subscriber, NULL if none.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsNotifySubscriber *
+HgfsNotifyFindSubscriber(HgfsSubscriberHandle handle)  // IN: subscriber handle
+{
+   DblLnkLst_Links *folderLink;
+   DblLnkLst_Links *link;
+
+   DblLnkLst_ForEach(folderLink, &hgfsNotifyFolders) {
+      HgfsNotifyFolder *folder =
+         DblLnkLst_Container(folderLink, HgfsNotifyFolder, links);
+
+      DblLnkLst_ForEach(link, &folder->subscribers) {
+         HgfsNotifySubscriber *subscriber =
+            DblLnkLst_Container(link, HgfsNotifySubscriber, links);
+
+         if (subscriber->handle == handle) {
+            return subscriber;
+         }
+      }
+   }
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyQueue --
+ *
+ *    Queues an event for a subscriber, merging it with a pending one on
+ *    the same name. Called by the notification thread with hgfsNotifyLock
+ *    held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Marks the subscriber as having lost events if the queue is full or
+ *    notifications are suspended.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyQueue(HgfsNotifySubscriber *subscriber,  // IN: subscriber
+                const char *name,                  // IN: name relative to the share
+                uint32 mask)                       // IN: HGFS events
+{
+   HgfsNotifyPending *pending;
+   uint32 i;
+
+   mask &= subscriber->eventFilter | HGFS_NOTIFY_FORCED_EVENTS;
+   if (mask == 0) {
+      return;
+   }
+   if (subscriber->suspended) {
+      subscriber->eventsDropped = TRUE;
+      return;
+   }
+
+   for (i = 0; i < hgfsNotifyNumPending; i++) {
+      pending = &hgfsNotifyPending[i];
+      if (pending->subscriber == subscriber->handle &&
+          strcmp(pending->name, name) == 0) {
+         pending->mask |= mask;
+         return;
+      }
+   }
+
+   if (hgfsNotifyNumPending == ARRAYSIZE(hgfsNotifyPending)) {
+      subscriber->eventsDropped = TRUE;
+      return;
+   }
+   pending = &hgfsNotifyPending[hgfsNotifyNumPending++];
+   pending->subscriber = subscriber->handle;
+   pending->name = Util_SafeStrdup(name);
+   pending->mask = mask;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyProcessEvent --
+ *
+ *    Turns an inotify event into events for the subscribers watching the
+ *    directory, and follows directories entering and leaving the trees of
+ *    recursive subscribers. Called with hgfsNotifyLock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Adds and removes inotify watches.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyProcessEvent(const struct inotify_event *event)  // IN: event
+{
+   HgfsNotifyWatch *watch;
+   DblLnkLst_Links *link;
+   DblLnkLst_Links *next;
+   uint32 mask;
+
+   if (event->mask & IN_Q_OVERFLOW) {
+      DblLnkLst_Links *folderLink;
+
+      LOG(4, ("%s: inotify queue overflow\n", __FUNCTION__));
+      DblLnkLst_ForEach(folderLink, &hgfsNotifyFolders) {
+         HgfsNotifyFolder *folder =
+            DblLnkLst_Container(folderLink, HgfsNotifyFolder, links);
+
+         DblLnkLst_ForEach(link, &folder->subscribers) {
+            DblLnkLst_Container(link, HgfsNotifySubscriber,
+                                links)->eventsDropped = TRUE;
+         }
+      }
+      return;
+   }
+
+   watch = HgfsNotifyFindWatch(event->wd);
+   if (watch == NULL) {
+      return;
+   }
+
+   if (event->mask & IN_IGNORED) {
+      /* The directory is gone, so is the watch. */
+      DblLnkLst_ForEachSafe(link, next, &watch->refs) {
+         HgfsNotifyWatchRef *ref =
+            DblLnkLst_Container(link, HgfsNotifyWatchRef, watchLinks);
+
+         if (strcmp(ref->path, ref->subscriber->path) == 0) {
+            HgfsNotifyQueue(ref->subscriber, ref->path, HGFS_NOTIFY_WATCH_DELETED);
+         }
+         HgfsNotifyDropRef(ref, FALSE);
+      }
+      return;
+   }
+
+   mask = HgfsNotifyHgfsMask(event->mask);
+
+   DblLnkLst_ForEachSafe(link, next, &watch->refs) {
+      HgfsNotifyWatchRef *ref =
+         DblLnkLst_Container(link, HgfsNotifyWatchRef, watchLinks);
+      HgfsNotifySubscriber *subscriber = ref->subscriber;
+      char *name;
+
+      if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+         /* Below the subscribed directory, the parent reports these. */
+         if (strcmp(ref->path, subscriber->path) == 0) {
+            HgfsNotifyQueue(subscriber, ref->path, mask);
+         }
+         continue;
+      }
+
+      name = event->len > 0 ? HgfsNotifyJoin(ref->path, event->name) :
+                              Util_SafeStrdup(ref->path);
+
+      if (subscriber->recursive && (event->mask & IN_ISDIR)) {
+         if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+            if (HgfsNotifyAddRef(subscriber, name)) {
+               HgfsNotifyWatchTree(subscriber, name);
+            }
+         } else if (event->mask & IN_MOVED_FROM) {
+            HgfsNotifyUnwatchTree(subscriber, name);
+         }
+      }
+
+      HgfsNotifyQueue(subscriber, name, mask);
+      free(name);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyReadEvents --
+ *
+ *    Reads inotify events until none came for HGFS_NOTIFY_COALESCE_QUIET ms,
+ *    for at most HGFS_NOTIFY_COALESCE_MAX ms or until the queue is full.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Queues events.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyReadEvents(void)
+{
+   union {
+      struct inotify_event event;
+      char buf[16 * 1024];
+   } events;
+   struct timespec start;
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+
+   for (;;) {
+      ssize_t len = read(hgfsNotifyFd, events.buf, sizeof events.buf);
+      struct pollfd pfd;
+      struct timespec now;
+      char *p;
+
+      if (len > 0) {
+         MXUser_AcquireExclLock(hgfsNotifyLock);
+         for (p = events.buf; p < events.buf + len;) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+
+            HgfsNotifyProcessEvent(event);
+            p += sizeof *event + event->len;
+         }
+         MXUser_ReleaseExclLock(hgfsNotifyLock);
+         continue;
+      }
+      if (len < 0 && errno == EINTR) {
+         continue;
+      }
+      if (len < 0 && errno != EAGAIN) {
+         LOG(4, ("%s: read failed: %d\n", __FUNCTION__, errno));
+         break;
+      }
+
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      if (hgfsNotifyNumPending == ARRAYSIZE(hgfsNotifyPending) ||
+          (now.tv_sec - start.tv_sec) * 1000 +
+          (now.tv_nsec - start.tv_nsec) / 1000000 >= HGFS_NOTIFY_COALESCE_MAX) {
+         break;
+      }
+
+      pfd.fd = hgfsNotifyFd;
+      pfd.events = POLLIN;
+      if (poll(&pfd, 1, HGFS_NOTIFY_COALESCE_QUIET) == 0) {
+         break;
+      }
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyDeliver --
+ *
+ *    Hands an event to the server. Called with hgfsNotifyDispatchLock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyDeliver(HgfsSharedFolderHandle folder,     // IN: shared folder
+                  HgfsSubscriberHandle subscriber,   // IN: subscriber
+                  char *name,                        // IN: name or NULL
+                  uint32 mask,                       // IN: HGFS events
+                  struct HgfsSessionInfo *session)   // IN: session
+{
+   hgfsNotifyCb->registerThread(session);
+   hgfsNotifyCb->eventReceive(folder, subscriber, name, mask, session);
+   hgfsNotifyCb->unregisterThread(session);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyDispatch --
+ *
+ *    Delivers the queued events, then tells the subscribers that lost
+ *    events. A subscriber removed since its events were queued gets
+ *    nothing.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Empties the queue.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyDispatch(void)
+{
+   uint32 i;
+
+   MXUser_AcquireExclLock(hgfsNotifyDispatchLock);
+
+   for (i = 0; i < hgfsNotifyNumPending; i++) {
+      HgfsNotifyPending *pending = &hgfsNotifyPending[i];
+      HgfsNotifySubscriber *subscriber;
+      HgfsSharedFolderHandle folder = HGFS_INVALID_FOLDER_HANDLE;
+      struct HgfsSessionInfo *session = NULL;
+
+      MXUser_AcquireExclLock(hgfsNotifyLock);
+      subscriber = HgfsNotifyFindSubscriber(pending->subscriber);
+      if (subscriber != NULL) {
+         if (subscriber->suspended) {
+            subscriber->eventsDropped = TRUE;
+         } else if (!subscriber->eventsDropped) {
+            folder = subscriber->folder->handle;
+            session = subscriber->session;
+         }
+      }
+      MXUser_ReleaseExclLock(hgfsNotifyLock);
+
+      if (session != NULL) {
+         HgfsNotifyDeliver(folder, pending->subscriber, pending->name,
+                           pending->mask, session);
+      }
+      free(pending->name);
+   }
+   hgfsNotifyNumPending = 0;
+
+   for (;;) {
+      HgfsNotifySubscriber *subscriber = NULL;
+      HgfsSharedFolderHandle folder = HGFS_INVALID_FOLDER_HANDLE;
+      HgfsSubscriberHandle handle = HGFS_INVALID_SUBSCRIBER_HANDLE;
+      struct HgfsSessionInfo *session = NULL;
+      DblLnkLst_Links *folderLink;
+      DblLnkLst_Links *link;
+
+      MXUser_AcquireExclLock(hgfsNotifyLock);
+      DblLnkLst_ForEach(folderLink, &hgfsNotifyFolders) {
+         DblLnkLst_ForEach(link, &DblLnkLst_Container(folderLink, HgfsNotifyFolder,
+                                                      links)->subscribers) {
+            subscriber = DblLnkLst_Container(link, HgfsNotifySubscriber, links);
+            if (subscriber->eventsDropped && !subscriber->suspended) {
+               subscriber->eventsDropped = FALSE;
+               folder = subscriber->folder->handle;
+               handle = subscriber->handle;
+               session = subscriber->session;
+               break;
+            }
+         }
+         if (session != NULL) {
+            break;
+         }
+      }
+      MXUser_ReleaseExclLock(hgfsNotifyLock);
+
+      if (session == NULL) {
+         break;
+      }
+      HgfsNotifyDeliver(folder, handle, NULL, HGFS_NOTIFY_EVENTS_DROPPED, session);
+   }
+
+   MXUser_ReleaseExclLock(hgfsNotifyDispatchLock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyThread --
+ *
+ *    The notification thread.
+ *
+ * Results:
+ *    NULL.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+HgfsNotifyThread(void *data)  // IN: unused
+{
+   for (;;) {
+      struct pollfd pfd[2];
+
+      pfd[0].fd = hgfsNotifyFd;
+      pfd[0].events = POLLIN;
+      pfd[1].fd = hgfsNotifyWakePipe[0];
+      pfd[1].events = POLLIN;
+
+      if (poll(pfd, ARRAYSIZE(pfd), -1) < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         Warning("%s: poll failed: %d\n", __FUNCTION__, errno);
+         break;
+      }
+
+      if (pfd[1].revents != 0) {
+         char buf[64];
+
+         while (read(hgfsNotifyWakePipe[0], buf, sizeof buf) > 0) {
+         }
+         if (hgfsNotifyExiting) {
+            break;
+         }
+      }
+      if (pfd[0].revents != 0) {
+         HgfsNotifyReadEvents();
+      }
+      HgfsNotifyDispatch();
+   }
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyWake --
+ *
+ *    Wakes up the notification thread.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyWake(void)
+{
+   char c = 0;
+
+   /* A full pipe already wakes the thread. */
+   if (write(hgfsNotifyWakePipe[1], &c, 1) < 0) {
+      LOG(4, ("%s: write failed: %d\n", __FUNCTION__, errno));
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_Init --
+ *
+ *    Initialization for the notification component: opens the inotify
+ *    descriptor and starts the notification thread.
+ *
+ * Results:
+ *    HGFS_STATUS_SUCCESS, or an error if notifications are not available.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsNotify_Init(const HgfsServerNotifyCallbacks *serverCbData) // IN: serverCbData
+{
+   HgfsInternalStatus status;
+   size_t i;
+   int err;
+
+   ASSERT(hgfsNotifyCb == NULL);
+
+   hgfsNotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if (hgfsNotifyFd < 0) {
+      status = errno;
+      Warning("%s: inotify_init1 failed: %d\n", __FUNCTION__, status);
+      return status;
+   }
+   if (pipe2(hgfsNotifyWakePipe, O_NONBLOCK | O_CLOEXEC) < 0) {
+      status = errno;
+      Warning("%s: pipe2 failed: %d\n", __FUNCTION__, status);
+      close(hgfsNotifyFd);
+      hgfsNotifyFd = -1;
+      return status;
+   }
+
+   hgfsNotifyLock = MXUser_CreateExclLock("hgfsNotifyLock", RANK_hgfsNotifyLock);
+   hgfsNotifyDispatchLock = MXUser_CreateExclLock("hgfsNotifyDispatchLock",
+                                                  RANK_hgfsNotifyDispatchLock);
+   DblLnkLst_Init(&hgfsNotifyFolders);
+   for (i = 0; i < ARRAYSIZE(hgfsNotifyWatches); i++) {
+      DblLnkLst_Init(&hgfsNotifyWatches[i]);
+   }
+   hgfsNotifyNextFolder = 0;
+   hgfsNotifyNextSubscriber = 0;
+   hgfsNotifyNumPending = 0;
+   hgfsNotifyExiting = FALSE;
+   hgfsNotifyCb = serverCbData;
+
+   err = pthread_create(&hgfsNotifyThread, NULL, HgfsNotifyThread, NULL);
+   if (err != 0) {
+      Warning("%s: pthread_create failed: %d\n", __FUNCTION__, err);
+      hgfsNotifyCb = NULL;
+      MXUser_DestroyExclLock(hgfsNotifyDispatchLock);
+      MXUser_DestroyExclLock(hgfsNotifyLock);
+      close(hgfsNotifyWakePipe[0]);
+      close(hgfsNotifyWakePipe[1]);
+      close(hgfsNotifyFd);
+      hgfsNotifyFd = -1;
+      return err;
+   }
+
+   return HGFS_ERROR_SUCCESS;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_Exit --
+ *
+ *    Exit for the notification component.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Stops the notification thread, removes all watches.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_Exit(void)
+{
+   if (hgfsNotifyCb == NULL) {
+      return;
+   }
+
+   hgfsNotifyExiting = TRUE;
+   HgfsNotifyWake();
+   pthread_join(hgfsNotifyThread, NULL);
+
+   while (DblLnkLst_IsLinked(&hgfsNotifyFolders)) {
+      HgfsNotifyFolder *folder =
+         DblLnkLst_Container(hgfsNotifyFolders.next, HgfsNotifyFolder, links);
+
+      HgfsNotify_RemoveSharedFolder(folder->handle);
+   }
+   while (hgfsNotifyNumPending > 0) {
+      free(hgfsNotifyPending[--hgfsNotifyNumPending].name);
+   }
+
+   close(hgfsNotifyWakePipe[0]);
+   close(hgfsNotifyWakePipe[1]);
+   close(hgfsNotifyFd);
+   hgfsNotifyFd = -1;
+   MXUser_DestroyExclLock(hgfsNotifyDispatchLock);
+   MXUser_DestroyExclLock(hgfsNotifyLock);
+   hgfsNotifyCb = NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifySetSuspended --
+ *
+ *    Suspends or resumes notifications for the subscribers of a session.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifySetSuspended(struct HgfsSessionInfo *session,  // IN: session
+                       Bool suspended)                   // IN: suspend or resume
+{
+   DblLnkLst_Links *folderLink;
+   DblLnkLst_Links *link;
+
+   MXUser_AcquireExclLock(hgfsNotifyLock);
+   DblLnkLst_ForEach(folderLink, &hgfsNotifyFolders) {
+      HgfsNotifyFolder *folder =
+         DblLnkLst_Container(folderLink, HgfsNotifyFolder, links);
+
+      DblLnkLst_ForEach(link, &folder->subscribers) {
+         HgfsNotifySubscriber *subscriber =
+            DblLnkLst_Container(link, HgfsNotifySubscriber, links);
+
+         if (subscriber->session == session) {
+            subscriber->suspended = suspended;
+         }
+      }
+   }
+   MXUser_ReleaseExclLock(hgfsNotifyLock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_Activate --
+ *
+ *    Activates generating file system change notifications for a session
+ *    after check point synchronization.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Subscribers which missed events are told so.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_Activate(HgfsNotifyActivateReason reason, // IN: reason
+                    struct HgfsSessionInfo *session) // IN: session
+{
+   if (hgfsNotifyCb == NULL || reason != HGFS_NOTIFY_REASON_SERVER_SYNC) {
+      return;
+   }
+   HgfsNotifySetSuspended(session, FALSE);
+   HgfsNotifyWake();
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_Deactivate --
+ *
+ *    Deactivates generating file system change notifications for a session
+ *    during check point synchronization. The changes meanwhile are reported
+ *    as dropped events on activation.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_Deactivate(HgfsNotifyActivateReason reason, // IN: reason
+                      struct HgfsSessionInfo *session) // IN: session
+{
+   if (hgfsNotifyCb == NULL || reason != HGFS_NOTIFY_REASON_SERVER_SYNC) {
+      return;
+   }
+   HgfsNotifySetSuspended(session, TRUE);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_AddSharedFolder --
+ *
+ *    Allocates shared folder handle for the shared folder.
+ *
+ * Results:
+ *    The new handle, HGFS_INVALID_FOLDER_HANDLE if notifications are not
+ *    available.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsSharedFolderHandle
+HgfsNotify_AddSharedFolder(const char *path,       // IN: path in the host
+                           const char *shareName)  // IN: name of the shared folder
+{
+   HgfsNotifyFolder *folder;
+   HgfsSharedFolderHandle handle;
+
+   if (hgfsNotifyCb == NULL) {
+      return HGFS_INVALID_FOLDER_HANDLE;
+   }
+
+   folder = Util_SafeMalloc(sizeof *folder);
+   folder->path = Util_SafeStrdup(path);
+   folder->shareName = Util_SafeStrdup(shareName);
+   DblLnkLst_Init(&folder->subscribers);
+   DblLnkLst_Init(&folder->links);
+
+   MXUser_AcquireExclLock(hgfsNotifyLock);
+   handle = hgfsNotifyNextFolder++;
+   if (hgfsNotifyNextFolder == HGFS_INVALID_FOLDER_HANDLE) {
+      hgfsNotifyNextFolder = 0;
+   }
+   folder->handle = handle;
+   DblLnkLst_LinkLast(&hgfsNotifyFolders, &folder->links);
+   MXUser_ReleaseExclLock(hgfsNotifyLock);
+
+   LOG(4, ("%s: folder %#x \"%s\" at \"%s\"\n", __FUNCTION__, handle,
+           shareName, path));
+   return handle;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_AddSubscriber --
+ *
+ *    Starts watching a directory of a shared folder, and with recursive
+ *    all the directories below it.
+ *
+ * Results:
+ *    The subscriber handle, HGFS_INVALID_SUBSCRIBER_HANDLE if the folder is
+ *    unknown or the directory cannot be watched.
+ *
+ * Side effects:
+ *    Adds inotify watches.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsSubscriberHandle
+HgfsNotify_AddSubscriber(HgfsSharedFolderHandle sharedFolder, // IN: shared folder handle
+                         const char *path,                    // IN: relative path
+                         uint32 eventFilter,                  // IN: event filter
+                         uint32 recursive,                    // IN: look in subfolders
+                         struct HgfsSessionInfo *session)     // IN: server context
+{
+   HgfsNotifySubscriber *subscriber = NULL;
+   HgfsSubscriberHandle handle = HGFS_INVALID_SUBSCRIBER_HANDLE;
+   DblLnkLst_Links *link;
+
+   if (hgfsNotifyCb == NULL) {
+      return HGFS_INVALID_SUBSCRIBER_HANDLE;
+   }
+
+   /* Paths come with a leading separator, except for the share itself. */
+   while (*path == DIRSEPC) {
+      path++;
+   }
+
+   MXUser_AcquireExclLock(hgfsNotifyLock);
+
+   DblLnkLst_ForEach(link, &hgfsNotifyFolders) {
+      HgfsNotifyFolder *folder = DblLnkLst_Container(link, HgfsNotifyFolder, links);
+
+      if (folder->handle == sharedFolder) {
+         subscriber = Util_SafeCalloc(1, sizeof *subscriber);
+         subscriber->folder = folder;
+         subscriber->path = Util_SafeStrdup(path);
+         subscriber->eventFilter = eventFilter;
+         subscriber->recursive = recursive != 0;
+         subscriber->session = session;
+         DblLnkLst_Init(&subscriber->refs);
+         DblLnkLst_Init(&subscriber->links);
+         DblLnkLst_LinkLast(&folder->subscribers, &subscriber->links);
+         break;
+      }
+   }
+
+   if (subscriber != NULL) {
+      if (HgfsNotifyAddRef(subscriber, subscriber->path)) {
+         if (subscriber->recursive) {
+            HgfsNotifyWatchTree(subscriber, subscriber->path);
+         }
+         handle = hgfsNotifyNextSubscriber++;
+         if (hgfsNotifyNextSubscriber == HGFS_INVALID_SUBSCRIBER_HANDLE) {
+            hgfsNotifyNextSubscriber = 0;
+         }
+         subscriber->handle = handle;
+      } else {
+         HgfsNotifyFreeSubscriber(subscriber);
+      }
+   }
+
+   MXUser_ReleaseExclLock(hgfsNotifyLock);
+
+   LOG(4, ("%s: folder %#x path \"%s\" filter %#x%s: %"FMT64"x\n", __FUNCTION__,
+           sharedFolder, path, eventFilter, recursive ? " recursive" : "", handle));
+   return handle;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_RemoveSharedFolder --
+ *
+ *    Deletes a shared folder and all its subscribers.
+ *
+ * Results:
+ *    TRUE if the folder was found.
+ *
+ * Side effects:
+ *    Removes inotify watches.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsNotify_RemoveSharedFolder(HgfsSharedFolderHandle sharedFolder) // IN
+{
+   HgfsNotifyFolder *folder = NULL;
+   DblLnkLst_Links *link;
+
+   if (hgfsNotifyCb == NULL) {
+      return FALSE;
+   }
+
+   MXUser_AcquireExclLock(hgfsNotifyLock);
+   DblLnkLst_ForEach(link, &hgfsNotifyFolders) {
+      HgfsNotifyFolder *curr = DblLnkLst_Container(link, HgfsNotifyFolder, links);
+
+      if (curr->handle == sharedFolder) {
+         folder = curr;
+         break;
+      }
+   }
+   if (folder != NULL) {
+      while (DblLnkLst_IsLinked(&folder->subscribers)) {
+         HgfsNotifyFreeSubscriber(DblLnkLst_Container(folder->subscribers.next,
+                                                      HgfsNotifySubscriber, links));
+      }
+      DblLnkLst_Unlink1(&folder->links);
+   }
+   MXUser_ReleaseExclLock(hgfsNotifyLock);
+
+   if (folder == NULL) {
+      return FALSE;
+   }
+   free(folder->path);
+   free(folder->shareName);
+   free(folder);
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_RemoveSubscriber --
+ *
+ *    Deletes a subscriber. Events already on their way may still be
+ *    delivered.
+ *
+ * Results:
+ *    TRUE if the subscriber was found.
+ *
+ * Side effects:
+ *    Removes the inotify watches only it used.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsNotify_RemoveSubscriber(HgfsSubscriberHandle subscriber) // IN
+{
+   HgfsNotifySubscriber *curr;
+
+   if (hgfsNotifyCb == NULL) {
+      return FALSE;
+   }
+
+   MXUser_AcquireExclLock(hgfsNotifyLock);
+   curr = HgfsNotifyFindSubscriber(subscriber);
+   if (curr != NULL) {
+      HgfsNotifyFreeSubscriber(curr);
+   }
+   MXUser_ReleaseExclLock(hgfsNotifyLock);
+
+   return curr != NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_RemoveSessionSubscribers --
+ *
+ *    Deletes all the subscribers of a session. Waits for the event being
+ *    delivered, if any, so that no event reaches the session afterwards.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Removes inotify watches.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_RemoveSessionSubscribers(struct HgfsSessionInfo *session) // IN
+{
+   DblLnkLst_Links *folderLink;
+   DblLnkLst_Links *link;
+   DblLnkLst_Links *next;
+
+   if (hgfsNotifyCb == NULL) {
+      return;
+   }
+
+   MXUser_AcquireExclLock(hgfsNotifyDispatchLock);
+   MXUser_AcquireExclLock(hgfsNotifyLock);
+   DblLnkLst_ForEach(folderLink, &hgfsNotifyFolders) {
+      HgfsNotifyFolder *folder =
+         DblLnkLst_Container(folderLink, HgfsNotifyFolder, links);
+
+      DblLnkLst_ForEachSafe(link, next, &folder->subscribers) {
+         HgfsNotifySubscriber *subscriber =
+            DblLnkLst_Container(link, HgfsNotifySubscriber, links);
+
+         if (subscriber->session == session) {
+            HgfsNotifyFreeSubscriber(subscriber);
+         }
+      }
+   }
+   MXUser_ReleaseExclLock(hgfsNotifyLock);
+   MXUser_ReleaseExclLock(hgfsNotifyDispatchLock);
+}
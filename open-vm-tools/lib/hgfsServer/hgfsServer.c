@@ -52,6 +52,7 @@
 #include "mutexRankLib.h"
 #include "vm_basic_asm.h"
 #include "unicodeOperations.h"
+#include "hostinfo.h"
 
 #if defined(_WIN32)
 #include <io.h>
@@ -64,6 +65,7 @@
 #define HGFS_PARENT_DIR_LEN 3
 
 
+
 /*
  * Define this to enable an ASSERT on HGFS_STATUS_PROTOCOL_ERROR.
  * This is useful if client is to be guaranteed to work with the server
@@ -122,9 +124,46 @@
 #define NUM_FILE_NODES 100
 #define NUM_SEARCHES 100
 
+/* End of an index chain of nodes or searches. */
+#define HGFS_INDEX_END MAX_UINT32
+
 /* Default maximun number of open nodes that have server locks. */
 #define MAX_LOCKED_FILENODES 10
 
+/*
+ * Adaptive open node cache, see HgfsServerCacheAdapt. Every
+ * HGFS_CACHE_ADAPT_PERIOD descriptor lookups, a session missing more than
+ * one in HGFS_CACHE_MISS_RATIO of them grows its cache by half, and one
+ * without misses using less than half of it shrinks back towards the
+ * configured size. A session caches at most HGFS_MAX_CACHED_FILENODES_CEILING
+ * nodes and 1/HGFS_CACHE_FD_SHARE of the open file limit of the process.
+ */
+#define HGFS_CACHE_ADAPT_PERIOD              256
+#define HGFS_CACHE_MISS_RATIO                16
+#define HGFS_CACHE_FD_SHARE                  4
+#define HGFS_MAX_CACHED_FILENODES_CEILING    4096
+
+/*
+ * A search streaming its directory keeps it open until the search is
+ * closed. Past this many per session, searches read the whole directory
+ * up front instead, so that a client leaving searches open cannot run the
+ * process out of descriptors.
+ */
+#define HGFS_MAX_STREAM_SEARCHES             64
+
+/*
+ * Cache hints (HGFS_CONFIG_CACHE_HINTS_ENABLED, off unless enabled by the
+ * server manager), see HgfsServerAdviseAccess.
+ * A node accessed sequentially for HGFS_ACCESS_STREAM_MIN bytes is streamed:
+ * reads are advised a window ahead and writes are written back a window at
+ * a time. Past HGFS_ACCESS_BULK_MIN it is a bulk copy, and what is more than
+ * two windows behind is dropped from the cache.
+ */
+#define HGFS_ACCESS_WINDOW       (1024 * 1024)
+#define HGFS_ACCESS_STREAM_MIN   (256 * 1024)
+#define HGFS_ACCESS_BULK_MIN     (32 * 1024 * 1024)
+#define HGFS_ACCESS_MAX_ADVICE   3
+
 
 struct HgfsTransportSessionInfo {
    /* Default session id. */
@@ -157,6 +196,9 @@ struct HgfsTransportSessionInfo {
    Atomic_uint32 refCount;    /* Reference count for session. */
 
    HgfsServerChannelData channelCapabilities;
+
+   /* Packet buffers of the channel, see HSPU_GetReplyPacket. */
+   HgfsServerBufPool bufPool;
 };
 
 /* The input request paramaters object. */
@@ -172,6 +214,7 @@ typedef struct HgfsInputParam {
    HgfsOp op;                    /* Hgfs operation command code */
    uint32 id;                    /* Request ID to be matched with the reply */
    Bool sessionEnabled;          /* Requests have session enabled headers */
+   VmTimeType receivedUS;        /* When the request was received */
 } HgfsInputParam;
 
 /*
@@ -183,6 +226,9 @@ static HgfsServerConfig gHgfsCfgSettings = {
    HGFS_MAX_CACHED_FILENODES
 };
 
+/* Limit to which a session may grow its open node cache. */
+static uint32 gHgfsMaxCachedOpenNodes = HGFS_MAX_CACHED_FILENODES;
+
 /*
  * Monotonically increasing handle counter used to dish out HgfsHandles.
  * This value is checkpointed.
@@ -316,6 +362,8 @@ static Bool HgfsAddToCacheInternal(HgfsHandle handle,
 static Bool HgfsIsCachedInternal(HgfsHandle handle,
                                  HgfsSessionInfo *session);
 static Bool HgfsRemoveLruNode(HgfsSessionInfo *session);
+static void HgfsCachedNodeRelink(HgfsFileNode *node,
+                                 HgfsSessionInfo *session);
 static Bool HgfsRemoveFromCacheInternal(HgfsHandle handle,
                                         HgfsSessionInfo *session);
 static void HgfsRemoveSearchInternal(HgfsSearch *search,
@@ -348,6 +396,16 @@ static HgfsFileNode *HgfsGetNewNode(HgfsSessionInfo *session);
 static HgfsHandle HgfsFileNode2Handle(HgfsFileNode const *fileNode);
 static HgfsFileNode *HgfsHandle2FileNode(HgfsHandle handle,
                                          HgfsSessionInfo *session);
+static void HgfsNodeIndexInsert(HgfsFileNode *node,
+                               HgfsSessionInfo *session);
+static void HgfsNodeIndexRemove(HgfsFileNode *node,
+                               HgfsSessionInfo *session);
+static void HgfsNodeIndexResize(HgfsSessionInfo *session);
+static void HgfsSearchHashInsert(HgfsSearch *search,
+                                 HgfsSessionInfo *session);
+static void HgfsSearchHashRemove(HgfsSearch *search,
+                                 HgfsSessionInfo *session);
+static void HgfsSearchHashResize(HgfsSessionInfo *session);
 static void HgfsServerExitSessionInternal(HgfsSessionInfo *session);
 static void HgfsServerCompleteRequest(HgfsInternalStatus status,
                                       size_t replyPayloadSize,
@@ -382,6 +440,7 @@ static void HgfsServerCreateDir(HgfsInputParam *input);
 static void HgfsServerDeleteFile(HgfsInputParam *input);
 static void HgfsServerDeleteDir(HgfsInputParam *input);
 static void HgfsServerRename(HgfsInputParam *input);
+static void HgfsServerCopyFile(HgfsInputParam *input);
 static void HgfsServerQueryVolume(HgfsInputParam *input);
 static void HgfsServerSymlinkCreate(HgfsInputParam *input);
 static void HgfsServerServerLockChange(HgfsInputParam *input);
@@ -595,22 +654,364 @@ static HgfsFileNode *
 HgfsHandle2FileNode(HgfsHandle handle,        // IN: Hgfs file handle
                     HgfsSessionInfo *session) // IN: Session info
 {
-   unsigned int i;
-   HgfsFileNode *fileNode = NULL;
+   uint32 i;
 
    ASSERT(session);
    ASSERT(session->nodeArray);
 
-   /* XXX: This O(n) lookup can and should be optimized. */
-   for (i = 0; i < session->numNodes; i++) {
-      if (session->nodeArray[i].state != FILENODE_STATE_UNUSED &&
-          session->nodeArray[i].handle == handle) {
-         fileNode = &session->nodeArray[i];
+   i = session->nodeHandleHash[handle % session->nodeHashSize];
+   while (i != HGFS_INDEX_END) {
+      HgfsFileNode *fileNode = &session->nodeArray[i];
+
+      ASSERT(fileNode->state != FILENODE_STATE_UNUSED);
+      if (fileNode->handle == handle) {
+         return fileNode;
+      }
+      i = fileNode->handleNext;
+   }
+
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNodeNameHash --
+ *
+ *    Hash a local file name (FNV-1a) to a bucket of nodeNameHash.
+ *
+ * Results:
+ *    The bucket index.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsNodeNameHash(const char *utf8Name,      // IN: local file name
+                 HgfsSessionInfo *session)  // IN: session info
+{
+   uint32 hash = 2166136261U;
+
+   for (; *utf8Name != '\0'; utf8Name++) {
+      hash = (hash ^ (unsigned char)*utf8Name) * 16777619U;
+   }
+   return hash % session->nodeHashSize;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNodeNameLink --
+ *
+ *    Add a node to the bucket of its name in nodeNameHash.
+ *
+ *    The session's nodeArrayLock should be acquired prior to calling this
+ *    function.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNodeNameLink(HgfsFileNode *node,        // IN: file node
+                 HgfsSessionInfo *session)  // IN: session info
+{
+   uint32 *bucket = &session->nodeNameHash[HgfsNodeNameHash(node->utf8Name,
+                                                            session)];
+   uint32 index = node - session->nodeArray;
+
+   node->namePrev = HGFS_INDEX_END;
+   node->nameNext = *bucket;
+   if (*bucket != HGFS_INDEX_END) {
+      session->nodeArray[*bucket].namePrev = index;
+   }
+   *bucket = index;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNodeNameUnlink --
+ *
+ *    Remove a node from the bucket of its name in nodeNameHash.
+ *
+ *    The session's nodeArrayLock should be acquired prior to calling this
+ *    function.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNodeNameUnlink(HgfsFileNode *node,        // IN: file node
+                   HgfsSessionInfo *session)  // IN: session info
+{
+   if (node->namePrev == HGFS_INDEX_END) {
+      uint32 *bucket =
+         &session->nodeNameHash[HgfsNodeNameHash(node->utf8Name, session)];
+
+      ASSERT(*bucket == node - session->nodeArray);
+      *bucket = node->nameNext;
+   } else {
+      session->nodeArray[node->namePrev].nameNext = node->nameNext;
+   }
+   if (node->nameNext != HGFS_INDEX_END) {
+      session->nodeArray[node->nameNext].namePrev = node->namePrev;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNodeShareLink --
+ *
+ *    Add a node to the group of the nodes of its share, creating the group
+ *    if it is the first one.
+ *
+ *    The session's nodeArrayLock should be acquired prior to calling this
+ *    function.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Memory allocation.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNodeShareLink(HgfsFileNode *node,        // IN: file node
+                  HgfsSessionInfo *session)  // IN: session info
+{
+   HgfsNodeShareGroup *group = NULL;
+   uint32 index = node - session->nodeArray;
+   DblLnkLst_Links *link;
+
+   /* There are only as many groups as shares in use. */
+   DblLnkLst_ForEach(link, &session->nodeShareGroups) {
+      HgfsNodeShareGroup *curr = DblLnkLst_Container(link, HgfsNodeShareGroup,
+                                                     links);
+
+      if (strcmp(curr->rootDir, node->shareInfo.rootDir) == 0) {
+         group = curr;
          break;
       }
    }
 
-   return fileNode;
+   if (group == NULL) {
+      group = Util_SafeMalloc(sizeof *group);
+      group->rootDir = Util_SafeStrdup(node->shareInfo.rootDir);
+      group->firstNode = HGFS_INDEX_END;
+      DblLnkLst_Init(&group->links);
+      DblLnkLst_LinkLast(&session->nodeShareGroups, &group->links);
+   }
+
+   node->shareGroup = group;
+   node->sharePrev = HGFS_INDEX_END;
+   node->shareNext = group->firstNode;
+   if (group->firstNode != HGFS_INDEX_END) {
+      session->nodeArray[group->firstNode].sharePrev = index;
+   }
+   group->firstNode = index;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNodeShareUnlink --
+ *
+ *    Remove a node from the group of the nodes of its share, freeing the
+ *    group if it was the last one.
+ *
+ *    The session's nodeArrayLock should be acquired prior to calling this
+ *    function.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNodeShareUnlink(HgfsFileNode *node,        // IN: file node
+                    HgfsSessionInfo *session)  // IN: session info
+{
+   HgfsNodeShareGroup *group = node->shareGroup;
+
+   ASSERT(group);
+
+   if (node->sharePrev == HGFS_INDEX_END) {
+      ASSERT(group->firstNode == node - session->nodeArray);
+      group->firstNode = node->shareNext;
+   } else {
+      session->nodeArray[node->sharePrev].shareNext = node->shareNext;
+   }
+   if (node->shareNext != HGFS_INDEX_END) {
+      session->nodeArray[node->shareNext].sharePrev = node->sharePrev;
+   }
+   node->shareGroup = NULL;
+
+   if (group->firstNode == HGFS_INDEX_END) {
+      DblLnkLst_Unlink1(&group->links);
+      free(group->rootDir);
+      free(group);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNodeIndexInsert --
+ *
+ *    Make a node that was just set up reachable by its handle, its name
+ *    and its share.
+ *
+ *    The session's nodeArrayLock should be acquired prior to calling this
+ *    function.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Memory allocation.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNodeIndexInsert(HgfsFileNode *node,        // IN: file node
+                    HgfsSessionInfo *session)  // IN: session info
+{
+   uint32 *bucket = &session->nodeHandleHash[node->handle %
+                                              session->nodeHashSize];
+
+   node->handleNext = *bucket;
+   *bucket = node - session->nodeArray;
+
+   HgfsNodeNameLink(node, session);
+   HgfsNodeShareLink(node, session);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNodeIndexRemove --
+ *
+ *    Undo HgfsNodeIndexInsert.
+ *
+ *    The session's nodeArrayLock should be acquired prior to calling this
+ *    function.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNodeIndexRemove(HgfsFileNode *node,        // IN: file node
+                    HgfsSessionInfo *session)  // IN: session info
+{
+   uint32 index = node - session->nodeArray;
+   uint32 *link = &session->nodeHandleHash[node->handle %
+                                            session->nodeHashSize];
+
+   while (*link != index) {
+      ASSERT(*link != HGFS_INDEX_END);
+      link = &session->nodeArray[*link].handleNext;
+   }
+   *link = node->handleNext;
+
+   HgfsNodeNameUnlink(node, session);
+   HgfsNodeShareUnlink(node, session);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNodeIndexResize --
+ *
+ *    Rehash the in use nodes over one bucket per node, after the node
+ *    array grew. Failing to allocate the new buckets is not fatal: the
+ *    old ones keep working, with longer chains. The share groups chain
+ *    array indices, which stay valid.
+ *
+ *    The session's nodeArrayLock should be acquired prior to calling this
+ *    function.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Memory allocation.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNodeIndexResize(HgfsSessionInfo *session)  // IN: session info
+{
+   uint32 *handleBuckets = malloc(session->numNodes * sizeof *handleBuckets);
+   uint32 *nameBuckets = malloc(session->numNodes * sizeof *nameBuckets);
+   unsigned int i;
+
+   if (handleBuckets == NULL || nameBuckets == NULL) {
+      LOG(4, ("%s: keeping %u buckets\n", __FUNCTION__,
+              session->nodeHashSize));
+      free(handleBuckets);
+      free(nameBuckets);
+      return;
+   }
+
+   free(session->nodeHandleHash);
+   free(session->nodeNameHash);
+   session->nodeHandleHash = handleBuckets;
+   session->nodeNameHash = nameBuckets;
+   session->nodeHashSize = session->numNodes;
+   for (i = 0; i < session->nodeHashSize; i++) {
+      handleBuckets[i] = HGFS_INDEX_END;
+      nameBuckets[i] = HGFS_INDEX_END;
+   }
+   for (i = 0; i < session->numNodes; i++) {
+      HgfsFileNode *node = &session->nodeArray[i];
+      uint32 *bucket;
+
+      if (node->state == FILENODE_STATE_UNUSED) {
+         continue;
+      }
+      bucket = &handleBuckets[node->handle % session->nodeHashSize];
+      node->handleNext = *bucket;
+      *bucket = i;
+      HgfsNodeNameLink(node, session);
+   }
 }
 
 
@@ -838,22 +1239,34 @@ HgfsFileDesc2Handle(fileDesc fd,              // IN: OS handle (file descriptor)
                     HgfsSessionInfo *session, // IN: Session info
                     HgfsHandle *handle)       // OUT: Hgfs file handle
 {
+   DblLnkLst_Links *lists[2];
+   DblLnkLst_Links *link;
    unsigned int i;
    Bool found = FALSE;
-   HgfsFileNode *existingFileNode = NULL;
 
    ASSERT(session);
    ASSERT(session->nodeArray);
 
    MXUser_AcquireExclLock(session->nodeArrayLock);
 
-   for (i = 0; i < session->numNodes; i++) {
-      existingFileNode = &session->nodeArray[i];
-      if ((existingFileNode->state == FILENODE_STATE_IN_USE_CACHED) &&
-          (existingFileNode->fileDesc == fd)) {
-         *handle = HgfsFileNode2Handle(existingFileNode);
-         found = TRUE;
-         break;
+   /*
+    * Only cached nodes have an open file descriptor, so walk their lists,
+    * which are bounded, rather than all the nodes of the session.
+    */
+   lists[0] = &session->nodeCachedList;
+   lists[1] = &session->nodePinnedList;
+   for (i = 0; i < ARRAYSIZE(lists) && !found; i++) {
+      DblLnkLst_ForEach(link, lists[i]) {
+         HgfsFileNode *existingFileNode = DblLnkLst_Container(link,
+                                                              HgfsFileNode,
+                                                              links);
+
+         ASSERT(existingFileNode->state == FILENODE_STATE_IN_USE_CACHED);
+         if (existingFileNode->fileDesc == fd) {
+            *handle = HgfsFileNode2Handle(existingFileNode);
+            found = TRUE;
+            break;
+         }
       }
    }
 
@@ -1043,7 +1456,8 @@ HgfsHandle2NotifyInfo(HgfsHandle handle,                    // IN: Hgfs file han
       nameSize = existingFileNode->utf8NameLen - existingFileNode->shareInfo.rootDirLen;
       name = Util_SafeMalloc(nameSize + 1);
       *folderHandle = existingFileNode->shareInfo.handle;
-      memcpy(name, existingFileNode->utf8Name, nameSize);
+      memcpy(name, existingFileNode->utf8Name + existingFileNode->shareInfo.rootDirLen,
+             nameSize);
       name[nameSize] = '\0';
       *fileName = name;
       *fileNameSize = nameSize;
@@ -1247,6 +1661,10 @@ HgfsUpdateNodeFileDesc(HgfsHandle handle,        // IN: Hgfs file handle
 
    node->fileDesc = fd;
    node->fileCtx = fileCtx;
+   if (node->state == FILENODE_STATE_IN_USE_CACHED) {
+      /* A file context pins the node. */
+      HgfsCachedNodeRelink(node, session);
+   }
    updated = TRUE;
 
 exit:
@@ -1293,6 +1711,10 @@ HgfsUpdateNodeServerLock(fileDesc fd,                // IN: OS handle
       if (existingFileNode->state != FILENODE_STATE_UNUSED) {
          if (existingFileNode->fileDesc == fd) {
             existingFileNode->serverLock = serverLock;
+            if (existingFileNode->state == FILENODE_STATE_IN_USE_CACHED) {
+               /* A server lock pins the node. */
+               HgfsCachedNodeRelink(existingFileNode, session);
+            }
             updated = TRUE;
             break;
          }
@@ -1554,9 +1976,11 @@ HgfsGetNewNode(HgfsSessionInfo *session)  // IN: session info
           * because if we are here, it is empty.
           */
 
-         /* Rebase the anchor of the cached file nodes list. */
+         /* Rebase the anchors of the cached file nodes lists. */
          HgfsServerRebase(session->nodeCachedList.prev, DblLnkLst_Links)
          HgfsServerRebase(session->nodeCachedList.next, DblLnkLst_Links)
+         HgfsServerRebase(session->nodePinnedList.prev, DblLnkLst_Links)
+         HgfsServerRebase(session->nodePinnedList.next, DblLnkLst_Links)
 
 #undef HgfsServerRebase
       }
@@ -1576,6 +2000,7 @@ HgfsGetNewNode(HgfsSessionInfo *session)  // IN: session info
       }
       session->nodeArray = newMem;
       session->numNodes = newNumNodes;
+      HgfsNodeIndexResize(session);
 
       if (DOLOG(4)) {
          Log("Dumping nodes after pointer changes\n");
@@ -1620,6 +2045,12 @@ HgfsRemoveFileNode(HgfsFileNode *node,        // IN: file node
    LOG(4, ("%s: handle %u, name %s, fileId %"FMT64"u\n", __FUNCTION__,
            HgfsFileNode2Handle(node), node->utf8Name, node->localId.fileId));
 
+   /* Nodes that failed to set up in HgfsAddNewFileNode were never hashed. */
+   if (node->state != FILENODE_STATE_UNUSED) {
+      HgfsNodeIndexRemove(node, session);
+      HgfsServerStatsDec(HGFS_STATS_OPEN_NODES);
+   }
+
    if (node->shareName) {
       free(node->shareName);
       node->shareName = NULL;
@@ -1807,9 +2238,15 @@ HgfsAddNewFileNode(HgfsFileOpenInfo *openInfo,  // IN: open info struct
    if (HGFS_OPEN_MODE_FLAGS(openInfo->mode) & HGFS_OPEN_SEQUENTIAL) {
       newNode->flags |= HGFS_FILE_NODE_SEQUENTIAL_FL;
    }
+   newNode->accessNext = 0;
+   newNode->accessRun = 0;
+   newNode->accessAhead = 0;
+   newNode->accessBehind = 0;
 
    newNode->serverLock = openInfo->acquiredLock;
    newNode->state = FILENODE_STATE_IN_USE_NOT_CACHED;
+   HgfsServerStatsInc(HGFS_STATS_OPEN_NODES);
+   HgfsNodeIndexInsert(newNode, session);
    newNode->shareInfo.readPermissions = openInfo->shareInfo.readPermissions;
    newNode->shareInfo.writePermissions = openInfo->shareInfo.writePermissions;
    newNode->shareInfo.handle = openInfo->shareInfo.handle;
@@ -1855,8 +2292,8 @@ HgfsAddToCacheInternal(HgfsHandle handle,         // IN: HGFS file handle
       return TRUE;
    }
 
-   /* Remove the LRU node if the list is full. */
-   if (session->numCachedOpenNodes == gHgfsCfgSettings.maxCachedOpenNodes) {
+   /* Remove the LRU node if the cache is full. */
+   if (session->numCachedOpenNodes >= session->maxCachedOpenNodes) {
       if (!HgfsRemoveLruNode(session)) {
          LOG(4, ("%s: Unable to remove LRU node from cache.\n",
                  __FUNCTION__));
@@ -1865,15 +2302,16 @@ HgfsAddToCacheInternal(HgfsHandle handle,         // IN: HGFS file handle
       }
    }
 
-   ASSERT(session->numCachedOpenNodes < gHgfsCfgSettings.maxCachedOpenNodes);
+   ASSERT(session->numCachedOpenNodes < session->maxCachedOpenNodes);
 
    node = HgfsHandle2FileNode(handle, session);
    ASSERT(node);
-   /* Append at the end of the list. */
-   DblLnkLst_LinkLast(&session->nodeCachedList, &node->links);
+   /* Append at the end of its list. */
+   HgfsCachedNodeRelink(node, session);
 
    node->state = FILENODE_STATE_IN_USE_CACHED;
    session->numCachedOpenNodes++;
+   HgfsServerStatsInc(HGFS_STATS_CACHED_NODES);
 
    /*
     * Keep track of how many open nodes we have with
@@ -1934,6 +2372,7 @@ HgfsRemoveFromCacheInternal(HgfsHandle handle,        // IN: Hgfs handle to the
       DblLnkLst_Unlink1(&node->links);
       node->state = FILENODE_STATE_IN_USE_NOT_CACHED;
       session->numCachedOpenNodes--;
+      HgfsServerStatsDec(HGFS_STATS_CACHED_NODES);
       LOG(4, ("%s: cache entries %u remove node %s id %"FMT64"u fd %u .\n",
               __FUNCTION__, session->numCachedOpenNodes, node->utf8Name,
               node->localId.fileId, node->fileDesc));
@@ -1963,7 +2402,7 @@ HgfsRemoveFromCacheInternal(HgfsHandle handle,        // IN: Hgfs handle to the
       * we have a problem (see bug 36244).
       */
 
-      ASSERT(session->numCachedOpenNodes < gHgfsCfgSettings.maxCachedOpenNodes);
+      ASSERT(session->numCachedOpenNodes < session->maxCachedOpenNodes);
    }
 
    return TRUE;
@@ -2009,10 +2448,9 @@ HgfsIsCachedInternal(HgfsHandle handle,         // IN: Structure representing fi
 
    if (node->state == FILENODE_STATE_IN_USE_CACHED) {
       /*
-       * Move this node to the end of the list.
+       * Move this node to the end of its list.
        */
-      DblLnkLst_Unlink1(&node->links);
-      DblLnkLst_LinkLast(&session->nodeCachedList, &node->links);
+      HgfsCachedNodeRelink(node, session);
 
       return TRUE;
    }
@@ -2021,6 +2459,173 @@ HgfsIsCachedInternal(HgfsHandle handle,         // IN: Structure representing fi
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsFileNodeIsPinned --
+ *
+ *    Check if a node must stay open once cached: a node with a server lock
+ *    or a file context, or opened in HGFS_FILE_NODE_SEQUENTIAL_FL mode. On
+ *    some platforms this mode does not allow files to be closed/re-opened
+ *    (eg: When restoring a file into a Windows guest you cannot use
+ *    BackupWrite, then close and re-open the file and continue to use
+ *    BackupWrite).
+ *
+ * Results:
+ *    TRUE if the node cannot be evicted from the cache.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE Bool
+HgfsFileNodeIsPinned(const HgfsFileNode *node)  // IN: file node
+{
+   return node->serverLock != HGFS_LOCK_NONE ||
+          node->fileCtx != NULL ||
+          (node->flags & HGFS_FILE_NODE_SEQUENTIAL_FL) != 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCachedNodeRelink --
+ *
+ *    Move a node to the end, most recently used, of the cached list it
+ *    belongs to: the pinned list if it cannot be evicted, or else the list
+ *    the LRU node is taken from.
+ *
+ *    The session's nodeArrayLock should be acquired prior to calling this
+ *    function.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsCachedNodeRelink(HgfsFileNode *node,         // IN/OUT: file node
+                     HgfsSessionInfo *session)   // IN: session info
+{
+   DblLnkLst_Unlink1(&node->links);
+   DblLnkLst_LinkLast(HgfsFileNodeIsPinned(node) ? &session->nodePinnedList
+                                                 : &session->nodeCachedList,
+                      &node->links);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerCacheAdapt --
+ *
+ *    Account a descriptor lookup and, at the end of an adaptation period,
+ *    resize the open node cache of the session to its hit rate: grow it by
+ *    half when more than one lookup in HGFS_CACHE_MISS_RATIO had to reopen
+ *    the file, shrink it back towards the configured size when none did and
+ *    less than half of it is used.
+ *
+ *    The session's nodeArrayLock should be acquired prior to calling this
+ *    function.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerCacheAdapt(HgfsSessionInfo *session,   // IN: session info
+                     Bool hit)                   // IN: node was cached
+{
+   uint32 minCached = gHgfsCfgSettings.maxCachedOpenNodes;
+   uint32 maxCached = session->maxCachedOpenNodes;
+
+   HgfsServerStatsInc(hit ? HGFS_STATS_CACHE_HITS : HGFS_STATS_CACHE_MISSES);
+   session->cacheLookups++;
+   if (!hit) {
+      session->cacheMisses++;
+   }
+
+   if (session->cacheLookups < HGFS_CACHE_ADAPT_PERIOD) {
+      return;
+   }
+
+   if (session->cacheMisses * HGFS_CACHE_MISS_RATIO > session->cacheLookups) {
+      maxCached = MIN(maxCached + MAX(maxCached / 2, 1),
+                      gHgfsMaxCachedOpenNodes);
+   } else if (session->cacheMisses == 0 &&
+              session->numCachedOpenNodes < maxCached / 2 &&
+              maxCached > minCached) {
+      maxCached -= (maxCached - minCached + 1) / 2;
+   }
+
+   if (maxCached != session->maxCachedOpenNodes) {
+      LOG(4, ("%s: %u misses in %u lookups, cache size %u -> %u\n",
+              __FUNCTION__, session->cacheMisses, session->cacheLookups,
+              session->maxCachedOpenNodes, maxCached));
+      session->maxCachedOpenNodes = maxCached;
+   }
+
+   session->cacheLookups = 0;
+   session->cacheMisses = 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerCacheLimitInit --
+ *
+ *    Set the limit to which sessions may grow their open node cache, from
+ *    the open file limit of the process, and make sure the configured size
+ *    is within it.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    May lower gHgfsCfgSettings.maxCachedOpenNodes.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerCacheLimitInit(void)
+{
+   uint32 openFileLimit = HgfsPlatformGetOpenFileLimit();
+   uint32 limit = HGFS_MAX_CACHED_FILENODES_CEILING;
+
+   if (openFileLimit != 0) {
+      limit = MIN(limit, openFileLimit / HGFS_CACHE_FD_SHARE);
+   }
+
+   /* Leave room for the locked nodes and one more. */
+   limit = MAX(limit, MAX_LOCKED_FILENODES + 1);
+
+   if (gHgfsCfgSettings.maxCachedOpenNodes > limit) {
+      Log("%s: open file limit %u, caching %u nodes instead of %u.\n",
+          __FUNCTION__, openFileLimit, limit,
+          gHgfsCfgSettings.maxCachedOpenNodes);
+      gHgfsCfgSettings.maxCachedOpenNodes = limit;
+   }
+
+   gHgfsMaxCachedOpenNodes = MAX(limit, gHgfsCfgSettings.maxCachedOpenNodes);
+   LOG(4, ("%s: cache %u nodes, up to %u\n", __FUNCTION__,
+           gHgfsCfgSettings.maxCachedOpenNodes, gHgfsMaxCachedOpenNodes));
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -2166,12 +2771,14 @@ HgfsGetNewSearch(HgfsSessionInfo *session)  // IN: session info
          newMem[i].shareInfo.rootDirLen = 0;
          newMem[i].dents = NULL;
          newMem[i].numDents = 0;
+         newMem[i].stream = NULL;
 
          /* Append at the end of the list */
          DblLnkLst_LinkLast(&session->searchFreeList, &newMem[i].links);
       }
       session->searchArray = newMem;
       session->numSearches = newNumSearches;
+      HgfsSearchHashResize(session);
 
       if (DOLOG(4)) {
          Log("Dumping searches after pointer changes\n");
@@ -2250,14 +2857,16 @@ HgfsSearchIsBaseNameSpace(HgfsSearch const *search) // IN
  *    search fields more efficiently.
  *
  *    Note that unlike HgfsGetNodeCopy, we always copy the name, and we never
- *    copy the dents.
+ *    copy the dents. The copy does share the directory stream, if any, so
+ *    that entry attributes can be looked up relative to it.
  *
  * Results:
  *    TRUE if the hgfs handle is valid and the copy was successful.
  *    FALSE otherwise.
  *
  * Side effects:
- *    Allocates memory for search.utf8Dir
+ *    Allocates memory for search.utf8Dir, takes a reference on the stream
+ *    to be dropped with HgfsPlatformSearchStreamPut.
  *
  *-----------------------------------------------------------------------------
  */
@@ -2297,6 +2906,10 @@ HgfsGetSearchCopy(HgfsHandle handle,        // IN: Hgfs search handle
    /* No dents for the copy, they consume too much memory and aren't needed. */
    copy->dents = NULL;
    copy->numDents = 0;
+   copy->stream = NULL;
+   if (original->stream != NULL) {
+      copy->stream = HgfsPlatformSearchStreamGet(original->stream);
+   }
 
    copy->handle = original->handle;
    copy->type = original->type;
@@ -2350,9 +2963,11 @@ HgfsAddNewSearch(char const *utf8Dir,       // IN: UTF8 name of dir to search in
 
    newSearch->dents = NULL;
    newSearch->numDents = 0;
+   newSearch->stream = NULL;
    newSearch->flags = 0;
    newSearch->type = type;
    newSearch->handle = HgfsServerGetNextHandleCounter();
+   HgfsSearchHashInsert(newSearch, session);
 
    newSearch->utf8DirLen = strlen(utf8Dir);
    newSearch->utf8Dir = Util_SafeStrdup(utf8Dir);
@@ -2363,6 +2978,8 @@ HgfsAddNewSearch(char const *utf8Dir,       // IN: UTF8 name of dir to search in
    newSearch->shareInfo.rootDirLen = strlen(rootDir);
    newSearch->shareInfo.rootDir = Util_SafeStrdup(rootDir);
 
+   HgfsServerStatsInc(HGFS_STATS_SEARCHES);
+
    LOG(4, ("%s: got new search, handle %u\n", __FUNCTION__,
            HgfsSearch2SearchHandle(newSearch)));
    return newSearch;
@@ -2374,7 +2991,7 @@ HgfsAddNewSearch(char const *utf8Dir,       // IN: UTF8 name of dir to search in
  *
  * HgfsFreeSearchDirents --
  *
- *    Frees all dirents and dirents pointer array.
+ *    Frees all dirents and dirents pointer array, and the directory stream.
  *
  *    Caller should hold the session's searchArrayLock.
  *
@@ -2400,6 +3017,10 @@ HgfsFreeSearchDirents(HgfsSearch *search)       // IN/OUT: search
       free(search->dents);
       search->dents = NULL;
    }
+   if (NULL != search->stream) {
+      HgfsPlatformSearchStreamPut(search->stream);
+      search->stream = NULL;
+   }
 }
 
 
@@ -2431,6 +3052,12 @@ HgfsRemoveSearchInternal(HgfsSearch *search,       // IN: search
    LOG(4, ("%s: handle %u, dir %s\n", __FUNCTION__,
            HgfsSearch2SearchHandle(search), search->utf8Dir));
 
+   HgfsSearchHashRemove(search, session);
+   HgfsServerStatsDec(HGFS_STATS_SEARCHES);
+   if (NULL != search->stream) {
+      ASSERT(session->numStreamSearches > 0);
+      session->numStreamSearches--;
+   }
    HgfsFreeSearchDirents(search);
    free(search->utf8Dir);
    free(search->utf8ShareName);
@@ -2605,11 +3232,13 @@ HgfsServerGetDirEntry(HgfsHandle handle,                // IN: Handle to search
    }
 
    /* No more entries or none. */
-   if (search->dents == NULL) {
+   if (search->dents == NULL && search->stream == NULL) {
       goto out;
    }
 
    if (HGFS_SEARCH_LAST_ENTRY_INDEX == index) {
+      /* Only searches read in full know their final entry. */
+      ASSERT(search->stream == NULL);
       /* Set the index to the final entry. */
       index = search->numDents - 1;
    }
@@ -2651,22 +3280,132 @@ HgfsSearch *
 HgfsSearchHandle2Search(HgfsHandle handle,         // IN: handle
                         HgfsSessionInfo *session)  // IN: session info
 {
-   unsigned int i;
-   HgfsSearch *search = NULL;
+   uint32 i;
 
    ASSERT(session);
    ASSERT(session->searchArray);
 
-   /* XXX: This O(n) lookup can and should be optimized. */
-   for (i = 0; i < session->numSearches; i++) {
-      if (!DblLnkLst_IsLinked(&session->searchArray[i].links) &&
-          session->searchArray[i].handle == handle) {
-         search = &session->searchArray[i];
-         break;
+   i = session->searchHandleHash[handle % session->searchHandleHashSize];
+   while (i != HGFS_INDEX_END) {
+      HgfsSearch *search = &session->searchArray[i];
+
+      ASSERT(!DblLnkLst_IsLinked(&search->links));
+      if (search->handle == handle) {
+         return search;
       }
+      i = search->handleNext;
    }
 
-   return search;
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsSearchHashInsert --
+ *
+ *    Make a search that was just given its handle reachable by it.
+ *
+ *    Caller should hold the session's searchArrayLock.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsSearchHashInsert(HgfsSearch *search,         // IN: search
+                     HgfsSessionInfo *session)   // IN: session info
+{
+   uint32 *bucket = &session->searchHandleHash[search->handle %
+                                                session->searchHandleHashSize];
+
+   search->handleNext = *bucket;
+   *bucket = search - session->searchArray;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsSearchHashRemove --
+ *
+ *    Unlink a search from its handle hash bucket.
+ *
+ *    Caller should hold the session's searchArrayLock.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsSearchHashRemove(HgfsSearch *search,         // IN: search
+                     HgfsSessionInfo *session)   // IN: session info
+{
+   uint32 index = search - session->searchArray;
+   uint32 *link = &session->searchHandleHash[search->handle %
+                                              session->searchHandleHashSize];
+
+   while (*link != index) {
+      ASSERT(*link != HGFS_INDEX_END);
+      link = &session->searchArray[*link].handleNext;
+   }
+   *link = search->handleNext;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsSearchHashResize --
+ *
+ *    Rehash the in use searches over one bucket per search, after the
+ *    search array grew. On allocation failure the old buckets are kept.
+ *
+ *    Caller should hold the session's searchArrayLock.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Memory allocation.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsSearchHashResize(HgfsSessionInfo *session)  // IN: session info
+{
+   uint32 *buckets = malloc(session->numSearches * sizeof *buckets);
+   unsigned int i;
+
+   if (buckets == NULL) {
+      LOG(4, ("%s: keeping %u buckets\n", __FUNCTION__,
+              session->searchHandleHashSize));
+      return;
+   }
+
+   free(session->searchHandleHash);
+   session->searchHandleHash = buckets;
+   session->searchHandleHashSize = session->numSearches;
+   for (i = 0; i < session->searchHandleHashSize; i++) {
+      buckets[i] = HGFS_INDEX_END;
+   }
+   for (i = 0; i < session->numSearches; i++) {
+      if (!DblLnkLst_IsLinked(&session->searchArray[i].links)) {
+         HgfsSearchHashInsert(&session->searchArray[i], session);
+      }
+   }
 }
 
 
@@ -2675,8 +3414,9 @@ HgfsSearchHandle2Search(HgfsHandle handle,         // IN: handle
  *
  * HgfsUpdateNodeNames --
  *
- *    Walk the node array and update all nodes that have the old file name to
- *    store the new file name.
+ *    Update all nodes that have the old file name to store the new file
+ *    name. Only the nodes in the name hash bucket of the old name are looked
+ *    at.
  *
  * Results:
  *    None
@@ -2693,8 +3433,7 @@ HgfsUpdateNodeNames(const char *oldLocalName,  // IN: Name of file to look for
                     const char *newLocalName,  // IN: Name to replace with
                     HgfsSessionInfo *session)  // IN: Session info
 {
-   HgfsFileNode *fileNode;
-   unsigned int i;
+   uint32 i;
    char *newBuffer;
    size_t newBufferLen;
 
@@ -2707,14 +3446,15 @@ HgfsUpdateNodeNames(const char *oldLocalName,  // IN: Name of file to look for
 
    MXUser_AcquireExclLock(session->nodeArrayLock);
 
-   for (i = 0; i < session->numNodes; i++) {
-      fileNode = &session->nodeArray[i];
+   /* Only the nodes in the bucket of the old name can have it. */
+   i = session->nodeNameHash[HgfsNodeNameHash(oldLocalName, session)];
+   while (i != HGFS_INDEX_END) {
+      HgfsFileNode *fileNode = &session->nodeArray[i];
 
-      /* If the node is on the free list, skip it. */
-      if (fileNode->state == FILENODE_STATE_UNUSED) {
-         continue;
-      }
+      /* Relinking the node puts it at the head of a bucket, after us. */
+      i = fileNode->nameNext;
 
+      ASSERT(fileNode->state != FILENODE_STATE_UNUSED);
       if (strcmp(fileNode->utf8Name, oldLocalName) == 0) {
          newBuffer = malloc(newBufferLen + 1);
          if (!newBuffer) {
@@ -2725,9 +3465,11 @@ HgfsUpdateNodeNames(const char *oldLocalName,  // IN: Name of file to look for
          newBuffer[newBufferLen] = '\0';
 
          /* Update this name to the new name. */
+         HgfsNodeNameUnlink(fileNode, session);
          free(fileNode->utf8Name);
          fileNode->utf8Name = newBuffer;
          fileNode->utf8NameLen = newBufferLen;
+         HgfsNodeNameLink(fileNode, session);
       }
    }
 
@@ -2902,6 +3644,23 @@ static struct {
    { HgfsServerRemoveDirNotifyWatch, sizeof (HgfsRequestRemoveWatchV4),            REQ_SYNC},
    { NULL,                       0,                                                REQ_SYNC}, // No Op notify
    { HgfsServerSearchRead,       sizeof (HgfsRequestSearchReadV4),                 REQ_SYNC},
+   { NULL,                       0,                                                REQ_SYNC}, // No Op open
+   { NULL,                       0,                                                REQ_SYNC}, // No Op enumerate streams
+   { NULL,                       0,                                                REQ_SYNC}, // No Op getattr
+   { NULL,                       0,                                                REQ_SYNC}, // No Op setattr
+   { NULL,                       0,                                                REQ_SYNC}, // No Op delete
+   { NULL,                       0,                                                REQ_SYNC}, // No Op linkmove
+   { NULL,                       0,                                                REQ_SYNC}, // No Op fsctl
+   { NULL,                       0,                                                REQ_SYNC}, // No Op access check
+   { NULL,                       0,                                                REQ_SYNC}, // No Op fsync
+   { NULL,                       0,                                                REQ_SYNC}, // No Op query volume info
+   { NULL,                       0,                                                REQ_SYNC}, // No Op oplock acquire
+   { NULL,                       0,                                                REQ_SYNC}, // No Op oplock break
+   { NULL,                       0,                                                REQ_SYNC}, // No Op lock byte range
+   { NULL,                       0,                                                REQ_SYNC}, // No Op unlock byte range
+   { NULL,                       0,                                                REQ_SYNC}, // No Op query EAs
+   { NULL,                       0,                                                REQ_SYNC}, // No Op set EAs
+   { HgfsServerCopyFile,         sizeof (HgfsRequestCopyFileV4),                   REQ_SYNC},
 
 };
 
@@ -2939,6 +3698,7 @@ HgfsServerInputAllocInit(HgfsPacket *packet,                        // IN: packe
 
    localParams = Util_SafeCalloc(1, sizeof *localParams);
 
+   localParams->receivedUS = Hostinfo_SystemTimerUS();
    localParams->packet = packet;
    localParams->request = request;
    localParams->requestSize = requestSize;
@@ -3022,7 +3782,8 @@ HgfsServerGetRequest(HgfsPacket *packet,                        // IN: packet
    size_t requestOpArgsSize;
    HgfsInternalStatus parseStatus = HGFS_ERROR_SUCCESS;
 
-   request = HSPU_GetMetaPacket(packet, &requestSize, transportSession->channelCbTable);
+   request = HSPU_GetMetaPacket(packet, &requestSize, transportSession->channelCbTable,
+                                &transportSession->bufPool);
 
    if (NULL == request) {
       /*
@@ -3235,6 +3996,7 @@ HgfsServerCompleteRequest(HgfsInternalStatus status,   // IN: Status of the requ
 
    reply = HSPU_GetReplyPacket(input->packet,
                                input->transportSession->channelCbTable,
+                               &input->transportSession->bufPool,
                                replySize,
                                &replyTotalSize);
 
@@ -3246,6 +4008,15 @@ HgfsServerCompleteRequest(HgfsInternalStatus status,   // IN: Status of the requ
       goto exit;
    }
 
+   HgfsServerStatsRecordOp(input->op, status,
+                           input->requestSize +
+                           (input->packet->dataMappingType == BUF_READABLE ?
+                            input->packet->dataPacketDataSize : 0),
+                           replySize +
+                           (input->packet->dataMappingType == BUF_WRITEABLE ?
+                            input->packet->dataPacketDataSize : 0),
+                           Hostinfo_SystemTimerUS() - input->receivedUS);
+
    if (!HgfsPacketSend(input->packet,
                        input->transportSession,
                        input->session,
@@ -3282,7 +4053,8 @@ HgfsServerProcessRequest(void *context)
    if (!input->request) {
       input->request = HSPU_GetMetaPacket(input->packet,
                                           &input->requestSize,
-                                          input->transportSession->channelCbTable);
+                                          input->transportSession->channelCbTable,
+                                          &input->transportSession->bufPool);
    }
 
    input->payload = (char *)input->request + input->payloadOffset;
@@ -3348,6 +4120,7 @@ HgfsServerSessionReceive(HgfsPacket *packet,      // IN: Hgfs Packet
    }
 
    HGFS_ASSERT_MINIMUM_OP(input->op);
+   ASSERT_ON_COMPILE(ARRAYSIZE(handlers) == HGFS_OP_MAX);
    if (HGFS_ERROR_SUCCESS == status) {
       HGFS_ASSERT_INPUT(input);
       if ((input->op < ARRAYSIZE(handlers)) &&
@@ -3365,7 +4138,8 @@ HgfsServerSessionReceive(HgfsPacket *packet,      // IN: Hgfs Packet
              * Asynchronous processing is supported by the transport.
              * We can release mappings here and reacquire when needed.
              */
-            HSPU_PutMetaPacket(packet, transportSession->channelCbTable);
+            HSPU_PutMetaPacket(packet, transportSession->channelCbTable,
+                               &transportSession->bufPool);
             input->request = NULL;
             HgfsServerAsyncInfoIncCount(&input->session->asyncRequestsInfo);
 
@@ -3940,6 +4714,10 @@ HgfsServer_InitState(const HgfsServerCallbacks **callbackTable,   // IN/OUT: our
       result = FALSE;
    }
 
+   if (result) {
+      HgfsServerCacheLimitInit();
+   }
+
    if (result) {
       *callbackTable = &gHgfsServerCBTable;
 
@@ -4365,6 +5143,7 @@ HgfsServerTransportInit(void *transportData,                         // IN: tran
                                RANK_hgfsSessionArrayLock);
 
    DblLnkLst_Init(&transportSession->sessionArray);
+   HSPU_BufPoolInit(&transportSession->bufPool);
 
    transportSession->defaultSessionId = HGFS_INVALID_SESSION_ID;
 
@@ -4407,6 +5186,7 @@ HgfsServerTransportExit(HgfsTransportSessionInfo *transportSession)   // IN: tra
       HgfsServerSessionPut(session);
    }
 
+   HSPU_BufPoolExit(&transportSession->bufPool);
    MXUser_DestroyExclLock(transportSession->sessionArrayLock);
    free(transportSession);
 }
@@ -4638,6 +5418,7 @@ HgfsServerAllocateSession(HgfsTransportSessionInfo *transportSession, // IN:
 
    DblLnkLst_Init(&session->nodeFreeList);
    DblLnkLst_Init(&session->nodeCachedList);
+   DblLnkLst_Init(&session->nodePinnedList);
 
    /* Allocate array of FileNodes and add them to free list. */
    session->numNodes = NUM_FILE_NODES;
@@ -4645,6 +5426,9 @@ HgfsServerAllocateSession(HgfsTransportSessionInfo *transportSession, // IN:
                                         sizeof (HgfsFileNode));
    session->numCachedOpenNodes = 0;
    session->numCachedLockedNodes = 0;
+   session->maxCachedOpenNodes = gHgfsCfgSettings.maxCachedOpenNodes;
+   session->cacheLookups = 0;
+   session->cacheMisses = 0;
 
    for (i = 0; i < session->numNodes; i++) {
       DblLnkLst_Init(&session->nodeArray[i].links);
@@ -4652,6 +5436,18 @@ HgfsServerAllocateSession(HgfsTransportSessionInfo *transportSession, // IN:
       DblLnkLst_LinkLast(&session->nodeFreeList, &session->nodeArray[i].links);
    }
 
+   /* One bucket per node in each hash, all empty. */
+   session->nodeHashSize = session->numNodes;
+   session->nodeHandleHash = Util_SafeMalloc(session->nodeHashSize *
+                                             sizeof *session->nodeHandleHash);
+   session->nodeNameHash = Util_SafeMalloc(session->nodeHashSize *
+                                           sizeof *session->nodeNameHash);
+   for (i = 0; i < session->nodeHashSize; i++) {
+      session->nodeHandleHash[i] = HGFS_INDEX_END;
+      session->nodeNameHash[i] = HGFS_INDEX_END;
+   }
+   DblLnkLst_Init(&session->nodeShareGroups);
+
    /*
     * Initialize the search handling components.
     */
@@ -4664,6 +5460,7 @@ HgfsServerAllocateSession(HgfsTransportSessionInfo *transportSession, // IN:
 
    /* Allocate array of searches and add them to free list. */
    session->numSearches = NUM_SEARCHES;
+   session->numStreamSearches = 0;
    session->searchArray = Util_SafeCalloc(session->numSearches,
                                           sizeof (HgfsSearch));
 
@@ -4673,6 +5470,13 @@ HgfsServerAllocateSession(HgfsTransportSessionInfo *transportSession, // IN:
       DblLnkLst_LinkLast(&session->searchFreeList,
                          &session->searchArray[i].links);
    }
+
+   session->searchHandleHashSize = session->numSearches;
+   session->searchHandleHash = Util_SafeMalloc(session->searchHandleHashSize *
+                                               sizeof *session->searchHandleHash);
+   for (i = 0; i < session->searchHandleHashSize; i++) {
+      session->searchHandleHash[i] = HGFS_INDEX_END;
+   }
    /* Initialize the async request info.*/
    HgfsServerAsyncInfoInit(&session->asyncRequestsInfo);
 
@@ -4890,6 +5694,11 @@ HgfsServerExitSessionInternal(HgfsSessionInfo *session)    // IN: session contex
    }
    free(session->nodeArray);
    session->nodeArray = NULL;
+   free(session->nodeHandleHash);
+   session->nodeHandleHash = NULL;
+   free(session->nodeNameHash);
+   session->nodeNameHash = NULL;
+   ASSERT(!DblLnkLst_IsLinked(&session->nodeShareGroups));
 
    MXUser_ReleaseExclLock(session->nodeArrayLock);
 
@@ -4908,6 +5717,8 @@ HgfsServerExitSessionInternal(HgfsSessionInfo *session)    // IN: session contex
    }
    free(session->searchArray);
    session->searchArray = NULL;
+   free(session->searchHandleHash);
+   session->searchHandleHash = NULL;
 
    MXUser_ReleaseExclLock(session->searchArrayLock);
 
@@ -4996,9 +5807,12 @@ HgfsServerSessionSendComplete(HgfsPacket *packet,   // IN/OUT: Hgfs packet
    HgfsTransportSessionInfo *transportSession = clientData;
 
    if (0 != (packet->state & HGFS_STATE_CLIENT_REQUEST)) {
-      HSPU_PutMetaPacket(packet, transportSession->channelCbTable);
-      HSPU_PutReplyPacket(packet, transportSession->channelCbTable);
-      HSPU_PutDataPacketBuf(packet, transportSession->channelCbTable);
+      HSPU_PutMetaPacket(packet, transportSession->channelCbTable,
+                         &transportSession->bufPool);
+      HSPU_PutReplyPacket(packet, transportSession->channelCbTable,
+                          &transportSession->bufPool);
+      HSPU_PutDataPacketBuf(packet, transportSession->channelCbTable,
+                            &transportSession->bufPool);
    } else {
       if (packet->metaPacketIsAllocated) {
          free(packet->metaPacket);
@@ -5125,8 +5939,8 @@ HgfsPacketSend(HgfsPacket *packet,                         // IN/OUT: Hgfs Packe
  *
  * HgfsInvalidateSessionObjects --
  *
- *      Iterates over all nodes and searches, invalidating and removing those
- *      that are no longer within a share.
+ *      Iterates over the nodes of removed shares and over all searches,
+ *      invalidating and removing those that are no longer within a share.
  *
  * Results:
  *      None
@@ -5141,6 +5955,8 @@ static void
 HgfsInvalidateSessionObjects(DblLnkLst_Links *shares,  // IN: List of new shares
                              HgfsSessionInfo *session) // IN: Session info
 {
+   DblLnkLst_Links *link;
+   DblLnkLst_Links *nextLink;
    unsigned int i;
 
    ASSERT(shares);
@@ -5152,36 +5968,43 @@ HgfsInvalidateSessionObjects(DblLnkLst_Links *shares,  // IN: List of new shares
    MXUser_AcquireExclLock(session->nodeArrayLock);
 
    /*
-    * Iterate over each node, skipping those that are unused. For each node,
-    * if its filename is no longer within a share, remove it.
+    * Iterate over the groups of nodes of each share. For each group, if its
+    * share root is no longer one of the shares, remove all of its nodes.
+    * Freeing the last node of a group frees the group.
     */
-   for (i = 0; i < session->numNodes; i++) {
-      HgfsHandle handle;
+   DblLnkLst_ForEachSafe(link, nextLink, &session->nodeShareGroups) {
+      HgfsNodeShareGroup *group = DblLnkLst_Container(link, HgfsNodeShareGroup,
+                                                      links);
       DblLnkLst_Links *l;
 
-      if (session->nodeArray[i].state == FILENODE_STATE_UNUSED) {
-         continue;
-      }
-
-      handle = HgfsFileNode2Handle(&session->nodeArray[i]);
-      LOG(4, ("%s: Examining node with fd %d (%s)\n", __FUNCTION__,
-              handle, session->nodeArray[i].utf8Name));
+      LOG(4, ("%s: Examining nodes of share root %s\n", __FUNCTION__,
+              group->rootDir));
 
-      /* For each share, is the node within the share? */
+      /* For each share, are the nodes within the share? */
       for (l = shares->next; l != shares; l = l->next) {
          HgfsSharedFolder *share;
 
          share = DblLnkLst_Container(l, HgfsSharedFolder, links);
          ASSERT(share);
-         if (strcmp(session->nodeArray[i].shareInfo.rootDir, share->path) == 0) {
-            LOG(4, ("%s: Node is still valid\n", __FUNCTION__));
+         if (strcmp(group->rootDir, share->path) == 0) {
+            LOG(4, ("%s: Nodes are still valid\n", __FUNCTION__));
             break;
          }
       }
 
-      /* If the node wasn't found in any share, remove it. */
-      if (l == shares) {
-         LOG(4, ("%s: Node is invalid, removing\n", __FUNCTION__));
+      if (l != shares) {
+         continue;
+      }
+
+      /* The nodes weren't found in any share, remove them. */
+      i = group->firstNode;
+      while (i != HGFS_INDEX_END) {
+         HgfsFileNode *node = &session->nodeArray[i];
+         HgfsHandle handle = HgfsFileNode2Handle(node);
+
+         i = node->shareNext;
+         LOG(4, ("%s: Node with fd %d (%s) is invalid, removing\n",
+                 __FUNCTION__, handle, node->utf8Name));
          if (!HgfsRemoveFromCacheInternal(handle, session)) {
             LOG(4, ("%s: Could not remove node with "
                     "fh %d from the cache.\n", __FUNCTION__, handle));
@@ -5638,12 +6461,13 @@ HgfsServerGetLocalNameInfo(const char *cpName,      // IN:  Cross-platform filen
    myBufOutLen = out - myBufOut;
 
 #if defined(__APPLE__)
-   {
+   if (!CodeSet_IsAscii(myBufOut, myBufOutLen)) {
       size_t nameLen;
       /*
        * For Mac hosts the unicode format is decomposed (form D)
        * so there is a need to convert the incoming name from HGFS clients
        * which is assumed to be in the normalized form C (precomposed).
+       * ASCII names are the same in both forms.
        */
 
       if (!CodeSet_Utf8FormCToUtf8FormD(myBufOut, myBufOutLen, &tempPtr,
@@ -5883,8 +6707,25 @@ HgfsServerSearchRealDir(char const *baseDir,      // IN: Directory to search
    followSymlinks = HgfsServerPolicy_IsShareOptionSet(configOptions,
                                                       HGFS_SHARE_FOLLOW_SYMLINKS);
 
-   status = HgfsPlatformScandir(baseDir, baseDirLen, followSymlinks,
-                                &search->dents, &search->numDents);
+   /*
+    * Read the entries as the client asks for them where the platform can,
+    * so that huge directories neither cost a huge allocation nor delay the
+    * first reply. Up to HGFS_MAX_STREAM_SEARCHES per session, as each keeps
+    * its directory open.
+    */
+   if (session->numStreamSearches < HGFS_MAX_STREAM_SEARCHES) {
+      status = HgfsPlatformOpenSearchStream(baseDir, followSymlinks,
+                                            &search->stream);
+      if (HGFS_ERROR_SUCCESS == status) {
+         session->numStreamSearches++;
+      }
+   } else {
+      status = HGFS_ERROR_NOT_SUPPORTED;
+   }
+   if (HGFS_ERROR_NOT_SUPPORTED == status) {
+      status = HgfsPlatformScandir(baseDir, baseDirLen, followSymlinks,
+                                   &search->dents, &search->numDents);
+   }
    if (HGFS_ERROR_SUCCESS != status) {
       LOG(4, ("%s: couldn't scandir\n", __FUNCTION__));
       HgfsRemoveSearchInternal(search, session);
@@ -6073,14 +6914,15 @@ HgfsRemoveFromCache(HgfsHandle handle,	      // IN: Hgfs handle to the node
  *
  * HgfsIsCached --
  *
- *    Grab a lock and call HgfsIsCachedInternal.
+ *    Grab a lock and call HgfsIsCachedInternal. This is the lookup of the
+ *    descriptor of a node, so account it as a hit or miss of the cache.
  *
  * Results:
  *    TRUE if the node is found in the cache.
  *    FALSE if the node is not in the cache.
  *
  * Side effects:
- *    None
+ *    May resize the cache of the session.
  *
  *-----------------------------------------------------------------------------
  */
@@ -6093,6 +6935,7 @@ HgfsIsCached(HgfsHandle handle,         // IN: Structure representing file node
 
    MXUser_AcquireExclLock(session->nodeArrayLock);
    cached = HgfsIsCachedInternal(handle, session);
+   HgfsServerCacheAdapt(session, cached);
    MXUser_ReleaseExclLock(session->nodeArrayLock);
 
    return cached;
@@ -6104,9 +6947,10 @@ HgfsIsCached(HgfsHandle handle,         // IN: Structure representing file node
  *
  * HgfsRemoveLruNode--
  *
- *    Removes the least recently used node in the cache. The first node is
- *    removed since most recently used nodes are moved to the end of the
- *    list.
+ *    Removes the least recently used node in the cache that can be closed.
+ *    The first node of the evictable list is removed since most recently
+ *    used nodes are moved to the end of the list, and the nodes that cannot
+ *    be closed are kept in the pinned list.
  *
  *    XXX: Right now we do not remove nodes that have server locks on them
  *         This is not correct and should be fixed before the release.
@@ -6131,51 +6975,39 @@ HgfsIsCached(HgfsHandle handle,         // IN: Structure representing file node
 Bool
 HgfsRemoveLruNode(HgfsSessionInfo *session)   // IN: session info
 {
-   HgfsFileNode *lruNode = NULL;
+   HgfsFileNode *lruNode;
    HgfsHandle handle;
-   Bool found = FALSE;
-   uint32 numOpenNodes = session->numCachedOpenNodes;
 
    ASSERT(session);
    ASSERT(session->numCachedOpenNodes > 0);
 
-   /*
-    * Remove the first item from the list that does not have a server lock,
-    * file context or is open in sequential mode.
-    */
-   while (!found && (numOpenNodes-- > 0)) {
+   while (DblLnkLst_IsLinked(&session->nodeCachedList)) {
       lruNode = DblLnkLst_Container(session->nodeCachedList.next,
                                     HgfsFileNode, links);
 
       ASSERT(lruNode->state == FILENODE_STATE_IN_USE_CACHED);
-      if (lruNode->serverLock != HGFS_LOCK_NONE || lruNode->fileCtx != NULL
-          || (lruNode->flags & HGFS_FILE_NODE_SEQUENTIAL_FL) != 0) {
+      if (HgfsFileNodeIsPinned(lruNode)) {
          /*
-	  * Move this node with the server lock to the beginning of the list.
-	  * Also, prevent files opened in HGFS_FILE_NODE_SEQUENTIAL_FL mode
-	  * from being closed. -- On some platforms, this mode does not
-	  * allow files to be closed/re-opened (eg: When restoring a file
-	  * into a Windows guest you cannot use BackupWrite, then close and
-	  * re-open the file and continue to use BackupWrite.
-	  */
-         DblLnkLst_Unlink1(&lruNode->links);
-         DblLnkLst_LinkLast(&session->nodeCachedList, &lruNode->links);
-      } else {
-         found = TRUE;
+          * Nodes are relinked when they get pinned, but should one be
+          * missed, file it with the other pinned nodes rather than close it.
+          */
+         HgfsCachedNodeRelink(lruNode, session);
+         continue;
       }
-   }
-   if (found) {
+
       handle = HgfsFileNode2Handle(lruNode);
       if (!HgfsRemoveFromCacheInternal(handle, session)) {
          LOG(4, ("%s: Could not remove the node from cache.\n", __FUNCTION__));
          return FALSE;
       }
-   } else {
-      LOG(4, ("%s: Could not find a node to remove from cache.\n", __FUNCTION__));
-      return FALSE;
+      HgfsServerStatsInc(HGFS_STATS_LRU_EVICTIONS);
+
+      return TRUE;
    }
 
-   return TRUE;
+   LOG(4, ("%s: Could not find a node to remove from cache.\n", __FUNCTION__));
+
+   return FALSE;
 }
 
 
@@ -6342,6 +7174,7 @@ HgfsAllocInitReply(HgfsPacket *packet,           // IN/OUT: Hgfs Packet
    }
    replyHeader = HSPU_GetReplyPacket(packet,
                                      session->transportSession->channelCbTable,
+                                     &session->transportSession->bufPool,
                                      headerSize + replyDataSize,
                                      &replyPacketSize);
 
@@ -6456,6 +7289,128 @@ exit:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerAdviseAccess --
+ *
+ *    Track the access pattern of a node through its reads and writes, and
+ *    advise the platform cache accordingly:
+ *    - a streaming reader is advised sequential when detected and back to
+ *      normal when it stops, and the next window is read ahead,
+ *    - a streaming writer has each window written back as it is done,
+ *    - a bulk reader or writer has the windows behind it dropped, so that a
+ *      large copy does not push everything else out of the cache.
+ *
+ *    Non seekable nodes and appends are not tracked.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerAdviseAccess(HgfsHandle file,            // IN: file handle
+                       HgfsSessionInfo *session,   // IN: session info
+                       fileDesc fd,                // IN: file descriptor
+                       uint64 offset,              // IN: offset accessed
+                       uint32 size,                // IN: bytes accessed
+                       Bool write)                 // IN: written or read
+{
+   struct {
+      HgfsAccessAdvice advice;
+      uint64 offset;
+      uint64 length;
+   } advices[HGFS_ACCESS_MAX_ADVICE];
+   uint32 numAdvices = 0;
+   HgfsFileNode *node;
+   uint32 i;
+
+   if (0 == (gHgfsCfgSettings.flags & HGFS_CONFIG_CACHE_HINTS_ENABLED) ||
+       0 == size) {
+      return;
+   }
+
+   MXUser_AcquireExclLock(session->nodeArrayLock);
+
+   node = HgfsHandle2FileNode(file, session);
+   if (NULL == node || 0 != (node->flags & HGFS_FILE_NODE_SEQUENTIAL_FL)) {
+      goto exit;
+   }
+
+   if (offset != node->accessNext) {
+      if (!write && node->accessRun >= HGFS_ACCESS_STREAM_MIN) {
+         advices[numAdvices].advice = HGFS_ACCESS_ADVICE_NORMAL;
+         advices[numAdvices].offset = 0;
+         advices[numAdvices].length = 0;
+         numAdvices++;
+      }
+      node->accessRun = 0;
+      node->accessAhead = offset;
+      node->accessBehind = offset;
+   }
+   node->accessNext = offset + size;
+   node->accessRun += size;
+
+   if (node->accessRun < HGFS_ACCESS_STREAM_MIN) {
+      goto exit;
+   }
+
+   if (write) {
+      if (node->accessNext - node->accessAhead >= HGFS_ACCESS_WINDOW) {
+         advices[numAdvices].advice = HGFS_ACCESS_ADVICE_WRITEBEHIND;
+         advices[numAdvices].offset = node->accessAhead;
+         advices[numAdvices].length = node->accessNext - node->accessAhead;
+         numAdvices++;
+         node->accessAhead = node->accessNext;
+      }
+   } else {
+      if (node->accessRun - size < HGFS_ACCESS_STREAM_MIN) {
+         advices[numAdvices].advice = HGFS_ACCESS_ADVICE_SEQUENTIAL;
+         advices[numAdvices].offset = 0;
+         advices[numAdvices].length = 0;
+         numAdvices++;
+      }
+      if (node->accessAhead < node->accessNext + HGFS_ACCESS_WINDOW / 2) {
+         uint64 start = MAX(node->accessAhead, node->accessNext);
+
+         advices[numAdvices].advice = HGFS_ACCESS_ADVICE_WILLNEED;
+         advices[numAdvices].offset = start;
+         advices[numAdvices].length = node->accessNext + HGFS_ACCESS_WINDOW - start;
+         numAdvices++;
+         node->accessAhead = node->accessNext + HGFS_ACCESS_WINDOW;
+      }
+   }
+
+   if (node->accessRun >= HGFS_ACCESS_BULK_MIN &&
+       node->accessNext - node->accessBehind >= 3 * HGFS_ACCESS_WINDOW &&
+       numAdvices < HGFS_ACCESS_MAX_ADVICE) {
+      uint64 end = node->accessNext - 2 * HGFS_ACCESS_WINDOW;
+
+      advices[numAdvices].advice = HGFS_ACCESS_ADVICE_DONTNEED;
+      advices[numAdvices].offset = node->accessBehind;
+      advices[numAdvices].length = end - node->accessBehind;
+      numAdvices++;
+      node->accessBehind = end;
+   }
+
+exit:
+   MXUser_ReleaseExclLock(session->nodeArrayLock);
+
+   for (i = 0; i < numAdvices; i++) {
+      LOG(4, ("%s: file %u advice %d offset %"FMT64"u length %"FMT64"u\n",
+              __FUNCTION__, file, advices[i].advice, advices[i].offset,
+              advices[i].length));
+      HgfsPlatformAdviseAccess(fd, advices[i].advice, advices[i].offset,
+                               advices[i].length);
+   }
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -6521,25 +7476,44 @@ HgfsServerRead(HgfsInputParam *input)  // IN: Input params
    case HGFS_OP_READ_FAST_V4:
    case HGFS_OP_READ_V3: {
          HgfsReplyReadV3 *reply = replyRead;
-         void *payload;
+         void *payload = NULL;
+         HgfsVmxIov *dataIov = NULL;
+         uint32 dataIovCount;
          Bool readUseDataBuffer = replyReadDataSize != 0;
 
          /*
           * The read data size holds the size of the data to read which will be read
           * into the separate data packet buffer. Zero indicates data is read into the
           * same buffer as the reply arguments.
+          *
+          * A data packet spanning several guest pages is read into directly
+          * rather than through a buffer copied to it afterwards.
           */
          if (readUseDataBuffer) {
-            payload = HSPU_GetDataPacketBuf(input->packet, BUF_WRITEABLE,
-                                            input->transportSession->channelCbTable);
+            dataIov = HSPU_GetDataPacketIov(input->packet, BUF_WRITEABLE,
+                                            input->transportSession->channelCbTable,
+                                            &dataIovCount);
+            if (dataIov == NULL) {
+               payload = HSPU_GetDataPacketBuf(input->packet, BUF_WRITEABLE,
+                                               input->transportSession->channelCbTable,
+                                               &input->transportSession->bufPool);
+            }
          } else {
             payload = &reply->payload[0];
          }
-         if (payload) {
-            status = HgfsPlatformReadFile(readFd, input->session, offset,
-                                          requiredSize, payload,
-                                          &reply->actualSize);
+         if (dataIov != NULL || payload != NULL) {
+            if (dataIov != NULL) {
+               status = HgfsPlatformReadFileV(readFd, input->session, offset,
+                                              requiredSize, dataIov, dataIovCount,
+                                              &reply->actualSize);
+            } else {
+               status = HgfsPlatformReadFile(readFd, input->session, offset,
+                                             requiredSize, payload,
+                                             &reply->actualSize);
+            }
             if (HGFS_ERROR_SUCCESS == status) {
+               HgfsServerAdviseAccess(file, input->session, readFd, offset,
+                                      reply->actualSize, FALSE);
                reply->reserved = 0;
                replyPayloadSize = sizeof *reply;
 
@@ -6561,6 +7535,8 @@ HgfsServerRead(HgfsInputParam *input)  // IN: Input params
          status = HgfsPlatformReadFile(readFd, input->session, offset, requiredSize,
                                        reply->payload, &reply->actualSize);
          if (HGFS_ERROR_SUCCESS == status) {
+            HgfsServerAdviseAccess(file, input->session, readFd, offset,
+                                   reply->actualSize, FALSE);
             replyPayloadSize = sizeof *reply + reply->actualSize;
          } else {
             LOG(4, ("%s: V1 Failed to read-> %d.\n", __FUNCTION__, status));
@@ -6795,30 +7771,59 @@ HgfsServerWrite(HgfsInputParam *input)  // IN: Input params
    }
 
    if (writeSize > 0) {
+      HgfsVmxIov *dataIov = NULL;
+      uint32 dataIovCount;
+
       if (NULL == writeData) {
-         /* No inline data to write, get it from the transport shared memory. */
+         /*
+          * No inline data to write, get it from the transport shared memory,
+          * writing straight from the guest pages when they can be mapped.
+          */
          HSPU_SetDataPacketSize(input->packet, writeSize);
-         writeData = HSPU_GetDataPacketBuf(input->packet, BUF_READABLE,
-                                           input->transportSession->channelCbTable);
-         if (NULL == writeData) {
-            LOG(4, ("%s: Error: Op %d mapping write data buffer\n", __FUNCTION__, input->op));
-            status = HGFS_ERROR_PROTOCOL;
-            goto exit;
+         dataIov = HSPU_GetDataPacketIov(input->packet, BUF_READABLE,
+                                         input->transportSession->channelCbTable,
+                                         &dataIovCount);
+         if (NULL == dataIov) {
+            writeData = HSPU_GetDataPacketBuf(input->packet, BUF_READABLE,
+                                              input->transportSession->channelCbTable,
+                                              &input->transportSession->bufPool);
+            if (NULL == writeData) {
+               LOG(4, ("%s: Error: Op %d mapping write data buffer\n", __FUNCTION__, input->op));
+               status = HGFS_ERROR_PROTOCOL;
+               goto exit;
+            }
          }
       }
 
-      status = HgfsPlatformWriteFile(writeFd,
-                                     input->session,
-                                     writeOffset,
-                                     writeSize,
-                                     writeFlags,
-                                     writeSequential,
-                                     writeAppend,
-                                     writeData,
-                                     &writtenSize);
+      if (NULL != dataIov) {
+         status = HgfsPlatformWriteFileV(writeFd,
+                                         input->session,
+                                         writeOffset,
+                                         writeSize,
+                                         writeFlags,
+                                         writeSequential,
+                                         writeAppend,
+                                         dataIov,
+                                         dataIovCount,
+                                         &writtenSize);
+      } else {
+         status = HgfsPlatformWriteFile(writeFd,
+                                        input->session,
+                                        writeOffset,
+                                        writeSize,
+                                        writeFlags,
+                                        writeSequential,
+                                        writeAppend,
+                                        writeData,
+                                        &writtenSize);
+      }
       if (HGFS_ERROR_SUCCESS != status) {
          goto exit;
       }
+      if (!writeSequential && !writeAppend) {
+         HgfsServerAdviseAccess(writeFile, input->session, writeFd, writeOffset,
+                                writtenSize, TRUE);
+      }
    }
 
    if (!HgfsPackWriteReply(input->packet, input->request, input->op,
@@ -7438,6 +8443,126 @@ HgfsServerRename(HgfsInputParam *input)  // IN: Input params
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerCopyFile --
+ *
+ *    Handle a CopyFile request.
+ *
+ *    Converts the source and target names to local filenames and has the
+ *    platform code copy the file on the host, so that the data does not go
+ *    through the client. Each request copies a bounded amount of data, the
+ *    reply tells the client where to continue.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerCopyFile(HgfsInputParam *input)  // IN: Input params
+{
+   char *utf8SrcName = NULL;
+   size_t utf8SrcNameLen;
+   char *utf8TargetName = NULL;
+   size_t utf8TargetNameLen;
+   const char *cpSrcName;
+   size_t cpSrcNameLen;
+   const char *cpTargetName;
+   size_t cpTargetNameLen;
+   HgfsInternalStatus status;
+#ifdef _WIN32
+   fileDesc srcFileDesc = INVALID_HANDLE_VALUE;
+   fileDesc targetFileDesc = INVALID_HANDLE_VALUE;
+#else
+   fileDesc srcFileDesc = -1;
+   fileDesc targetFileDesc = -1;
+#endif
+   Bool useSrcFile;
+   Bool useTargetFile;
+   HgfsHandle srcFile;
+   HgfsHandle targetFile;
+   HgfsCopyFileFlags flags;
+   uint32 srcCaseFlags;
+   uint32 targetCaseFlags;
+   HgfsShareInfo shareInfo;
+   uint64 offset;
+   uint64 size = 0;
+   uint64 nextOffset = 0;
+   size_t replyPayloadSize = 0;
+
+   HGFS_ASSERT_INPUT(input);
+
+   /*
+    * The source and target are checked as for a rename: neither may be a
+    * shared folder itself nor have an oplock that the copy would break.
+    */
+   if (HgfsUnpackCopyFileRequest(input->payload, input->payloadSize,
+                                 &cpSrcName, &cpSrcNameLen,
+                                 &cpTargetName, &cpTargetNameLen,
+                                 &flags, &offset, &useSrcFile, &srcFile,
+                                 &useTargetFile, &targetFile,
+                                 &srcCaseFlags, &targetCaseFlags)) {
+      status = HgfsValidateRenameFile(useSrcFile,
+                                      srcFile,
+                                      cpSrcName,
+                                      cpSrcNameLen,
+                                      srcCaseFlags,
+                                      input->session,
+                                      &srcFileDesc,
+                                      &shareInfo,
+                                      &utf8SrcName,
+                                      &utf8SrcNameLen);
+      if (HGFS_ERROR_SUCCESS == status && !shareInfo.readPermissions) {
+         LOG(4, ("%s: source not readable\n", __FUNCTION__));
+         status = HGFS_ERROR_ACCESS_DENIED;
+      }
+      if (HGFS_ERROR_SUCCESS == status) {
+         status = HgfsValidateRenameFile(useTargetFile,
+                                         targetFile,
+                                         cpTargetName,
+                                         cpTargetNameLen,
+                                         targetCaseFlags,
+                                         input->session,
+                                         &targetFileDesc,
+                                         &shareInfo,
+                                         &utf8TargetName,
+                                         &utf8TargetNameLen);
+         if (HGFS_ERROR_SUCCESS == status && !shareInfo.writePermissions) {
+            LOG(4, ("%s: target not writeable\n", __FUNCTION__));
+            status = HGFS_ERROR_ACCESS_DENIED;
+         }
+      }
+   } else {
+      status = HGFS_ERROR_PROTOCOL;
+   }
+
+   if (HGFS_ERROR_SUCCESS == status) {
+      status = HgfsPlatformCopyFile(utf8SrcName, utf8TargetName,
+                                    (flags & HGFS_COPY_FILE_NO_REPLACE_EXISTING) != 0,
+                                    (flags & HGFS_COPY_FILE_CONTINUE) != 0,
+                                    offset, &size, &nextOffset);
+      if (HGFS_ERROR_SUCCESS == status) {
+         if (!HgfsPackCopyFileReply(input->packet, input->request, size,
+                                    nextOffset, &replyPayloadSize,
+                                    input->session)) {
+            status = HGFS_ERROR_INTERNAL;
+         }
+      }
+   }
+
+   free(utf8SrcName);
+   free(utf8TargetName);
+
+   HgfsServerCompleteRequest(status, replyPayloadSize, input);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -8908,7 +10033,8 @@ HgfsServerSearchRead(HgfsInputParam *input)  // IN: Input params
 
       if (inlineDataSize == 0) {
          info.replyPayload = HSPU_GetDataPacketBuf(input->packet, BUF_WRITEABLE,
-                                                   input->transportSession->channelCbTable);
+                                                   input->transportSession->channelCbTable,
+                                                   &input->transportSession->bufPool);
       } else {
          info.replyPayload = (char *)info.reply + baseReplySize;
       }
@@ -8981,6 +10107,9 @@ HgfsServerSearchRead(HgfsInputParam *input)  // IN: Input params
 
             free(search.utf8Dir);
             free(search.utf8ShareName);
+            if (search.stream != NULL) {
+               HgfsPlatformSearchStreamPut(search.stream);
+            }
 
          } else {
             LOG(4, ("%s: handle %u is invalid\n", __FUNCTION__, hgfsSearchHandle));
@@ -124,6 +124,28 @@ typedef enum {
 
 #define HGFS_SEARCH_LAST_ENTRY_INDEX         ((uint32)~((uint32)0))
 
+/* Server statistics counters besides the per operation ones. */
+typedef enum {
+   HGFS_STATS_OPEN_NODES,        /* Gauge: in use file nodes. */
+   HGFS_STATS_CACHED_NODES,      /* Gauge: of which with an open descriptor. */
+   HGFS_STATS_SEARCHES,          /* Gauge: in use searches. */
+   HGFS_STATS_LRU_EVICTIONS,     /* Counter: nodes evicted from the cache. */
+   HGFS_STATS_CACHE_HITS,        /* Counter: descriptor lookups of open nodes. */
+   HGFS_STATS_CACHE_MISSES,      /* Counter: of evicted nodes, reopened. */
+   HGFS_STATS_BUF_POOL_HITS,     /* Counter: packet buffers reused. */
+   HGFS_STATS_BUF_POOL_MISSES,   /* Counter: packet buffers allocated. */
+   HGFS_STATS_COUNTER_MAX
+} HgfsServerStatsCounter;
+
+/* Hints to the platform page cache about how a file range is accessed. */
+typedef enum {
+   HGFS_ACCESS_ADVICE_NORMAL,       /* No particular pattern (any more). */
+   HGFS_ACCESS_ADVICE_SEQUENTIAL,   /* Read front to back. */
+   HGFS_ACCESS_ADVICE_WILLNEED,     /* Read soon: read ahead now. */
+   HGFS_ACCESS_ADVICE_WRITEBEHIND,  /* Written: start writing it back. */
+   HGFS_ACCESS_ADVICE_DONTNEED,     /* Not accessed again: drop it. */
+} HgfsAccessAdvice;
+
 
 /* Two possible volume info type */
 typedef enum {
@@ -181,6 +203,20 @@ typedef struct HgfsFileNode {
    /* HGFS handle uniquely identifying this node. */
    HgfsHandle handle;
 
+   /* Index of the next node in the same handle hash bucket. */
+   uint32 handleNext;
+
+   /* Indices of the neighbours in the same name hash bucket. */
+   uint32 nameNext;
+   uint32 namePrev;
+
+   /* Indices of the neighbours among the nodes of the same share. */
+   uint32 shareNext;
+   uint32 sharePrev;
+
+   /* The nodes of the same share. */
+   struct HgfsNodeShareGroup *shareGroup;
+
    /* Local filename (in UTF8) */
    char *utf8Name;
 
@@ -214,6 +250,17 @@ typedef struct HgfsFileNode {
    /* File flags - see below. */
    uint32 flags;
 
+   /*
+    * Access pattern of reads and writes, to give the platform cache hints:
+    * the offset following the last access, the length of the run of
+    * sequential accesses ending there, and how far ahead and behind of it
+    * the cache was advised.
+    */
+   uint64 accessNext;
+   uint64 accessRun;
+   uint64 accessAhead;
+   uint64 accessBehind;
+
    /*
     * Context as required by some file operations. Eg: BackupWrite on
     * Windows: BackupWrite requires the caller to hold on to a pointer
@@ -227,6 +274,22 @@ typedef struct HgfsFileNode {
 } HgfsFileNode;
 
 
+/*
+ * The in use nodes of a session with the same share root directory, so
+ * that removing a share only visits the nodes within it.
+ */
+typedef struct HgfsNodeShareGroup {
+   /* Links on the session's list of share groups. */
+   DblLnkLst_Links links;
+
+   /* Share root directory of the nodes. */
+   char *rootDir;
+
+   /* Index of the first node, the rest are chained through shareNext. */
+   uint32 firstNode;
+} HgfsNodeShareGroup;
+
+
 /* HgfsFileNode flags. */
 
 /* TRUE if opened in append mode */
@@ -253,6 +316,9 @@ typedef struct HgfsSearch {
    /* HGFS handle uniquely identifying this search. */
    HgfsHandle handle;
 
+   /* Index of the next search in the same handle hash bucket. */
+   uint32 handleNext;
+
    /* Local directory name (in UTF8) */
    char *utf8Dir;
 
@@ -271,6 +337,12 @@ typedef struct HgfsSearch {
    /* Number of dents */
    uint32 numDents;
 
+   /*
+    * The directory being read as the client asks for its entries, in place
+    * of dents. NULL if the entries were all read when the search started.
+    */
+   struct HgfsSearchStream *stream;
+
    /*
     * What type of search is this (what objects does it track)? This is
     * important to know so we can do the right kind of stat operation later
@@ -337,7 +409,7 @@ typedef struct HgfsSessionInfo {
    /*
     ** START NODE ARRAY **************************************************
     *
-    * Lock for the following 6 fields: the node array,
+    * Lock for the following 10 fields: the node array, its indices,
     * counters and lists for this session.
     */
    MXUserExclLock *nodeArrayLock;
@@ -348,15 +420,42 @@ typedef struct HgfsSessionInfo {
    /* Number of nodes in the nodeArray. */
    uint32 numNodes;
 
+   /*
+    * In use nodes hashed by handle: index of the first node of each
+    * bucket, the rest are chained through handleNext.
+    */
+   uint32 *nodeHandleHash;
+
+   /* In use nodes hashed by utf8Name, chained through nameNext. */
+   uint32 *nodeNameHash;
+
+   /* Number of buckets in nodeHandleHash and nodeNameHash. */
+   uint32 nodeHashSize;
+
+   /* HgfsNodeShareGroups of the in use nodes. */
+   DblLnkLst_Links nodeShareGroups;
+
    /* Free list of file nodes. LIFO to be cache-friendly. */
    DblLnkLst_Links nodeFreeList;
 
-   /* List of cached open nodes. */
+   /*
+    * Lists of cached open nodes, least recently used first: the ones that
+    * can be closed to make room, and the pinned ones that cannot (with a
+    * server lock, a file context or opened in sequential mode).
+    */
    DblLnkLst_Links nodeCachedList;
+   DblLnkLst_Links nodePinnedList;
 
-   /* Current number of open nodes. */
+   /* Current number of open nodes, of both lists. */
    unsigned int numCachedOpenNodes;
 
+   /* Limit of open nodes, adapted to the hit rate, see HgfsIsCached. */
+   unsigned int maxCachedOpenNodes;
+
+   /* Cache lookups and misses in the current adaptation period. */
+   uint32 cacheLookups;
+   uint32 cacheMisses;
+
    /* Number of open nodes having server locks. */
    unsigned int numCachedLockedNodes;
    /** END NODE ARRAY ****************************************************/
@@ -364,8 +463,8 @@ typedef struct HgfsSessionInfo {
    /*
     ** START SEARCH ARRAY ************************************************
     *
-    * Lock for the following three fields: for the search array
-    * and it's counter and list, for this session.
+    * Lock for the following six fields: for the search array, its
+    * handle hash, counters and list, for this session.
     */
    MXUserExclLock *searchArrayLock;
 
@@ -375,8 +474,17 @@ typedef struct HgfsSessionInfo {
    /* Number of entries in searchArray. */
    uint32 numSearches;
 
+   /* In use searches hashed by handle, like nodeHandleHash. */
+   uint32 *searchHandleHash;
+
+   /* Number of buckets in searchHandleHash. */
+   uint32 searchHandleHashSize;
+
    /* Free list of searches. LIFO. */
    DblLnkLst_Links searchFreeList;
+
+   /* Searches reading their directory as a stream, each with a descriptor. */
+   uint32 numStreamSearches;
    /** END SEARCH ARRAY ****************************************************/
 
    /* Array of session specific capabiities. */
@@ -724,6 +832,8 @@ Bool
 HgfsPlatformInit(void);
 void
 HgfsPlatformDestroy(void);
+uint32
+HgfsPlatformGetOpenFileLimit(void);
 HgfsInternalStatus
 HgfsPlatformCloseFile(fileDesc fileDesc,            // IN: OS handle of the file
                       void *fileCtx);               // IN: file context
@@ -775,6 +885,14 @@ HgfsPlatformScandir(char const *baseDir,             // IN: Directory to search
                     struct DirectoryEntry ***dents,  // OUT: Array of DirectoryEntrys
                     int *numDents);                  // OUT: Number of DirectoryEntrys
 HgfsInternalStatus
+HgfsPlatformOpenSearchStream(char const *baseDir,               // IN: Directory to search in
+                             Bool followSymlinks,               // IN: followSymlinks config option
+                             struct HgfsSearchStream **stream); // OUT: Directory stream
+struct HgfsSearchStream *
+HgfsPlatformSearchStreamGet(struct HgfsSearchStream *stream);   // IN: Directory stream
+void
+HgfsPlatformSearchStreamPut(struct HgfsSearchStream *stream);   // IN: Directory stream
+HgfsInternalStatus
 HgfsPlatformScanvdir(HgfsServerResEnumGetFunc enumNamesGet,   // IN: Function to get name
                      HgfsServerResEnumInitFunc enumNamesInit, // IN: Setup function
                      HgfsServerResEnumExitFunc enumNamesExit, // IN: Cleanup function
@@ -818,6 +936,30 @@ HgfsPlatformWriteFile(fileDesc writeFile,          // IN: file descriptor
                       const void *writeData,       // IN: data to be written
                       uint32 *writtenSize);        // OUT: byte length written
 HgfsInternalStatus
+HgfsPlatformReadFileV(fileDesc readFile,           // IN: file descriptor
+                      HgfsSessionInfo *session,    // IN: session info
+                      uint64 offset,               // IN: file offset to read from
+                      uint32 requiredSize,         // IN: length of data to read
+                      const HgfsVmxIov *iov,       // OUT: mapped buffers for the data
+                      uint32 iovCount,             // IN: number of buffers
+                      uint32 *actualSize);         // OUT: actual length read
+HgfsInternalStatus
+HgfsPlatformWriteFileV(fileDesc writeFile,          // IN: file descriptor
+                       HgfsSessionInfo *session,    // IN: session info
+                       uint64 writeOffset,          // IN: file offset to write to
+                       uint32 writeDataSize,        // IN: length of data to write
+                       HgfsWriteFlags writeFlags,   // IN: write flags
+                       Bool writeSequential,        // IN: write is sequential
+                       Bool writeAppend,            // IN: write is appended
+                       const HgfsVmxIov *iov,       // IN: mapped buffers of the data
+                       uint32 iovCount,             // IN: number of buffers
+                       uint32 *writtenSize);        // OUT: byte length written
+void
+HgfsPlatformAdviseAccess(fileDesc file,             // IN: file descriptor
+                         HgfsAccessAdvice advice,   // IN: access advice
+                         uint64 offset,             // IN: start of the range
+                         uint64 length);            // IN: length, 0 to the end
+HgfsInternalStatus
 HgfsPlatformWriteWin32Stream(HgfsHandle file,           // IN: packet header
                              char *dataToWrite,         // IN: data to write
                              size_t requiredSize,       // IN: data size
@@ -853,6 +995,14 @@ HgfsPlatformRename(char *localSrcName,     // IN: local path to source file
                    fileDesc targetFile,    // IN: target file handle
                    HgfsRenameHint hints);  // IN: rename hints
 HgfsInternalStatus
+HgfsPlatformCopyFile(const char *localSrcName,     // IN: local path to source file
+                     const char *localTargetName,  // IN: local path to target file
+                     Bool noReplace,               // IN: fail if the target exists
+                     Bool resume,                  // IN: continue a partial copy
+                     uint64 offset,                // IN: offset to continue at
+                     uint64 *size,                 // OUT: bytes copied
+                     uint64 *nextOffset);          // OUT: offset to continue at
+HgfsInternalStatus
 HgfsPlatformCreateDir(HgfsCreateDirInfo *info,  // IN: direcotry properties
                       char *utf8Name);          // IN: full path for the new directory
 HgfsInternalStatus
@@ -893,10 +1043,29 @@ HgfsPlatformValidateOpen(HgfsFileOpenInfo *openInfo, // IN: Open info struct
                          HgfsLocalId *localId,       // OUT: Local unique file ID
                          fileDesc *newHandle);       // OUT: Handle to the file
 
+/*
+ * Reply and bounce buffers that the server allocates for the packets of a
+ * transport session, kept for reuse in free lists by size class. Unused by
+ * channels supplying their own buffers, such as the backdoor.
+ */
+#define HGFS_BUF_POOL_CLASSES 5
+
+typedef struct HgfsServerBufPool {
+   MXUserExclLock *lock;
+   void *freeList[HGFS_BUF_POOL_CLASSES];
+   size_t freeBytes;                 /* Size of the buffers of the lists. */
+} HgfsServerBufPool;
+
+void
+HSPU_BufPoolInit(HgfsServerBufPool *bufPool);   // OUT: buffer pool
+void
+HSPU_BufPoolExit(HgfsServerBufPool *bufPool);   // IN/OUT: buffer pool
+
 void *
 HSPU_GetMetaPacket(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
                    size_t *metaPacketSize,               // OUT: Size of metaPacket
-                   HgfsServerChannelCallbacks *chanCb);  // IN: Channel callbacks
+                   HgfsServerChannelCallbacks *chanCb,   // IN: Channel callbacks
+                   HgfsServerBufPool *bufPool);          // IN: buffer pool
 
 Bool
 HSPU_ValidateDataPacketSize(HgfsPacket *packet,     // IN: Hgfs Packet
@@ -905,7 +1074,14 @@ HSPU_ValidateDataPacketSize(HgfsPacket *packet,     // IN: Hgfs Packet
 void *
 HSPU_GetDataPacketBuf(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
                       MappingType mappingType,              // IN: Readable/ Writeable ?
-                      HgfsServerChannelCallbacks *chanCb);  // IN: Channel callbacks
+                      HgfsServerChannelCallbacks *chanCb,   // IN: Channel callbacks
+                      HgfsServerBufPool *bufPool);          // IN: buffer pool
+
+HgfsVmxIov *
+HSPU_GetDataPacketIov(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
+                      MappingType mappingType,              // IN: Readable/ Writeable ?
+                      HgfsServerChannelCallbacks *chanCb,   // IN: Channel callbacks
+                      uint32 *iovCount);                    // OUT: mapped iov count
 
 void
 HSPU_SetDataPacketSize(HgfsPacket *packet,            // IN/OUT: Hgfs Packet
@@ -913,11 +1089,13 @@ HSPU_SetDataPacketSize(HgfsPacket *packet,            // IN/OUT: Hgfs Packet
 
 void
 HSPU_PutDataPacketBuf(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
-                      HgfsServerChannelCallbacks *chanCb);  // IN: Channel callbacks
+                      HgfsServerChannelCallbacks *chanCb,   // IN: Channel callbacks
+                      HgfsServerBufPool *bufPool);          // IN: buffer pool
 
 void
 HSPU_PutMetaPacket(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
-                   HgfsServerChannelCallbacks *chanCb);  // IN: Channel callbacks
+                   HgfsServerChannelCallbacks *chanCb,   // IN: Channel callbacks
+                   HgfsServerBufPool *bufPool);          // IN: buffer pool
 
 Bool
 HSPU_ValidateRequestPacketSize(HgfsPacket *packet,        // IN: Hgfs Packet
@@ -935,10 +1113,22 @@ HSPU_ValidateReplyPacketSize(HgfsPacket *packet,         // IN: Hgfs Packet
 void *
 HSPU_GetReplyPacket(HgfsPacket *packet,                  // IN/OUT: Hgfs Packet
                     HgfsServerChannelCallbacks *chanCb,  // IN: Channel callbacks
+                    HgfsServerBufPool *bufPool,          // IN: buffer pool
                     size_t replyDataSize,                // IN: Size of reply data
                     size_t *replyPacketSize);            // OUT: Size of reply Packet
 
 void
 HSPU_PutReplyPacket(HgfsPacket *packet,                  // IN/OUT: Hgfs Packet
-                    HgfsServerChannelCallbacks *chanCb); // IN: Channel callbacks
+                    HgfsServerChannelCallbacks *chanCb,  // IN: Channel callbacks
+                    HgfsServerBufPool *bufPool);         // IN: buffer pool
+
+/* Server statistics. */
+void
+HgfsServerStatsRecordOp(HgfsOp op,                   // IN: operation
+                        HgfsInternalStatus status,   // IN: request status
+                        uint64 bytesIn,              // IN: request size
+                        uint64 bytesOut,             // IN: reply size
+                        uint64 latencyUS);           // IN: time to reply
+void HgfsServerStatsInc(HgfsServerStatsCounter counter);
+void HgfsServerStatsDec(HgfsServerStatsCounter counter);
 #endif /* __HGFS_SERVER_INT_H__ */
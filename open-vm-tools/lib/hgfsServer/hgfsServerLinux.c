@@ -44,6 +44,7 @@
 #include <sys/types.h>
 #include <dirent.h>
 #include <sys/resource.h> // for getrlimit
+#include <sys/uio.h>      // for preadv/pwritev
 
 #if defined(__FreeBSD__)
 #   include <sys/param.h>
@@ -67,13 +68,23 @@
 #include "su.h"
 #include "codeset.h"
 #include "unicodeOperations.h"
+#include "unicodeTransforms.h"
 #include "userlock.h"
+#include "mutexRankLib.h"
+#include "vm_atomic.h"
 
 #if defined(__linux__) && !defined(SYS_getdents64)
 /* For DT_UNKNOWN */
 #   include <dirent.h>
 #endif
 
+#if defined(__linux__)
+#   include <sys/ioctl.h>  // for FICLONE
+#   ifndef FICLONE
+#      define FICLONE _IOW(0x94, 9, int)
+#   endif
+#endif
+
 #ifndef VMX86_TOOLS
 #   include "config.h"
 #endif
@@ -231,6 +242,36 @@ getdents_apple(DIR *fd,               // IN
 #define O_NOFOLLOW 0
 #endif
 
+#if defined(__linux__)
+/*
+ * A directory search that reads the directory as the client asks for the
+ * entries. Only the entries of the latest getdents batches are kept, from
+ * the index the client last asked for on; the directory offset of the open
+ * descriptor is where the next batch starts. Asking for an index that was
+ * already dropped rereads the directory from its start.
+ */
+#define HGFS_SEARCH_STREAM_BUFFER_SIZE   (64 * 1024)
+
+typedef struct HgfsSearchStream {
+   Atomic_uint32 refCount;   /* The search and its copies being served. */
+   int fd;                   /* The directory, also for fstatat. */
+   Bool eof;                 /* No more batches. */
+   uint32 dentsBase;         /* Search index of dents[0]. */
+   uint32 numDents;          /* Entries kept. */
+   uint32 maxDents;          /* Size of dents. */
+   DirectoryEntry **dents;
+} HgfsSearchStream;
+#endif
+
+
+/*
+ * Server side copy, see HgfsPlatformCopyFile: the data copied by one request,
+ * which holds up the channel and every other request while it runs, and the
+ * size of the buffer used when the data has to be read and written.
+ */
+#define HGFS_COPY_REQUEST_SIZE  (16 * 1024 * 1024)
+#define HGFS_COPY_BUFFER_SIZE   (1024 * 1024)
+
 
 #if defined(sun) || defined(__linux__) || \
     (defined(__FreeBSD_version) && __FreeBSD_version < 490000)
@@ -317,6 +358,47 @@ static const int HgfsServerOpenMode[] = {
    O_RDWR,
 };
 
+/*
+ * Case insensitive lookups match a path component against the names of its
+ * directory. Rather than scanning the directory each time, keep the case
+ * folded names of the most recently searched directories. A directory is
+ * known by its device and inode, and its listing is good for as long as
+ * its modification and change times stay the same.
+ */
+#define HGFS_CASE_CACHE_MAX_DIRS     64
+#define HGFS_CASE_CACHE_MAX_NAMES    (128 * 1024)
+
+/*
+ * Directories changed less than this long ago (in 100ns units, as NT
+ * times) are not cached: a change in the same timestamp tick as the scan
+ * would go unnoticed.
+ */
+#define HGFS_CASE_CACHE_MIN_AGE      (10 * 1000 * 1000)
+
+typedef struct HgfsCaseName {
+   struct HgfsCaseName *next;   /* Next name in the same bucket. */
+   uint32 hash;                 /* Hash of folded. */
+   char *folded;                /* Case folded name, the key. */
+   size_t nameSize;             /* Size of name, with the nul. */
+   char name[1];                /* Name as read from the directory. */
+} HgfsCaseName;
+
+typedef struct HgfsCaseDir {
+   DblLnkLst_Links links;       /* On hgfsCaseCache, most recent first. */
+   dev_t dev;
+   ino_t ino;
+   uint64 writeTime;            /* Times of the directory when scanned. */
+   uint64 attrChangeTime;
+   uint32 numNames;
+   uint32 numBuckets;           /* Power of 2. */
+   HgfsCaseName **buckets;
+} HgfsCaseDir;
+
+static MXUserExclLock *hgfsCaseCacheLock;
+static DblLnkLst_Links hgfsCaseCache;
+static uint32 hgfsCaseCacheDirs;
+static uint32 hgfsCaseCacheNames;
+
 /* Local functions. */
 static HgfsInternalStatus HgfsGetattrResolveAlias(char const *fileName,
                                                   char **targetName);
@@ -339,6 +421,18 @@ static void HgfsGetSequentialOnlyFlagFromName(const char *fileName,
 static void HgfsGetSequentialOnlyFlagFromFd(int fd,
                                             HgfsFileAttrInfo *attr);
 
+static void HgfsCaseDirFree(HgfsCaseDir *dir);
+#if defined(__linux__)
+static HgfsInternalStatus HgfsSearchStreamGetEntry(HgfsSearchStream *stream,
+                                                   uint32 index,
+                                                   DirectoryEntry **dirEntry);
+static HgfsInternalStatus HgfsGetattrAt(int dirFd,
+                                        const char *name,
+                                        const char *fileName,
+                                        HgfsShareOptions configOptions,
+                                        char *shareName,
+                                        HgfsFileAttrInfo *attr);
+#endif
 static int HgfsConvertComponentCase(char *currentComponent,
                                     const char *dirPath,
                                     const char **convertedComponent,
@@ -559,7 +653,45 @@ HgfsServerGetOpenFlags(HgfsOpenFlags flagsIn, // IN
 Bool
 HgfsPlatformInit(void)
 {
-   return TRUE;
+   DblLnkLst_Init(&hgfsCaseCache);
+   hgfsCaseCacheLock = MXUser_CreateExclLock("HgfsCaseCacheLock",
+                                             RANK_hgfsCaseCacheLock);
+   return hgfsCaseCacheLock != NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformGetOpenFileLimit --
+ *
+ *      Get the number of files the process may have open.
+ *
+ * Results:
+ *      The soft RLIMIT_NOFILE, 0 if it is unlimited or unknown.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+uint32
+HgfsPlatformGetOpenFileLimit(void)
+{
+   struct rlimit openFiles;
+
+   if (getrlimit(RLIMIT_NOFILE, &openFiles) < 0) {
+      LOG(4, ("%s: Could not get the open file limit: %s\n", __FUNCTION__,
+              Err_Errno2String(errno)));
+      return 0;
+   }
+
+   if (openFiles.rlim_cur == RLIM_INFINITY || openFiles.rlim_cur > MAX_UINT32) {
+      return 0;
+   }
+
+   return (uint32)openFiles.rlim_cur;
 }
 
 
@@ -582,6 +714,18 @@ HgfsPlatformInit(void)
 void
 HgfsPlatformDestroy(void)
 {
+   DblLnkLst_Links *link;
+   DblLnkLst_Links *nextLink;
+
+   DblLnkLst_ForEachSafe(link, nextLink, &hgfsCaseCache) {
+      HgfsCaseDirFree(DblLnkLst_Container(link, HgfsCaseDir, links));
+   }
+   hgfsCaseCacheDirs = 0;
+   hgfsCaseCacheNames = 0;
+   if (hgfsCaseCacheLock != NULL) {
+      MXUser_DestroyExclLock(hgfsCaseCacheLock);
+      hgfsCaseCacheLock = NULL;
+   }
 }
 
 
@@ -1404,125 +1548,278 @@ HgfsGetHiddenAttr(char const *fileName,         // IN:  Input filename
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsConvertComponentCase --
+ * HgfsCaseNameHash --
  *
- *    Do a case insensitive search of a directory for the specified entry. If
- *    a matching entry is found, return it in the convertedComponent argument.
+ *    Hash a case folded name (FNV-1a).
  *
  * Results:
- *    On Success:
- *    Returns 0 and the converted component name in the argument convertedComponent.
- *    The length for the convertedComponent is returned in convertedComponentSize.
+ *    The hash.
  *
- *    On Failure:
- *    Non-zero errno return, with convertedComponent and convertedComponentSize
- *    set to NULL and 0 respectively.
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsCaseNameHash(const char *folded)  // IN
+{
+   uint32 hash = 2166136261U;
+
+   for (; *folded != '\0'; folded++) {
+      hash = (hash ^ (unsigned char)*folded) * 16777619U;
+   }
+   return hash;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCaseDirFind --
+ *
+ *    Find the entry of a name in a scanned directory.
+ *
+ * Results:
+ *    The first name of the directory that folds to folded, NULL if none.
  *
  * Side effects:
- *    On success, allocated memory is returned in convertedComponent and needs
- *    to be freed.
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsCaseName *
+HgfsCaseDirFind(const HgfsCaseDir *dir,  // IN
+                const char *folded,      // IN: case folded name
+                uint32 hash)             // IN: its hash
+{
+   HgfsCaseName *entry;
+
+   for (entry = dir->buckets[hash & (dir->numBuckets - 1)];
+        entry != NULL;
+        entry = entry->next) {
+      if (entry->hash == hash && strcmp(entry->folded, folded) == 0) {
+         return entry;
+      }
+   }
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCaseDirFree --
+ *
+ *    Free a scanned directory. It must not be on hgfsCaseCache.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsCaseDirFree(HgfsCaseDir *dir)  // IN
+{
+   uint32 i;
+
+   for (i = 0; i < dir->numBuckets; i++) {
+      while (dir->buckets[i] != NULL) {
+         HgfsCaseName *entry = dir->buckets[i];
+
+         dir->buckets[i] = entry->next;
+         free(entry->folded);
+         free(entry);
+      }
+   }
+   free(dir->buckets);
+   free(dir);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCaseDirGrow --
+ *
+ *    Double the number of buckets of a directory being scanned.
+ *
+ * Results:
+ *    0 on success, ENOMEM otherwise.
+ *
+ * Side effects:
+ *    None
  *
  *-----------------------------------------------------------------------------
  */
 
 static int
-HgfsConvertComponentCase(char *currentComponent,           // IN
-                         const char *dirPath,              // IN
-                         const char **convertedComponent,  // OUT
-                         size_t *convertedComponentSize)   // OUT
+HgfsCaseDirGrow(HgfsCaseDir *dir)  // IN/OUT
+{
+   uint32 numBuckets = dir->numBuckets * 2;
+   HgfsCaseName **buckets = calloc(numBuckets, sizeof *buckets);
+   uint32 i;
+
+   if (buckets == NULL) {
+      return ENOMEM;
+   }
+
+   /* Keep the order within the buckets: the first of equal names wins. */
+   for (i = dir->numBuckets; i-- > 0;) {
+      HgfsCaseName *entry = dir->buckets[i];
+      HgfsCaseName **tail[2];
+
+      tail[0] = &buckets[i];
+      tail[1] = &buckets[i + dir->numBuckets];
+      while (entry != NULL) {
+         HgfsCaseName *next = entry->next;
+         int half = (entry->hash & dir->numBuckets) != 0;
+
+         entry->next = NULL;
+         *tail[half] = entry;
+         tail[half] = &entry->next;
+         entry = next;
+      }
+   }
+   free(dir->buckets);
+   dir->buckets = buckets;
+   dir->numBuckets = numBuckets;
+   return 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCaseDirScan --
+ *
+ *    Read a directory and index its names by their case folded form.
+ *
+ * Results:
+ *    0 and the directory on success, errno otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+HgfsCaseDirScan(const char *dirPath,     // IN
+                HgfsCaseDir **dirOut)    // OUT
 {
+   HgfsCaseDir *dir = NULL;
    struct dirent *dirent;
-   DIR *dir = NULL;
-   char *dentryName;
-   size_t dentryNameLen;
-   char *myConvertedComponent = NULL;
-   size_t myConvertedComponentSize;
+   struct stat stats;
+   HgfsFileAttrInfo attr;
+   uint64 creationTime = 0;
+   DIR *dirStream;
    int ret;
 
-   ASSERT(currentComponent);
-   ASSERT(dirPath);
-   ASSERT(convertedComponent);
-   ASSERT(convertedComponentSize);
-
    /* Open the specified directory. */
-   dir = Posix_OpenDir(dirPath);
-   if (!dir) {
+   dirStream = Posix_OpenDir(dirPath);
+   if (!dirStream) {
+      return errno;
+   }
+
+   /* Stamp the listing with the directory it comes from, before reading. */
+   if (fstat(dirfd(dirStream), &stats) == -1) {
       ret = errno;
       goto exit;
    }
 
-   /*
-    * Unicode_CompareIgnoreCase crashes with invalid unicode strings,
-    * validate it before passing it to Unicode_* functions.
-    */
-   if (!Unicode_IsBufferValid(currentComponent, -1, STRING_ENCODING_UTF8)) {
-      /* Invalid unicode string, return failure. */
-      ret = EINVAL;
+   dir = calloc(1, sizeof *dir);
+   if (dir == NULL) {
+      ret = ENOMEM;
+      goto exit;
+   }
+   DblLnkLst_Init(&dir->links);
+   HgfsStatToFileAttr(&stats, &creationTime, &attr);
+   dir->dev = stats.st_dev;
+   dir->ino = stats.st_ino;
+   dir->writeTime = attr.writeTime;
+   dir->attrChangeTime = attr.attrChangeTime;
+   dir->numBuckets = 64;
+   dir->buckets = calloc(dir->numBuckets, sizeof *dir->buckets);
+   if (dir->buckets == NULL) {
+      ret = ENOMEM;
       goto exit;
    }
 
-   /*
-    * Read all of the directory entries. For each one, convert the name
-    * to lower case and then compare it to the lower case component.
-    */
-   while ((dirent = readdir(dir))) {
+   while ((dirent = readdir(dirStream))) {
+      const char *dentryName = dirent->d_name;
+      size_t dentryNameLen = strlen(dentryName);
+      HgfsCaseName *entry;
       char *dentryNameU;
-      int cmpResult;
-
-      dentryName = dirent->d_name;
-      dentryNameLen = strlen(dentryName);
+      char *folded;
+      uint32 hash;
 
       /*
-       * Unicode_CompareIgnoreCase crashes with invalid unicode strings,
-       * validate and convert it appropriately before passing it to Unicode_*
-       * functions.
+       * Unicode_FoldCase crashes with invalid unicode strings, validate and
+       * convert it appropriately before passing it to Unicode_* functions.
+       * ASCII names are the same in every encoding and need neither.
        */
-
-      if (!Unicode_IsBufferValid(dentryName, dentryNameLen,
-                                 STRING_ENCODING_DEFAULT)) {
+      if (CodeSet_IsAscii(dentryName, dentryNameLen)) {
+         folded = Unicode_FoldCase(dentryName);
+      } else if (!Unicode_IsBufferValid(dentryName, dentryNameLen,
+                                        STRING_ENCODING_DEFAULT)) {
          /* Invalid unicode string, skip the entry. */
          continue;
+      } else {
+         dentryNameU = Unicode_Alloc(dentryName, STRING_ENCODING_DEFAULT);
+         folded = Unicode_FoldCase(dentryNameU);
+         free(dentryNameU);
       }
 
-      dentryNameU = Unicode_Alloc(dentryName, STRING_ENCODING_DEFAULT);
-
-      cmpResult = Unicode_CompareIgnoreCase(currentComponent, dentryNameU);
-      free(dentryNameU);
+      hash = HgfsCaseNameHash(folded);
+      if (HgfsCaseDirFind(dir, folded, hash) != NULL) {
+         free(folded);
+         continue;
+      }
 
-      if (cmpResult == 0) {
-         /*
-          * The current directory entry is a case insensitive match to
-          * the specified component. Malloc and copy the current directory entry.
-          */
-         myConvertedComponentSize = dentryNameLen + 1;
-         myConvertedComponent = malloc(myConvertedComponentSize);
-         if (myConvertedComponent == NULL) {
-            ret = errno;
-            LOG(4, ("%s: failed to malloc myConvertedComponent.\n",
-                    __FUNCTION__));
-            goto exit;
-         }
-         Str_Strcpy(myConvertedComponent, dentryName, myConvertedComponentSize);
+      if (dir->numNames >= dir->numBuckets &&
+          (ret = HgfsCaseDirGrow(dir)) != 0) {
+         free(folded);
+         goto exit;
+      }
 
-         /* Success. Cleanup and exit. */
-         ret = 0;
-         *convertedComponentSize = myConvertedComponentSize;
-         *convertedComponent = myConvertedComponent;
+      entry = malloc(sizeof *entry + dentryNameLen);
+      if (entry == NULL) {
+         free(folded);
+         ret = ENOMEM;
          goto exit;
       }
-   }
+      entry->hash = hash;
+      entry->folded = folded;
+      entry->nameSize = dentryNameLen + 1;
+      memcpy(entry->name, dentryName, entry->nameSize);
 
-   /* We didn't find a match. Failure. */
-   ret = ENOENT;
+      /* Append, so that the first of the names folding the same wins. */
+      {
+         HgfsCaseName **tail = &dir->buckets[hash & (dir->numBuckets - 1)];
 
-exit:
-   if (dir) {
-      closedir(dir);
+         while (*tail != NULL) {
+            tail = &(*tail)->next;
+         }
+         entry->next = NULL;
+         *tail = entry;
+      }
+      dir->numNames++;
    }
-   if (ret) {
-      *convertedComponent = NULL;
-      *convertedComponentSize = 0;
+   ret = 0;
+
+exit:
+   closedir(dirStream);
+   if (ret != 0 && dir != NULL) {
+      HgfsCaseDirFree(dir);
+      dir = NULL;
    }
+   *dirOut = dir;
    return ret;
 }
 
@@ -1530,87 +1827,330 @@ exit:
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsConstructConvertedPath --
+ * HgfsCaseCacheLookup --
  *
- *    Expand the passed string and append the converted path.
+ *    Look a name up in the cached listing of a directory, if the directory
+ *    has not changed since it was read.
+ *
+ *    Caller should hold hgfsCaseCacheLock.
  *
  * Results:
- *    Returns 0 if successful, errno on failure. Note that this
- *    function cannot return ENOENT.
+ *    TRUE if the directory was in the cache, with the matching name or
+ *    NULL in entry. FALSE if the directory needs to be read.
  *
  * Side effects:
- *    Reallocs the path.
+ *    Drops the stale listing of the directory, if any.
  *
  *-----------------------------------------------------------------------------
  */
 
-static int
-HgfsConstructConvertedPath(char **path,                 // IN/OUT
-                           size_t *pathSize,            // IN/OUT
-                           char *convertedPath,         // IN
-                           size_t convertedPathSize)    // IN
+static Bool
+HgfsCaseCacheLookup(const struct stat *stats,   // IN: directory
+                    const HgfsFileAttrInfo *attr, // IN: its times
+                    const char *folded,         // IN: case folded name
+                    uint32 hash,                // IN: its hash
+                    HgfsCaseName **entry)       // OUT
 {
-   char *p;
-   size_t convertedPathLen = convertedPathSize - 1;
+   DblLnkLst_Links *link;
 
-   ASSERT(path);
-   ASSERT(*path);
-   ASSERT(convertedPath);
-   ASSERT(pathSize);
+   DblLnkLst_ForEach(link, &hgfsCaseCache) {
+      HgfsCaseDir *dir = DblLnkLst_Container(link, HgfsCaseDir, links);
 
-   p = realloc(*path, *pathSize + convertedPathLen + sizeof (DIRSEPC));
-   if (!p) {
-      int error = errno;
-      LOG(4, ("%s: failed to realloc.\n", __FUNCTION__));
-      return error;
-   }
+      if (dir->dev != stats->st_dev || dir->ino != stats->st_ino) {
+         continue;
+      }
 
-   *path = p;
-   *pathSize += convertedPathLen + sizeof (DIRSEPC);
+      if (dir->writeTime != attr->writeTime ||
+          dir->attrChangeTime != attr->attrChangeTime) {
+         LOG(4, ("%s: dropping stale listing\n", __FUNCTION__));
+         DblLnkLst_Unlink1(&dir->links);
+         hgfsCaseCacheDirs--;
+         hgfsCaseCacheNames -= dir->numNames;
+         HgfsCaseDirFree(dir);
+         return FALSE;
+      }
 
-   /* Copy out the converted component to curDir, and free it. */
-   Str_Strncat(p, *pathSize, DIRSEPS, sizeof (DIRSEPS));
-   Str_Strncat(p, *pathSize, convertedPath, convertedPathLen);
-   return 0;
+      /* Most recently used first. */
+      DblLnkLst_Unlink1(&dir->links);
+      DblLnkLst_LinkFirst(&hgfsCaseCache, &dir->links);
+      *entry = HgfsCaseDirFind(dir, folded, hash);
+      return TRUE;
+   }
+   return FALSE;
 }
 
 
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsCaseInsensitiveLookup --
+ * HgfsCaseCacheInsert --
  *
- *    Do a case insensitive lookup for fileName. Each component past sharePath is
- *    looked-up case-insensitively. Expensive!
+ *    Cache a directory listing, evicting the least recently used ones to
+ *    stay within HGFS_CASE_CACHE_MAX_DIRS and HGFS_CASE_CACHE_MAX_NAMES.
+ *    Listings that are larger than the cache, or of directories that
+ *    changed just now, are freed instead.
  *
- *    NOTE:
- *    shareName is always expected to be a prefix of fileName.
+ *    Caller should hold hgfsCaseCacheLock.
  *
  * Results:
- *    Returns 0 if successful and resolved path for fileName is returned in
- *    convertedFileName and its length (without nul) in convertedFileNameLength.
- *    Otherwise returns non-zero errno with convertedFileName and
- *    convertedFileNameLength set to NULL and 0 respectively.
+ *    None
  *
  * Side effects:
- *    On success, allocated memory is returned in convertedFileName and needs
- *    to be freed.
+ *    Takes ownership of dir.
  *
  *-----------------------------------------------------------------------------
  */
 
-static int
-HgfsCaseInsensitiveLookup(const char *sharePath,           // IN
-                          size_t sharePathLength,          // IN
-                          char *fileName,                  // IN
-                          size_t fileNameLength,           // IN
-                          char **convertedFileName,        // OUT
-                          size_t *convertedFileNameLength) // OUT
+static void
+HgfsCaseCacheInsert(HgfsCaseDir *dir)  // IN
 {
-   char *currentComponent;
-   char *nextComponent;
-   char *curDir;
-   size_t curDirSize;
+   uint64 now = HgfsConvertToNtTime(time(NULL), 0);
+   DblLnkLst_Links *link;
+
+   if (dir->numNames > HGFS_CASE_CACHE_MAX_NAMES ||
+       dir->writeTime + HGFS_CASE_CACHE_MIN_AGE > now ||
+       dir->attrChangeTime + HGFS_CASE_CACHE_MIN_AGE > now) {
+      HgfsCaseDirFree(dir);
+      return;
+   }
+
+   /* Another lookup may have read the directory at the same time. */
+   DblLnkLst_ForEach(link, &hgfsCaseCache) {
+      HgfsCaseDir *curr = DblLnkLst_Container(link, HgfsCaseDir, links);
+
+      if (curr->dev == dir->dev && curr->ino == dir->ino) {
+         DblLnkLst_Unlink1(&curr->links);
+         hgfsCaseCacheDirs--;
+         hgfsCaseCacheNames -= curr->numNames;
+         HgfsCaseDirFree(curr);
+         break;
+      }
+   }
+
+   while (hgfsCaseCacheDirs >= HGFS_CASE_CACHE_MAX_DIRS ||
+          hgfsCaseCacheNames + dir->numNames > HGFS_CASE_CACHE_MAX_NAMES) {
+      HgfsCaseDir *lru = DblLnkLst_Container(hgfsCaseCache.prev, HgfsCaseDir,
+                                             links);
+
+      DblLnkLst_Unlink1(&lru->links);
+      hgfsCaseCacheDirs--;
+      hgfsCaseCacheNames -= lru->numNames;
+      HgfsCaseDirFree(lru);
+   }
+
+   DblLnkLst_LinkFirst(&hgfsCaseCache, &dir->links);
+   hgfsCaseCacheDirs++;
+   hgfsCaseCacheNames += dir->numNames;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsConvertComponentCase --
+ *
+ *    Do a case insensitive search of a directory for the specified entry. If
+ *    a matching entry is found, return it in the convertedComponent argument.
+ *
+ *    The case folded names of the directory come from hgfsCaseCache if it
+ *    has not changed since it was last read, otherwise the directory is
+ *    read and its names added to the cache.
+ *
+ * Results:
+ *    On Success:
+ *    Returns 0 and the converted component name in the argument convertedComponent.
+ *    The length for the convertedComponent is returned in convertedComponentSize.
+ *
+ *    On Failure:
+ *    Non-zero errno return, with convertedComponent and convertedComponentSize
+ *    set to NULL and 0 respectively.
+ *
+ * Side effects:
+ *    On success, allocated memory is returned in convertedComponent and needs
+ *    to be freed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+HgfsConvertComponentCase(char *currentComponent,           // IN
+                         const char *dirPath,              // IN
+                         const char **convertedComponent,  // OUT
+                         size_t *convertedComponentSize)   // OUT
+{
+   struct stat stats;
+   HgfsFileAttrInfo attr;
+   uint64 creationTime = 0;
+   HgfsCaseName *entry = NULL;
+   HgfsCaseDir *dir = NULL;
+   char *folded = NULL;
+   char *myConvertedComponent = NULL;
+   uint32 hash;
+   Bool cached;
+   int ret;
+
+   ASSERT(currentComponent);
+   ASSERT(dirPath);
+   ASSERT(convertedComponent);
+   ASSERT(convertedComponentSize);
+
+   if (Posix_Stat(dirPath, &stats) == -1) {
+      ret = errno;
+      goto exit;
+   }
+   if (!S_ISDIR(stats.st_mode)) {
+      ret = ENOTDIR;
+      goto exit;
+   }
+
+   /*
+    * Unicode_FoldCase crashes with invalid unicode strings,
+    * validate it before passing it to Unicode_* functions.
+    */
+   if (!Unicode_IsBufferValid(currentComponent, -1, STRING_ENCODING_UTF8)) {
+      /* Invalid unicode string, return failure. */
+      ret = EINVAL;
+      goto exit;
+   }
+
+   folded = Unicode_FoldCase(currentComponent);
+   hash = HgfsCaseNameHash(folded);
+   HgfsStatToFileAttr(&stats, &creationTime, &attr);
+
+   MXUser_AcquireExclLock(hgfsCaseCacheLock);
+   cached = HgfsCaseCacheLookup(&stats, &attr, folded, hash, &entry);
+   if (!cached) {
+      MXUser_ReleaseExclLock(hgfsCaseCacheLock);
+
+      ret = HgfsCaseDirScan(dirPath, &dir);
+      if (ret != 0) {
+         goto exit;
+      }
+      entry = HgfsCaseDirFind(dir, folded, hash);
+
+      MXUser_AcquireExclLock(hgfsCaseCacheLock);
+   }
+
+   if (entry == NULL) {
+      /* We didn't find a match. Failure. */
+      ret = ENOENT;
+   } else {
+      /*
+       * The directory entry is a case insensitive match to the specified
+       * component. Malloc and copy the directory entry.
+       */
+      myConvertedComponent = malloc(entry->nameSize);
+      if (myConvertedComponent == NULL) {
+         ret = errno;
+         LOG(4, ("%s: failed to malloc myConvertedComponent.\n",
+                 __FUNCTION__));
+      } else {
+         memcpy(myConvertedComponent, entry->name, entry->nameSize);
+         *convertedComponentSize = entry->nameSize;
+         *convertedComponent = myConvertedComponent;
+         ret = 0;
+      }
+   }
+
+   if (dir != NULL) {
+      HgfsCaseCacheInsert(dir);
+   }
+   MXUser_ReleaseExclLock(hgfsCaseCacheLock);
+
+exit:
+   free(folded);
+   if (ret) {
+      *convertedComponent = NULL;
+      *convertedComponentSize = 0;
+   }
+   return ret;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsConstructConvertedPath --
+ *
+ *    Expand the passed string and append the converted path.
+ *
+ * Results:
+ *    Returns 0 if successful, errno on failure. Note that this
+ *    function cannot return ENOENT.
+ *
+ * Side effects:
+ *    Reallocs the path.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+HgfsConstructConvertedPath(char **path,                 // IN/OUT
+                           size_t *pathSize,            // IN/OUT
+                           char *convertedPath,         // IN
+                           size_t convertedPathSize)    // IN
+{
+   char *p;
+   size_t convertedPathLen = convertedPathSize - 1;
+
+   ASSERT(path);
+   ASSERT(*path);
+   ASSERT(convertedPath);
+   ASSERT(pathSize);
+
+   p = realloc(*path, *pathSize + convertedPathLen + sizeof (DIRSEPC));
+   if (!p) {
+      int error = errno;
+      LOG(4, ("%s: failed to realloc.\n", __FUNCTION__));
+      return error;
+   }
+
+   *path = p;
+   *pathSize += convertedPathLen + sizeof (DIRSEPC);
+
+   /* Copy out the converted component to curDir, and free it. */
+   Str_Strncat(p, *pathSize, DIRSEPS, sizeof (DIRSEPS));
+   Str_Strncat(p, *pathSize, convertedPath, convertedPathLen);
+   return 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCaseInsensitiveLookup --
+ *
+ *    Do a case insensitive lookup for fileName. Each component past sharePath is
+ *    looked-up case-insensitively. Expensive!
+ *
+ *    NOTE:
+ *    shareName is always expected to be a prefix of fileName.
+ *
+ * Results:
+ *    Returns 0 if successful and resolved path for fileName is returned in
+ *    convertedFileName and its length (without nul) in convertedFileNameLength.
+ *    Otherwise returns non-zero errno with convertedFileName and
+ *    convertedFileNameLength set to NULL and 0 respectively.
+ *
+ * Side effects:
+ *    On success, allocated memory is returned in convertedFileName and needs
+ *    to be freed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+HgfsCaseInsensitiveLookup(const char *sharePath,           // IN
+                          size_t sharePathLength,          // IN
+                          char *fileName,                  // IN
+                          size_t fileNameLength,           // IN
+                          char **convertedFileName,        // OUT
+                          size_t *convertedFileNameLength) // OUT
+{
+   char *currentComponent;
+   char *nextComponent;
+   char *curDir;
+   size_t curDirSize;
    char *convertedComponent = NULL;
    size_t convertedComponentSize = 0;
    int error = 0;
@@ -2316,11 +2856,14 @@ HgfsPlatformGetattrFromName(char *fileName,                 // IN/OUT:  Input fi
       /*
        * HGFS clients will expect filenames in unicode normal form C
        * (precomposed) so Mac hosts must convert from normal form D
-       * (decomposed).
+       * (decomposed). ASCII names are the same in both forms.
        */
 
-      if (!CodeSet_Utf8FormDToUtf8FormC(myTargetName, strlen(myTargetName),
-                                        targetName, NULL)) {
+      if (CodeSet_IsAscii(myTargetName, strlen(myTargetName))) {
+         *targetName = myTargetName;
+         myTargetName = NULL;
+      } else if (!CodeSet_Utf8FormDToUtf8FormC(myTargetName, strlen(myTargetName),
+                                               targetName, NULL)) {
          LOG(4, ("%s: Unable to normalize form C \"%s\"\n",
                  __FUNCTION__, myTargetName));
          status = HgfsPlatformConvertFromNameStatus(HGFS_NAME_STATUS_FAILURE);
@@ -3386,6 +3929,18 @@ HgfsPlatformDirDumpDents(HgfsSearch *search)         // IN: search
    for (i = 0; i < search->numDents; i++) {
       Log("\"%s\"\n", search->dents[i]->d_name);
    }
+
+#if defined(__linux__)
+   if (search->stream != NULL) {
+      HgfsSearchStream *stream = search->stream;
+
+      Log("%s: streaming, %u dents kept from index %u%s\n", __FUNCTION__,
+          stream->numDents, stream->dentsBase, stream->eof ? ", at end" : "");
+      for (i = 0; i < stream->numDents; i++) {
+         Log("\"%s\"\n", stream->dents[i]->d_name);
+      }
+   }
+#endif
 }
 #endif
 
@@ -3399,7 +3954,8 @@ HgfsPlatformDirDumpDents(HgfsSearch *search)         // IN: search
  *    The function NOOP on Linux where the name is already in correct
  *    encoding.
  *    On Mac OS the default encoding is Utf8 form D thus a convertion to
- *    Utf8 for C is required.
+ *    Utf8 for C is required, except for ASCII names which are the same in
+ *    both forms.
  *
  * Results:
  *    TRUE on success. Buffer has name in Utf8 form C encoding.
@@ -3426,6 +3982,10 @@ HgfsConvertToUtf8FormC(char *buffer,         // IN/OUT: name to normalize
     * (decomposed).
     */
 
+   if (CodeSet_IsAscii(buffer, strnlen(buffer, bufferSize))) {
+      return TRUE;
+   }
+
    if (CodeSet_Utf8FormDToUtf8FormC(buffer, bufferSize, &entryName, &entryNameLen)) {
       result = entryNameLen < bufferSize;
       if (result) {
@@ -3439,20 +3999,14 @@ HgfsConvertToUtf8FormC(char *buffer,         // IN/OUT: name to normalize
 
    return result;
 #else
-   size_t size;
    /*
     * Buffer may contain invalid data after the null terminating character.
     * We need to check the validity of the buffer only till the null
     * terminating character (if any). Calculate the real size of the
     * string before calling Unicode_IsBufferValid().
     */
-   for (size = 0; size < bufferSize ; size++) {
-      if ('\0' == buffer[size]) {
-         break;
-      }
-   }
-
-   return Unicode_IsBufferValid(buffer, size, STRING_ENCODING_UTF8);
+   return Unicode_IsBufferValid(buffer, strnlen(buffer, bufferSize),
+                                STRING_ENCODING_UTF8);
 #endif /* defined(__APPLE__) */
 }
 
@@ -3485,6 +4039,15 @@ HgfsPlatformGetDirEntry(HgfsSearch *search,               // IN: search
    DirectoryEntry *dent = NULL;
    HgfsInternalStatus status = HGFS_ERROR_SUCCESS;
 
+#if defined(__linux__)
+   if (search->stream != NULL) {
+      /* Entries of a stream are only ever read in order. */
+      ASSERT(!remove);
+      status = HgfsSearchStreamGetEntry(search->stream, index, &dent);
+      goto out;
+   }
+#endif
+
    if (index >= search->numDents) {
       goto out;
    }
@@ -3620,6 +4183,12 @@ HgfsPlatformSetDirEntry(HgfsSearch *search,              // IN: partially valid
                LOG(4, ("%s: Reusing existing oplocked handle "
                         "to avoid oplock break deadlock\n", __FUNCTION__));
                status = HgfsPlatformGetattrFromFd(fileDesc, session, entryAttr);
+#if defined(__linux__)
+            } else if (search->stream != NULL) {
+               status = HgfsGetattrAt(search->stream->fd, dirEntry->d_name,
+                                      fullName, configOptions,
+                                      search->utf8ShareName, entryAttr);
+#endif
             } else {
                status = HgfsPlatformGetattrFromName(fullName, configOptions,
                                                     search->utf8ShareName,
@@ -3920,17 +4489,16 @@ HgfsPlatformScandir(char const *baseDir,            // IN: Directory to search i
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsPlatformScanvdir --
- *
- *    Perform a scandir on our virtual directory.
+ * HgfsPlatformOpenSearchStream --
  *
- *    Get directory entry names from the given callback function, and
- *    build an array of DirectoryEntrys of all the names. Somewhat similar to
- *    scandir(3) on linux, but more general.
+ *    Opens a directory to be read as the client asks for its entries,
+ *    rather than all at once with HgfsPlatformScandir. The directory is
+ *    opened the same way.
  *
  * Results:
- *    On success, the number of directory entries found.
- *    On failure, negative error.
+ *    Zero on success, HGFS_ERROR_NOT_SUPPORTED where the directories have
+ *    to be read with HgfsPlatformScandir.
+ *    Non-zero on error.
  *
  * Side effects:
  *    Memory allocation.
@@ -3939,41 +4507,456 @@ HgfsPlatformScandir(char const *baseDir,            // IN: Directory to search i
  */
 
 HgfsInternalStatus
-HgfsPlatformScanvdir(HgfsServerResEnumGetFunc enumNamesGet,   // IN: Function to get name
-                     HgfsServerResEnumInitFunc enumNamesInit, // IN: Setup function
-                     HgfsServerResEnumExitFunc enumNamesExit, // IN: Cleanup function
-                     DirectorySearchType type,                // IN: Kind of search - unused
-                     struct DirectoryEntry ***dents,          // OUT: Array of DirectoryEntrys
-                     uint32 *numDents)                        // OUT: total number of directory entrys
+HgfsPlatformOpenSearchStream(char const *baseDir,               // IN: Directory to search in
+                             Bool followSymlinks,               // IN: followSymlinks config option
+                             struct HgfsSearchStream **stream)  // OUT: Directory stream
 {
-   HgfsInternalStatus status = HGFS_ERROR_SUCCESS;
-   uint32 totalDents = 0;   // Number of allocated dents
-   uint32 myNumDents = 0;     // Current actual number of dents
-   DirectoryEntry **myDents = NULL; // So realloc is happy w/ zero myNumDents
-   void *enumNamesHandle;
+#if defined(__linux__)
+   int openFlags = O_NONBLOCK | O_RDONLY | O_DIRECTORY | O_NOFOLLOW;
+   HgfsSearchStream *myStream;
+   int fd;
 
-   ASSERT(NULL != enumNamesInit);
-   ASSERT(NULL != enumNamesGet);
-   ASSERT(NULL != enumNamesExit);
+   /* Follow symlinks if config option is set. */
+   if (followSymlinks) {
+      openFlags &= ~O_NOFOLLOW;
+   }
 
-   enumNamesHandle = enumNamesInit();
-   if (NULL == enumNamesHandle) {
-      status = HGFS_ERROR_NOT_ENOUGH_MEMORY;
-      LOG(4, ("%s: Error: init state ret %u\n", __FUNCTION__, status));
-      goto exit;
+   /* We want a directory. No FIFOs. Symlinks only if config option is set. */
+   fd = Posix_Open(baseDir, openFlags);
+   if (fd < 0) {
+      HgfsInternalStatus status = errno;
+
+      LOG(4, ("%s: error in open: %d (%s)\n", __FUNCTION__, status,
+              Err_Errno2String(status)));
+      return status;
    }
 
-   for (;;) {
-      DirectoryEntry *currentEntry;
-      char const *currentEntryName;
-      size_t currentEntryNameLen;
-      size_t currentEntryLen;
-      size_t maxNameLen;
-      Bool done = FALSE;
+   myStream = Util_SafeCalloc(1, sizeof *myStream);
+   Atomic_Write(&myStream->refCount, 1);
+   myStream->fd = fd;
+   *stream = myStream;
+   return 0;
+#else
+   return HGFS_ERROR_NOT_SUPPORTED;
+#endif
+}
 
-      /* Add '.' and ".." as the first dents. */
-      if (myNumDents == 0) {
-         currentEntryName = ".";
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformSearchStreamGet --
+ *
+ *    Takes a reference on a directory stream.
+ *
+ * Results:
+ *    The stream.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+struct HgfsSearchStream *
+HgfsPlatformSearchStreamGet(struct HgfsSearchStream *stream)  // IN: Directory stream
+{
+#if defined(__linux__)
+   ASSERT(Atomic_Read(&stream->refCount) != 0);
+   Atomic_Inc(&stream->refCount);
+#else
+   NOT_REACHED();
+#endif
+   return stream;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformSearchStreamPut --
+ *
+ *    Drops a reference on a directory stream, closing the directory with
+ *    the last one.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsPlatformSearchStreamPut(struct HgfsSearchStream *stream)  // IN: Directory stream
+{
+#if defined(__linux__)
+   uint32 i;
+
+   ASSERT(Atomic_Read(&stream->refCount) != 0);
+   if (Atomic_ReadDec32(&stream->refCount) != 1) {
+      return;
+   }
+
+   for (i = 0; i < stream->numDents; i++) {
+      free(stream->dents[i]);
+   }
+   free(stream->dents);
+   if (close(stream->fd) < 0) {
+      LOG(4, ("%s: error in close: %d (%s)\n", __FUNCTION__, errno,
+              Err_Errno2String(errno)));
+   }
+   free(stream);
+#else
+   NOT_REACHED();
+#endif
+}
+
+
+#if defined(__linux__)
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsSearchStreamDrop --
+ *
+ *    Frees the entries of a directory stream that come before index. If
+ *    index is past the entries kept, the next entry read gets it.
+ *
+ *    Caller should hold the session's searchArrayLock.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsSearchStreamDrop(HgfsSearchStream *stream,  // IN/OUT: Directory stream
+                     uint32 index)              // IN: First index to keep
+{
+   uint32 numDrop;
+   uint32 i;
+
+   ASSERT(index >= stream->dentsBase);
+
+   numDrop = MIN(index - stream->dentsBase, stream->numDents);
+   for (i = 0; i < numDrop; i++) {
+      free(stream->dents[i]);
+   }
+   memmove(&stream->dents[0], &stream->dents[numDrop],
+           (stream->numDents - numDrop) * sizeof stream->dents[0]);
+   stream->numDents -= numDrop;
+   stream->dentsBase += numDrop;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsSearchStreamRead --
+ *
+ *    Reads the next batch of entries of a directory stream.
+ *
+ *    Caller should hold the session's searchArrayLock.
+ *
+ * Results:
+ *    Zero on success, with stream->eof set when the directory has been
+ *    read entirely.
+ *    Non-zero on error.
+ *
+ * Side effects:
+ *    Memory allocation.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsInternalStatus
+HgfsSearchStreamRead(HgfsSearchStream *stream)  // IN/OUT: Directory stream
+{
+   char *buffer = Util_SafeMalloc(HGFS_SEARCH_STREAM_BUFFER_SIZE);
+   HgfsInternalStatus status = 0;
+   size_t offset = 0;
+   int result;
+
+   result = getdents(stream->fd, (void *)buffer, HGFS_SEARCH_STREAM_BUFFER_SIZE);
+   if (result == -1) {
+      status = errno;
+      LOG(4, ("%s: error in getdents: %d (%s)\n", __FUNCTION__, status,
+              Err_Errno2String(status)));
+      goto exit;
+   }
+   if (result == 0) {
+      stream->eof = TRUE;
+      goto exit;
+   }
+
+   while (offset < result) {
+      DirectoryEntry *newDent = (DirectoryEntry *)(buffer + offset);
+
+      /* This dent had better fit in the actual space we've got left. */
+      ASSERT(newDent->d_reclen <= result - offset);
+      offset += newDent->d_reclen;
+
+      /* Names that can't be converted to utf8 are dropped, as by scandir. */
+      if (!HgfsConvertToUtf8FormC(newDent->d_name,
+                                  newDent->d_reclen -
+                                  offsetof(DirectoryEntry, d_name))) {
+         continue;
+      }
+
+      if (stream->numDents == stream->maxDents) {
+         stream->maxDents = MAX(64, stream->maxDents * 2);
+         stream->dents = Util_SafeRealloc(stream->dents,
+                                          stream->maxDents *
+                                          sizeof stream->dents[0]);
+      }
+      stream->dents[stream->numDents] = Util_SafeMalloc(newDent->d_reclen);
+      memcpy(stream->dents[stream->numDents], newDent, newDent->d_reclen);
+      stream->numDents++;
+   }
+
+exit:
+   free(buffer);
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsSearchStreamGetEntry --
+ *
+ *    Returns a copy of the directory entry at the given index of a stream,
+ *    reading the directory up to it if needed. Entries before the index
+ *    are freed: the client reads the entries in order.
+ *
+ *    Caller should hold the session's searchArrayLock.
+ *
+ * Results:
+ *    HGFS_ERROR_SUCCESS or an appropriate error code. The entry is NULL
+ *    past the end of the directory.
+ *
+ * Side effects:
+ *    Memory allocation.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsInternalStatus
+HgfsSearchStreamGetEntry(HgfsSearchStream *stream,    // IN/OUT: Directory stream
+                         uint32 index,                // IN: Search index
+                         DirectoryEntry **dirEntry)   // OUT: Entry copy or NULL
+{
+   HgfsInternalStatus status = HGFS_ERROR_SUCCESS;
+   DirectoryEntry *originalDent;
+   DirectoryEntry *dent;
+   size_t nameLen;
+
+   *dirEntry = NULL;
+
+   if (index < stream->dentsBase) {
+      /* Asked again for entries already dropped: start over. */
+      LOG(4, ("%s: rewinding for index %u\n", __FUNCTION__, index));
+      if (lseek(stream->fd, 0, SEEK_SET) == (off_t)-1) {
+         status = errno;
+         LOG(4, ("%s: error in lseek: %d (%s)\n", __FUNCTION__, status,
+                 Err_Errno2String(status)));
+         return status;
+      }
+      HgfsSearchStreamDrop(stream, stream->dentsBase + stream->numDents);
+      stream->dentsBase = 0;
+      stream->eof = FALSE;
+   }
+
+   HgfsSearchStreamDrop(stream, index);
+   while (index >= stream->dentsBase + stream->numDents && !stream->eof) {
+      status = HgfsSearchStreamRead(stream);
+      if (HGFS_ERROR_SUCCESS != status) {
+         return status;
+      }
+      HgfsSearchStreamDrop(stream, index);
+   }
+
+   if (index >= stream->dentsBase + stream->numDents) {
+      return HGFS_ERROR_SUCCESS;
+   }
+
+   originalDent = stream->dents[index - stream->dentsBase];
+   nameLen = strlen(originalDent->d_name);
+   ASSERT(offsetof(DirectoryEntry, d_name) + nameLen < originalDent->d_reclen);
+
+   dent = malloc(originalDent->d_reclen);
+   if (dent == NULL) {
+      return HGFS_ERROR_NOT_ENOUGH_MEMORY;
+   }
+   dent->d_reclen = originalDent->d_reclen;
+   memcpy(dent->d_name, originalDent->d_name, nameLen + 1);
+   *dirEntry = dent;
+
+   return HGFS_ERROR_SUCCESS;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsGetattrAt --
+ *
+ *    HgfsPlatformGetattrFromName for an entry of an open directory: the
+ *    entry is looked up relative to the directory rather than by walking
+ *    its full path again for each system call.
+ *
+ * Results:
+ *    Zero on success.
+ *    Non-zero on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsInternalStatus
+HgfsGetattrAt(int dirFd,                       // IN: Directory
+              const char *name,                // IN: Entry name in dirFd
+              const char *fileName,            // IN: Entry full path
+              HgfsShareOptions configOptions,  // IN: Share config options
+              char *shareName,                 // IN: Share name
+              HgfsFileAttrInfo *attr)          // OUT: Struct to copy into
+{
+   struct stat stats;
+   uint64 creationTime;
+   Bool followSymlinks;
+   int openFlags;
+   int fd;
+
+   LOG(4, ("%s: getting attrs for \"%s\"\n", __FUNCTION__, fileName));
+   followSymlinks = HgfsServerPolicy_IsShareOptionSet(configOptions,
+                                                      HGFS_SHARE_FOLLOW_SYMLINKS);
+
+   if (fstatat(dirFd, name, &stats,
+               followSymlinks ? 0 : AT_SYMLINK_NOFOLLOW) == -1) {
+      HgfsInternalStatus status = errno;
+
+      LOG(4, ("%s: error stating file: %s\n", __FUNCTION__,
+              Err_Errno2String(status)));
+      return status;
+   }
+   creationTime = HgfsGetCreationTime(&stats);
+
+   if (S_ISDIR(stats.st_mode)) {
+      attr->type = HGFS_FILE_TYPE_DIRECTORY;
+   } else if (S_ISLNK(stats.st_mode)) {
+      attr->type = HGFS_FILE_TYPE_SYMLINK;
+   } else {
+      attr->type = HGFS_FILE_TYPE_REGULAR;
+   }
+
+   HgfsStatToFileAttr(&stats, &creationTime, attr);
+   HgfsGetHiddenAttr(fileName, attr);
+
+   /* See HgfsGetSequentialOnlyFlagFromName. */
+   HgfsServerGetOpenFlags(0, &openFlags);
+   if (followSymlinks) {
+      openFlags &= ~O_NOFOLLOW;
+   }
+   fd = openat(dirFd, name, openFlags | O_RDONLY);
+   if (fd >= 0) {
+      HgfsGetSequentialOnlyFlagFromFd(fd, attr);
+      close(fd);
+   } else {
+      LOG(4, ("%s: Couldn't open the file \"%s\"\n", __FUNCTION__, fileName));
+   }
+
+   /* Get effective permissions if we can, as HgfsEffectivePermissions. */
+   if (!(S_ISLNK(stats.st_mode))) {
+      HgfsOpenMode shareMode;
+      HgfsNameStatus nameStatus;
+
+      nameStatus = HgfsServerPolicy_GetShareMode(shareName, strlen(shareName),
+                                                 &shareMode);
+      if (nameStatus == HGFS_NAME_STATUS_COMPLETE) {
+         attr->effectivePerms = 0;
+         if (faccessat(dirFd, name, R_OK, 0) == 0) {
+            attr->effectivePerms |= HGFS_PERM_READ;
+         }
+         if (faccessat(dirFd, name, X_OK, 0) == 0) {
+            attr->effectivePerms |= HGFS_PERM_EXEC;
+         }
+         if (shareMode != HGFS_OPEN_MODE_READ_ONLY &&
+             faccessat(dirFd, name, W_OK, 0) == 0) {
+            attr->effectivePerms |= HGFS_PERM_WRITE;
+         }
+         attr->mask |= HGFS_ATTR_VALID_EFFECTIVE_PERMS;
+      }
+   }
+
+   return 0;
+}
+#endif
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformScanvdir --
+ *
+ *    Perform a scandir on our virtual directory.
+ *
+ *    Get directory entry names from the given callback function, and
+ *    build an array of DirectoryEntrys of all the names. Somewhat similar to
+ *    scandir(3) on linux, but more general.
+ *
+ * Results:
+ *    On success, the number of directory entries found.
+ *    On failure, negative error.
+ *
+ * Side effects:
+ *    Memory allocation.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformScanvdir(HgfsServerResEnumGetFunc enumNamesGet,   // IN: Function to get name
+                     HgfsServerResEnumInitFunc enumNamesInit, // IN: Setup function
+                     HgfsServerResEnumExitFunc enumNamesExit, // IN: Cleanup function
+                     DirectorySearchType type,                // IN: Kind of search - unused
+                     struct DirectoryEntry ***dents,          // OUT: Array of DirectoryEntrys
+                     uint32 *numDents)                        // OUT: total number of directory entrys
+{
+   HgfsInternalStatus status = HGFS_ERROR_SUCCESS;
+   uint32 totalDents = 0;   // Number of allocated dents
+   uint32 myNumDents = 0;     // Current actual number of dents
+   DirectoryEntry **myDents = NULL; // So realloc is happy w/ zero myNumDents
+   void *enumNamesHandle;
+
+   ASSERT(NULL != enumNamesInit);
+   ASSERT(NULL != enumNamesGet);
+   ASSERT(NULL != enumNamesExit);
+
+   enumNamesHandle = enumNamesInit();
+   if (NULL == enumNamesHandle) {
+      status = HGFS_ERROR_NOT_ENOUGH_MEMORY;
+      LOG(4, ("%s: Error: init state ret %u\n", __FUNCTION__, status));
+      goto exit;
+   }
+
+   for (;;) {
+      DirectoryEntry *currentEntry;
+      char const *currentEntryName;
+      size_t currentEntryNameLen;
+      size_t currentEntryLen;
+      size_t maxNameLen;
+      Bool done = FALSE;
+
+      /* Add '.' and ".." as the first dents. */
+      if (myNumDents == 0) {
+         currentEntryName = ".";
          currentEntryNameLen = 1;
       } else if (myNumDents == 1) {
          currentEntryName = "..";
@@ -4225,114 +5208,416 @@ HgfsPlatformReadFile(fileDesc file,               // IN: file descriptor
       *actualSize = error;
    }
 
-   return status;
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformWriteFile --
+ *
+ *    Performs actual writing data to a file.
+ *
+ * Results:
+ *    Zero on success.
+ *    Non-zero on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformWriteFile(fileDesc writeFd,            // IN: file descriptor
+                      HgfsSessionInfo *session,    // IN: session info
+                      uint64 writeOffset,          // IN: file offset to write to
+                      uint32 writeDataSize,        // IN: length of data to write
+                      HgfsWriteFlags writeFlags,   // IN: write flags
+                      Bool writeSequential,        // IN: write is sequential
+                      Bool writeAppend,            // IN: write is appended
+                      const void *writeData,       // IN: data to be written
+                      uint32 *writtenSize)         // OUT: actual length written
+{
+   HgfsInternalStatus status = 0;
+   int error = 0;
+
+   LOG(4, ("%s: write fh %u offset %"FMT64"u, count %u\n",
+           __FUNCTION__, writeFd, writeOffset, writeDataSize));
+
+#if !defined(sun)
+   if (!writeSequential) {
+      status = HgfsWriteCheckIORange(writeOffset, writeDataSize);
+      if (status != 0) {
+         return status;
+      }
+   }
+#endif
+
+#if defined(__linux__)
+   /* Write to the file. */
+   if (writeSequential) {
+      error = write(writeFd, writeData, writeDataSize);
+   } else {
+      error = pwrite(writeFd, writeData, writeDataSize, writeOffset);
+   }
+#elif defined(__APPLE__)
+   {
+      /* Write to the file. */
+      if (writeSequential || writeAppend) {
+         error = write(writeFd, writeData, writeDataSize);
+      } else {
+         error = pwrite(writeFd, writeData, writeDataSize, writeOffset);
+      }
+   }
+#else
+   /*
+    * Seek to the offset and write from the file. Grab the IO lock to make
+    * this and the subsequent write atomic.
+    */
+
+   MXUser_AcquireExclLock(session->fileIOLock);
+   if (!writeSequential) {
+#   ifdef linux
+      {
+         uint64 res;
+#      if !defined(VM_X86_64)
+         error = _llseek(writeFd, writeOffset >> 32, writeOffset & 0xFFFFFFFF, &res, 0);
+#      else
+         error = llseek(writeFd, writeOffset >> 32, writeOffset & 0xFFFFFFFF, &res, 0);
+#      endif
+      }
+#   else
+      error = lseek(writeFd, writeOffset, 0);
+#   endif
+
+   }
+
+   if (error < 0) {
+      LOG(4, ("%s: could not seek to %"FMT64"u: %s\n", __FUNCTION__,
+              writeOffset, Err_Errno2String(errno)));
+   } else {
+      error = write(writeFd, writeData, writeDataSize);
+   }
+   {
+      int savedErr = errno;
+      MXUser_ReleaseExclLock(session->fileIOLock);
+      errno = savedErr;
+   }
+#endif
+
+   if (error < 0) {
+      status = errno;
+      LOG(4, ("%s: error writing to file: %s\n", __FUNCTION__,
+         Err_Errno2String(status)));
+   } else {
+      *writtenSize = error;
+      LOG(4, ("%s: wrote %d bytes\n", __FUNCTION__, *writtenSize));
+   }
+   return status;
+}
+
+
+#if defined(__linux__)
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsVmxIovToIovec --
+ *
+ *    Describes the first size bytes of mapped guest buffers as an iovec
+ *    array for vectored I/O. The array is the one given if large enough.
+ *
+ * Results:
+ *    The iovec array, to free if not vecBuf, and its entry count.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static struct iovec *
+HgfsVmxIovToIovec(const HgfsVmxIov *iov,    // IN: mapped buffers
+                  uint32 iovCount,          // IN: number of buffers
+                  size_t size,              // IN: bytes to describe
+                  struct iovec *vecBuf,     // IN: default iovec array
+                  uint32 vecBufCount,       // IN: its entry count
+                  int *vecCount)            // OUT: iovec count
+{
+   struct iovec *vec = vecBuf;
+   uint32 i;
+
+   if (iovCount > vecBufCount) {
+      vec = Util_SafeMalloc(iovCount * sizeof *vec);
+   }
+   for (i = 0; i < iovCount && size > 0; i++) {
+      vec[i].iov_base = iov[i].va;
+      vec[i].iov_len = MIN(iov[i].len, size);
+      size -= vec[i].iov_len;
+   }
+   *vecCount = i;
+   return vec;
+}
+#endif
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformReadFileV --
+ *
+ *    Reads data from a file straight into mapped guest buffers, sparing
+ *    the copy through a contiguous reply buffer.
+ *
+ * Results:
+ *    Zero on success.
+ *    Non-zero on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformReadFileV(fileDesc file,               // IN: file descriptor
+                      HgfsSessionInfo *session,    // IN: session info
+                      uint64 offset,               // IN: file offset to read from
+                      uint32 requiredSize,         // IN: length of data to read
+                      const HgfsVmxIov *iov,       // OUT: mapped buffers for the data
+                      uint32 iovCount,             // IN: number of buffers
+                      uint32 *actualSize)          // OUT: actual length read
+{
+#if defined(__linux__)
+   struct iovec vecBuf[HGFS_LARGE_IO_MAX_PAGES + 1];
+   struct iovec *vec;
+   int vecCount;
+   ssize_t error;
+   HgfsInternalStatus status = 0;
+   HgfsHandle handle;
+   Bool sequentialOpen;
+
+   ASSERT(session);
+
+   LOG(4, ("%s: read fh %u, offset %"FMT64"u, count %u, %u buffers\n",
+           __FUNCTION__, file, offset, requiredSize, iovCount));
+
+   if (!HgfsFileDesc2Handle(file, session, &handle)) {
+      LOG(4, ("%s: Could not get file handle\n", __FUNCTION__));
+      return EBADF;
+   }
+
+   if (!HgfsHandleIsSequentialOpen(handle, session, &sequentialOpen)) {
+      LOG(4, ("%s: Could not get sequenial open status\n", __FUNCTION__));
+      return EBADF;
+   }
+
+   vec = HgfsVmxIovToIovec(iov, iovCount, requiredSize, vecBuf,
+                           ARRAYSIZE(vecBuf), &vecCount);
+   if (sequentialOpen) {
+      error = readv(file, vec, vecCount);
+   } else {
+      error = preadv(file, vec, vecCount, offset);
+   }
+   if (error < 0) {
+      status = errno;
+      LOG(4, ("%s: error reading from file: %s\n", __FUNCTION__,
+              Err_Errno2String(status)));
+   } else {
+      LOG(4, ("%s: read %"FMTSZ"d bytes\n", __FUNCTION__, error));
+      *actualSize = error;
+   }
+   if (vec != vecBuf) {
+      free(vec);
+   }
+
+   return status;
+#else
+   HgfsInternalStatus status = 0;
+   uint32 i;
+
+   /* Read each buffer in turn, until the end of the file. */
+   *actualSize = 0;
+   for (i = 0; i < iovCount && *actualSize < requiredSize; i++) {
+      uint32 size = MIN(iov[i].len, requiredSize - *actualSize);
+      uint32 readSize;
+
+      status = HgfsPlatformReadFile(file, session, offset + *actualSize, size,
+                                    iov[i].va, &readSize);
+      if (status != 0) {
+         break;
+      }
+      *actualSize += readSize;
+      if (readSize < size) {
+         break;
+      }
+   }
+
+   return *actualSize > 0 ? 0 : status;
+#endif
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformWriteFileV --
+ *
+ *    Writes data to a file straight from mapped guest buffers, sparing the
+ *    copy into a contiguous request buffer.
+ *
+ * Results:
+ *    Zero on success.
+ *    Non-zero on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformWriteFileV(fileDesc writeFd,            // IN: file descriptor
+                       HgfsSessionInfo *session,    // IN: session info
+                       uint64 writeOffset,          // IN: file offset to write to
+                       uint32 writeDataSize,        // IN: length of data to write
+                       HgfsWriteFlags writeFlags,   // IN: write flags
+                       Bool writeSequential,        // IN: write is sequential
+                       Bool writeAppend,            // IN: write is appended
+                       const HgfsVmxIov *iov,       // IN: mapped buffers of the data
+                       uint32 iovCount,             // IN: number of buffers
+                       uint32 *writtenSize)         // OUT: actual length written
+{
+#if defined(__linux__)
+   struct iovec vecBuf[HGFS_LARGE_IO_MAX_PAGES + 1];
+   struct iovec *vec;
+   int vecCount;
+   ssize_t error;
+   HgfsInternalStatus status = 0;
+
+   LOG(4, ("%s: write fh %u offset %"FMT64"u, count %u, %u buffers\n",
+           __FUNCTION__, writeFd, writeOffset, writeDataSize, iovCount));
+
+   if (!writeSequential) {
+      status = HgfsWriteCheckIORange(writeOffset, writeDataSize);
+      if (status != 0) {
+         return status;
+      }
+   }
+
+   vec = HgfsVmxIovToIovec(iov, iovCount, writeDataSize, vecBuf,
+                           ARRAYSIZE(vecBuf), &vecCount);
+   if (writeSequential) {
+      error = writev(writeFd, vec, vecCount);
+   } else {
+      error = pwritev(writeFd, vec, vecCount, writeOffset);
+   }
+   if (error < 0) {
+      status = errno;
+      LOG(4, ("%s: error writing to file: %s\n", __FUNCTION__,
+              Err_Errno2String(status)));
+   } else {
+      *writtenSize = error;
+      LOG(4, ("%s: wrote %d bytes\n", __FUNCTION__, *writtenSize));
+   }
+   if (vec != vecBuf) {
+      free(vec);
+   }
+
+   return status;
+#else
+   HgfsInternalStatus status = 0;
+   uint32 i;
+
+   /* Write each buffer in turn, until one is not written in full. */
+   *writtenSize = 0;
+   for (i = 0; i < iovCount && *writtenSize < writeDataSize; i++) {
+      uint32 size = MIN(iov[i].len, writeDataSize - *writtenSize);
+      uint32 written;
+
+      status = HgfsPlatformWriteFile(writeFd, session, writeOffset + *writtenSize,
+                                     size, writeFlags, writeSequential,
+                                     writeAppend, iov[i].va, &written);
+      if (status != 0) {
+         break;
+      }
+      *writtenSize += written;
+      if (written < size) {
+         break;
+      }
+   }
+
+   return *writtenSize > 0 ? 0 : status;
+#endif
 }
 
 
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsPlatformWriteFile --
+ * HgfsPlatformAdviseAccess --
  *
- *    Performs actual writing data to a file.
+ *    Pass an access pattern hint on to the page cache. Hints are best
+ *    effort: errors are only logged, and platforms without the calls
+ *    ignore them.
  *
  * Results:
- *    Zero on success.
- *    Non-zero on failure.
+ *    None.
  *
  * Side effects:
- *    None
+ *    WILLNEED starts reading the range, WRITEBEHIND writing it back, and
+ *    DONTNEED waits for the range to be written back before dropping it.
  *
  *-----------------------------------------------------------------------------
  */
 
-HgfsInternalStatus
-HgfsPlatformWriteFile(fileDesc writeFd,            // IN: file descriptor
-                      HgfsSessionInfo *session,    // IN: session info
-                      uint64 writeOffset,          // IN: file offset to write to
-                      uint32 writeDataSize,        // IN: length of data to write
-                      HgfsWriteFlags writeFlags,   // IN: write flags
-                      Bool writeSequential,        // IN: write is sequential
-                      Bool writeAppend,            // IN: write is appended
-                      const void *writeData,       // IN: data to be written
-                      uint32 *writtenSize)         // OUT: actual length written
+void
+HgfsPlatformAdviseAccess(fileDesc file,             // IN: file descriptor
+                         HgfsAccessAdvice advice,   // IN: access advice
+                         uint64 offset,             // IN: start of the range
+                         uint64 length)             // IN: length, 0 to the end
 {
-   HgfsInternalStatus status = 0;
+#if defined(__linux__)
    int error = 0;
 
-   LOG(4, ("%s: write fh %u offset %"FMT64"u, count %u\n",
-           __FUNCTION__, writeFd, writeOffset, writeDataSize));
-
-#if !defined(sun)
-   if (!writeSequential) {
-      status = HgfsWriteCheckIORange(writeOffset, writeDataSize);
-      if (status != 0) {
-         return status;
+   switch (advice) {
+   case HGFS_ACCESS_ADVICE_NORMAL:
+      error = posix_fadvise(file, 0, 0, POSIX_FADV_NORMAL);
+      break;
+   case HGFS_ACCESS_ADVICE_SEQUENTIAL:
+      error = posix_fadvise(file, 0, 0, POSIX_FADV_SEQUENTIAL);
+      break;
+   case HGFS_ACCESS_ADVICE_WILLNEED:
+      if (readahead(file, offset, length) < 0) {
+         error = errno;
       }
-   }
-#endif
-
-#if defined(__linux__)
-   /* Write to the file. */
-   if (writeSequential) {
-      error = write(writeFd, writeData, writeDataSize);
-   } else {
-      error = pwrite(writeFd, writeData, writeDataSize, writeOffset);
-   }
-#elif defined(__APPLE__)
-   {
-      /* Write to the file. */
-      if (writeSequential || writeAppend) {
-         error = write(writeFd, writeData, writeDataSize);
-      } else {
-         error = pwrite(writeFd, writeData, writeDataSize, writeOffset);
+      break;
+   case HGFS_ACCESS_ADVICE_WRITEBEHIND:
+      if (sync_file_range(file, offset, length, SYNC_FILE_RANGE_WRITE) < 0) {
+         error = errno;
       }
-   }
-#else
-   /*
-    * Seek to the offset and write from the file. Grab the IO lock to make
-    * this and the subsequent write atomic.
-    */
-
-   MXUser_AcquireExclLock(session->fileIOLock);
-   if (!writeSequential) {
-#   ifdef linux
-      {
-         uint64 res;
-#      if !defined(VM_X86_64)
-         error = _llseek(writeFd, writeOffset >> 32, writeOffset & 0xFFFFFFFF, &res, 0);
-#      else
-         error = llseek(writeFd, writeOffset >> 32, writeOffset & 0xFFFFFFFF, &res, 0);
-#      endif
+      break;
+   case HGFS_ACCESS_ADVICE_DONTNEED:
+      /* Dirty pages are not dropped: write them back first. */
+      if (sync_file_range(file, offset, length,
+                          SYNC_FILE_RANGE_WAIT_BEFORE |
+                          SYNC_FILE_RANGE_WRITE |
+                          SYNC_FILE_RANGE_WAIT_AFTER) < 0) {
+         error = errno;
+      } else {
+         error = posix_fadvise(file, offset, length, POSIX_FADV_DONTNEED);
       }
-#   else
-      error = lseek(writeFd, writeOffset, 0);
-#   endif
-
+      break;
+   default:
+      NOT_REACHED();
    }
 
-   if (error < 0) {
-      LOG(4, ("%s: could not seek to %"FMT64"u: %s\n", __FUNCTION__,
-              writeOffset, Err_Errno2String(errno)));
-   } else {
-      error = write(writeFd, writeData, writeDataSize);
-   }
-   {
-      int savedErr = errno;
-      MXUser_ReleaseExclLock(session->fileIOLock);
-      errno = savedErr;
+   if (error != 0) {
+      LOG(4, ("%s: advice %d on fd %d: %s\n", __FUNCTION__, advice, file,
+              Err_Errno2String(error)));
    }
 #endif
-
-   if (error < 0) {
-      status = errno;
-      LOG(4, ("%s: error writing to file: %s\n", __FUNCTION__,
-         Err_Errno2String(status)));
-   } else {
-      *writtenSize = error;
-      LOG(4, ("%s: wrote %d bytes\n", __FUNCTION__, *writtenSize));
-   }
-   return status;
 }
 
 
@@ -4755,6 +6040,242 @@ exit:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCopyFileData --
+ *
+ *    Copy at most HGFS_COPY_REQUEST_SIZE bytes of a file, starting at the
+ *    given offset in both files. On Linux a copy from the start is first
+ *    tried as a clone of the whole file, which only shares the blocks on
+ *    filesystems supporting it, then the data is copied with
+ *    copy_file_range, which lets the kernel or filesystem copy without going
+ *    through user space. Failing both, or elsewhere, the data is read and
+ *    written.
+ *
+ * Results:
+ *    0 on success, POSIX error code otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsInternalStatus
+HgfsCopyFileData(int srcFd,         // IN: source file
+                 int targetFd,      // IN: target file
+                 uint64 offset,     // IN: where to start in both files
+                 uint64 srcSize,    // IN: size of the source
+                 uint64 *size,      // OUT: bytes copied
+                 Bool *eof)         // OUT: the end of the source was reached
+{
+   char *buffer;
+   HgfsInternalStatus status = 0;
+
+   *size = 0;
+   *eof = FALSE;
+
+#if defined(__linux__)
+   if (offset == 0 && ioctl(targetFd, FICLONE, srcFd) == 0) {
+      LOG(4, ("%s: cloned %"FMT64"u bytes\n", __FUNCTION__, srcSize));
+      *size = srcSize;
+      *eof = TRUE;
+      return 0;
+   }
+
+#   if defined(SYS_copy_file_range)
+   /* A copy falling back below continues where this one stopped. */
+   while (*size < HGFS_COPY_REQUEST_SIZE) {
+      loff_t srcOffset = offset + *size;
+      loff_t targetOffset = srcOffset;
+      ssize_t copied = syscall(SYS_copy_file_range, srcFd, &srcOffset,
+                               targetFd, &targetOffset,
+                               HGFS_COPY_REQUEST_SIZE - *size, 0);
+
+      if (copied > 0) {
+         *size += copied;
+      } else if (copied == 0) {
+         *eof = TRUE;
+         return 0;
+      } else if (errno != EINTR) {
+         status = errno;
+         if (status != ENOSYS && status != EXDEV && status != EINVAL &&
+             status != EOPNOTSUPP) {
+            return status;
+         }
+         LOG(4, ("%s: copy_file_range: %s, reading and writing instead\n",
+                 __FUNCTION__, Err_Errno2String(status)));
+         status = 0;
+         break;
+      }
+   }
+   if (*size == HGFS_COPY_REQUEST_SIZE) {
+      return 0;
+   }
+#   endif
+#endif
+
+   buffer = Util_SafeMalloc(HGFS_COPY_BUFFER_SIZE);
+   while (*size < HGFS_COPY_REQUEST_SIZE) {
+      ssize_t bytesRead = pread(srcFd, buffer,
+                                MIN(HGFS_COPY_BUFFER_SIZE,
+                                    HGFS_COPY_REQUEST_SIZE - *size),
+                                offset + *size);
+      ssize_t bytesWritten = 0;
+
+      if (bytesRead < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         status = errno;
+         break;
+      }
+      if (bytesRead == 0) {
+         *eof = TRUE;
+         break;
+      }
+      while (bytesWritten < bytesRead) {
+         ssize_t written = pwrite(targetFd, buffer + bytesWritten,
+                                  bytesRead - bytesWritten,
+                                  offset + *size + bytesWritten);
+
+         if (written < 0 && errno != EINTR) {
+            status = errno;
+            break;
+         }
+         if (written > 0) {
+            bytesWritten += written;
+         }
+      }
+      if (status != 0) {
+         break;
+      }
+      *size += bytesRead;
+   }
+   free(buffer);
+
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformCopyFile --
+ *
+ *    POSIX version of the function that copies a regular file, see
+ *    HgfsCopyFileData. The target gets the permissions of the source if
+ *    created.
+ *
+ *    A request copies a bounded amount of data, so that a large file does not
+ *    hold up the channel for the whole copy. When the source has more data,
+ *    nextOffset is set and the client continues the copy with resume set,
+ *    which opens the existing target as it is.
+ *
+ * Results:
+ *    0 on success, POSIX error code otherwise.
+ *
+ * Side effects:
+ *    Unless resuming, the target is created, or truncated when it exists and
+ *    may be replaced. A target created here is removed again if the copy
+ *    fails.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformCopyFile(const char *localSrcName,     // IN: local path to source file
+                     const char *localTargetName,  // IN: local path to target file
+                     Bool noReplace,               // IN: fail if the target exists
+                     Bool resume,                  // IN: continue a partial copy
+                     uint64 offset,                // IN: offset to continue at
+                     uint64 *size,                 // OUT: bytes copied
+                     uint64 *nextOffset)           // OUT: offset to continue at
+{
+   struct stat srcStat;
+   struct stat targetStat;
+   Bool created = FALSE;
+   Bool eof = FALSE;
+   int srcFd;
+   int targetFd = -1;
+   HgfsInternalStatus status = 0;
+
+   *size = 0;
+   *nextOffset = 0;
+
+   LOG(4, ("%s: copying \"%s\" to \"%s\" from %"FMT64"u\n", __FUNCTION__,
+           localSrcName, localTargetName, offset));
+
+   srcFd = Posix_Open(localSrcName, O_RDONLY | O_NOFOLLOW);
+   if (srcFd < 0 || fstat(srcFd, &srcStat) < 0) {
+      status = errno;
+      goto exit;
+   }
+   if (!S_ISREG(srcStat.st_mode)) {
+      status = S_ISDIR(srcStat.st_mode) ? EISDIR : EINVAL;
+      goto exit;
+   }
+   if (offset > (uint64)srcStat.st_size) {
+      status = EINVAL;
+      goto exit;
+   }
+
+   if (resume) {
+      targetFd = Posix_Open(localTargetName, O_WRONLY | O_NOFOLLOW);
+   } else {
+      targetFd = Posix_Open(localTargetName,
+                            O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW,
+                            srcStat.st_mode & ACCESSPERMS);
+      if (targetFd >= 0) {
+         created = TRUE;
+      } else if (errno == EEXIST && !noReplace) {
+         /* Not truncated on open: the target may be the source itself. */
+         targetFd = Posix_Open(localTargetName, O_WRONLY | O_NOFOLLOW);
+      }
+   }
+   if (targetFd < 0 || fstat(targetFd, &targetStat) < 0) {
+      status = errno;
+      goto exit;
+   }
+   if (!created) {
+      if (targetStat.st_dev == srcStat.st_dev &&
+          targetStat.st_ino == srcStat.st_ino) {
+         status = EINVAL;
+         goto exit;
+      }
+      if (!resume && ftruncate(targetFd, 0) < 0) {
+         status = errno;
+         goto exit;
+      }
+   }
+
+   status = HgfsCopyFileData(srcFd, targetFd, offset, srcStat.st_size,
+                             size, &eof);
+   if (status == 0 && !eof) {
+      *nextOffset = offset + *size;
+   }
+
+exit:
+   if (targetFd >= 0) {
+      if (close(targetFd) < 0 && status == 0) {
+         status = errno;
+      }
+      if (status != 0 && created) {
+         Posix_Unlink(localTargetName);
+      }
+   }
+   if (srcFd >= 0) {
+      close(srcFd);
+   }
+   if (status != 0) {
+      LOG(4, ("%s: error: %s\n", __FUNCTION__, Err_Errno2String(status)));
+   }
+
+   return status;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -4860,6 +6381,73 @@ HgfsPlatformSymlinkCreate(char *localSymlinkName,   // IN: symbolic link file na
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsPathIsPlainBelowShare --
+ *
+ *      Check with lstat(2) that every component of dirName below sharePath
+ *      is a directory, not a symlink. Names from requests contain no "."
+ *      or ".." components (see CPName_ConvertFrom), so such a path resolves
+ *      to itself and is inside the share, without realpath(3) resolving it
+ *      from the file system root.
+ *
+ * Results:
+ *      TRUE if dirName is sharePath or made of directories below it.
+ *      FALSE if a component is a symlink, is missing or is not a
+ *      directory, or dirName is not below sharePath.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+HgfsPathIsPlainBelowShare(char *dirName,            // IN: directory
+                          const char *sharePath,    // IN
+                          size_t sharePathLength)   // IN
+{
+   char *p = dirName + sharePathLength;
+   Bool plain = TRUE;
+
+   ASSERT(sharePathLength > 0);
+
+   /* A volume root share ends with a separator, others are followed by one. */
+   if (Str_Strncmp(dirName, sharePath, sharePathLength) != 0 ||
+       (*p != '\0' && *p != DIRSEPC &&
+        sharePath[sharePathLength - 1] != DIRSEPC)) {
+      return FALSE;
+   }
+
+   while (plain && *p != '\0') {
+      struct stat stats;
+      char *next;
+
+      while (*p == DIRSEPC) {
+         p++;
+      }
+      if (*p == '\0') {
+         break;
+      }
+      next = strchr(p, DIRSEPC);
+
+      /* Stat the path up to and including this component. */
+      if (next != NULL) {
+         *next = '\0';
+      }
+      plain = Posix_Lstat(dirName, &stats) == 0 && S_ISDIR(stats.st_mode);
+      if (next == NULL) {
+         break;
+      }
+      *next = DIRSEPC;
+      p = next;
+   }
+
+   return plain;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -4882,6 +6470,10 @@ HgfsPlatformSymlinkCreate(char *localSymlinkName,   // IN: symbolic link file na
  *      that doesn't exist. After resolving, we determine if sharePath is a
  *      prefix of fileName.
  *
+ *      Most parents have no symlinks below the share, which a lstat(2) of
+ *      each component below it establishes, see HgfsPathIsPlainBelowShare.
+ *      Only the others are resolved.
+ *
  *      Note that realpath(3) behaves differently on GNU and BSD systems.
  *      Following table lists the difference:
  *
@@ -4956,6 +6548,11 @@ HgfsPlatformPathHasSymlink(const char *fileName,      // IN
       }
    }
 
+   /* Without symlinks below the share, there is nothing to resolve. */
+   if (HgfsPathIsPlainBelowShare(fileDirName, sharePath, sharePathLength)) {
+      goto exit;
+   }
+
    /*
     * Resolve parent directory of fileName.
     * Use realpath(2) to resolve the parent.
@@ -29,8 +29,38 @@
 #include "hgfsServer.h"
 #include "hgfsServerInt.h"
 #include "util.h"
+#include "userlock.h"
+#include "mutexRankLib.h"
 
+/*
+ * Buffer pool size classes, see HSPUBufAlloc. The smallest class holds
+ * HSPU_BUF_CLASS_MIN bytes and each next one four times as much, so the
+ * largest one is 256KB: enough for any reply and the bounce buffer of any
+ * packet but the largest V4 reads and writes. A pool keeps at most
+ * HSPU_BUF_POOL_MAX_BYTES in its free lists.
+ */
+#define HSPU_BUF_CLASS_MIN        1024
+#define HSPU_BUF_CLASS_SHIFT      2
+#define HSPU_BUF_POOL_MAX_BYTES   (1024 * 1024)
+
+/*
+ * Header of the buffers of HSPUBufAlloc, the buffer follows. Sized to keep
+ * the buffer aligned as malloc would.
+ */
+typedef struct HSPUBuf {
+   union {
+      struct HSPUBuf *next;      /* Next free buffer of the class. */
+      uint64 align;
+   } u;
+   uint64 sizeClass;             /* HGFS_BUF_POOL_CLASSES if not pooled. */
+} HSPUBuf;
+
+static void *HSPUBufAlloc(HgfsServerBufPool *bufPool,
+                          size_t size);
+static void HSPUBufFree(HgfsServerBufPool *bufPool,
+                        void *buf);
 static void *HSPUGetBuf(HgfsServerChannelCallbacks *chanCb,
+                        HgfsServerBufPool *bufPool,
                         MappingType mappingType,
                         HgfsVmxIov *iov,
                         uint32 iovCount,
@@ -41,6 +71,7 @@ static void *HSPUGetBuf(HgfsServerChannelCallbacks *chanCb,
                         Bool *isAllocated,
                         uint32 *iovMappedCount);
 static void HSPUPutBuf(HgfsServerChannelCallbacks *chanCb,
+                       HgfsServerBufPool *bufPool,
                        MappingType mappingType,
                        HgfsVmxIov *iov,
                        uint32 iovCount,
@@ -72,6 +103,171 @@ static void HSPUUnmapBuf(HgfsChannelUnmapVirtAddrFunc unmapVa,
                          uint32 *mappedCount);
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HSPU_BufPoolInit --
+ *
+ *    Initialize an empty buffer pool.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HSPU_BufPoolInit(HgfsServerBufPool *bufPool)  // OUT: buffer pool
+{
+   memset(bufPool, 0, sizeof *bufPool);
+   bufPool->lock = MXUser_CreateExclLock("HgfsBufPoolLock",
+                                         RANK_hgfsBufPoolLock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HSPU_BufPoolExit --
+ *
+ *    Free the buffers of a pool. The buffers in use must have been put back.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HSPU_BufPoolExit(HgfsServerBufPool *bufPool)  // IN/OUT: buffer pool
+{
+   uint32 i;
+
+   for (i = 0; i < ARRAYSIZE(bufPool->freeList); i++) {
+      while (bufPool->freeList[i] != NULL) {
+         HSPUBuf *buf = bufPool->freeList[i];
+
+         bufPool->freeList[i] = buf->u.next;
+         free(buf);
+      }
+   }
+   bufPool->freeBytes = 0;
+
+   if (bufPool->lock != NULL) {
+      MXUser_DestroyExclLock(bufPool->lock);
+      bufPool->lock = NULL;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HSPUBufAlloc --
+ *
+ *    Get a buffer from the free list of the smallest size class that holds
+ *    size bytes, or allocate one of that class. Sizes larger than the
+ *    largest class are allocated as they are.
+ *
+ *    Only reached for channels that leave the buffers to the server: a
+ *    reply without a reply buffer from the channel, or a packet spanning
+ *    several guest mappings. The backdoor channel of the tools passes its
+ *    own request and reply buffers in a single iov, so it never gets here.
+ *
+ * Results:
+ *    The buffer, free it with HSPUBufFree.
+ *
+ * Side effects:
+ *    None.
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+HSPUBufAlloc(HgfsServerBufPool *bufPool,  // IN: buffer pool, may be NULL
+             size_t size)                 // IN: buffer size
+{
+   size_t classSize = HSPU_BUF_CLASS_MIN;
+   uint32 sizeClass = 0;
+   HSPUBuf *buf = NULL;
+
+   while (classSize < size && sizeClass < HGFS_BUF_POOL_CLASSES) {
+      classSize <<= HSPU_BUF_CLASS_SHIFT;
+      sizeClass++;
+   }
+
+   if (sizeClass == HGFS_BUF_POOL_CLASSES) {
+      buf = Util_SafeMalloc(sizeof *buf + size);
+      buf->sizeClass = HGFS_BUF_POOL_CLASSES;
+      return buf + 1;
+   }
+
+   if (bufPool != NULL) {
+      MXUser_AcquireExclLock(bufPool->lock);
+      buf = bufPool->freeList[sizeClass];
+      if (buf != NULL) {
+         bufPool->freeList[sizeClass] = buf->u.next;
+         bufPool->freeBytes -= classSize;
+      }
+      MXUser_ReleaseExclLock(bufPool->lock);
+   }
+
+   if (buf != NULL) {
+      HgfsServerStatsInc(HGFS_STATS_BUF_POOL_HITS);
+   } else {
+      HgfsServerStatsInc(HGFS_STATS_BUF_POOL_MISSES);
+      buf = Util_SafeMalloc(sizeof *buf + classSize);
+      buf->sizeClass = sizeClass;
+   }
+   ASSERT(buf->sizeClass == sizeClass);
+
+   return buf + 1;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HSPUBufFree --
+ *
+ *    Put a buffer of HSPUBufAlloc back on the free list of its class, or
+ *    free it if the pool holds enough already.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HSPUBufFree(HgfsServerBufPool *bufPool,  // IN: buffer pool, may be NULL
+            void *data)                  // IN: buffer
+{
+   HSPUBuf *buf = (HSPUBuf *)data - 1;
+
+   if (bufPool != NULL && buf->sizeClass < HGFS_BUF_POOL_CLASSES) {
+      size_t classSize = (size_t)HSPU_BUF_CLASS_MIN <<
+                         (buf->sizeClass * HSPU_BUF_CLASS_SHIFT);
+
+      MXUser_AcquireExclLock(bufPool->lock);
+      if (bufPool->freeBytes + classSize <= HSPU_BUF_POOL_MAX_BYTES) {
+         buf->u.next = bufPool->freeList[buf->sizeClass];
+         bufPool->freeList[buf->sizeClass] = buf;
+         bufPool->freeBytes += classSize;
+         buf = NULL;
+      }
+      MXUser_ReleaseExclLock(bufPool->lock);
+   }
+
+   free(buf);
+}
+
+
 
 /*
  *-----------------------------------------------------------------------------
@@ -201,6 +397,7 @@ exit:
 void *
 HSPU_GetReplyPacket(HgfsPacket *packet,                  // IN/OUT: Hgfs Packet
                     HgfsServerChannelCallbacks *chanCb,  // IN: Channel callbacks
+                    HgfsServerBufPool *bufPool,          // IN: buffer pool
                     size_t replyDataSize,                // IN: Size of reply data
                     size_t *replyPacketSize)             // OUT: Size of reply Packet
 {
@@ -246,7 +443,7 @@ HSPU_GetReplyPacket(HgfsPacket *packet,                  // IN/OUT: Hgfs Packet
    } else {
       /* For sockets channel we always need to allocate buffer */
       LOG(10, ("%s Allocating reply packet\n", __FUNCTION__));
-      packet->replyPacket = Util_SafeMalloc(replyDataSize);
+      packet->replyPacket = HSPUBufAlloc(bufPool, replyDataSize);
       packet->replyPacketIsAllocated = TRUE;
       packet->replyPacketDataSize = replyDataSize;
       packet->replyPacketSize = replyDataSize;
@@ -274,7 +471,8 @@ HSPU_GetReplyPacket(HgfsPacket *packet,                  // IN/OUT: Hgfs Packet
 
 void
 HSPU_PutReplyPacket(HgfsPacket *packet,                  // IN/OUT: Hgfs Packet
-                    HgfsServerChannelCallbacks *chanCb)  // IN: Channel callbacks
+                    HgfsServerChannelCallbacks *chanCb,  // IN: Channel callbacks
+                    HgfsServerBufPool *bufPool)          // IN: buffer pool
 {
    /*
     * If there wasn't an allocated buffer for the reply, there is nothing to
@@ -283,7 +481,7 @@ HSPU_PutReplyPacket(HgfsPacket *packet,                  // IN/OUT: Hgfs Packet
     */
    if (packet->replyPacketIsAllocated) {
       LOG(10, ("%s Freeing reply packet", __FUNCTION__));
-      free(packet->replyPacket);
+      HSPUBufFree(bufPool, packet->replyPacket);
       packet->replyPacketIsAllocated = FALSE;
       packet->replyPacket = NULL;
       packet->replyPacketSize = 0;
@@ -310,7 +508,8 @@ HSPU_PutReplyPacket(HgfsPacket *packet,                  // IN/OUT: Hgfs Packet
 void *
 HSPU_GetMetaPacket(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
                    size_t *metaPacketSize,               // OUT: Size of metaPacket
-                   HgfsServerChannelCallbacks *chanCb)   // IN: Channel callbacks
+                   HgfsServerChannelCallbacks *chanCb,   // IN: Channel callbacks
+                   HgfsServerBufPool *bufPool)           // IN: buffer pool
 {
    *metaPacketSize = packet->metaPacketDataSize;
    if (packet->metaPacket != NULL) {
@@ -324,6 +523,7 @@ HSPU_GetMetaPacket(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
    packet->metaMappingType = BUF_READWRITEABLE;
 
    return HSPUGetBuf(chanCb,
+                     bufPool,
                      packet->metaMappingType,
                      packet->iov,
                      packet->iovCount,
@@ -380,7 +580,8 @@ HSPU_ValidateDataPacketSize(HgfsPacket *packet,     // IN: Hgfs Packet
 void *
 HSPU_GetDataPacketBuf(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
                       MappingType mappingType,              // IN: Writeable/Readable
-                      HgfsServerChannelCallbacks *chanCb)   // IN: Channel callbacks
+                      HgfsServerChannelCallbacks *chanCb,   // IN: Channel callbacks
+                      HgfsServerBufPool *bufPool)           // IN: buffer pool
 {
    if (packet->dataPacket != NULL) {
       return packet->dataPacket;
@@ -392,6 +593,7 @@ HSPU_GetDataPacketBuf(HgfsPacket *packet,                   // IN/OUT: Hgfs Pack
 
    packet->dataMappingType = mappingType;
    return HSPUGetBuf(chanCb,
+                     bufPool,
                      packet->dataMappingType,
                      packet->iov,
                      packet->iovCount,
@@ -404,6 +606,64 @@ HSPU_GetDataPacketBuf(HgfsPacket *packet,                   // IN/OUT: Hgfs Pack
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HSPU_GetDataPacketIov --
+ *
+ *    Get the guest mappings of a data packet, for the caller to do vectored
+ *    I/O on them directly instead of through a contiguous buffer which,
+ *    when the data spans several pages, is allocated and copied in or out.
+ *    Guest mappings will be established and released by
+ *    HSPU_PutDataPacketBuf.
+ *
+ * Results:
+ *    Pointer to the first mapped iov of the data, and their count.
+ *    NULL if the packet has no mappable data or a buffer is already in use.
+ *
+ * Side effects:
+ *    None.
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsVmxIov *
+HSPU_GetDataPacketIov(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
+                      MappingType mappingType,              // IN: Writeable/Readable
+                      HgfsServerChannelCallbacks *chanCb,   // IN: Channel callbacks
+                      uint32 *iovCount)                     // OUT: mapped iov count
+{
+   HgfsChannelMapVirtAddrFunc mapVa;
+
+   if (packet->dataPacket != NULL || packet->dataPacketMappedIov != 0 ||
+       packet->dataPacketSize == 0 || chanCb == NULL) {
+      return NULL;
+   }
+
+   if (mappingType == BUF_WRITEABLE ||
+       mappingType == BUF_READWRITEABLE) {
+      mapVa = chanCb->getWriteVa;
+   } else {
+      ASSERT(mappingType == BUF_READABLE);
+      mapVa = chanCb->getReadVa;
+   }
+
+   if (mapVa == NULL ||
+       !HSPUMapBuf(mapVa,
+                   chanCb->putVa,
+                   packet->dataPacketSize,
+                   packet->dataPacketIovIndex,
+                   packet->iovCount,
+                   packet->iov,
+                   &packet->dataPacketMappedIov)) {
+      return NULL;
+   }
+
+   packet->dataMappingType = mappingType;
+   *iovCount = packet->dataPacketMappedIov;
+   return &packet->iov[packet->dataPacketIovIndex];
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -422,6 +682,7 @@ HSPU_GetDataPacketBuf(HgfsPacket *packet,                   // IN/OUT: Hgfs Pack
 
 static void *
 HSPUGetBuf(HgfsServerChannelCallbacks *chanCb,  // IN: Channel callbacks
+           HgfsServerBufPool *bufPool,          // IN: buffer pool
            MappingType mappingType,             // IN: Access type Readable/Writeable
            HgfsVmxIov *iov,                     // IN: iov array
            uint32 iovCount,                     // IN: iov array size
@@ -480,7 +741,7 @@ HSPUGetBuf(HgfsServerChannelCallbacks *chanCb,  // IN: Channel callbacks
    ASSERT(iov[startIndex].len < bufSize);
 
    LOG(10, ("%s: Hgfs Allocating buffer \n", __FUNCTION__));
-   *buf = Util_SafeMalloc(bufSize);
+   *buf = HSPUBufAlloc(bufPool, bufSize);
    *isAllocated = TRUE;
 
    if ((mappingType == BUF_READABLE || mappingType == BUF_READWRITEABLE) &&
@@ -518,7 +779,8 @@ exit:
 
 void
 HSPU_PutMetaPacket(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
-                   HgfsServerChannelCallbacks *chanCb)   // IN: Channel callbacks
+                   HgfsServerChannelCallbacks *chanCb,   // IN: Channel callbacks
+                   HgfsServerBufPool *bufPool)           // IN: buffer pool
 {
    if (packet->metaPacket == NULL) {
       return;
@@ -526,6 +788,7 @@ HSPU_PutMetaPacket(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
 
    LOG(4, ("%s Hgfs Putting Meta packet\n", __FUNCTION__));
    HSPUPutBuf(chanCb,
+              bufPool,
               packet->metaMappingType,
               packet->iov,
               packet->iovCount,
@@ -580,14 +843,17 @@ HSPU_SetDataPacketSize(HgfsPacket *packet,            // IN/OUT: Hgfs Packet
 
 void
 HSPU_PutDataPacketBuf(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
-                      HgfsServerChannelCallbacks *chanCb)   // IN: Channel callbacks
+                      HgfsServerChannelCallbacks *chanCb,   // IN: Channel callbacks
+                      HgfsServerBufPool *bufPool)           // IN: buffer pool
 {
-   if (packet->dataPacket == NULL) {
+   /* The data may be mapped without a buffer, see HSPU_GetDataPacketIov. */
+   if (packet->dataPacket == NULL && packet->dataPacketMappedIov == 0) {
       return;
    }
 
    LOG(4, ("%s Hgfs Putting Data packet\n", __FUNCTION__));
    HSPUPutBuf(chanCb,
+              bufPool,
               packet->dataMappingType,
               packet->iov,
               packet->iovCount,
@@ -616,6 +882,7 @@ HSPU_PutDataPacketBuf(HgfsPacket *packet,                   // IN/OUT: Hgfs Pack
 
 void
 HSPUPutBuf(HgfsServerChannelCallbacks *chanCb,  // IN: Channel callbacks
+           HgfsServerBufPool *bufPool,          // IN: buffer pool
            MappingType mappingType,             // IN: Access type Readable/Writeable
            HgfsVmxIov *iov,                     // IN: iov array
            uint32 iovCount,                     // IN: iov array size
@@ -659,7 +926,7 @@ HSPUPutBuf(HgfsServerChannelCallbacks *chanCb,  // IN: Channel callbacks
 exit:
    if (*isAllocated) {
       LOG(10, ("%s: Hgfs Freeing buffer \n", __FUNCTION__));
-      free(*buf);
+      HSPUBufFree(bufPool, *buf);
       *isAllocated = FALSE;
    }
 
@@ -120,6 +120,7 @@ static HgfsOpCapability hgfsDefaultCapabilityTable[] =
    {HGFS_OP_UNLOCK_BYTE_RANGE_V4,  HGFS_OP_CAPFLAG_NOT_SUPPORTED},
    {HGFS_OP_QUERY_EAS_V4,          HGFS_OP_CAPFLAG_NOT_SUPPORTED},
    {HGFS_OP_SET_EAS_V4,            HGFS_OP_CAPFLAG_NOT_SUPPORTED},
+   {HGFS_OP_COPY_FILE_V4,          HGFS_OP_CAPFLAG_POSIX_IS_SUPPORTED},
 };
 
 
@@ -2133,6 +2134,125 @@ HgfsUnpackRenameRequest(const void *packet,       // IN: HGFS packet
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsUnpackCopyFileRequest --
+ *
+ *    Unpack hgfs copy file request V4 and initialize the source and target
+ *    file names or handles.
+ *
+ * Results:
+ *    TRUE on success.
+ *    FALSE on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsUnpackCopyFileRequest(const void *packet,        // IN: HGFS packet
+                          size_t packetSize,         // IN: request packet size
+                          const char **cpSrcName,    // OUT: copy src
+                          size_t *cpSrcNameLen,      // OUT: copy src size
+                          const char **cpTargetName, // OUT: copy dst
+                          size_t *cpTargetNameLen,   // OUT: copy dst size
+                          HgfsCopyFileFlags *flags,  // OUT: copy flags
+                          uint64 *offset,            // OUT: offset to continue at
+                          Bool *useSrcFile,          // OUT: src is a handle
+                          HgfsHandle *srcFile,       // OUT: src file handle
+                          Bool *useTargetFile,       // OUT: dst is a handle
+                          HgfsHandle *targetFile,    // OUT: target file handle
+                          uint32 *srcCaseFlags,      // OUT: source case flags
+                          uint32 *targetCaseFlags)   // OUT: dest. case flags
+{
+   const HgfsRequestCopyFileV4 *requestV4 = packet;
+   const HgfsFileNameV3 *targetName;
+   size_t extra;
+
+   LOG(4, ("%s: HGFS_OP_COPY_FILE_V4\n", __FUNCTION__));
+
+   if (packetSize < sizeof *requestV4) {
+      return FALSE;
+   }
+   extra = packetSize - sizeof *requestV4;
+
+   *flags = requestV4->flags;
+   *offset = (*flags & HGFS_COPY_FILE_CONTINUE) != 0 ? requestV4->offset : 0;
+
+   /* As for rename V3, the target name follows the variable length source. */
+   if (!HgfsUnpackFileNameV3(&requestV4->srcName,
+                             extra,
+                             useSrcFile,
+                             cpSrcName,
+                             cpSrcNameLen,
+                             srcFile,
+                             srcCaseFlags)) {
+      LOG(4, ("%s: Error decoding HGFS packet\n", __FUNCTION__));
+      return FALSE;
+   }
+   if (*useSrcFile) {
+      targetName = &requestV4->targetName;
+   } else {
+      targetName = (const HgfsFileNameV3 *)(requestV4->srcName.name + 1 +
+                                            *cpSrcNameLen);
+      extra -= *cpSrcNameLen;
+   }
+   if (!HgfsUnpackFileNameV3(targetName,
+                             extra,
+                             useTargetFile,
+                             cpTargetName,
+                             cpTargetNameLen,
+                             targetFile,
+                             targetCaseFlags)) {
+      LOG(4, ("%s: Error decoding HGFS packet\n", __FUNCTION__));
+      return FALSE;
+   }
+
+   LOG(8, ("%s: unpacking HGFS_OP_COPY_FILE_V4 -> success\n", __FUNCTION__));
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPackCopyFileReply --
+ *
+ *    Pack hgfs copy file reply.
+ *
+ * Results:
+ *    TRUE if valid op and reply set, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsPackCopyFileReply(HgfsPacket *packet,        // IN/OUT: Hgfs Packet
+                      const void *packetHeader,  // IN: packet header
+                      uint64 size,               // IN: bytes copied
+                      uint64 nextOffset,         // IN: offset to continue at
+                      size_t *payloadSize,       // OUT: size of packet
+                      HgfsSessionInfo *session)  // IN: Session info
+{
+   HgfsReplyCopyFileV4 *reply;
+
+   HGFS_ASSERT_PACK_PARAMS;
+
+   reply = HgfsAllocInitReply(packet, packetHeader, sizeof *reply, session);
+   reply->size = size;
+   reply->nextOffset = nextOffset;
+   *payloadSize = sizeof *reply;
+
+   return TRUE;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -120,6 +120,30 @@ HgfsPackRenameReply(HgfsPacket *packet,         // IN/OUT: Hgfs Packet
                     size_t *payloadSize,        // OUT: size of packet
                     HgfsSessionInfo *session);  // IN: Session Info
 
+Bool
+HgfsUnpackCopyFileRequest(const void *packet,         // IN: request packet
+                          size_t packetSize,          // IN: request packet size
+                          const char **cpSrcName,     // OUT: copy src
+                          size_t *cpSrcNameLen,       // OUT: copy src size
+                          const char **cpTargetName,  // OUT: copy dst
+                          size_t *cpTargetNameLen,    // OUT: copy dst size
+                          HgfsCopyFileFlags *flags,   // OUT: copy flags
+                          uint64 *offset,             // OUT: offset to continue at
+                          Bool *useSrcFile,           // OUT: src is a handle
+                          HgfsHandle *srcFile,        // OUT: src file handle
+                          Bool *useTargetFile,        // OUT: dst is a handle
+                          HgfsHandle *targetFile,     // OUT: target file handle
+                          uint32 *srcCaseFlags,       // OUT: src case-sensitivity flags
+                          uint32 *targetCaseFlags);   // OUT: dst case-sensitivity flags
+
+Bool
+HgfsPackCopyFileReply(HgfsPacket *packet,         // IN/OUT: Hgfs Packet
+                      const void *packetHeader,   // IN: packet header
+                      uint64 size,                // IN: bytes copied
+                      uint64 nextOffset,          // IN: offset to continue at
+                      size_t *payloadSize,        // OUT: size of packet
+                      HgfsSessionInfo *session);  // IN: Session Info
+
 Bool
 HgfsPackGetattrReply(HgfsPacket *packet,          // IN/OUT: Hgfs packet
                      const void *packetHeader,    // IN: packet header
@@ -0,0 +1,267 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsServerStats.c --
+ *
+ *    Server statistics: for every operation the number of requests, errors,
+ *    bytes received and sent and a latency histogram, and gauges of the open
+ *    nodes and searches of all sessions.
+ *
+ *    Counters are updated with atomic operations only, so that recording
+ *    takes no lock on the request path. A snapshot reads them one at a time
+ *    and is therefore not exactly consistent, which is fine for statistics.
+ */
+
+#include "vmware.h"
+#include "vm_atomic.h"
+#include "hgfsServerInt.h"
+
+typedef struct HgfsServerOpCounters {
+   Atomic_uint64 requests;
+   Atomic_uint64 errors;
+   Atomic_uint64 bytesIn;
+   Atomic_uint64 bytesOut;
+   Atomic_uint64 latency[HGFS_STATS_LATENCY_BUCKETS];
+} HgfsServerOpCounters;
+
+static HgfsServerOpCounters gHgfsOpCounters[HGFS_OP_MAX];
+static Atomic_uint64 gHgfsStatsCounters[HGFS_STATS_COUNTER_MAX];
+
+/* Operation names, in HgfsOp order. */
+static const char *const gHgfsOpNames[] = {
+   "OPEN",
+   "READ",
+   "WRITE",
+   "CLOSE",
+   "SEARCH_OPEN",
+   "SEARCH_READ",
+   "SEARCH_CLOSE",
+   "GETATTR",
+   "SETATTR",
+   "CREATE_DIR",
+   "DELETE_FILE",
+   "DELETE_DIR",
+   "RENAME",
+   "QUERY_VOLUME_INFO",
+   "OPEN_V2",
+   "GETATTR_V2",
+   "SETATTR_V2",
+   "SEARCH_READ_V2",
+   "CREATE_SYMLINK",
+   "SERVER_LOCK_CHANGE",
+   "CREATE_DIR_V2",
+   "DELETE_FILE_V2",
+   "DELETE_DIR_V2",
+   "RENAME_V2",
+   "OPEN_V3",
+   "READ_V3",
+   "WRITE_V3",
+   "CLOSE_V3",
+   "SEARCH_OPEN_V3",
+   "SEARCH_READ_V3",
+   "SEARCH_CLOSE_V3",
+   "GETATTR_V3",
+   "SETATTR_V3",
+   "CREATE_DIR_V3",
+   "DELETE_FILE_V3",
+   "DELETE_DIR_V3",
+   "RENAME_V3",
+   "QUERY_VOLUME_INFO_V3",
+   "CREATE_SYMLINK_V3",
+   "SERVER_LOCK_CHANGE_V3",
+   "WRITE_WIN32_STREAM_V3",
+   "CREATE_SESSION_V4",
+   "DESTROY_SESSION_V4",
+   "READ_FAST_V4",
+   "WRITE_FAST_V4",
+   "SET_WATCH_V4",
+   "REMOVE_WATCH_V4",
+   "NOTIFY_V4",
+   "SEARCH_READ_V4",
+   "OPEN_V4",
+   "ENUMERATE_STREAMS_V4",
+   "GETATTR_V4",
+   "SETATTR_V4",
+   "DELETE_V4",
+   "LINKMOVE_V4",
+   "FSCTL_V4",
+   "ACCESS_CHECK_V4",
+   "FSYNC_V4",
+   "QUERY_VOLUME_INFO_V4",
+   "OPLOCK_ACQUIRE_V4",
+   "OPLOCK_BREAK_V4",
+   "LOCK_BYTE_RANGE_V4",
+   "UNLOCK_BYTE_RANGE_V4",
+   "QUERY_EAS_V4",
+   "SET_EAS_V4",
+   "COPY_FILE_V4",
+};
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStatsRecordOp --
+ *
+ *    Account a completed request.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServerStatsRecordOp(HgfsOp op,                   // IN: operation
+                        HgfsInternalStatus status,   // IN: request status
+                        uint64 bytesIn,              // IN: request size
+                        uint64 bytesOut,             // IN: reply size
+                        uint64 latencyUS)            // IN: time to reply
+{
+   HgfsServerOpCounters *counters;
+   uint64 bucketLimit = HGFS_STATS_LATENCY_MIN_US;
+   uint32 bucket = 0;
+
+   if (op >= HGFS_OP_MAX) {
+      return;
+   }
+   counters = &gHgfsOpCounters[op];
+
+   while (latencyUS >= bucketLimit && bucket < HGFS_STATS_LATENCY_BUCKETS - 1) {
+      bucketLimit *= 2;
+      bucket++;
+   }
+
+   Atomic_Inc64(&counters->requests);
+   if (status != HGFS_ERROR_SUCCESS) {
+      Atomic_Inc64(&counters->errors);
+   }
+   Atomic_Add64(&counters->bytesIn, bytesIn);
+   Atomic_Add64(&counters->bytesOut, bytesOut);
+   Atomic_Inc64(&counters->latency[bucket]);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStatsInc --
+ * HgfsServerStatsDec --
+ *
+ *    Count up or down a gauge, or count up a counter.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServerStatsInc(HgfsServerStatsCounter counter)  // IN: counter
+{
+   ASSERT(counter < HGFS_STATS_COUNTER_MAX);
+   Atomic_Inc64(&gHgfsStatsCounters[counter]);
+}
+
+void
+HgfsServerStatsDec(HgfsServerStatsCounter counter)  // IN: gauge
+{
+   ASSERT(counter < HGFS_STATS_COUNTER_MAX);
+   ASSERT(counter == HGFS_STATS_OPEN_NODES ||
+          counter == HGFS_STATS_CACHED_NODES ||
+          counter == HGFS_STATS_SEARCHES);
+   Atomic_Dec64(&gHgfsStatsCounters[counter]);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServer_GetStats --
+ *
+ *    Take a snapshot of the server statistics.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServer_GetStats(HgfsServerStats *stats)  // OUT: statistics
+{
+   uint32 op;
+   uint32 i;
+
+   for (op = 0; op < HGFS_OP_MAX; op++) {
+      HgfsServerOpCounters *counters = &gHgfsOpCounters[op];
+      HgfsServerOpStats *opStats = &stats->ops[op];
+
+      opStats->requests = Atomic_Read64(&counters->requests);
+      opStats->errors = Atomic_Read64(&counters->errors);
+      opStats->bytesIn = Atomic_Read64(&counters->bytesIn);
+      opStats->bytesOut = Atomic_Read64(&counters->bytesOut);
+      for (i = 0; i < HGFS_STATS_LATENCY_BUCKETS; i++) {
+         opStats->latency[i] = Atomic_Read64(&counters->latency[i]);
+      }
+   }
+
+   stats->openNodes = Atomic_Read64(&gHgfsStatsCounters[HGFS_STATS_OPEN_NODES]);
+   stats->cachedNodes = Atomic_Read64(&gHgfsStatsCounters[HGFS_STATS_CACHED_NODES]);
+   stats->searches = Atomic_Read64(&gHgfsStatsCounters[HGFS_STATS_SEARCHES]);
+   stats->lruEvictions = Atomic_Read64(&gHgfsStatsCounters[HGFS_STATS_LRU_EVICTIONS]);
+   stats->cacheHits = Atomic_Read64(&gHgfsStatsCounters[HGFS_STATS_CACHE_HITS]);
+   stats->cacheMisses = Atomic_Read64(&gHgfsStatsCounters[HGFS_STATS_CACHE_MISSES]);
+   stats->bufPoolHits = Atomic_Read64(&gHgfsStatsCounters[HGFS_STATS_BUF_POOL_HITS]);
+   stats->bufPoolMisses = Atomic_Read64(&gHgfsStatsCounters[HGFS_STATS_BUF_POOL_MISSES]);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServer_OpName --
+ *
+ *    Get the name of an operation, without the HGFS_OP_ prefix.
+ *
+ * Results:
+ *    The name, "UNKNOWN" for an invalid operation.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+const char *
+HgfsServer_OpName(HgfsOp op)  // IN: operation
+{
+   ASSERT_ON_COMPILE(ARRAYSIZE(gHgfsOpNames) == HGFS_OP_MAX);
+
+   return op < HGFS_OP_MAX ? gHgfsOpNames[op] : "UNKNOWN";
+}
@@ -28,6 +28,8 @@
 #include "vm_assert.h"
 #include "vm_atomic.h"
 #include "util.h"
+#include "conf.h"
+#include "vmware/tools/utils.h"
 #include "hgfsChannelGuestInt.h"
 #include "hgfsServer.h"
 #include "hgfsServerManager.h"
@@ -96,6 +98,10 @@ static HgfsChannelData gHgfsChannels[] = {
    { "guest", &gGuestBackdoorOps, 0, NULL, NULL, {0} },
 };
 
+/*
+ * Cache hints (HGFS_CONFIG_CACHE_HINTS_ENABLED) are added from tools.conf,
+ * see HgfsChannelInitServer.
+ */
 static HgfsServerConfig gHgfsGuestCfgSettings = {
    (HGFS_CONFIG_SHARE_ALL_HOST_DRIVES_ENABLED | HGFS_CONFIG_VOL_INFO_MIN),
    HGFS_MAX_CACHED_FILENODES
@@ -175,7 +181,8 @@ HgfsChannelPutServer(HgfsChannelServerData *serverInfo)   // IN/OUT: ref count
  *
  * HgfsChannelInitServer --
  *
- *      Initialize HGFS server and save the state.
+ *      Initialize HGFS server and save the state. Cache hints are enabled
+ *      by hgfsServer.cache-hints in tools.conf.
  *
  * Results:
  *      TRUE if success, FALSE otherwise.
@@ -190,15 +197,32 @@ static Bool
 HgfsChannelInitServer(HgfsServerMgrCallbacks *mgrCb,       // IN: server manager callbacks
                       HgfsChannelServerData *serverInfo)   // IN/OUT: ref count
 {
+   HgfsServerConfig cfgSettings = gHgfsGuestCfgSettings;
+   GKeyFile *config = NULL;
    Bool result;
 
    ASSERT(NULL == serverInfo->serverCBTable);
 
    Debug("%s: Initialize Hgfs server.\n", __FUNCTION__);
 
+   /*
+    * The server is shared by the plugins of the process, so read the
+    * settings from tools.conf rather than from whichever plugin is first.
+    */
+   VMTools_LoadConfig(NULL, G_KEY_FILE_NONE, &config, NULL);
+   if (VMTools_ConfigGetBoolean(config,
+                                CONFGROUPNAME_HGFSSERVER,
+                                CONFNAME_HGFSSERVER_CACHEHINTS,
+                                FALSE)) {
+      cfgSettings.flags |= HGFS_CONFIG_CACHE_HINTS_ENABLED;
+   }
+   if (NULL != config) {
+      g_key_file_free(config);
+   }
+
    /* If we have a new connection initialize the server session with default settings. */
    result = HgfsServer_InitState(&serverInfo->serverCBTable,
-                                 &gHgfsGuestCfgSettings,
+                                 &cfgSettings,
                                  mgrCb);
    if (!result) {
       Debug("%s: Could not init Hgfs server.\n", __FUNCTION__);
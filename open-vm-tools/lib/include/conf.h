@@ -233,6 +233,38 @@
  */
 
 
+/*
+ ******************************************************************************
+ * BEGIN HgfsServer goodies.
+ */
+
+/**
+ * Defines the string used for the HGFS server config file group.
+ */
+#define CONFGROUPNAME_HGFSSERVER "hgfsServer"
+
+/**
+ * Define how often (in seconds) the HGFS server logs its statistics.
+ *
+ * @param int   User-defined interval. 0, the default, disables the log.
+ */
+#define CONFNAME_HGFSSERVER_STATSLOGINTERVAL "stats-log-interval"
+
+/**
+ * Lets the HGFS server advise the guest page cache of the access pattern
+ * of the files it serves, and write streamed writes back as they go. Read
+ * when the server starts.
+ *
+ * @param boolean Set to TRUE to enable the hints. FALSE by default.
+ */
+#define CONFNAME_HGFSSERVER_CACHEHINTS "cache-hints"
+
+/*
+ * END HgfsServer goodies.
+ ******************************************************************************
+ */
+
+
 /** Where to find Tools data in the Win32 registry. */
 #define CONF_VMWARE_TOOLS_REGKEY    "Software\\VMware, Inc.\\VMware Tools"
 
@@ -239,6 +239,11 @@ typedef enum {
 #define HGFS_SYNC_REQREP_CLIENT_CMD HGFS_SYNC_REQREP_CMD " "
 #define HGFS_SYNC_REQREP_CLIENT_CMD_LEN (sizeof HGFS_SYNC_REQREP_CLIENT_CMD - 1)
 
+/*
+ * RpcIn command returning the statistics of the guest HGFS server, as text.
+ */
+#define HGFS_STATS_CMD "hgfs.stats"
+
 /*
  * This is just for the sake of macro naming. Since we are guaranteed
  * equal command lengths, defining command length via a generalized macro name
@@ -146,6 +146,7 @@ typedef enum {
    HGFS_OP_UNLOCK_BYTE_RANGE_V4,  /* Release byte range lock. */
    HGFS_OP_QUERY_EAS_V4,          /* Query extended attributes. */
    HGFS_OP_SET_EAS_V4,            /* Add or modify extended attributes. */
+   HGFS_OP_COPY_FILE_V4,          /* Copy a file on the host. */
 
    HGFS_OP_MAX,                   /* Dummy op, must be last in enum */
    HGFS_OP_NEW_HEADER = 0xff,     /* Header op, must be unique, distinguishes packet headers. */
@@ -2714,4 +2715,43 @@ struct HgfsReplyDeleteFileV4 {
 #include "vmware_pack_end.h"
 HgfsReplyDeleteFileV4;
 
+/*
+ * Copy of a file done by the host, to another name in the same or another
+ * share: the file data does not go through the client. The source and
+ * target are each a name or, with HGFS_FILE_NAME_USE_FILE_DESC, an open
+ * file. The target is created or, unless HGFS_COPY_FILE_NO_REPLACE_EXISTING
+ * is set, truncated and overwritten. Only sent to servers reporting the
+ * HGFS_OP_COPY_FILE_V4 capability.
+ *
+ * The server copies a bounded amount of data per request. A reply with a
+ * non-zero nextOffset means the copy is not complete yet: the client sends
+ * the request again with HGFS_COPY_FILE_CONTINUE and that offset, which
+ * carries on into the existing target without truncating it.
+ */
+
+typedef uint32 HgfsCopyFileFlags;
+#define HGFS_COPY_FILE_NO_REPLACE_EXISTING   (1 << 0)
+#define HGFS_COPY_FILE_CONTINUE              (1 << 1)
+
+typedef
+#include "vmware_pack_begin.h"
+struct HgfsRequestCopyFileV4 {
+   HgfsCopyFileFlags flags;
+   uint32 reserved1;              /* Reserved for future use */
+   uint64 offset;                 /* With HGFS_COPY_FILE_CONTINUE. */
+   HgfsFileNameV3 srcName;
+   HgfsFileNameV3 targetName;     /* Follows the variable length srcName. */
+}
+#include "vmware_pack_end.h"
+HgfsRequestCopyFileV4;
+
+typedef
+#include "vmware_pack_begin.h"
+struct HgfsReplyCopyFileV4 {
+   uint64 size;                   /* Bytes copied by this request. */
+   uint64 nextOffset;             /* Where to continue, 0 once complete. */
+}
+#include "vmware_pack_end.h"
+HgfsReplyCopyFileV4;
+
 #endif /* _HGFS_PROTO_H_ */
@@ -20,6 +20,7 @@
 #define _HGFS_SERVER_H_
 
 #include "hgfs.h"             /* for HGFS_PACKET_MAX */
+#include "hgfsProto.h"        /* for HgfsOp */
 #include "dbllnklst.h"
 
 #if defined(__cplusplus)
@@ -120,6 +121,7 @@ typedef uint32 HgfsConfigFlags;
 #define HGFS_CONFIG_VOL_INFO_MIN                     (1 << 2)
 #define HGFS_CONFIG_OPLOCK_ENABLED                   (1 << 3)
 #define HGFS_CONFIG_SHARE_ALL_HOST_DRIVES_ENABLED    (1 << 4)
+#define HGFS_CONFIG_CACHE_HINTS_ENABLED              (1 << 5)
 
 typedef struct HgfsServerConfig {
    HgfsConfigFlags flags;
@@ -217,6 +219,39 @@ Bool HgfsServer_ShareAccessCheck(HgfsOpenMode accessMode,
 uint32 HgfsServer_GetHandleCounter(void);
 void HgfsServer_SetHandleCounter(uint32 newHandleCounter);
 
+/*
+ * Server statistics, since the library was loaded.
+ *
+ * Request latencies are counted in HGFS_STATS_LATENCY_BUCKETS buckets: the
+ * first for requests taking less than HGFS_STATS_LATENCY_MIN_US, each next
+ * one up to twice as long, and the last for all the slower ones.
+ */
+#define HGFS_STATS_LATENCY_BUCKETS   12
+#define HGFS_STATS_LATENCY_MIN_US    16
+
+typedef struct HgfsServerOpStats {
+   uint64 requests;
+   uint64 errors;
+   uint64 bytesIn;
+   uint64 bytesOut;
+   uint64 latency[HGFS_STATS_LATENCY_BUCKETS];
+} HgfsServerOpStats;
+
+typedef struct HgfsServerStats {
+   HgfsServerOpStats ops[HGFS_OP_MAX];
+   uint64 openNodes;       /* Open file nodes, of all sessions. */
+   uint64 cachedNodes;     /* Of which have an open file descriptor. */
+   uint64 searches;        /* Open searches, of all sessions. */
+   uint64 lruEvictions;    /* Descriptors closed to cache others. */
+   uint64 cacheHits;       /* Descriptor lookups finding it open... */
+   uint64 cacheMisses;     /* ...and having to reopen the file. */
+   uint64 bufPoolHits;     /* Packet buffers reused from a pool... */
+   uint64 bufPoolMisses;   /* ...and allocated. */
+} HgfsServerStats;
+
+void HgfsServer_GetStats(HgfsServerStats *stats);
+const char *HgfsServer_OpName(HgfsOp op);
+
 #if defined(__cplusplus)
 }  // extern "C"
 #endif
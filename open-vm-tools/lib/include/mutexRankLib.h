@@ -58,11 +58,14 @@ extern "C" {
  * hgfs locks
  */
 #define RANK_hgfsSessionArrayLock    (RANK_libLockBase + 0x4010)
+#define RANK_hgfsNotifyDispatchLock  (RANK_libLockBase + 0x4020)
 #define RANK_hgfsSharedFolders       (RANK_libLockBase + 0x4030)
 #define RANK_hgfsNotifyLock          (RANK_libLockBase + 0x4040)
 #define RANK_hgfsFileIOLock          (RANK_libLockBase + 0x4050)
 #define RANK_hgfsSearchArrayLock     (RANK_libLockBase + 0x4060)
 #define RANK_hgfsNodeArrayLock       (RANK_libLockBase + 0x4070)
+#define RANK_hgfsCaseCacheLock       (RANK_libLockBase + 0x4080)
+#define RANK_hgfsBufPoolLock         (RANK_libLockBase + 0x40B0)
 
 /*
  * vigor (must be < VMDB range and < disklib, see bug 741290)
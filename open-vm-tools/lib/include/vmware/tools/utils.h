@@ -191,6 +191,9 @@ VMTools_SuspendLogIO(void);
 void
 VMTools_ResumeLogIO(void);
 
+gboolean
+VMTools_IsDebugLogEnabled(void);
+
 GArray *
 VMTools_WrapArray(gconstpointer data,
                   guint elemSize,
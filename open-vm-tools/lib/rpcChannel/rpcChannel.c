@@ -35,7 +35,6 @@
 #endif
 
 #include "str.h"
-#include "strutil.h"
 #include "util.h"
 #include "vm_assert.h"
 
@@ -89,6 +88,57 @@ static RpcChannelCallback gRpcHandlers[] =  {
    { "ping", RpcChannelPing, NULL, NULL, NULL, 0 }
 };
 
+/**
+ * Key of the registered RPCs table: a name that does not need to be
+ * NUL-terminated, so that incoming commands can be looked up in place.
+ */
+typedef struct RpcChannelKey {
+   const char *name;
+   size_t      len;
+} RpcChannelKey;
+
+/**
+ * Hashes an RPC name, the same way as g_str_hash().
+ *
+ * @param[in]  _key     The RpcChannelKey.
+ *
+ * @return The hash value.
+ */
+
+static guint
+RpcChannelKeyHash(gconstpointer _key)
+{
+   const RpcChannelKey *key = _key;
+   guint hash = 5381;
+   size_t i;
+
+   for (i = 0; i < key->len; i++) {
+      hash = (hash << 5) + hash + (guchar) key->name[i];
+   }
+   return hash;
+}
+
+
+/**
+ * Compares two RPC names.
+ *
+ * @param[in]  _a       An RpcChannelKey.
+ * @param[in]  _b       Another RpcChannelKey.
+ *
+ * @return Whether the names are the same.
+ */
+
+static gboolean
+RpcChannelKeyEqual(gconstpointer _a,
+                   gconstpointer _b)
+{
+   const RpcChannelKey *a = _a;
+   const RpcChannelKey *b = _b;
+
+   return a->len == b->len && memcmp(a->name, b->name, a->len) == 0;
+}
+
+
 /**
  * Handler for a "ping" message. Does nothing.
  *
@@ -376,35 +426,48 @@ exit:
 gboolean
 RpcChannel_Dispatch(RpcInData *data)
 {
-   char *name = NULL;
-   unsigned int index = 0;
-   size_t nameLen;
+   RpcChannelKey key;
+   const char *end;
+   const char *argsEnd = data->args + data->argsSize;
    Bool status;
    RpcChannelCallback *rpc = NULL;
    RpcChannelInt *chan = data->clientData;
 
-   name = StrUtil_GetNextToken(&index, data->args, " ");
-   if (name == NULL) {
+   /*
+    * Find the command name in place: the first token of the message, as
+    * StrUtil_GetNextToken() would return it.
+    */
+   key.name = data->args;
+   while (key.name < argsEnd && *key.name == ' ') {
+      key.name++;
+   }
+   end = key.name;
+   while (end < argsEnd && *end != ' ' && *end != '\0') {
+      end++;
+   }
+   key.len = end - key.name;
+
+   if (key.len == 0) {
       Debug(LGPFX "Bad command (null) received.\n");
       status = RPCIN_SETRETVALS(data, "Bad command", FALSE);
       goto exit;
    }
 
    if (chan->rpcs != NULL) {
-      rpc = g_hash_table_lookup(chan->rpcs, name);
+      rpc = g_hash_table_lookup(chan->rpcs, &key);
    }
 
    if (rpc == NULL) {
-      Debug(LGPFX "Unknown Command '%s': Handler not registered.\n", name);
+      Debug(LGPFX "Unknown Command '%.*s': Handler not registered.\n",
+            (int) key.len, key.name);
       status = RPCIN_SETRETVALS(data, "Unknown Command", FALSE);
       goto exit;
    }
 
    /* Adjust the RPC arguments. */
-   nameLen = strlen(name);
-   data->name = name;
-   data->args = data->args + nameLen;
-   data->argsSize -= nameLen;
+   data->name = rpc->name;
+   data->argsSize -= end - data->args;
+   data->args = end;
    data->appCtx = chan->appCtx;
    data->clientData = rpc->clientData;
 
@@ -418,7 +481,6 @@ RpcChannel_Dispatch(RpcInData *data)
 
 exit:
    data->name = NULL;
-   free(name);
    return status;
 }
 
@@ -495,16 +557,24 @@ RpcChannel_RegisterCallback(RpcChannel *chan,
                             RpcChannelCallback *rpc)
 {
    RpcChannelInt *cdata = (RpcChannelInt *) chan;
+   RpcChannelKey *key;
+
    ASSERT(rpc->name != NULL && strlen(rpc->name) > 0);
+   ASSERT(strchr(rpc->name, ' ') == NULL);
    ASSERT(rpc->callback);
    ASSERT(rpc->xdrIn == NULL || rpc->xdrInSize > 0);
    if (cdata->rpcs == NULL) {
-      cdata->rpcs = g_hash_table_new(g_str_hash, g_str_equal);
+      cdata->rpcs = g_hash_table_new_full(RpcChannelKeyHash,
+                                          RpcChannelKeyEqual,
+                                          g_free, NULL);
    }
-   if (g_hash_table_lookup(cdata->rpcs, rpc->name) != NULL) {
+   key = g_new(RpcChannelKey, 1);
+   key->name = rpc->name;
+   key->len = strlen(rpc->name);
+   if (g_hash_table_lookup(cdata->rpcs, key) != NULL) {
       Panic("Trying to overwrite existing RPC registration for %s!\n", rpc->name);
    }
-   g_hash_table_insert(cdata->rpcs, (gpointer) rpc->name, rpc);
+   g_hash_table_insert(cdata->rpcs, key, rpc);
 }
 
 
@@ -522,7 +592,8 @@ RpcChannel_UnregisterCallback(RpcChannel *chan,
 {
    RpcChannelInt *cdata = (RpcChannelInt *) chan;
    if (cdata->rpcs != NULL) {
-      g_hash_table_remove(cdata->rpcs, rpc->name);
+      RpcChannelKey key = { rpc->name, strlen(rpc->name) };
+      g_hash_table_remove(cdata->rpcs, &key);
    }
 }
 
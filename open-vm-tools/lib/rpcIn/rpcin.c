@@ -72,6 +72,9 @@
 #if defined(VMTOOLS_USE_GLIB)
 #  include "vmware/tools/guestrpc.h"
 #  include "vmware/tools/utils.h"
+#  define RPCIN_DEBUG_ENABLED()  VMTools_IsDebugLogEnabled()
+#else
+#  define RPCIN_DEBUG_ENABLED()  TRUE
 #endif
 
 #include "vmware.h"
@@ -1596,11 +1599,16 @@ RpcInLoop(void *clientData) // IN
    }
 
    if (repLen) {
-      char *s = ByteDump(reply, repLen);
-      Debug("RpcIn: received %d bytes, content:\"%s\"\n", (int) repLen, s);
+      /* Escaping the message is costly, only do it if it gets logged. */
+      if (RPCIN_DEBUG_ENABLED()) {
+         Debug("RpcIn: received %d bytes, content:\"%s\"\n", (int) repLen,
+               ByteDump(reply, repLen));
+      }
 
       /* If reply is not a "reset", the channel is functioning. */
-      if (in->errStatus && strcmp(s, "reset") != 0) {
+      if (in->errStatus &&
+          (repLen != sizeof "reset" - 1 ||
+           memcmp(reply, "reset", repLen) != 0)) {
          RpcInClearErrorStatus(in);
       }
 
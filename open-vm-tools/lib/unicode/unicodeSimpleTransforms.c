@@ -22,8 +22,12 @@
  *      Simple UTF-8 implementation of unicodeTransforms.h interface.
  */
 
+#include <string.h>
+
 #include "vmware.h"
 
+#include "codeset.h"
+#include "util.h"
 #include "unicodeBase.h"
 #include "unicodeInt.h"
 #include "unicodeTransforms.h"
@@ -304,6 +308,9 @@ UnicodeSimpleIsWhiteSpace(utf16_t codeUnit) // IN
  *      simple case folding (upper-case, then lower-case) on the
  *      input string.
  *
+ *      ASCII strings, in which only A-Z fold, are folded as they are
+ *      copied rather than through UTF-16.
+ *
  * Results:
  *      The allocated Unicode string.  Caller must free with free().
  *
@@ -319,9 +326,24 @@ Unicode_FoldCase(const char *str) // IN
    char *folded;
    utf16_t *utf16;
    utf16_t *utf16Current;
+   size_t length;
 
    ASSERT(str);
 
+   length = strlen(str);
+   if (CodeSet_IsAscii(str, length)) {
+      size_t i;
+
+      folded = Util_SafeMalloc(length + 1);
+      for (i = 0; i <= length; i++) {
+         char c = str[i];
+
+         folded[i] = c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+      }
+
+      return folded;
+   }
+
    utf16 = Unicode_GetAllocBytes(str, STRING_ENCODING_UTF16);
 
    utf16Current = utf16;
@@ -1408,6 +1408,27 @@ VMTools_ResumeLogIO()
 }
 
 
+/**
+ * Tells whether messages logged with Debug() are written anywhere, so that
+ * callers can skip building expensive debug output. Errs on the side of
+ * TRUE when the configuration is not known, as in Guestlib SDK mode.
+ *
+ * @return Whether debug logging is enabled for the default domain.
+ */
+
+gboolean
+VMTools_IsDebugLogEnabled(void)
+{
+   if (gGuestSDKMode) {
+      return TRUE;
+   }
+   if (!gLogInitialized || !gLogEnabled) {
+      return FALSE;
+   }
+   return gDefaultData == NULL || (gDefaultData->mask & G_LOG_LEVEL_DEBUG) != 0;
+}
+
+
 /**
  * Called if vmtools lib is used along with Guestlib SDK.
  */
@@ -1432,8 +1453,10 @@ Debug(const char *fmt, ...)
    va_start(args, fmt);
    if (gGuestSDKMode) {
       GuestSDK_Debug(fmt, args);
-   } else {
+   } else if (VMTools_IsDebugLogEnabled()) {
       /*
+       * Only format the message if it is going to be logged.
+       *
        * Preserve errno/lastError.
        * This keeps compatibility with bora/lib Log(), preventing
        * Log() calls in bora/lib code from clobbering errno/lastError.
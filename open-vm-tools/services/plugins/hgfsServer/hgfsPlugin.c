@@ -32,7 +32,10 @@
 #define G_LOG_DOMAIN "hgfsd"
 
 #include "hgfs.h"
+#include "hgfsServer.h"
 #include "hgfsServerManager.h"
+#include "conf.h"
+#include "util.h"
 #include "vm_basic_defs.h"
 #include "vm_assert.h"
 #include "vm_vmx_type.h"
@@ -71,6 +74,10 @@ static void HgfsServerClientRdrSetEvent(void);
 #endif // defined(_WIN32)
 static void HgfsServerCloseClientRdrEvent(void);
 
+/* Periodic statistics log, see HgfsServerStatsLogConfig. */
+static GSource *gStatsLogSource = NULL;
+static gint gStatsLogInterval = 0;
+
 /**
  * Clean up internal state on shutdown.
  *
@@ -85,6 +92,11 @@ HgfsServerShutdown(gpointer src,
                    ToolsPluginData *plugin)
 {
    HgfsServerMgrData *mgrData = plugin->_private;
+
+   if (gStatsLogSource != NULL) {
+      g_source_destroy(gStatsLogSource);
+      gStatsLogSource = NULL;
+   }
    HgfsServerManager_Unregister(mgrData);
    g_free(mgrData);
    HgfsServerCloseClientRdrEvent();
@@ -123,6 +135,167 @@ HgfsServerRpcDispatch(RpcInData *data)
 }
 
 
+/**
+ * Formats the HGFS server statistics: the node, search, cache and buffer
+ * pool counters, then a line per operation used with its request, error and byte counts,
+ * latency percentiles from the histogram and the histogram itself.
+ *
+ * @return The statistics text, free with g_free.
+ */
+
+static gchar *
+HgfsServerStatsFormat(void)
+{
+   HgfsServerStats *stats = g_malloc(sizeof *stats);
+   GString *text = g_string_new(NULL);
+   guint op;
+
+   HgfsServer_GetStats(stats);
+
+   g_string_append_printf(text,
+                          "nodes %" G_GUINT64_FORMAT
+                          " cached %" G_GUINT64_FORMAT
+                          " searches %" G_GUINT64_FORMAT
+                          " evictions %" G_GUINT64_FORMAT
+                          " hits %" G_GUINT64_FORMAT
+                          " misses %" G_GUINT64_FORMAT
+                          " buffer hits %" G_GUINT64_FORMAT
+                          " misses %" G_GUINT64_FORMAT "\n",
+                          stats->openNodes, stats->cachedNodes,
+                          stats->searches, stats->lruEvictions,
+                          stats->cacheHits, stats->cacheMisses,
+                          stats->bufPoolHits, stats->bufPoolMisses);
+
+   for (op = 0; op < HGFS_OP_MAX; op++) {
+      const HgfsServerOpStats *opStats = &stats->ops[op];
+      guint64 seen = 0;
+      guint64 p50 = 0;
+      guint64 p99 = 0;
+      guint i;
+
+      if (opStats->requests == 0) {
+         continue;
+      }
+
+      /* Upper bounds of the buckets reaching the percentiles. */
+      for (i = 0; i < HGFS_STATS_LATENCY_BUCKETS; i++) {
+         guint64 limit = (guint64)HGFS_STATS_LATENCY_MIN_US << i;
+
+         seen += opStats->latency[i];
+         if (p50 == 0 && seen * 2 >= opStats->requests) {
+            p50 = limit;
+         }
+         if (p99 == 0 && seen * 100 >= opStats->requests * 99) {
+            p99 = limit;
+         }
+      }
+
+      g_string_append_printf(text,
+                             "%s requests %" G_GUINT64_FORMAT
+                             " errors %" G_GUINT64_FORMAT
+                             " in %" G_GUINT64_FORMAT
+                             " out %" G_GUINT64_FORMAT
+                             " p50 <%" G_GUINT64_FORMAT "us"
+                             " p99 <%" G_GUINT64_FORMAT "us latency",
+                             HgfsServer_OpName(op), opStats->requests,
+                             opStats->errors, opStats->bytesIn,
+                             opStats->bytesOut, p50, p99);
+      for (i = 0; i < HGFS_STATS_LATENCY_BUCKETS; i++) {
+         g_string_append_printf(text, " %" G_GUINT64_FORMAT,
+                                opStats->latency[i]);
+      }
+      g_string_append_c(text, '\n');
+   }
+
+   g_free(stats);
+   return g_string_free(text, FALSE);
+}
+
+
+/**
+ * Returns the HGFS server statistics.
+ *
+ * @param[in]  data  RPC request data.
+ *
+ * @return TRUE.
+ */
+
+static gboolean
+HgfsServerStatsRpc(RpcInData *data)
+{
+   gchar *text = HgfsServerStatsFormat();
+   char *result = Util_SafeStrdup(text);
+
+   g_free(text);
+   return RPCIN_SETRETVALSF(data, result, TRUE);
+}
+
+
+/**
+ * Logs the HGFS server statistics.
+ *
+ * @param[in]  data  Unused.
+ *
+ * @return TRUE, to keep logging.
+ */
+
+static gboolean
+HgfsServerStatsLog(gpointer data)
+{
+   gchar *text = HgfsServerStatsFormat();
+
+   g_message("HGFS server statistics:\n%s", text);
+   g_free(text);
+   return TRUE;
+}
+
+
+/**
+ * Starts, restarts or stops the periodic statistics log according to the
+ * configured interval.
+ *
+ * @param[in]  src      The source object.
+ * @param[in]  ctx      The app context.
+ * @param[in]  data     Unused.
+ */
+
+static void
+HgfsServerStatsLogConfig(gpointer src,
+                         ToolsAppCtx *ctx,
+                         gpointer data)
+{
+   gint interval = VMTools_ConfigGetInteger(ctx->config,
+                                            CONFGROUPNAME_HGFSSERVER,
+                                            CONFNAME_HGFSSERVER_STATSLOGINTERVAL,
+                                            0);
+
+   if (interval < 0) {
+      g_warning("Invalid %s.%s value: %d. Disabling the statistics log.\n",
+                CONFGROUPNAME_HGFSSERVER,
+                CONFNAME_HGFSSERVER_STATSLOGINTERVAL,
+                interval);
+      interval = 0;
+   }
+
+   if (interval == gStatsLogInterval) {
+      return;
+   }
+
+   if (gStatsLogSource != NULL) {
+      g_source_destroy(gStatsLogSource);
+      gStatsLogSource = NULL;
+   }
+
+   gStatsLogInterval = interval;
+   if (gStatsLogInterval > 0) {
+      gStatsLogSource = g_timeout_source_new_seconds(gStatsLogInterval);
+      VMTOOLSAPP_ATTACH_SOURCE(ctx, gStatsLogSource, HgfsServerStatsLog,
+                               NULL, NULL);
+      g_source_unref(gStatsLogSource);
+   }
+}
+
+
 /**
  * Sends the HGFS capability to the VMX.
  *
@@ -1133,10 +1306,12 @@ ToolsOnLoad(ToolsAppCtx *ctx)
 
    {
       RpcChannelCallback rpcs[] = {
-         { HGFS_SYNC_REQREP_CMD, HgfsServerRpcDispatch, mgrData, NULL, NULL, 0 }
+         { HGFS_SYNC_REQREP_CMD, HgfsServerRpcDispatch, mgrData, NULL, NULL, 0 },
+         { HGFS_STATS_CMD, HgfsServerStatsRpc, NULL, NULL, NULL, 0 }
       };
       ToolsPluginSignalCb sigs[] = {
          { TOOLS_CORE_SIG_CAPABILITIES, HgfsServerCapReg, &regData },
+         { TOOLS_CORE_SIG_CONF_RELOAD, HgfsServerStatsLogConfig, NULL },
          { TOOLS_CORE_SIG_SHUTDOWN, HgfsServerShutdown, &regData }
       };
       ToolsAppReg regs[] = {
@@ -1148,5 +1323,7 @@ ToolsOnLoad(ToolsAppCtx *ctx)
    }
    regData._private = mgrData;
 
+   HgfsServerStatsLogConfig(NULL, ctx, NULL);
+
    return &regData;
 }
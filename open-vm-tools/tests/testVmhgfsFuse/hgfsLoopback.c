@@ -0,0 +1,518 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsLoopback.c --
+ *
+ *   Loopback transport channel for vmhgfs-fuse. Requests are handed
+ *   straight to the guest HGFS server (lib/hgfsServer) running in the
+ *   same process, which serves the local file system through its "root"
+ *   share, so a local path /a/b is reached as HGFS_LOOPBACK_ROOT/a/b.
+ *
+ *   The channel replaces bdhandler.c at link time by providing its own
+ *   HgfsBdChannelInit. All channels share one server transport session,
+ *   the way all backdoor channels of a VM reach the same one on the host,
+ *   and call into it concurrently.
+ *
+ *   Like the backdoor, send returns with the request completed. The
+ *   session can instead advertise asynchronous requests, in which case
+ *   the channel is asynchronous too: send returns once the server has
+ *   the request, and the reply is delivered through the send callback of
+ *   the server to HgfsTransportProcessPacket. The guest server processes
+ *   every request synchronously, so the reply still arrives from within
+ *   send, but the client goes through its asynchronous reply path.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "module.h"
+#include "bdhandler.h"
+#include "transport.h"
+#include "hgfsServer.h"
+#include "hgfsServerPolicy.h"
+#include "hgfsLoopback.h"
+
+/* Same as the guest server of vmtoolsd, which shares the whole root. */
+static HgfsServerConfig loopbackServerConfig = {
+   HGFS_CONFIG_SHARE_ALL_HOST_DRIVES_ENABLED | HGFS_CONFIG_VOL_INFO_MIN |
+   HGFS_CONFIG_CACHE_HINTS_ENABLED,
+   HGFS_MAX_CACHED_FILENODES
+};
+
+/*
+ * Like the backdoor, requests and replies come in the client buffers. Data
+ * packets of the fast read and write ops are described as guest pages, as
+ * over a shared memory channel, see HgfsLoopback_SendData.
+ */
+static HgfsServerChannelData loopbackChannelData = {
+   HGFS_CHANNEL_SHARED_MEM,
+   HGFS_LARGE_PACKET_MAX
+};
+
+static const HgfsServerCallbacks *loopbackServerCb;
+static HgfsServerMgrCallbacks loopbackMgrCb;
+static HgfsServerChannelCallbacks loopbackChannelCb;
+static void *loopbackSession;
+static int loopbackConn;     /* Only its address is used, as session data. */
+static Bool loopbackAsync;
+
+/*
+ * A request in flight: its completion, and the server packet. The call
+ * of an asynchronous request is allocated with its reply buffer. The
+ * iovs of a data packet follow the packet.
+ */
+typedef struct HgfsLoopbackCall {
+   HgfsHandle id;            /* Request id, for an error reply. */
+   Bool async;
+   pthread_mutex_t lock;
+   pthread_cond_t replied;
+   Bool done;
+   HgfsPacket packet;        /* Must be last. */
+} HgfsLoopbackCall;
+
+#define HGFS_LOOPBACK_CALL(p) \
+   ((HgfsLoopbackCall *)((char *)(p) - offsetof(HgfsLoopbackCall, packet)))
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLoopbackMapVa --
+ *
+ *    Server callback mapping a guest page of a data packet. The "guest
+ *    physical address" is the address in this process.
+ *
+ * Results:
+ *    The address.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void *
+HgfsLoopbackMapVa(uint64 pa,        // IN: address
+                  uint32 size,      // IN: size, within a page
+                  void **context)   // OUT: mapping context
+{
+   *context = (void *)(uintptr_t)pa;
+   return (void *)(uintptr_t)pa;
+}
+
+
+static void
+HgfsLoopbackUnmapVa(void **context)  // IN/OUT: mapping context
+{
+   *context = NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLoopbackServerSend --
+ *
+ *    Server callback delivering a reply. The reply was built in the
+ *    buffer the request came with, and its size is left in the packet.
+ *    A synchronous sender is woken up to complete the request; an
+ *    asynchronous one is completed here, the way a channel receive
+ *    thread would.
+ *
+ * Results:
+ *    TRUE.
+ *
+ * Side effects:
+ *    Frees the call of an asynchronous request.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+HgfsLoopbackServerSend(void *conn,              // IN: loopbackConn
+                       HgfsPacket *packet,      // IN/OUT: packet
+                       HgfsSendFlags flags)     // IN: send flags
+{
+   HgfsLoopbackCall *call = HGFS_LOOPBACK_CALL(packet);
+
+   ASSERT(conn == &loopbackConn);
+   ASSERT(packet->replyPacketDataSize <= packet->replyPacketSize);
+
+   if (!(flags & HGFS_SEND_NO_COMPLETE)) {
+      loopbackServerCb->session.sendComplete(packet, loopbackSession);
+   }
+
+   if (call->async) {
+      if (packet->replyPacketDataSize > 0) {
+         HgfsTransportProcessPacket(packet->replyPacket,
+                                    packet->replyPacketDataSize);
+      } else {
+         HgfsReply reply;
+
+         reply.id = call->id;
+         reply.status = HGFS_STATUS_GENERIC_ERROR;
+         HgfsTransportProcessPacket((char *)&reply, sizeof reply);
+      }
+      free(call);
+      return TRUE;
+   }
+
+   /* The packet is gone once the sender wakes up. */
+   pthread_mutex_lock(&call->lock);
+   call->done = TRUE;
+   pthread_cond_signal(&call->replied);
+   pthread_mutex_unlock(&call->lock);
+   return TRUE;
+}
+
+
+static HgfsChannelStatus
+HgfsLoopbackChannelOpen(HgfsTransportChannel *channel)  // IN: channel
+{
+   channel->status = HGFS_CHANNEL_CONNECTED;
+   return channel->status;
+}
+
+
+static void
+HgfsLoopbackChannelClose(HgfsTransportChannel *channel)  // IN: channel
+{
+   channel->status = HGFS_CHANNEL_NOTCONNECTED;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLoopbackCallSync --
+ *
+ *    Has the server process the packet of a synchronous call, waits for
+ *    the reply and completes the request with it.
+ *
+ * Results:
+ *    0 on success, -EIO if the server gave no reply.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsLoopbackCallSync(HgfsLoopbackCall *call,  // IN: call, packet set up
+                     HgfsReq *req)            // IN/OUT: request
+{
+   HgfsPacket *packet = &call->packet;
+
+   pthread_mutex_init(&call->lock, NULL);
+   pthread_cond_init(&call->replied, NULL);
+   call->done = FALSE;
+
+   loopbackServerCb->session.receive(packet, loopbackSession);
+
+   pthread_mutex_lock(&call->lock);
+   while (!call->done) {
+      pthread_cond_wait(&call->replied, &call->lock);
+   }
+   pthread_mutex_unlock(&call->lock);
+   pthread_cond_destroy(&call->replied);
+   pthread_mutex_destroy(&call->lock);
+
+   if (packet->replyPacketDataSize == 0) {
+      return -EIO;
+   }
+   HgfsCompleteReq(req, packet->replyPacket, packet->replyPacketDataSize);
+   return 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLoopbackChannelSend --
+ *
+ *    Has the server process a request. A synchronous channel completes
+ *    the request with the reply. An asynchronous one marks it submitted
+ *    and returns, leaving the reply to HgfsLoopbackServerSend.
+ *
+ * Results:
+ *    0 on success, -ENOTCONN if the server is not running, -ENOMEM if
+ *    out of memory, -EIO if the server gave no reply.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsLoopbackChannelSend(HgfsTransportChannel *channel,  // IN: channel
+                        HgfsReq *req)                   // IN: request
+{
+   char *reply = channel->priv;
+   HgfsLoopbackCall syncCall;
+   HgfsLoopbackCall *call = &syncCall;
+   HgfsPacket *packet;
+
+   ASSERT(req->state == HGFS_REQ_STATE_UNSENT);
+
+   if (channel->status != HGFS_CHANNEL_CONNECTED || loopbackSession == NULL) {
+      return -ENOTCONN;
+   }
+
+   if (loopbackAsync) {
+      call = malloc(sizeof *call + HGFS_LARGE_PACKET_MAX);
+      if (call == NULL) {
+         return -ENOMEM;
+      }
+      reply = (char *)(call + 1);
+   }
+
+   call->async = loopbackAsync;
+   packet = &call->packet;
+   memset(packet, 0, sizeof *packet);
+   packet->iov[0].va = HGFS_REQ_PAYLOAD(req);
+   packet->iov[0].len = req->payloadSize;
+   packet->iovCount = 1;
+   packet->metaPacket = HGFS_REQ_PAYLOAD(req);
+   packet->metaPacketDataSize = req->payloadSize;
+   packet->metaPacketSize = req->payloadSize;
+   packet->replyPacket = reply;
+   packet->replyPacketSize = HGFS_LARGE_PACKET_MAX;
+   packet->state |= HGFS_STATE_CLIENT_REQUEST;
+
+   if (loopbackAsync) {
+      /* The reply may be processed before receive returns. */
+      call->id = req->id;
+      req->state = HGFS_REQ_STATE_SUBMITTED;
+      loopbackServerCb->session.receive(packet, loopbackSession);
+      return 0;
+   }
+
+   return HgfsLoopbackCallSync(call, req);
+}
+
+
+static void
+HgfsLoopbackChannelExit(HgfsTransportChannel *channel)  // IN: channel
+{
+   free(channel->priv);
+   free(channel);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsBdChannelInit --
+ *
+ *    Link-time replacement for the backdoor channel.
+ *
+ * Results:
+ *    A new loopback channel, NULL if out of memory.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+HgfsTransportChannel *
+HgfsBdChannelInit(void)
+{
+   HgfsTransportChannel *channel = calloc(1, sizeof *channel);
+   char *reply = loopbackAsync ? NULL : malloc(HGFS_LARGE_PACKET_MAX);
+
+   if (channel == NULL || (reply == NULL && !loopbackAsync)) {
+      free(channel);
+      free(reply);
+      return NULL;
+   }
+   channel->name = "loopback";
+   channel->ops.open = HgfsLoopbackChannelOpen;
+   channel->ops.close = HgfsLoopbackChannelClose;
+   channel->ops.send = HgfsLoopbackChannelSend;
+   channel->ops.recv = NULL;
+   channel->ops.exit = HgfsLoopbackChannelExit;
+   channel->status = HGFS_CHANNEL_NOTCONNECTED;
+   channel->priv = reply;
+   channel->async = loopbackAsync;
+   return channel;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLoopback_Init --
+ *
+ *    Starts the HGFS server and connects the transport session all
+ *    loopback channels use, advertising asynchronous requests if async.
+ *    Call before HgfsTransportInit.
+ *
+ * Results:
+ *    TRUE on success.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+Bool
+HgfsLoopback_Init(Bool async)  // IN: asynchronous requests
+{
+   loopbackAsync = async;
+   loopbackChannelData.flags = async ? HGFS_CHANNEL_ASYNC : 0;
+   if (!HgfsServerPolicy_Init(NULL, &loopbackMgrCb.enumResources)) {
+      return FALSE;
+   }
+   if (!HgfsServer_InitState(&loopbackServerCb, &loopbackServerConfig,
+                             &loopbackMgrCb)) {
+      HgfsServerPolicy_Cleanup();
+      return FALSE;
+   }
+
+   memset(&loopbackChannelCb, 0, sizeof loopbackChannelCb);
+   loopbackChannelCb.getReadVa = HgfsLoopbackMapVa;
+   loopbackChannelCb.getWriteVa = HgfsLoopbackMapVa;
+   loopbackChannelCb.putVa = HgfsLoopbackUnmapVa;
+   loopbackChannelCb.send = HgfsLoopbackServerSend;
+   if (!loopbackServerCb->session.connect(&loopbackConn, &loopbackChannelCb,
+                                          &loopbackChannelData,
+                                          &loopbackSession)) {
+      loopbackSession = NULL;
+      HgfsLoopback_Exit();
+      return FALSE;
+   }
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLoopback_SendData --
+ *
+ *    Has the server process a fast read or write request, with its data
+ *    in a separate buffer passed page by page, as over a shared memory
+ *    channel. The vmhgfs-fuse client never sends these ops, so the
+ *    request goes to the server synchronously, not through the
+ *    transport.
+ *
+ * Results:
+ *    0 on success with the reply in the request, -ENOTCONN if the server
+ *    is not running, -ENOMEM if out of memory, -EIO if the server gave
+ *    no reply.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HgfsLoopback_SendData(HgfsReq *req,     // IN/OUT: request, header packed
+                      char *data,       // IN/OUT: data to write or read
+                      size_t dataSize)  // IN: size of the data
+{
+   uint32 pages = (PAGE_OFFSET((uintptr_t)data) + dataSize + PAGE_SIZE - 1) /
+                  PAGE_SIZE;
+   HgfsLoopbackCall *call;
+   HgfsPacket *packet;
+   char *reply;
+   char *va;
+   uint32 i;
+   int res;
+
+   if (loopbackSession == NULL) {
+      return -ENOTCONN;
+   }
+
+   call = malloc(sizeof *call + pages * sizeof call->packet.iov[0]);
+   reply = malloc(HGFS_LARGE_PACKET_MAX);
+   if (call == NULL || reply == NULL) {
+      free(call);
+      free(reply);
+      return -ENOMEM;
+   }
+
+   call->async = FALSE;
+   packet = &call->packet;
+   memset(packet, 0, sizeof *packet);
+   packet->iov[0].va = HGFS_REQ_PAYLOAD(req);
+   packet->iov[0].len = req->payloadSize;
+   for (i = 1, va = data; va < data + dataSize; i++) {
+      size_t len = MIN(PAGE_SIZE - PAGE_OFFSET((uintptr_t)va),
+                       data + dataSize - va);
+
+      packet->iov[i].pa = (uintptr_t)va;
+      packet->iov[i].len = len;
+      va += len;
+   }
+   packet->iovCount = i;
+   packet->metaPacket = HGFS_REQ_PAYLOAD(req);
+   packet->metaPacketDataSize = req->payloadSize;
+   packet->metaPacketSize = req->payloadSize;
+   packet->dataPacketIovIndex = 1;
+   packet->dataPacketSize = dataSize;
+   packet->replyPacket = reply;
+   packet->replyPacketSize = HGFS_LARGE_PACKET_MAX;
+   packet->state |= HGFS_STATE_CLIENT_REQUEST;
+
+   res = HgfsLoopbackCallSync(call, req);
+   free(reply);
+   free(call);
+   return res;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLoopback_Exit --
+ *
+ *    Closes the server transport session and stops the server. Call
+ *    after HgfsTransportExit.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsLoopback_Exit(void)
+{
+   if (loopbackSession != NULL) {
+      loopbackServerCb->session.disconnect(loopbackSession);
+      loopbackServerCb->session.close(loopbackSession);
+      loopbackSession = NULL;
+   }
+   if (loopbackServerCb != NULL) {
+      HgfsServer_ExitState();
+      loopbackServerCb = NULL;
+   }
+   HgfsServerPolicy_Cleanup();
+}
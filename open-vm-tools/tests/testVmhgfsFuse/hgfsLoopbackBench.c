@@ -0,0 +1,915 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsLoopbackBench.c --
+ *
+ *   End to end benchmark of the vmhgfs-fuse client code and the HGFS
+ *   server, connected by the loopback channel of hgfsLoopback.c, so it
+ *   needs no hypervisor. N threads run each phase against their own
+ *   files in a local directory (-d, a new one in /tmp by default):
+ *
+ *     create     create and close a new file
+ *     stat       get the attributes of one of those files
+ *     readdir    list a directory of -e files, 100 by default
+ *     seqread    read a file front to back, BENCH_READ_SIZE at a time
+ *     randwrite  write BENCH_WRITE_SIZE at a random aligned offset
+ *     rename     rename one of the files created in the first phase
+ *
+ *   Every phase reports its throughput and latency percentiles. Calls go
+ *   to the vmhgfs-fuse functions below the FUSE layer, bypassing the
+ *   attribute cache, so each operation is at least one round trip.
+ *
+ *   With -H n, n file handles and n search handles stay open on the
+ *   server during all phases, to catch per-handle costs in the server.
+ *
+ *   With -a, the channel is asynchronous, as for a channel that allows
+ *   asynchronous requests: replies reach the client through its
+ *   asynchronous reply path.
+ *
+ *   Before the phases, a check with write-back enabled makes sure that
+ *   writes still buffered for one handle are seen by reads through
+ *   another one, opened read-only, before and after a rename. Another
+ *   sends fast reads and writes with their data spanning several pages,
+ *   which the server does with preadv and pwritev straight on the
+ *   pages. Failures count as errors.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "module.h"
+#include "cache.h"
+#include "readahead.h"
+#include "session.h"
+#include "writeback.h"
+#include "hgfsLoopback.h"
+/* By path, lib/include/file.h comes first in the include path. */
+#include "../../vmhgfs-fuse/file.h"
+
+#define BENCH_DEFAULT_THREADS  4
+#define BENCH_DEFAULT_OPS      2000
+#define BENCH_FILE_SIZE        (16 * 1024 * 1024)
+#define BENCH_READ_SIZE        (64 * 1024)
+#define BENCH_WRITE_SIZE       4096
+#define BENCH_DEFAULT_ENTRIES  100
+#define BENCH_FAST_IO_SIZE     (3 * 4096 + 100)
+
+int LOGLEVEL_THRESHOLD = 0;
+
+typedef int (*BenchOpFunc)(unsigned int thread, unsigned int i);
+
+typedef struct BenchPhase {
+   const char *name;
+   BenchOpFunc op;
+} BenchPhase;
+
+typedef struct BenchThread {
+   pthread_t tid;
+   unsigned int index;
+   BenchOpFunc op;
+   uint64 *latencies;        /* ns per op */
+   unsigned long errors;
+   unsigned int seed;
+   char *buf;                /* I/O buffer */
+   Bool fileOpen;            /* fi holds an open data file */
+   struct fuse_file_info fi;
+} BenchThread;
+
+static unsigned int benchThreads = BENCH_DEFAULT_THREADS;
+static unsigned int benchOps = BENCH_DEFAULT_OPS;
+static unsigned int benchEntries = BENCH_DEFAULT_ENTRIES;
+static unsigned int benchHeld;          /* handles of each kind held open */
+static HgfsHandle *benchHeldFiles;
+static HgfsHandle *benchHeldSearches;
+static const char *benchDir;            /* local directory */
+static char *benchHgfsDir;              /* same, as seen by the client */
+static char *benchListDir;              /* directory for readdir */
+static BenchThread *benchThreadInfo;
+
+
+static uint64
+BenchNow(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static char *
+BenchPath(const char *dir,          // IN: directory
+          const char *prefix,       // IN: file name prefix
+          unsigned int thread,      // IN: thread index
+          unsigned int i)           // IN: file index
+{
+   return Str_Asprintf(NULL, "%s/%s%u.%u", dir, prefix, thread, i);
+}
+
+
+static int
+BenchCreate(unsigned int thread,  // IN: thread index
+            unsigned int i)       // IN: op index
+{
+   struct fuse_file_info fi;
+   char *path = BenchPath(benchHgfsDir, "f", thread, i);
+   int res;
+
+   memset(&fi, 0, sizeof fi);
+   fi.flags = O_CREAT | O_WRONLY;
+   res = HgfsCreate(path, 0644, &fi);
+   if (res == 0) {
+      res = HgfsRelease(fi.fh);
+   }
+   free(path);
+   return res;
+}
+
+
+static int
+BenchStat(unsigned int thread,  // IN: thread index
+          unsigned int i)       // IN: op index
+{
+   HgfsAttrInfo attr;
+   char *path = BenchPath(benchHgfsDir, "f", thread, i);
+   int res;
+
+   memset(&attr, 0, sizeof attr);
+   res = HgfsPrivateGetattr(HGFS_INVALID_HANDLE, path, &attr);
+   free(attr.fileName);
+   free(path);
+   return res;
+}
+
+
+static int
+BenchFillDir(void *buf,                  // IN: entry counter
+             const char *name,           // IN: unused
+             const struct stat *stbuf,   // IN: unused
+             off_t off)                  // IN: unused
+{
+   (*(unsigned int *)buf)++;
+   return 0;
+}
+
+
+static int
+BenchReaddir(unsigned int thread,  // IN: thread index
+             unsigned int i)       // IN: op index
+{
+   HgfsHandle handle;
+   unsigned int entries = 0;
+   int res;
+
+   res = HgfsDirOpen(benchListDir, &handle);
+   if (res == 0) {
+      res = HgfsReaddir(NULL, handle, &entries, BenchFillDir);
+      HgfsDirClose(handle);
+   }
+   /* Plus "." and "..". */
+   return res == 0 && entries != benchEntries + 2 ? -EIO : res;
+}
+
+
+static int
+BenchIo(unsigned int thread,  // IN: thread index
+        unsigned int i,       // IN: op index
+        Bool write)           // IN: write, else read
+{
+   BenchThread *info = &benchThreadInfo[thread];
+   int res;
+
+   /* The file stays open for the phase, BenchRun closes it. */
+   if (!info->fileOpen) {
+      char *path = BenchPath(benchHgfsDir, "d", thread, 0);
+
+      memset(&info->fi, 0, sizeof info->fi);
+      info->fi.flags = O_RDWR;
+      res = HgfsOpen(path, &info->fi);
+      free(path);
+      if (res != 0) {
+         return res;
+      }
+      info->fileOpen = TRUE;
+   }
+
+   if (write) {
+      loff_t offset = (loff_t)(rand_r(&info->seed) %
+                               (BENCH_FILE_SIZE / BENCH_WRITE_SIZE)) *
+                      BENCH_WRITE_SIZE;
+
+      res = HgfsWrite(&info->fi, info->buf, BENCH_WRITE_SIZE, offset);
+      res = res == BENCH_WRITE_SIZE ? 0 : (res < 0 ? res : -EIO);
+   } else {
+      loff_t offset = ((loff_t)i * BENCH_READ_SIZE) % BENCH_FILE_SIZE;
+
+      res = HgfsRead(&info->fi, info->buf, BENCH_READ_SIZE, offset);
+      res = res == BENCH_READ_SIZE ? 0 : (res < 0 ? res : -EIO);
+   }
+   return res;
+}
+
+
+static int
+BenchSeqRead(unsigned int thread,  // IN: thread index
+             unsigned int i)       // IN: op index
+{
+   return BenchIo(thread, i, FALSE);
+}
+
+
+static int
+BenchRandWrite(unsigned int thread,  // IN: thread index
+               unsigned int i)       // IN: op index
+{
+   return BenchIo(thread, i, TRUE);
+}
+
+
+static int
+BenchRename(unsigned int thread,  // IN: thread index
+            unsigned int i)       // IN: op index
+{
+   char *from = BenchPath(benchHgfsDir, "f", thread, i);
+   char *to = BenchPath(benchHgfsDir, "g", thread, i);
+   int res;
+
+   res = HgfsRename(from, to);
+   free(from);
+   free(to);
+   return res;
+}
+
+
+static void *
+BenchRun(void *arg)  // IN: BenchThread
+{
+   BenchThread *info = arg;
+   unsigned int i;
+
+   for (i = 0; i < benchOps; i++) {
+      uint64 start = BenchNow();
+
+      if (info->op(info->index, i) != 0) {
+         info->errors++;
+      }
+      info->latencies[i] = BenchNow() - start;
+   }
+   if (info->fileOpen) {
+      HgfsRelease(info->fi.fh);
+      info->fileOpen = FALSE;
+   }
+   return NULL;
+}
+
+
+static int
+BenchCompare(const void *a,  // IN
+             const void *b)  // IN
+{
+   uint64 x = *(const uint64 *)a;
+   uint64 y = *(const uint64 *)b;
+
+   return x < y ? -1 : x > y;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * BenchPhaseRun --
+ *
+ *    Runs one phase on all threads and prints its results.
+ *
+ * Results:
+ *    Number of failed operations.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static unsigned long
+BenchPhaseRun(const BenchPhase *phase,  // IN: phase
+              uint64 *all)              // IN: room for all latencies
+{
+   unsigned long errors = 0;
+   uint64 count = (uint64)benchThreads * benchOps;
+   uint64 start, elapsed;
+   unsigned int i;
+
+   start = BenchNow();
+   for (i = 0; i < benchThreads; i++) {
+      benchThreadInfo[i].op = phase->op;
+      benchThreadInfo[i].errors = 0;
+      benchThreadInfo[i].latencies = all + (uint64)i * benchOps;
+      pthread_create(&benchThreadInfo[i].tid, NULL, BenchRun,
+                     &benchThreadInfo[i]);
+   }
+   for (i = 0; i < benchThreads; i++) {
+      pthread_join(benchThreadInfo[i].tid, NULL);
+      errors += benchThreadInfo[i].errors;
+   }
+   elapsed = BenchNow() - start;
+
+   qsort(all, count, sizeof *all, BenchCompare);
+   printf("%-10s %9.0f ops/sec  p50 %7.1f  p90 %7.1f  p99 %7.1f  "
+          "max %8.1f us  %lu errors\n",
+          phase->name, count * 1e9 / MAX(elapsed, 1),
+          all[count / 2] / 1e3, all[count * 9 / 10] / 1e3,
+          all[count * 99 / 100] / 1e3, all[count - 1] / 1e3, errors);
+   return errors;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * BenchCheckWriteBack --
+ *
+ *    Writes through one handle, with write-back enabled, and reads the
+ *    data back through another, opened read-only, flushing the path
+ *    first the way hgfs_read and HgfsLLRead do. Then the same again
+ *    after the file has been renamed with the writer still open. Last,
+ *    writes the same range through two writers and checks that the
+ *    later write wins.
+ *
+ * Results:
+ *    Number of failed checks.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static unsigned long
+BenchCheckWriteBack(void)
+{
+   char *paths[2];
+   char wbuf[BENCH_WRITE_SIZE];
+   char rbuf[BENCH_WRITE_SIZE];
+   struct fuse_file_info wfi;
+   struct fuse_file_info wfi2;
+   unsigned long failures = 0;
+   unsigned int i;
+
+   paths[0] = BenchPath(benchHgfsDir, "w", 0, 0);
+   paths[1] = BenchPath(benchHgfsDir, "w", 0, 1);
+   if (paths[0] == NULL || paths[1] == NULL) {
+      failures++;
+      goto exit;
+   }
+
+   memset(&wfi, 0, sizeof wfi);
+   wfi.flags = O_CREAT | O_WRONLY;
+   if (HgfsCreate(paths[0], 0644, &wfi) != 0) {
+      failures++;
+      goto exit;
+   }
+
+   for (i = 0; i < ARRAYSIZE(paths); i++) {
+      struct fuse_file_info rfi;
+      ssize_t res;
+
+      if (i > 0 && HgfsRename(paths[i - 1], paths[i]) != 0) {
+         fprintf(stderr, "%s: rename failed\n", paths[i - 1]);
+         failures++;
+         break;
+      }
+
+      memset(wbuf, 'A' + i, sizeof wbuf);
+      res = HgfsWrite(&wfi, wbuf, sizeof wbuf, 0);
+      if (res != sizeof wbuf || !HgfsWriteBackPending()) {
+         fprintf(stderr, "%s: write was not buffered\n", paths[i]);
+         failures++;
+         continue;
+      }
+
+      memset(&rfi, 0, sizeof rfi);
+      rfi.flags = O_RDONLY;
+      if (HgfsOpen(paths[i], &rfi) != 0) {
+         fprintf(stderr, "%s: open for reading failed\n", paths[i]);
+         failures++;
+         continue;
+      }
+      HgfsWriteBackFlushPath(paths[i]);
+      res = HgfsRead(&rfi, rbuf, sizeof rbuf, 0);
+      if (res != sizeof rbuf || memcmp(rbuf, wbuf, sizeof rbuf) != 0) {
+         fprintf(stderr, "%s: read-only handle missed the buffered write\n",
+                 paths[i]);
+         failures++;
+      }
+      HgfsRelease(rfi.fh);
+   }
+
+   /*
+    * A write through another handle writes out the older buffer first,
+    * even when the older buffer is the one released last.
+    */
+   memset(&wfi2, 0, sizeof wfi2);
+   wfi2.flags = O_WRONLY;
+   if (failures == 0 && HgfsOpen(paths[1], &wfi2) == 0) {
+      struct fuse_file_info rfi;
+
+      memset(wbuf, 'C', sizeof wbuf);
+      HgfsWrite(&wfi, wbuf, sizeof wbuf, 0);
+      memset(wbuf, 'D', sizeof wbuf);
+      HgfsWrite(&wfi2, wbuf, sizeof wbuf, 0);
+      HgfsRelease(wfi2.fh);
+      HgfsRelease(wfi.fh);
+
+      memset(&rfi, 0, sizeof rfi);
+      rfi.flags = O_RDONLY;
+      if (HgfsOpen(paths[1], &rfi) != 0) {
+         fprintf(stderr, "%s: open for reading failed\n", paths[1]);
+         failures++;
+      } else {
+         if (HgfsRead(&rfi, rbuf, sizeof rbuf, 0) != sizeof rbuf ||
+             memcmp(rbuf, wbuf, sizeof rbuf) != 0) {
+            fprintf(stderr, "%s: older buffered write landed last\n",
+                    paths[1]);
+            failures++;
+         }
+         HgfsRelease(rfi.fh);
+      }
+   } else {
+      HgfsRelease(wfi.fh);
+   }
+
+exit:
+   free(paths[0]);
+   free(paths[1]);
+   return failures;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * BenchFastIo --
+ *
+ *    Sends a HGFS_OP_READ_FAST_V4 or HGFS_OP_WRITE_FAST_V4 request with
+ *    its data in buf, see HgfsLoopback_SendData.
+ *
+ * Results:
+ *    Bytes read or written, or a negative error.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static ssize_t
+BenchFastIo(HgfsOp op,          // IN: fast read or write
+            HgfsHandle handle,  // IN: open file
+            char *buf,          // IN/OUT: data
+            size_t size)        // IN: size of the data
+{
+   HgfsReq *req = HgfsGetNewRequest();
+   ssize_t res;
+
+   if (req == NULL) {
+      return -ENOMEM;
+   }
+
+   if (op == HGFS_OP_READ_FAST_V4) {
+      HgfsRequestReadV3 *request = HgfsGetRequestPayload(req);
+
+      request->file = handle;
+      request->offset = 0;
+      request->requiredSize = size;
+      request->reserved = 0;
+      req->payloadSize = sizeof *request;
+   } else {
+      HgfsRequestWriteV3 *request = HgfsGetRequestPayload(req);
+
+      request->file = handle;
+      request->flags = 0;
+      request->offset = 0;
+      request->requiredSize = size;
+      request->reserved = 0;
+      req->payloadSize = sizeof *request;
+   }
+   req->payloadSize += HgfsGetRequestHeaderSize();
+   HgfsPackHeader(req, op);
+
+   res = HgfsLoopback_SendData(req, buf, size);
+   if (res == 0) {
+      res = HgfsStatusConvertToLinux(HgfsGetReplyStatus(req));
+   }
+   if (res == 0) {
+      /* Both replies start with the actual size. */
+      res = ((HgfsReplyWriteV3 *)HgfsGetReplyPayload(req))->actualSize;
+   }
+   HgfsFreeRequest(req);
+   return res;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * BenchCheckFastIo --
+ *
+ *    Writes data spanning several pages, not page aligned, with a fast
+ *    write, and reads it back with a fast read and with a regular read.
+ *
+ * Results:
+ *    Number of failed checks.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static unsigned long
+BenchCheckFastIo(void)
+{
+   char *path = BenchPath(benchHgfsDir, "v", 0, 0);
+   char *wbuf = malloc(BENCH_FAST_IO_SIZE + 200);
+   char *rbuf = malloc(BENCH_FAST_IO_SIZE + 200);
+   struct fuse_file_info fi;
+   unsigned long failures = 0;
+   unsigned int i;
+
+   if (path == NULL || wbuf == NULL || rbuf == NULL) {
+      failures++;
+      goto exit;
+   }
+
+   memset(&fi, 0, sizeof fi);
+   fi.flags = O_CREAT | O_RDWR;
+   if (HgfsCreate(path, 0644, &fi) != 0) {
+      failures++;
+      goto exit;
+   }
+
+   for (i = 0; i < BENCH_FAST_IO_SIZE; i++) {
+      wbuf[100 + i] = i % 251;
+   }
+   if (BenchFastIo(HGFS_OP_WRITE_FAST_V4, fi.fh, wbuf + 100,
+                   BENCH_FAST_IO_SIZE) != BENCH_FAST_IO_SIZE) {
+      fprintf(stderr, "%s: fast write failed\n", path);
+      failures++;
+   } else {
+      memset(rbuf, 0, BENCH_FAST_IO_SIZE + 200);
+      if (BenchFastIo(HGFS_OP_READ_FAST_V4, fi.fh, rbuf + 200,
+                      BENCH_FAST_IO_SIZE) != BENCH_FAST_IO_SIZE ||
+          memcmp(rbuf + 200, wbuf + 100, BENCH_FAST_IO_SIZE) != 0) {
+         fprintf(stderr, "%s: fast read differs\n", path);
+         failures++;
+      }
+      memset(rbuf, 0, BENCH_FAST_IO_SIZE + 200);
+      if (HgfsRead(&fi, rbuf, BENCH_FAST_IO_SIZE, 0) != BENCH_FAST_IO_SIZE ||
+          memcmp(rbuf, wbuf + 100, BENCH_FAST_IO_SIZE) != 0) {
+         fprintf(stderr, "%s: read after fast write differs\n", path);
+         failures++;
+      }
+   }
+   HgfsRelease(fi.fh);
+
+exit:
+   free(path);
+   free(wbuf);
+   free(rbuf);
+   return failures;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * BenchHold --
+ *
+ *    Opens benchHeld files, cycling over the entries of the readdir
+ *    directory, and as many searches of that directory.
+ *
+ * Results:
+ *    TRUE on success. Whatever was opened is recorded for BenchRelease.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+BenchHold(void)
+{
+   unsigned int i;
+
+   benchHeldFiles = malloc(benchHeld * sizeof *benchHeldFiles);
+   benchHeldSearches = malloc(benchHeld * sizeof *benchHeldSearches);
+   if (benchHeldFiles == NULL || benchHeldSearches == NULL) {
+      return FALSE;
+   }
+   for (i = 0; i < benchHeld; i++) {
+      benchHeldFiles[i] = HGFS_INVALID_HANDLE;
+      benchHeldSearches[i] = HGFS_INVALID_HANDLE;
+   }
+
+   for (i = 0; i < benchHeld; i++) {
+      char *path = BenchPath(benchListDir, "e", 0, i % benchEntries);
+      struct fuse_file_info fi;
+      int res;
+
+      memset(&fi, 0, sizeof fi);
+      fi.flags = O_RDONLY;
+      res = HgfsOpen(path, &fi);
+      free(path);
+      if (res != 0) {
+         return FALSE;
+      }
+      benchHeldFiles[i] = fi.fh;
+
+      if (HgfsDirOpen(benchListDir, &benchHeldSearches[i]) != 0) {
+         benchHeldSearches[i] = HGFS_INVALID_HANDLE;
+         return FALSE;
+      }
+   }
+   return TRUE;
+}
+
+
+static void
+BenchRelease(void)
+{
+   unsigned int i;
+
+   for (i = 0; i < benchHeld; i++) {
+      if (benchHeldFiles != NULL && benchHeldFiles[i] != HGFS_INVALID_HANDLE) {
+         HgfsRelease(benchHeldFiles[i]);
+      }
+      if (benchHeldSearches != NULL &&
+          benchHeldSearches[i] != HGFS_INVALID_HANDLE) {
+         HgfsDirClose(benchHeldSearches[i]);
+      }
+   }
+   free(benchHeldFiles);
+   free(benchHeldSearches);
+   benchHeldFiles = NULL;
+   benchHeldSearches = NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * BenchSetup --
+ *
+ *    Creates, locally, the data file of each thread and the directory
+ *    for readdir.
+ *
+ * Results:
+ *    TRUE on success.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+BenchSetup(void)
+{
+   char *listDir = Str_Asprintf(NULL, "%s/list", benchDir);
+   unsigned int i;
+
+   if (listDir == NULL || (mkdir(listDir, 0755) != 0 && errno != EEXIST)) {
+      free(listDir);
+      return FALSE;
+   }
+   for (i = 0; i < benchEntries; i++) {
+      char *path = BenchPath(listDir, "e", 0, i);
+      int fd = open(path, O_CREAT | O_WRONLY, 0644);
+
+      free(path);
+      if (fd < 0) {
+         free(listDir);
+         return FALSE;
+      }
+      close(fd);
+   }
+   free(listDir);
+
+   for (i = 0; i < benchThreads; i++) {
+      char *path = BenchPath(benchDir, "d", i, 0);
+      int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+      size_t done;
+
+      free(path);
+      if (fd < 0) {
+         return FALSE;
+      }
+      memset(benchThreadInfo[i].buf, 'a' + i % 26, BENCH_READ_SIZE);
+      for (done = 0; done < BENCH_FILE_SIZE; done += BENCH_READ_SIZE) {
+         if (write(fd, benchThreadInfo[i].buf,
+                   BENCH_READ_SIZE) != BENCH_READ_SIZE) {
+            close(fd);
+            return FALSE;
+         }
+      }
+      close(fd);
+   }
+   return TRUE;
+}
+
+
+static void
+BenchCleanup(void)
+{
+   char *listDir = Str_Asprintf(NULL, "%s/list", benchDir);
+   char *path;
+   unsigned int i, j;
+
+   for (i = 0; i < benchEntries && listDir != NULL; i++) {
+      path = BenchPath(listDir, "e", 0, i);
+      unlink(path);
+      free(path);
+   }
+   if (listDir != NULL) {
+      rmdir(listDir);
+      free(listDir);
+   }
+
+   for (i = 0; i < 2; i++) {
+      path = BenchPath(benchDir, "w", 0, i);
+      unlink(path);
+      free(path);
+   }
+   path = BenchPath(benchDir, "v", 0, 0);
+   unlink(path);
+   free(path);
+
+   for (i = 0; i < benchThreads; i++) {
+      path = BenchPath(benchDir, "d", i, 0);
+      unlink(path);
+      free(path);
+      for (j = 0; j < benchOps; j++) {
+         path = BenchPath(benchDir, "f", i, j);
+         unlink(path);
+         free(path);
+         path = BenchPath(benchDir, "g", i, j);
+         unlink(path);
+         free(path);
+      }
+   }
+}
+
+
+int
+main(int argc,
+     char *argv[])
+{
+   static const BenchPhase phases[] = {
+      { "create",    BenchCreate },
+      { "stat",      BenchStat },
+      { "readdir",   BenchReaddir },
+      { "seqread",   BenchSeqRead },
+      { "randwrite", BenchRandWrite },
+      { "rename",    BenchRename },
+   };
+   char tmpDir[] = "/tmp/hgfsLoopback.XXXXXX";
+   unsigned int channels = 1;
+   unsigned long errors = 0;
+   Bool madeDir = FALSE;
+   Bool async = FALSE;
+   uint64 *latencies;
+   unsigned int i;
+   int opt;
+   int res = 1;
+
+   while ((opt = getopt(argc, argv, "t:n:c:d:e:H:a")) != -1) {
+      switch (opt) {
+      case 't':
+         benchThreads = atoi(optarg);
+         break;
+      case 'n':
+         benchOps = atoi(optarg);
+         break;
+      case 'c':
+         channels = atoi(optarg);
+         break;
+      case 'd':
+         benchDir = optarg;
+         break;
+      case 'e':
+         benchEntries = atoi(optarg);
+         break;
+      case 'H':
+         benchHeld = atoi(optarg);
+         break;
+      case 'a':
+         async = TRUE;
+         break;
+      default:
+         fprintf(stderr, "Usage: %s [-t threads] [-n ops per thread] "
+                 "[-c channels] [-d local directory] "
+                 "[-e entries listed] [-H handles held open] "
+                 "[-a]\n", argv[0]);
+         return 1;
+      }
+   }
+   benchThreads = MAX(benchThreads, 1);
+   benchOps = MAX(benchOps, 1);
+   benchEntries = MAX(benchEntries, 1);
+
+   if (benchDir == NULL) {
+      benchDir = mkdtemp(tmpDir);
+      if (benchDir == NULL) {
+         perror("mkdtemp");
+         return 1;
+      }
+      madeDir = TRUE;
+   }
+   benchHgfsDir = Str_Asprintf(NULL, "%s%s", HGFS_LOOPBACK_ROOT, benchDir);
+   benchListDir = Str_Asprintf(NULL, "%s%s/list", HGFS_LOOPBACK_ROOT, benchDir);
+
+   benchThreadInfo = calloc(benchThreads, sizeof *benchThreadInfo);
+   latencies = malloc((size_t)benchThreads * benchOps * sizeof *latencies);
+   if (benchHgfsDir == NULL || benchListDir == NULL ||
+       benchThreadInfo == NULL || latencies == NULL) {
+      goto exit;
+   }
+   for (i = 0; i < benchThreads; i++) {
+      benchThreadInfo[i].index = i;
+      benchThreadInfo[i].seed = i + 1;
+      benchThreadInfo[i].buf = malloc(BENCH_READ_SIZE);
+      if (benchThreadInfo[i].buf == NULL) {
+         goto exit;
+      }
+   }
+   if (!BenchSetup()) {
+      fprintf(stderr, "Cannot create the data files in %s.\n", benchDir);
+      goto exit;
+   }
+
+   if (!HgfsLoopback_Init(async)) {
+      fprintf(stderr, "Cannot start the HGFS server.\n");
+      goto exit;
+   }
+   HgfsResetOps();
+   HgfsRequestPoolInit(HGFS_REQUEST_POOL_DEFAULT);
+   if (HgfsTransportInit(channels) != 0) {
+      fprintf(stderr, "Cannot initialize the transport.\n");
+      HgfsLoopback_Exit();
+      goto exit;
+   }
+   HgfsInitCache(FALSE);
+   HgfsReadAheadInit(HGFS_READAHEAD_DEFAULT_WINDOW);
+   HgfsWriteBackInit(TRUE);
+   if (HgfsCreateSession() != 0) {
+      LOG(4, ("No session, using the session-less protocol.\n"));
+   }
+
+   /* The phases write through, as without the writeback mount option. */
+   errors += BenchCheckWriteBack();
+   HgfsWriteBackInit(FALSE);
+   if (gState->sessionEnabled) {
+      errors += BenchCheckFastIo();
+   }
+
+   if (!BenchHold()) {
+      fprintf(stderr, "Cannot hold %u handles open.\n", benchHeld);
+      errors++;
+   } else {
+      printf("%s, %u threads x %u ops on %u channels, %u handles held\n",
+             benchDir, benchThreads, benchOps, channels, benchHeld);
+      for (i = 0; i < ARRAYSIZE(phases); i++) {
+         errors += BenchPhaseRun(&phases[i], latencies);
+      }
+   }
+   BenchRelease();
+
+   if (gState->sessionEnabled) {
+      HgfsDestroySession();
+   }
+   HgfsTransportExit();
+   HgfsLoopback_Exit();
+   res = errors == 0 ? 0 : 1;
+
+exit:
+   BenchCleanup();
+   if (madeDir) {
+      rmdir(benchDir);
+   }
+   if (benchThreadInfo != NULL) {
+      for (i = 0; i < benchThreads; i++) {
+         free(benchThreadInfo[i].buf);
+      }
+   }
+   free(benchThreadInfo);
+   free(latencies);
+   free(benchHgfsDir);
+   free(benchListDir);
+   return res;
+}
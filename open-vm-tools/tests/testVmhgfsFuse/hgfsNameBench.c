@@ -0,0 +1,277 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsNameBench.c --
+ *
+ *   Microbenchmark for the per-name Unicode work of the HGFS server: the
+ *   UTF-8 validation of every name received or listed, and the case folding
+ *   of case insensitive lookups. The corpus is the paths and file names of
+ *   a directory tree, the current directory unless given, so running it in
+ *   a source or build tree measures the names such shares serve. -u appends
+ *   a non-ASCII character to the given percentage of the names.
+ *
+ *   Every operation is timed through the library calls, which take an ASCII
+ *   fast path, and through what they did for every name before: the byte at
+ *   a time UTF-8 decoder, and a round trip through UTF-16 (without the case
+ *   folding table lookups, which are internal).
+ */
+
+#define _XOPEN_SOURCE 500    // for nftw
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <ftw.h>
+
+#include "vmware.h"
+#include "codeset.h"
+#include "unicodeBase.h"
+#include "unicodeTransforms.h"
+
+#define BENCH_DEFAULT_NAMES    100000
+#define BENCH_DEFAULT_ROUNDS   10
+
+typedef struct BenchCorpus {
+   char **names;
+   size_t *lengths;
+   unsigned int count;
+   unsigned int max;
+   unsigned int nonAsciiPercent;
+} BenchCorpus;
+
+static BenchCorpus benchCorpus;
+static volatile uint64 benchSink;
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * BenchCorpusAdd --
+ *
+ *    Add a name to the corpus, with a non-ASCII character appended to
+ *    the requested share of them.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+BenchCorpusAdd(const char *name)  // IN
+{
+   BenchCorpus *corpus = &benchCorpus;
+   size_t length = strlen(name);
+   char *copy;
+
+   if (corpus->count == corpus->max || length == 0) {
+      return;
+   }
+   copy = malloc(length + sizeof "\xc3\xa9");
+   if (copy == NULL) {
+      return;
+   }
+   memcpy(copy, name, length + 1);
+   if ((unsigned int)(rand() % 100) < corpus->nonAsciiPercent) {
+      memcpy(copy + length, "\xc3\xa9", sizeof "\xc3\xa9");
+      length += sizeof "\xc3\xa9" - 1;
+   }
+   corpus->names[corpus->count] = copy;
+   corpus->lengths[corpus->count] = length;
+   corpus->count++;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * BenchCorpusVisit --
+ *
+ *    nftw callback: add the path and the file name of an entry.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+BenchCorpusVisit(const char *path,           // IN
+                 const struct stat *stats,   // IN: unused
+                 int type,                   // IN: unused
+                 struct FTW *ftw)            // IN
+{
+   BenchCorpusAdd(path);
+   BenchCorpusAdd(path + ftw->base);
+   return benchCorpus.count == benchCorpus.max;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Bench operations, each over one name.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+BenchValidate(const char *name,  // IN
+              size_t length)     // IN
+{
+   benchSink += CodeSet_IsValidUTF8(name, length);
+}
+
+static void
+BenchValidateDecoder(const char *name,  // IN
+                     size_t length)     // IN
+{
+   benchSink += CodeSet_IsStringValidUTF8(name);
+}
+
+static void
+BenchFold(const char *name,  // IN
+          size_t length)     // IN
+{
+   char *folded = Unicode_FoldCase(name);
+
+   benchSink += folded[0];
+   free(folded);
+}
+
+static void
+BenchFoldUtf16(const char *name,  // IN
+               size_t length)     // IN
+{
+   utf16_t *utf16 = Unicode_GetAllocBytes(name, STRING_ENCODING_UTF16);
+   char *folded = Unicode_AllocWithUTF16(utf16);
+
+   benchSink += folded[0];
+   free(utf16);
+   free(folded);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * BenchRun --
+ *
+ *    Run an operation over the corpus the given number of times.
+ *
+ * Results:
+ *    Nanoseconds per name.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static double
+BenchRun(void (*op)(const char *, size_t),  // IN
+         unsigned int rounds)               // IN
+{
+   struct timespec start, end;
+   unsigned int round;
+   unsigned int i;
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (round = 0; round < rounds; round++) {
+      for (i = 0; i < benchCorpus.count; i++) {
+         op(benchCorpus.names[i], benchCorpus.lengths[i]);
+      }
+   }
+   clock_gettime(CLOCK_MONOTONIC, &end);
+
+   return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) /
+          ((double)rounds * benchCorpus.count);
+}
+
+
+int
+main(int argc,
+     char *argv[])
+{
+   static const struct {
+      const char *name;
+      void (*op)(const char *, size_t);
+      void (*before)(const char *, size_t);
+   } ops[] = {
+      { "validate", BenchValidate, BenchValidateDecoder },
+      { "fold",     BenchFold,     BenchFoldUtf16 },
+   };
+   const char *dir = ".";
+   unsigned int rounds = BENCH_DEFAULT_ROUNDS;
+   uint64 bytes = 0;
+   unsigned int ascii = 0;
+   unsigned int i;
+   int opt;
+
+   benchCorpus.max = BENCH_DEFAULT_NAMES;
+   while ((opt = getopt(argc, argv, "m:r:u:")) != -1) {
+      switch (opt) {
+      case 'm':
+         benchCorpus.max = atoi(optarg);
+         break;
+      case 'r':
+         rounds = atoi(optarg);
+         break;
+      case 'u':
+         benchCorpus.nonAsciiPercent = atoi(optarg);
+         break;
+      default:
+         fprintf(stderr, "Usage: %s [-m max names] [-r rounds] "
+                 "[-u non-ASCII percent] [directory]\n", argv[0]);
+         return 1;
+      }
+   }
+   if (optind < argc) {
+      dir = argv[optind];
+   }
+   if (rounds == 0) {
+      rounds = 1;
+   }
+
+   benchCorpus.names = calloc(benchCorpus.max, sizeof *benchCorpus.names);
+   benchCorpus.lengths = calloc(benchCorpus.max, sizeof *benchCorpus.lengths);
+   if (benchCorpus.names == NULL || benchCorpus.lengths == NULL) {
+      return 1;
+   }
+   srand(1);
+   if (nftw(dir, BenchCorpusVisit, 64, FTW_PHYS) < 0 || benchCorpus.count == 0) {
+      fprintf(stderr, "No names found in %s.\n", dir);
+      return 1;
+   }
+   for (i = 0; i < benchCorpus.count; i++) {
+      bytes += benchCorpus.lengths[i];
+      ascii += CodeSet_IsAscii(benchCorpus.names[i], benchCorpus.lengths[i]);
+   }
+   printf("%s: %u names, %.1f bytes average, %u%% ASCII\n", dir,
+          benchCorpus.count, (double)bytes / benchCorpus.count,
+          (unsigned int)(100.0 * ascii / benchCorpus.count));
+
+   for (i = 0; i < ARRAYSIZE(ops); i++) {
+      double now = BenchRun(ops[i].op, rounds);
+      double before = BenchRun(ops[i].before, rounds);
+
+      printf("%-10s %8.1f ns/name, %8.1f ns/name before, %5.1fx\n",
+             ops[i].name, now, before, now > 0 ? before / now : 0.0);
+   }
+
+   for (i = 0; i < benchCorpus.count; i++) {
+      free(benchCorpus.names[i]);
+   }
+   free(benchCorpus.names);
+   free(benchCorpus.lengths);
+
+   return 0;
+}
@@ -0,0 +1,384 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsTransportBench.c --
+ *
+ *   Microbenchmark for the vmhgfs-fuse transport. N reader threads push
+ *   READ_V3 requests through HgfsSendRequest against a stub asynchronous
+ *   channel whose responder thread answers them in reverse arrival order,
+ *   so every reply has to be matched back to its request. Requests come
+ *   from the request pool, sized with -p (0 allocates every request).
+ *
+ *   With -s the stub channel is synchronous instead, like the backdoor:
+ *   send takes the given number of microseconds and completes the
+ *   request itself. -c sets the number of transport channels, which is
+ *   what lets such sends overlap.
+ *
+ *   The stub channel replaces bdhandler.c at link time by providing its
+ *   own HgfsBdChannelInit.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "module.h"
+#include "bdhandler.h"
+#include "transport.h"
+
+#define BENCH_DEFAULT_THREADS  8
+#define BENCH_DEFAULT_OPS      100000
+#define BENCH_QUEUE_MAX        4096
+
+int LOGLEVEL_THRESHOLD = 0;
+static HgfsFuseState benchState = { TRUE, 0x1234, HGFS_HEADER_VERSION };
+HgfsFuseState *gState = &benchState;
+
+typedef struct StubChannelPriv {
+   pthread_t thread;
+   pthread_mutex_t lock;
+   pthread_cond_t cond;
+   Bool quit;
+   unsigned int count;
+   HgfsHandle ids[BENCH_QUEUE_MAX];
+} StubChannelPriv;
+
+static unsigned int stubSendUsec;
+static unsigned int benchOps = BENCH_DEFAULT_OPS;
+static unsigned long benchErrors;
+static pthread_mutex_t benchErrorsLock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsCreateSession --
+ *
+ *    Stub, the benchmark never sees a stale session.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HgfsCreateSession(void)
+{
+   return 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * StubChannelResponder --
+ *
+ *    Reply thread of the stub channel. Drains the queue of submitted
+ *    request ids newest first and hands a success reply for each to
+ *    the transport.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void *
+StubChannelResponder(void *arg)  // IN: channel private data
+{
+   StubChannelPriv *priv = arg;
+   HgfsHandle ids[BENCH_QUEUE_MAX];
+   HgfsHeader reply;
+
+   memset(&reply, 0, sizeof reply);
+   reply.version = HGFS_HEADER_VERSION;
+   reply.dummy = HGFS_OP_NEW_HEADER;
+   reply.headerSize = sizeof reply;
+   reply.packetSize = sizeof reply;
+   reply.op = HGFS_OP_READ_V3;
+   reply.status = HGFS_STATUS_SUCCESS;
+   reply.flags = HGFS_PACKET_FLAG_REPLY;
+
+   for (;;) {
+      unsigned int count;
+
+      pthread_mutex_lock(&priv->lock);
+      while (priv->count == 0 && !priv->quit) {
+         pthread_cond_wait(&priv->cond, &priv->lock);
+      }
+      if (priv->count == 0) {
+         pthread_mutex_unlock(&priv->lock);
+         break;
+      }
+      count = priv->count;
+      memcpy(ids, priv->ids, count * sizeof ids[0]);
+      priv->count = 0;
+      pthread_cond_broadcast(&priv->cond);
+      pthread_mutex_unlock(&priv->lock);
+
+      while (count-- > 0) {
+         reply.requestId = ids[count];
+         HgfsTransportProcessPacket((char *)&reply, sizeof reply);
+      }
+   }
+   return NULL;
+}
+
+
+static HgfsChannelStatus
+StubChannelOpen(HgfsTransportChannel *channel)  // IN: channel
+{
+   StubChannelPriv *priv = channel->priv;
+
+   if (stubSendUsec > 0) {
+      channel->status = HGFS_CHANNEL_CONNECTED;
+      return channel->status;
+   }
+
+   priv->quit = FALSE;
+   priv->count = 0;
+   if (pthread_create(&priv->thread, NULL, StubChannelResponder, priv) != 0) {
+      return HGFS_CHANNEL_NOTCONNECTED;
+   }
+   channel->status = HGFS_CHANNEL_CONNECTED;
+   return channel->status;
+}
+
+
+static void
+StubChannelClose(HgfsTransportChannel *channel)  // IN: channel
+{
+   StubChannelPriv *priv = channel->priv;
+
+   if (channel->status != HGFS_CHANNEL_CONNECTED) {
+      return;
+   }
+   if (stubSendUsec > 0) {
+      channel->status = HGFS_CHANNEL_NOTCONNECTED;
+      return;
+   }
+   pthread_mutex_lock(&priv->lock);
+   priv->quit = TRUE;
+   pthread_cond_broadcast(&priv->cond);
+   pthread_mutex_unlock(&priv->lock);
+   pthread_join(priv->thread, NULL);
+   channel->status = HGFS_CHANNEL_NOTCONNECTED;
+}
+
+
+static int
+StubChannelSend(HgfsTransportChannel *channel,  // IN: channel
+                HgfsReq *req)                   // IN: request to send
+{
+   StubChannelPriv *priv = channel->priv;
+
+   if (stubSendUsec > 0) {
+      struct timespec delay = { 0, stubSendUsec * 1000L };
+      HgfsHeader reply = *(HgfsHeader *)HGFS_REQ_PAYLOAD(req);
+
+      nanosleep(&delay, NULL);
+      reply.packetSize = sizeof reply;
+      reply.status = HGFS_STATUS_SUCCESS;
+      reply.flags = HGFS_PACKET_FLAG_REPLY;
+      HgfsCompleteReq(req, (char *)&reply, sizeof reply);
+      return 0;
+   }
+
+   pthread_mutex_lock(&priv->lock);
+   while (priv->count == BENCH_QUEUE_MAX) {
+      pthread_cond_wait(&priv->cond, &priv->lock);
+   }
+   req->state = HGFS_REQ_STATE_SUBMITTED;
+   priv->ids[priv->count++] = req->id;
+   pthread_cond_signal(&priv->cond);
+   pthread_mutex_unlock(&priv->lock);
+   return 0;
+}
+
+
+static void
+StubChannelExit(HgfsTransportChannel *channel)  // IN: channel
+{
+   StubChannelPriv *priv = channel->priv;
+
+   pthread_cond_destroy(&priv->cond);
+   pthread_mutex_destroy(&priv->lock);
+   free(priv);
+   free(channel);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsBdChannelInit --
+ *
+ *    Link-time replacement for the backdoor channel.
+ *
+ *----------------------------------------------------------------------
+ */
+
+HgfsTransportChannel *
+HgfsBdChannelInit(void)
+{
+   HgfsTransportChannel *channel = calloc(1, sizeof *channel);
+   StubChannelPriv *priv = calloc(1, sizeof *priv);
+
+   if (channel == NULL || priv == NULL) {
+      free(channel);
+      free(priv);
+      return NULL;
+   }
+   pthread_mutex_init(&priv->lock, NULL);
+   pthread_cond_init(&priv->cond, NULL);
+   channel->name = "stub";
+   channel->ops.open = StubChannelOpen;
+   channel->ops.close = StubChannelClose;
+   channel->ops.send = StubChannelSend;
+   channel->ops.recv = NULL;
+   channel->ops.exit = StubChannelExit;
+   channel->status = HGFS_CHANNEL_NOTCONNECTED;
+   channel->priv = priv;
+   channel->async = TRUE;
+   return channel;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * BenchReader --
+ *
+ *    Reader thread body: sends benchOps READ_V3 requests one at a time.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void *
+BenchReader(void *arg)  // IN: thread index
+{
+   uintptr_t index = (uintptr_t)arg;
+   unsigned long errors = 0;
+   unsigned int i;
+
+   for (i = 0; i < benchOps; i++) {
+      HgfsReq *req = HgfsGetNewRequest();
+      HgfsRequestReadV3 *request;
+
+      if (req == NULL) {
+         errors++;
+         continue;
+      }
+      request = HgfsGetRequestPayload(req);
+      request->file = (HgfsHandle)index;
+      request->offset = (uint64)i * 4096;
+      request->requiredSize = 4096;
+      request->reserved = 0;
+      req->payloadSize = HgfsGetRequestHeaderSize() + sizeof *request;
+      HgfsPackHeader(req, HGFS_OP_READ_V3);
+
+      if (HgfsSendRequest(req) != 0 ||
+          HgfsGetReplyStatus(req) != HGFS_STATUS_SUCCESS ||
+          ((HgfsHeader *)HGFS_REQ_PAYLOAD(req))->requestId != req->id) {
+         errors++;
+      }
+      HgfsFreeRequest(req);
+   }
+
+   pthread_mutex_lock(&benchErrorsLock);
+   benchErrors += errors;
+   pthread_mutex_unlock(&benchErrorsLock);
+   return NULL;
+}
+
+
+int
+main(int argc,
+     char *argv[])
+{
+   unsigned int threads = BENCH_DEFAULT_THREADS;
+   unsigned int pool = HGFS_REQUEST_POOL_DEFAULT;
+   unsigned int channels = 1;
+   HgfsRequestPoolStats poolStats;
+   pthread_t *tids;
+   struct timespec start, end;
+   double elapsed;
+   unsigned int i;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "t:n:p:c:s:")) != -1) {
+      switch (opt) {
+      case 't':
+         threads = atoi(optarg);
+         break;
+      case 'n':
+         benchOps = atoi(optarg);
+         break;
+      case 'p':
+         pool = atoi(optarg);
+         break;
+      case 'c':
+         channels = atoi(optarg);
+         break;
+      case 's':
+         stubSendUsec = atoi(optarg);
+         break;
+      default:
+         fprintf(stderr, "Usage: %s [-t threads] [-n ops per thread] "
+                 "[-p request pool] [-c channels] [-s sync send usec]\n", argv[0]);
+         return 1;
+      }
+   }
+   if (threads == 0) {
+      threads = 1;
+   }
+
+   HgfsRequestPoolInit(pool);
+   if (HgfsTransportInit(channels) != 0) {
+      fprintf(stderr, "Failed to initialize the transport.\n");
+      return 1;
+   }
+
+   tids = calloc(threads, sizeof *tids);
+   if (tids == NULL) {
+      return 1;
+   }
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (i = 0; i < threads; i++) {
+      pthread_create(&tids[i], NULL, BenchReader, (void *)(uintptr_t)i);
+   }
+   for (i = 0; i < threads; i++) {
+      pthread_join(tids[i], NULL);
+   }
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   free(tids);
+
+   HgfsTransportExit();
+
+   elapsed = (end.tv_sec - start.tv_sec) +
+             (end.tv_nsec - start.tv_nsec) / 1e9;
+   printf("%u threads x %u reads on %u channels: %.3f s, %.0f ops/sec, %lu errors\n",
+          threads, benchOps, channels, elapsed,
+          elapsed > 0 ? threads * (double)benchOps / elapsed : 0.0,
+          benchErrors);
+   HgfsGetRequestPoolStats(&poolStats);
+   printf("request pool of %u: %"FMT64"u hits, %"FMT64"u misses, "
+          "%"FMT64"u released\n", pool, poolStats.hits, poolStats.misses,
+          poolStats.released);
+
+   return benchErrors == 0 ? 0 : 1;
+}
@@ -0,0 +1,147 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file rpcDispatchBench.c
+ *
+ * Microbenchmark for the inbound RPC dispatch. Sets up a debug channel with
+ * a handful of registered RPCs, like an application would, and feeds it a
+ * mix of TCLO messages (known and unknown commands, with and without
+ * arguments) the same way the debug channel does, timing the dispatch.
+ *
+ * Usage: vmware-rpcdispatch-bench [number of dispatches]
+ */
+
+#define G_LOG_DOMAIN "rpcdbg"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "vmware.h"
+#include "vmrpcdbgInt.h"
+#include "rpcChannelInt.h"
+
+#define BENCH_DEFAULT_DISPATCHES   1000000
+
+/**
+ * Handler of the benchmark RPCs. Does nothing.
+ *
+ * @param[in]  data     The RPC data.
+ *
+ * @return TRUE.
+ */
+
+static gboolean
+BenchRpcCb(RpcInData *data)
+{
+   return RPCIN_SETRETVALS(data, "", TRUE);
+}
+
+
+int
+main(int argc,
+     char *argv[])
+{
+   static RpcChannelCallback rpcs[] = {
+      { "Capabilities_Register", BenchRpcCb, NULL, NULL, NULL, 0 },
+      { "Set_Option", BenchRpcCb, NULL, NULL, NULL, 0 },
+      { "OS_PowerOn", BenchRpcCb, NULL, NULL, NULL, 0 },
+      { "OS_Resume", BenchRpcCb, NULL, NULL, NULL, 0 },
+      { "Time_Synchronize", BenchRpcCb, NULL, NULL, NULL, 0 },
+      { "vmsvc.guestInfo.refresh", BenchRpcCb, NULL, NULL, NULL, 0 },
+   };
+   static const char *msgs[] = {
+      "ping",
+      "Capabilities_Register",
+      "Set_Option synctime 1",
+      "Set_Option broadcastIP 1",
+      "OS_Resume",
+      "Time_Synchronize 0",
+      "vmsvc.guestInfo.refresh",
+      "Unknown_Command with some arguments",
+   };
+   size_t msgLens[ARRAYSIZE(msgs)];
+   RpcDebugPlugin plugin;
+   RpcDebugLibData libData;
+   ToolsAppCtx ctx;
+   RpcChannel *chan;
+   GTimer *timer;
+   gulong dispatches = BENCH_DEFAULT_DISPATCHES;
+   gulong failures = 0;
+   gulong i;
+   gdouble secs;
+
+   if (argc > 1) {
+      dispatches = strtoul(argv[1], NULL, 10);
+   }
+   if (dispatches == 0) {
+      dispatches = 1;
+   }
+
+   memset(&plugin, 0, sizeof plugin);
+   memset(&libData, 0, sizeof libData);
+   memset(&ctx, 0, sizeof ctx);
+   libData.debugPlugin = &plugin;
+   ctx.name = "rpcDispatchBench";
+   ctx.mainLoop = g_main_loop_new(NULL, FALSE);
+
+   chan = RpcDebug_NewDebugChannel(&ctx, &libData);
+   ctx.rpc = chan;
+   RpcChannel_Setup(chan, ctx.name, g_main_loop_get_context(ctx.mainLoop),
+                    &ctx, NULL, NULL, NULL, 0);
+   for (i = 0; i < ARRAYSIZE(rpcs); i++) {
+      RpcChannel_RegisterCallback(chan, &rpcs[i]);
+   }
+   for (i = 0; i < ARRAYSIZE(msgs); i++) {
+      msgLens[i] = strlen(msgs[i]);
+   }
+
+   timer = g_timer_new();
+   for (i = 0; i < dispatches; i++) {
+      RpcInData data;
+      size_t msg = i % ARRAYSIZE(msgs);
+
+      memset(&data, 0, sizeof data);
+      data.clientData = chan;
+      data.appCtx = &ctx;
+      data.args = msgs[msg];
+      data.argsSize = msgLens[msg];
+
+      if (!RpcChannel_Dispatch(&data)) {
+         failures++;
+      }
+      if (data.freeResult) {
+         vm_free(data.result);
+      }
+   }
+   g_timer_stop(timer);
+   secs = g_timer_elapsed(timer, NULL);
+
+   g_print("%lu dispatches (%lu unknown commands) in %.3f s: "
+           "%.1f ns/dispatch\n",
+           dispatches, failures, secs, secs * 1e9 / dispatches);
+
+   g_timer_destroy(timer);
+   for (i = 0; i < ARRAYSIZE(rpcs); i++) {
+      RpcChannel_UnregisterCallback(chan, &rpcs[i]);
+   }
+   RpcChannel_Destroy(chan);
+   g_main_loop_unref(ctx.mainLoop);
+
+   return 0;
+}
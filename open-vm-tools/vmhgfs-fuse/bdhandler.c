@@ -34,8 +34,6 @@
 #include "transport.h"
 #include "vm_assert.h"
 
-static HgfsTransportChannel bdChannel;
-
 
 /*
  *-----------------------------------------------------------------------------
@@ -207,7 +205,7 @@ HgfsBdChannelSend(HgfsTransportChannel *channel, // IN: Channel
  *     None
  *
  * Side effects:
- *     None
+ *     Frees the channel.
  *
  *----------------------------------------------------------------------
  */
@@ -219,6 +217,8 @@ HgfsBdChannelExit(HgfsTransportChannel *channel)  // IN
    HgfsBdChannelCloseInt(channel);
    channel->status = HGFS_CHANNEL_UNINITIALIZED;
    pthread_mutex_unlock(&channel->connLock);
+   pthread_mutex_destroy(&channel->connLock);
+   free(channel);
 }
 
 
@@ -227,10 +227,12 @@ HgfsBdChannelExit(HgfsTransportChannel *channel)  // IN
  *
  * HgfsBdChannelInit --
  *
- *     Initialize backdoor channel.
+ *     Initialize a backdoor channel. Each channel has its own RPC
+ *     channel to the host, so several of them can be used in parallel.
  *
  * Results:
- *     Always return pointer to back door channel.
+ *     Pointer to the new back door channel, NULL if out of memory. It is
+ *     freed by its exit operation.
  *
  * Side effects:
  *     None
@@ -241,14 +243,23 @@ HgfsBdChannelExit(HgfsTransportChannel *channel)  // IN
 HgfsTransportChannel*
 HgfsBdChannelInit(void)
 {
-   bdChannel.name = "backdoor";
-   bdChannel.ops.open = HgfsBdChannelOpen;
-   bdChannel.ops.close = HgfsBdChannelClose;
-   bdChannel.ops.send = HgfsBdChannelSend;
-   bdChannel.ops.recv = NULL;
-   bdChannel.ops.exit = HgfsBdChannelExit;
-   bdChannel.priv = NULL;
-   pthread_mutex_init(&bdChannel.connLock, NULL);
-   bdChannel.status = HGFS_CHANNEL_NOTCONNECTED;
-   return &bdChannel;
+   HgfsTransportChannel *bdChannel;
+
+   bdChannel = malloc(sizeof *bdChannel);
+   if (bdChannel == NULL) {
+      LOG(4, ("Cannot allocate backdoor channel.\n"));
+      return NULL;
+   }
+
+   bdChannel->name = "backdoor";
+   bdChannel->ops.open = HgfsBdChannelOpen;
+   bdChannel->ops.close = HgfsBdChannelClose;
+   bdChannel->ops.send = HgfsBdChannelSend;
+   bdChannel->ops.recv = NULL;
+   bdChannel->ops.exit = HgfsBdChannelExit;
+   bdChannel->priv = NULL;
+   bdChannel->async = FALSE;
+   pthread_mutex_init(&bdChannel->connLock, NULL);
+   bdChannel->status = HGFS_CHANNEL_NOTCONNECTED;
+   return bdChannel;
 }
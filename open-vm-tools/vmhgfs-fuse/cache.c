@@ -20,11 +20,31 @@
  * cache.c --
  *
  * Module-specific components of the vmhgfs driver.
+ *
+ * The attribute cache is a hash table keyed by the absolute HGFS path.
+ * It is split into a fixed number of shards, each with its own lock,
+ * hash buckets and LRU list, so that concurrent FUSE worker threads
+ * looking up unrelated paths do not contend with each other. Every shard
+ * enforces a hard cap on both the number of entries and the bytes used by
+ * them; inserting past either cap evicts from the cold end of the LRU.
+ *
+ * The same table also holds negative entries for paths the server
+ * reported as missing, so that repeated probes of nonexistent files (include
+ * search paths, optional configuration files) are answered locally for
+ * the attribute timeout. Negative entries live under the same limits as
+ * the attribute entries. Each shard counts its invalidations so that a
+ * lookup which raced with a create does not insert a stale negative entry.
+ *
+ * A rename or a symlink can make a whole subtree of missing paths appear
+ * at once. Rather than searching the cache for the negative entries below
+ * the new path, the invalidation bumps a counter in a small table indexed
+ * by the path hash. A negative entry records the sum of the counters of
+ * its path and of every directory above it, and is only trusted while
+ * that sum is unchanged. The hashes of the leading directories come for
+ * free when hashing a path, so checking this is one pass over the path.
  */
 #include "module.h"
-#if !defined(__FreeBSD__) && !defined(__SOLARIS__)
-#include <glib.h>
-#endif
+#include "vm_atomic.h"
 
 /*
  * We make the default attribute cache timeout 1 second which is the same
@@ -34,8 +54,24 @@
 #define CACHE_TIMEOUT HGFS_DEFAULT_TTL
 #define CACHE_PURGE_TIME 10
 #define CACHE_PURGE_SLEEP_TIME 30
-#define HASH_THRESHOLD_SIZE (2046 * 4)
-#define HASH_PURGE_SIZE (HASH_THRESHOLD_SIZE / 2)
+
+/*
+ * Cache geometry. Shard and bucket counts must be powers of 2.
+ * The entry and byte limits are for the whole cache and are divided
+ * evenly between the shards.
+ */
+#define CACHE_SHARD_COUNT 16
+#define CACHE_BUCKET_COUNT 1024
+#define CACHE_MAX_ENTRIES (64 * 1024)
+#define CACHE_MAX_BYTES (32 * 1024 * 1024)
+#define CACHE_SHARD_MAX_ENTRIES (CACHE_MAX_ENTRIES / CACHE_SHARD_COUNT)
+#define CACHE_SHARD_MAX_BYTES (CACHE_MAX_BYTES / CACHE_SHARD_COUNT)
+/* Slots of subtree invalidation counters, must be a power of 2. */
+#define CACHE_NEGATIVE_SLOTS 1024
+
+/* FNV-1a parameters. */
+#define CACHE_FNV_OFFSET_BASIS 2166136261U
+#define CACHE_FNV_PRIME 16777619U
 #include "cache.h"
 
 /*
@@ -45,59 +81,116 @@
 typedef struct HgfsAttrCache {
    HgfsAttrInfo attr; /* Attribute of a file or directory */
    uint64 changeTime; /* time the attribute was last updated */
-   struct list_head list; /* used in linked list implementation */
+   uint32 hash;       /* hash of path */
+   size_t size;       /* bytes accounted to this entry */
+   Bool negative;     /* path does not exist, attr is unused */
+   uint32 negativeGeneration; /* subtree counters when cached as missing */
+   struct list_head hashList; /* link in the hash bucket chain */
+   struct list_head lruList;  /* link in the shard LRU, newest first */
    char path[0];      /* path of the file corresponding the the attr */
 } HgfsAttrCache;
 
+/*
+ * HgfsAttrCacheShard, an independently locked slice of the cache
+ */
 
-/* Head of the list */
-struct HgfsAttrCache attrList;
+typedef struct HgfsAttrCacheShard {
+   pthread_mutex_t lock;      /* protects everything in the shard */
+   struct list_head buckets[CACHE_BUCKET_COUNT];
+   struct list_head lru;      /* most recently used entry at the head */
+   uint32 entries;            /* number of cached entries */
+   uint32 negatives;          /* how many of them are negative entries */
+   uint32 generation;         /* bumped by every invalidation */
+   size_t bytes;              /* memory used by cached entries */
+   uint64 hits;               /* lookups answered from the cache */
+   uint64 misses;             /* lookups not found or expired */
+   uint64 negativeHits;       /* lookups answered by a negative entry */
+   uint64 evictions;          /* entries dropped to honor the limits */
+} HgfsAttrCacheShard;
+
+static HgfsAttrCacheShard attrCacheShards[CACHE_SHARD_COUNT];
+static Bool negativeCacheEnabled;
+static Atomic_uint32 negativeGenerations[CACHE_NEGATIVE_SLOTS];
 
-/*Lock for accessing the attribute cache*/
-static pthread_mutex_t HgfsAttrCacheLock = PTHREAD_MUTEX_INITIALIZER;
 
 /*
- * Lists are used to manage attribute cache in Solaris and FreeBSD,
- * HashTables are used in Linux. HashTables perform better and hence
- * once newer version of glib with hash tables are packaged for Solaris
- * and FreeBSD, this section will go away.
+ *----------------------------------------------------------------------
+ *
+ * HgfsAttrCacheHash
+ *
+ *    Computes the FNV-1a hash of the path.
+ *
+ * Results:
+ *    The hash value.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
  */
 
-#if defined(__FreeBSD__) || defined(__SOLARIS__)
+static uint32
+HgfsAttrCacheHash(const char *path) //IN: Path of file or directory
+{
+   uint32 hash = CACHE_FNV_OFFSET_BASIS;
+
+   while (*path != '\0') {
+      hash ^= (uint8)*path++;
+      hash *= CACHE_FNV_PRIME;
+   }
+   return hash;
+}
+
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsInitCache
+ * HgfsAttrCacheNegativeGeneration
  *
- *    Initializes the list attrList to cache attributes.
+ *    Sums the subtree invalidation counters of the path and of every
+ *    directory above it. The hash of each leading directory is the hash
+ *    of the path so far when reaching the '/' that ends it.
  *
  * Results:
- *    None
+ *    The sum. It changes whenever HgfsInvalidateNegativeAttrCache is
+ *    called on the path or on one of its ancestors, and occasionally
+ *    for an unrelated path sharing a counter.
  *
  * Side effects:
  *    None
  *
  *----------------------------------------------------------------------
- *
  */
 
-void
-HgfsInitCache()
+static uint32
+HgfsAttrCacheNegativeGeneration(const char *path) //IN: Path of file or directory
 {
-   INIT_LIST_HEAD(&attrList.list);
+   const char *cur;
+   uint32 hash = CACHE_FNV_OFFSET_BASIS;
+   uint32 generation = 0;
+
+   for (cur = path; *cur != '\0'; cur++) {
+      if (*cur == '/' && cur != path) {
+         generation += Atomic_Read32(
+            &negativeGenerations[hash & (CACHE_NEGATIVE_SLOTS - 1)]);
+      }
+      hash ^= (uint8)*cur;
+      hash *= CACHE_FNV_PRIME;
+   }
+   return generation +
+          Atomic_Read32(&negativeGenerations[hash & (CACHE_NEGATIVE_SLOTS - 1)]);
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsGetAttrCache
+ * HgfsAttrCacheGetShard
  *
- *    Retrieves the attr from the list for a given path.
+ *    Maps a hash value to the shard that owns it.
  *
  * Results:
- *    0 on success else -1 on error
+ *    The shard.
  *
  * Side effects:
  *    None
@@ -105,47 +198,47 @@ HgfsInitCache()
  *----------------------------------------------------------------------
  */
 
-int
-HgfsGetAttrCache(const char* path,   //IN: Path of file or directory
-                 HgfsAttrInfo *attr) //IN: Attribute for a given path
+static INLINE HgfsAttrCacheShard *
+HgfsAttrCacheGetShard(uint32 hash) //IN: Path hash
 {
-   HgfsAttrCache *tmp;
-   int res = -1;
-   int diff;
-
-   pthread_mutex_lock(&HgfsAttrCacheLock);
-
-   attrList.changeTime = HGFS_GET_TIME(time(NULL));
-   list_for_each_entry(tmp, &attrList.list, list) {
-      LOG(4, ("tmp->path = %d\n", tmp->path));
-      if (strcmp(path, tmp->path) == 0) {
-         LOG(4, ("cache hit. path = %s\n", tmp->path));
+   return &attrCacheShards[hash & (CACHE_SHARD_COUNT - 1)];
+}
 
-         diff = (HGFS_GET_TIME(time(NULL)) - tmp->changeTime) / 10000000;
 
-         LOG(4, ("time since last updated is %d seconds\n", diff));
-         if (diff <= CACHE_TIMEOUT) {
-            *attr = tmp->attr;
-            res = 0;
-         }
-         break;
-      }
-   }
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsAttrCacheGetBucket
+ *
+ *    Maps a hash value to the bucket chain inside its shard. The low
+ *    bits already selected the shard, so use the next ones up.
+ *
+ * Results:
+ *    The bucket list head.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
 
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
-   return res;
+static INLINE struct list_head *
+HgfsAttrCacheGetBucket(HgfsAttrCacheShard *shard, //IN: Shard
+                       uint32 hash)               //IN: Path hash
+{
+   return &shard->buckets[(hash / CACHE_SHARD_COUNT) & (CACHE_BUCKET_COUNT - 1)];
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsSetAttrCache
+ * HgfsAttrCacheFind
  *
- *    Updates the list with the given (key, attr)pair.
+ *    Looks up the entry for a path. Shard lock must be held.
  *
  * Results:
- *    0 on success else negative value on error
+ *    The entry or NULL if the path is not cached.
  *
  * Side effects:
  *    None
@@ -153,49 +246,29 @@ HgfsGetAttrCache(const char* path,   //IN: Path of file or directory
  *----------------------------------------------------------------------
  */
 
-int
-HgfsSetAttrCache(const char* path,   //IN: Path of file or directory
-                 HgfsAttrInfo *attr) //IN: Attribute for a given path
+static HgfsAttrCache *
+HgfsAttrCacheFind(HgfsAttrCacheShard *shard, //IN: Shard
+                  uint32 hash,               //IN: Path hash
+                  const char *path)          //IN: Path of file or directory
 {
    HgfsAttrCache *tmp;
-   int res = 0;
 
-   pthread_mutex_lock(&HgfsAttrCacheLock);
-
-   attrList.changeTime = HGFS_GET_TIME(time(NULL));
-   list_for_each_entry (tmp, &attrList.list, list) {
-      if (strcmp(path, tmp->path) == 0) {
-         tmp->attr = *attr;
-         tmp->changeTime = HGFS_GET_TIME(time(NULL));
-         LOG(4, ("cache entry updated. path = %s\n", tmp->path));
-         goto out;
+   list_for_each_entry(tmp, HgfsAttrCacheGetBucket(shard, hash), hashList) {
+      if (tmp->hash == hash && strcmp(path, tmp->path) == 0) {
+         return tmp;
       }
    }
-
-   tmp = malloc(sizeof(HgfsAttrCache) + strlen(path) + 1);
-   if (tmp == NULL) {
-      res = -ENOMEM;
-      goto out;
-   }
-   INIT_LIST_HEAD(&tmp->list);
-   Str_Strcpy(tmp->path, path, strlen(path) + 1);
-   tmp->attr = *attr;
-   tmp->changeTime = HGFS_GET_TIME(time(NULL));
-   list_add(&tmp->list, &attrList.list);
-   LOG(4, ("cache entry added. path = %s\n", tmp->path));
-
-out:
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
-   return res;
+   return NULL;
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsInvalidateAttrCache
+ * HgfsAttrCacheRemove
  *
- *    Invalidate the attribute list entry for a given path.
+ *    Unlinks an entry from its shard and frees it. Shard lock must be
+ *    held.
  *
  * Results:
  *    None
@@ -206,32 +279,30 @@ out:
  *----------------------------------------------------------------------
  */
 
-void
-HgfsInvalidateAttrCache(const char* path)      //IN: Path to file
+static void
+HgfsAttrCacheRemove(HgfsAttrCacheShard *shard, //IN: Shard
+                    HgfsAttrCache *entry)      //IN: Entry to remove
 {
-   HgfsAttrCache *tmp;
-
-   pthread_mutex_lock(&HgfsAttrCacheLock);
-
-   list_for_each_entry (tmp, &attrList.list, list) {
-      if (strcmp(path, tmp->path) == 0) {
-         list_del(&tmp->list);
-         free(tmp);
-         break;
-      }
+   list_del(&entry->hashList);
+   list_del(&entry->lruList);
+   ASSERT(shard->entries > 0 && shard->bytes >= entry->size);
+   if (entry->negative) {
+      ASSERT(shard->negatives > 0);
+      shard->negatives--;
    }
-
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
+   shard->entries--;
+   shard->bytes -= entry->size;
+   free(entry);
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsPurgeCache:
+ * HgfsAttrCacheEvict
  *
- *    This routine is called by an independent thread to purge the cache,
- *    deletion is based on time of last update.
+ *    Drops least recently used entries until there is room for a new
+ *    entry of the given size. Shard lock must be held.
  *
  * Results:
  *    None
@@ -242,43 +313,101 @@ HgfsInvalidateAttrCache(const char* path)      //IN: Path to file
  *----------------------------------------------------------------------
  */
 
-void*
-HgfsPurgeCache(void* unused) //IN: Thread argument
+static void
+HgfsAttrCacheEvict(HgfsAttrCacheShard *shard, //IN: Shard
+                   size_t size)               //IN: Size of the new entry
 {
-   HgfsAttrCache *tmp;
-   HgfsAttrCache *prev;
-   int diff;
+   while (!list_empty(&shard->lru) &&
+          (shard->entries + 1 > CACHE_SHARD_MAX_ENTRIES ||
+           shard->bytes + size > CACHE_SHARD_MAX_BYTES)) {
+      HgfsAttrCache *victim = list_entry(shard->lru.prev, HgfsAttrCache,
+                                         lruList);
+
+      LOG(4, ("cache entry evicted. path = %s\n", victim->path));
+      HgfsAttrCacheRemove(shard, victim);
+      shard->evictions++;
+   }
+}
 
-   while (1)
-   {
-      sleep(CACHE_PURGE_SLEEP_TIME);
 
-      pthread_mutex_lock(&HgfsAttrCacheLock);
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsAttrCacheAdd
+ *
+ *    Adds or updates the entry for a path. A NULL attr makes it a
+ *    negative entry, valid while the subtree counters of the path sum
+ *    to negativeGeneration. Shard lock must be held.
+ *
+ * Results:
+ *    0 on success else negative value on error
+ *
+ * Side effects:
+ *    May evict the least recently used entries of the shard.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsAttrCacheAdd(HgfsAttrCacheShard *shard, //IN: Shard
+                 uint32 hash,               //IN: Path hash
+                 const char *path,          //IN: Path of file or directory
+                 HgfsAttrInfo *attr,        //IN: Attribute or NULL
+                 uint32 negativeGeneration) //IN: Subtree counters if NULL
+{
+   size_t pathLen = strlen(path);
+   size_t size = sizeof(HgfsAttrCache) + pathLen + 1;
+   HgfsAttrCache *tmp;
 
-      list_for_each_entry_safe (tmp, prev, &attrList.list, list) {
-         diff = (HGFS_GET_TIME(time(NULL)) - tmp->changeTime) / 10000000;
-         if (diff > CACHE_PURGE_TIME) {
-            list_del (&tmp->list);
-            free (tmp);
-         }
+   tmp = HgfsAttrCacheFind(shard, hash, path);
+   if (tmp != NULL) {
+      list_move(&tmp->lruList, &shard->lru);
+      LOG(4, ("cache entry updated. path = %s\n", tmp->path));
+   } else {
+      HgfsAttrCacheEvict(shard, size);
+
+      tmp = malloc(size);
+      if (tmp == NULL) {
+         return -ENOMEM;
       }
 
-      pthread_mutex_unlock(&HgfsAttrCacheLock);
+      Str_Strcpy(tmp->path, path, pathLen + 1);
+      tmp->hash = hash;
+      tmp->size = size;
+      tmp->negative = FALSE;
+
+      list_add(&tmp->hashList, HgfsAttrCacheGetBucket(shard, hash));
+      list_add(&tmp->lruList, &shard->lru);
+      shard->entries++;
+      shard->bytes += size;
+      LOG(4, ("cache entry added. path = %s\n", tmp->path));
    }
+
+   if (tmp->negative) {
+      shard->negatives--;
+   }
+   if (attr != NULL) {
+      tmp->attr = *attr;
+      /* The symlink target is owned by the caller. */
+      tmp->attr.fileName = NULL;
+      tmp->negative = FALSE;
+   } else {
+      memset(&tmp->attr, 0, sizeof tmp->attr);
+      tmp->negative = TRUE;
+      tmp->negativeGeneration = negativeGeneration;
+      shard->negatives++;
+   }
+   tmp->changeTime = HGFS_GET_TIME(time(NULL));
    return 0;
 }
 
-#else
-
-
-GHashTable *g_hash_table;
 
 /*
  *----------------------------------------------------------------------
  *
  * HgfsInitCache
  *
- *    Creates a hash table with string as a key.
+ *    Initializes the shards of the attribute cache.
  *
  * Results:
  *    None
@@ -290,9 +419,32 @@ GHashTable *g_hash_table;
  */
 
 void
-HgfsInitCache()
+HgfsInitCache(Bool negativeCache) //IN: Whether to cache missing paths
 {
-   g_hash_table = g_hash_table_new(g_str_hash, g_str_equal);
+   unsigned int i;
+   unsigned int j;
+
+   for (i = 0; i < CACHE_SHARD_COUNT; i++) {
+      HgfsAttrCacheShard *shard = &attrCacheShards[i];
+
+      pthread_mutex_init(&shard->lock, NULL);
+      for (j = 0; j < CACHE_BUCKET_COUNT; j++) {
+         INIT_LIST_HEAD(&shard->buckets[j]);
+      }
+      INIT_LIST_HEAD(&shard->lru);
+      shard->entries = 0;
+      shard->negatives = 0;
+      shard->generation = 0;
+      shard->bytes = 0;
+      shard->hits = 0;
+      shard->misses = 0;
+      shard->negativeHits = 0;
+      shard->evictions = 0;
+   }
+   for (i = 0; i < CACHE_NEGATIVE_SLOTS; i++) {
+      Atomic_Write32(&negativeGenerations[i], 0);
+   }
+   negativeCacheEnabled = negativeCache;
 }
 
 
@@ -301,13 +453,14 @@ HgfsInitCache()
  *
  * HgfsGetAttrCache
  *
- *    Retrieves the attr from the HashTable for a given path.
+ *    Retrieves the attr from the cache for a given path.
  *
  * Results:
- *    0 on success else -1 on error
+ *    0 on success, -ENOENT if the path is cached as missing, else -1.
  *
  * Side effects:
- *    None
+ *    A hit moves the entry to the head of the LRU. A negative entry
+ *    below a path invalidated since is dropped.
  *
  *----------------------------------------------------------------------
  */
@@ -316,25 +469,47 @@ int
 HgfsGetAttrCache(const char* path,   //IN: Path of file or directory
                  HgfsAttrInfo *attr) //IN: Attribute for a given path
 {
+   uint32 hash = HgfsAttrCacheHash(path);
+   HgfsAttrCacheShard *shard = HgfsAttrCacheGetShard(hash);
    HgfsAttrCache *tmp;
    int res = -1;
    int diff;
 
-   pthread_mutex_lock(&HgfsAttrCacheLock);
+   pthread_mutex_lock(&shard->lock);
 
-   tmp = (HgfsAttrCache *)g_hash_table_lookup(g_hash_table, path);
+   tmp = HgfsAttrCacheFind(shard, hash, path);
    if (tmp != NULL) {
       LOG(4, ("cache hit. path = %s\n", tmp->path));
 
       diff = (HGFS_GET_TIME(time(NULL)) - tmp->changeTime) / 10000000;
       LOG(4, ("time since last updated is %d seconds\n", diff));
-      if ( diff <= CACHE_TIMEOUT ) {
-         *attr = tmp->attr;
-         res = 0;
+      if (diff <= CACHE_TIMEOUT) {
+         if (!tmp->negative) {
+            *attr = tmp->attr;
+            res = 0;
+         } else if (tmp->negativeGeneration ==
+                    HgfsAttrCacheNegativeGeneration(path)) {
+            res = -ENOENT;
+         }
+
+         if (res != -1) {
+            list_move(&tmp->lruList, &shard->lru);
+         } else {
+            LOG(4, ("stale negative entry. path = %s\n", tmp->path));
+            HgfsAttrCacheRemove(shard, tmp);
+         }
       }
    }
 
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
+   if (res == 0) {
+      shard->hits++;
+   } else if (res == -ENOENT) {
+      shard->negativeHits++;
+   } else {
+      shard->misses++;
+   }
+
+   pthread_mutex_unlock(&shard->lock);
    return res;
 }
 
@@ -344,13 +519,13 @@ HgfsGetAttrCache(const char* path,   //IN: Path of file or directory
  *
  * HgfsSetAttrCache
  *
- *    Updates the HashTable with the given (key, attr) pair.
+ *    Updates the cache with the given (key, attr) pair.
  *
  * Results:
  *    0 on success else negative value on error
  *
  * Side effects:
- *    None
+ *    May evict the least recently used entries of the shard.
  *
  *----------------------------------------------------------------------
  */
@@ -359,33 +534,88 @@ int
 HgfsSetAttrCache(const char* path,         //IN: Path of file or directory
                  HgfsAttrInfo *attr)       //IN: Attribute for a given path
 {
-   HgfsAttrCache *tmp;
-   int res = 0;
+   uint32 hash = HgfsAttrCacheHash(path);
+   HgfsAttrCacheShard *shard = HgfsAttrCacheGetShard(hash);
+   int res;
 
-   pthread_mutex_lock(&HgfsAttrCacheLock);
+   pthread_mutex_lock(&shard->lock);
+   res = HgfsAttrCacheAdd(shard, hash, path, attr, 0);
+   pthread_mutex_unlock(&shard->lock);
+   return res;
+}
 
-   tmp = (HgfsAttrCache *)g_hash_table_lookup(g_hash_table, path);
-   if (tmp != NULL) {
-      tmp->attr = *attr;
-      tmp->changeTime = HGFS_GET_TIME(time(NULL));
-      goto out;
-   }
 
-   tmp = malloc(sizeof(HgfsAttrCache) + strlen(path) + 1);
-   if (tmp == NULL) {
-      res = -ENOMEM;
-      goto out;
-   }
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsGetAttrCacheGeneration
+ *
+ *    Samples the invalidation counts covering a path: those of its shard
+ *    and the subtree counters of the path and its ancestors. Taken before
+ *    asking the server about the path and handed back to
+ *    HgfsSetNegativeAttrCache.
+ *
+ * Results:
+ *    The generation.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
 
-   Str_Strcpy(tmp->path, path, strlen(path) + 1);
-   tmp->attr = *attr;
-   tmp->changeTime = HGFS_GET_TIME(time(NULL));
+uint32
+HgfsGetAttrCacheGeneration(const char* path) //IN: Path of file or directory
+{
+   HgfsAttrCacheShard *shard = HgfsAttrCacheGetShard(HgfsAttrCacheHash(path));
+   uint32 generation;
 
-   g_hash_table_insert(g_hash_table, (gpointer)tmp->path, (gpointer)tmp);
+   pthread_mutex_lock(&shard->lock);
+   generation = shard->generation;
+   pthread_mutex_unlock(&shard->lock);
+   return generation + HgfsAttrCacheNegativeGeneration(path);
+}
 
-out:
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
-   return res;
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsSetNegativeAttrCache
+ *
+ *    Records that the server reported the path as missing. Nothing is
+ *    recorded if negative caching is disabled or if the path may have
+ *    been created since the generation was sampled.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    May evict the least recently used entries of the shard.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsSetNegativeAttrCache(const char* path,  //IN: Path of missing file
+                         uint32 generation) //IN: From HgfsGetAttrCacheGeneration
+{
+   uint32 hash;
+   uint32 negativeGeneration;
+   HgfsAttrCacheShard *shard;
+
+   if (!negativeCacheEnabled) {
+      return;
+   }
+
+   hash = HgfsAttrCacheHash(path);
+   shard = HgfsAttrCacheGetShard(hash);
+
+   pthread_mutex_lock(&shard->lock);
+   negativeGeneration = HgfsAttrCacheNegativeGeneration(path);
+   if (shard->generation + negativeGeneration == generation) {
+      HgfsAttrCacheAdd(shard, hash, path, NULL, negativeGeneration);
+   }
+   pthread_mutex_unlock(&shard->lock);
 }
 
 
@@ -394,7 +624,7 @@ out:
  *
  * HgfsInvalidateAttrCache
  *
- *    Invalidate the HashTable entry for a path.
+ *    Invalidate the cache entry for a path.
  *
  * Results:
  *    None
@@ -408,24 +638,96 @@ out:
 void
 HgfsInvalidateAttrCache(const char* path)      //IN: Path to file
 {
+   uint32 hash = HgfsAttrCacheHash(path);
+   HgfsAttrCacheShard *shard = HgfsAttrCacheGetShard(hash);
    HgfsAttrCache *tmp;
 
-   pthread_mutex_lock(&HgfsAttrCacheLock);
-   tmp = (HgfsAttrCache *)g_hash_table_lookup(g_hash_table, path);
+   pthread_mutex_lock(&shard->lock);
+   shard->generation++;
+   tmp = HgfsAttrCacheFind(shard, hash, path);
    if (tmp != NULL) {
-      tmp->changeTime = 0;
+      HgfsAttrCacheRemove(shard, tmp);
+   }
+   pthread_mutex_unlock(&shard->lock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsInvalidateNegativeAttrCache
+ *
+ *    Invalidates the negative entries for a path and everything below it.
+ *    Used when a directory or symlink appears at the path, which can
+ *    make paths under it resolve. Takes no lock and touches no entry: the
+ *    entries are dropped when next looked up, and lookups in flight below
+ *    the path do not cache their answer.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsInvalidateNegativeAttrCache(const char* path) //IN: Path of new entry
+{
+   uint32 hash = HgfsAttrCacheHash(path);
+
+   Atomic_Inc32(&negativeGenerations[hash & (CACHE_NEGATIVE_SLOTS - 1)]);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsGetAttrCacheStats
+ *
+ *    Sums up the counters of all the shards.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsGetAttrCacheStats(HgfsAttrCacheStats *stats) //OUT: Cache counters
+{
+   unsigned int i;
+
+   memset(stats, 0, sizeof *stats);
+   for (i = 0; i < CACHE_SHARD_COUNT; i++) {
+      HgfsAttrCacheShard *shard = &attrCacheShards[i];
+
+      pthread_mutex_lock(&shard->lock);
+      stats->entries += shard->entries;
+      stats->bytes += shard->bytes;
+      stats->hits += shard->hits;
+      stats->misses += shard->misses;
+      stats->negativeHits += shard->negativeHits;
+      stats->evictions += shard->evictions;
+      pthread_mutex_unlock(&shard->lock);
    }
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
 }
 
+
 /*
  *----------------------------------------------------------------------
  *
  * HgfsPurgeCache
  *
  *    This routine is called by an independent thread to purge the cache,
- *    for performance reasons, the deletion is done in random based
- *    on the order of iteration.
+ *    deletion is based on time of last update. The size limits are
+ *    enforced on insertion, so this only drops entries that are too old
+ *    to ever be returned again. Shards are purged one at a time so
+ *    lookups in the other shards proceed meanwhile.
  *
  * Results:
  *    None
@@ -439,25 +741,36 @@ HgfsInvalidateAttrCache(const char* path)      //IN: Path to file
 void*
 HgfsPurgeCache(void* unused)      //IN: Thread argument
 {
-   gpointer key, value;
-   GHashTableIter iter;
+   HgfsAttrCache *tmp;
+   HgfsAttrCache *next;
+   HgfsAttrCacheStats stats;
+   unsigned int i;
+   int diff;
 
    while (1) {
       sleep(CACHE_PURGE_SLEEP_TIME);
 
-      pthread_mutex_lock(&HgfsAttrCacheLock);
+      for (i = 0; i < CACHE_SHARD_COUNT; i++) {
+         HgfsAttrCacheShard *shard = &attrCacheShards[i];
+
+         pthread_mutex_lock(&shard->lock);
 
-      if (g_hash_table_size(g_hash_table) >= HASH_THRESHOLD_SIZE) {
-         g_hash_table_iter_init(&iter, g_hash_table);
-         while (g_hash_table_iter_next(&iter, &key, &value) &&
-               (g_hash_table_size(g_hash_table) >= HASH_PURGE_SIZE)) {
-            g_hash_table_iter_remove(&iter);
-            free(value);
+         list_for_each_entry_safe(tmp, next, &shard->lru, lruList) {
+            diff = (HGFS_GET_TIME(time(NULL)) - tmp->changeTime) / 10000000;
+            if (diff > CACHE_PURGE_TIME) {
+               HgfsAttrCacheRemove(shard, tmp);
+            }
          }
+
+         pthread_mutex_unlock(&shard->lock);
       }
 
-      pthread_mutex_unlock(&HgfsAttrCacheLock);
+      HgfsGetAttrCacheStats(&stats);
+      LOG(4, ("attr cache: %u entries, %"FMTSZ"u bytes, %"FMT64"u hits, "
+              "%"FMT64"u negative hits, %"FMT64"u misses, "
+              "%"FMT64"u evictions\n", stats.entries, stats.bytes,
+              stats.hits, stats.negativeHits, stats.misses,
+              stats.evictions));
    }
    return 0;
 }
-#endif
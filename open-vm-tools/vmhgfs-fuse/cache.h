@@ -25,10 +25,26 @@
 #ifndef _HGFS_DRIVER_CACHE_H_
 #define _HGFS_DRIVER_CACHE_H_
 
+/*
+ * Attribute cache counters, summed over all the shards.
+ */
+typedef struct HgfsAttrCacheStats {
+   uint32 entries;     /* Number of cached entries */
+   size_t bytes;       /* Memory used by cached entries */
+   uint64 hits;        /* Lookups answered from the cache */
+   uint64 misses;      /* Lookups not found or expired */
+   uint64 negativeHits; /* Lookups answered by a negative entry */
+   uint64 evictions;   /* Entries dropped to honor the size limits */
+} HgfsAttrCacheStats;
+
 int HgfsGetAttrCache(const char* path, HgfsAttrInfo *attr);
 int HgfsSetAttrCache(const char* path, HgfsAttrInfo *attr);
-void HgfsInitCache();
+uint32 HgfsGetAttrCacheGeneration(const char* path);
+void HgfsSetNegativeAttrCache(const char* path, uint32 generation);
+void HgfsInitCache(Bool negativeCache);
 void* HgfsPurgeCache(void*);
 void HgfsInvalidateAttrCache(const char* path);
+void HgfsInvalidateNegativeAttrCache(const char* path);
+void HgfsGetAttrCacheStats(HgfsAttrCacheStats *stats);
 
 #endif
@@ -22,6 +22,7 @@
  */
 
 #include "module.h"
+#include "readahead.h"
 #include <sys/utsname.h>
 
 #ifdef VMX86_DEVEL
@@ -75,6 +76,14 @@ const struct fuse_opt vmhgfsOpts[] = {
      VMHGFS_OPT("--loglevel %i",    logLevel, 4),
      VMHGFS_OPT("-l %i",            logLevel, 4),
 #endif
+     VMHGFS_OPT("readahead_window=%u", readAheadWindow, 0),
+     VMHGFS_OPT("writeback",        writeBack, TRUE),
+     VMHGFS_OPT("nowriteback",      writeBack, FALSE),
+     VMHGFS_OPT("negative_cache",   negativeCache, TRUE),
+     VMHGFS_OPT("nonegative_cache", negativeCache, FALSE),
+     VMHGFS_OPT("request_pool=%u",  requestPool, 0),
+     VMHGFS_OPT("lowlevel",         lowLevel, TRUE),
+     VMHGFS_OPT("channels=%u",      channels, 0),
      /* We will change the default value, unless it is specified explicitly. */
      FUSE_OPT_KEY("big_writes",     KEY_BIG_WRITES),
      FUSE_OPT_KEY("nobig_writes",   KEY_NO_BIG_WRITES),
@@ -121,12 +130,34 @@ Usage(char *prog_name)  // IN
            "                           1 - system OS version is not supported for HGFS FUSE\n"
            "                           2 - system needs FUSE packages for HGFS FUSE\n"
            "\n"
+           "vmhgfs mount options:\n"
+           "    -o readahead_window=N  sequential read-ahead per open file in\n"
+           "                           bytes (default %u, max %u, 0 disables);\n"
+           "                           needs an asynchronous host connection,\n"
+           "                           no effect over the backdoor\n"
+           "    -o writeback           buffer and merge small writes, errors\n"
+           "                           are reported by fsync and close\n"
+           "    -o nowriteback         write through (default)\n"
+           "    -o negative_cache      cache lookups of missing paths for the\n"
+           "                           attribute timeout (default)\n"
+           "    -o nonegative_cache    always ask the host about missing paths\n"
+           "    -o request_pool=N      request buffers kept for reuse\n"
+           "                           (default %u, max %u, 0 disables)\n"
+           "    -o lowlevel            use the inode based FUSE interface, with\n"
+           "                           -o entry_timeout=T, attr_timeout=T and\n"
+           "                           negative_timeout=T in seconds\n"
+           "    -o channels=N          host connections used in parallel\n"
+           "                           (default %u, max %u)\n"
+           "\n"
 #ifdef VMX86_DEVEL
            "vmhgfs options:\n"
            "    -l   --loglevel NUM    set loglevel=NUM only available in debug build.\n"
            "\n"
 #endif
-           , prog_name, prog_name, prog_name);
+           , prog_name, prog_name, prog_name,
+           HGFS_READAHEAD_DEFAULT_WINDOW, HGFS_READAHEAD_MAX_WINDOW,
+           HGFS_REQUEST_POOL_DEFAULT, HGFS_REQUEST_POOL_MAX,
+           HGFS_TRANSPORT_DEFAULT_CHANNELS, HGFS_TRANSPORT_MAX_CHANNELS);
 }
 
 #define LIB_MODULEPATH         "/lib/modules"
@@ -502,6 +533,12 @@ vmhgfsPreprocessArgs(struct fuse_args *outargs)    // IN/OUT
 #else
    config.addBigWrites = TRUE;
 #endif
+   config.readAheadWindow = HGFS_READAHEAD_DEFAULT_WINDOW;
+   config.writeBack = FALSE;
+   config.negativeCache = TRUE;
+   config.requestPool = HGFS_REQUEST_POOL_DEFAULT;
+   config.lowLevel = FALSE;
+   config.channels = HGFS_TRANSPORT_DEFAULT_CHANNELS;
 
    res = fuse_opt_parse(outargs, &config, vmhgfsOpts, vmhgfsOptProc);
    if (res != 0) {
@@ -511,6 +548,12 @@ vmhgfsPreprocessArgs(struct fuse_args *outargs)    // IN/OUT
 #ifdef VMX86_DEVEL
    LOGLEVEL_THRESHOLD = config.logLevel;
 #endif
+   gState->readAheadWindow = config.readAheadWindow;
+   gState->writeBack = config.writeBack;
+   gState->negativeCache = config.negativeCache;
+   gState->requestPool = config.requestPool;
+   gState->lowLevel = config.lowLevel;
+   gState->channels = config.channels;
    /* Default option changes for vmhgfs fuse client. */
    if (config.addBigWrites) {
       res = fuse_opt_add_arg(outargs, "-obig_writes");
@@ -32,6 +32,12 @@ struct vmhgfsConfig {
 #endif
    int addBigWrites;
    int addAllowOther;
+   unsigned int readAheadWindow;
+   int writeBack;
+   int negativeCache;
+   unsigned int requestPool;
+   int lowLevel;
+   unsigned int channels;
 };
 
 int vmhgfsOptProc(void *data, const char *arg,
@@ -22,6 +22,8 @@
  * File operations for the hgfs driver.
  */
 #include "module.h"
+#include "cache.h"
+#include "writeback.h"
 
 
 #define HGFS_CREATE_DIR_MASK (HGFS_CREATE_DIR_VALID_FILE_NAME | \
@@ -217,6 +219,126 @@ out:
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsDirClose --
+ *
+ *    Closes a search handle opened by HgfsDirOpen.
+ *
+ * Results:
+ *    Returns zero on success, or a negative error on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HgfsDirClose(HgfsHandle handle)     // IN: Handle to the dir
+{
+   HgfsReq *req;
+   int result;
+   HgfsOp opUsed;
+   HgfsStatus replyStatus;
+
+   req = HgfsGetNewRequest();
+   if (!req) {
+      LOG(4, ("Out of memory while getting new request.\n"));
+      result = -ENOMEM;
+      goto out;
+   }
+
+retry:
+   opUsed = hgfsVersionSearchClose;
+   if (opUsed == HGFS_OP_SEARCH_CLOSE_V3) {
+      HgfsRequestSearchCloseV3 *requestV3 = HgfsGetRequestPayload(req);
+
+      requestV3->search = handle;
+      requestV3->reserved = 0;
+      req->payloadSize = sizeof(*requestV3) + HgfsGetRequestHeaderSize();
+
+   } else {
+      HgfsRequestSearchClose *request;
+
+      request = (HgfsRequestSearchClose *)(HGFS_REQ_PAYLOAD(req));
+      request->search = handle;
+      req->payloadSize = sizeof *request;
+   }
+
+   /* Fill in header here as payloadSize needs to be there. */
+   HgfsPackHeader(req, opUsed);
+
+   /* Send the request and process the reply. */
+   result = HgfsSendRequest(req);
+   if (result == 0) {
+      replyStatus = HgfsGetReplyStatus(req);
+      result = HgfsStatusConvertToLinux(replyStatus);
+
+      /* Retry with older version(s). Set globally. */
+      if (result == -EPROTO && opUsed == HGFS_OP_SEARCH_CLOSE_V3) {
+         LOG(4, ("Version 3 not supported. Falling back to version 1.\n"));
+         hgfsVersionSearchClose = HGFS_OP_SEARCH_CLOSE;
+         goto retry;
+      }
+      LOG(6, ("Closed search %u, result %d\n", handle, result));
+   } else {
+      LOG(4, ("Error %d closing search %u\n", result, handle));
+   }
+
+out:
+   HgfsFreeRequest(req);
+   return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReadDirCacheAttr --
+ *
+ *    Adds the attributes of a directory entry to the attribute cache so
+ *    that the getattr calls which usually follow a listing do not each
+ *    go to the server.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsReadDirCacheAttr(const char *dirPath,   // IN: Path of the directory
+                     const char *name,      // IN: Escaped entry name
+                     HgfsAttrInfo *attr)    // IN: Attributes of the entry
+{
+   size_t dirLen = strlen(dirPath);
+   size_t size;
+   char *path;
+
+   if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+      return;
+   }
+
+   /* The root directory is "/", everything else has no trailing slash. */
+   if (dirLen > 0 && dirPath[dirLen - 1] == '/') {
+      dirLen--;
+   }
+   size = dirLen + strlen(name) + 2;
+   path = malloc(size);
+   if (path == NULL) {
+      return;
+   }
+   snprintf(path, size, "%.*s/%s", (int)dirLen, dirPath, name);
+   HgfsSetAttrCache(path, attr);
+   free(path);
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -230,6 +352,9 @@ out:
  *    server, while for V3 we may have multiple directory entries. The
  *    number of entries can be read from the reply packet.
  *
+ *    If dirPath is not NULL the attributes of each entry are also added
+ *    to the attribute cache.
+ *
  * Results:
  *    0 on success, anything else on failure.
  *
@@ -240,7 +365,8 @@ out:
  */
 
 static int
-HgfsReadDirFromReply(uint32 *f_pos,     // IN/OUT: Offset
+HgfsReadDirFromReply(const char *dirPath, // IN: Path of dir or NULL
+                     uint32 *f_pos,     // IN/OUT: Offset
                      void *vfsDirent,   // OUT: Buffer to copy dentries into
                      fuse_fill_dir_t filldir, // IN:  Filler function
                      HgfsReq *req,      // IN:  The request containing reply
@@ -400,6 +526,9 @@ HgfsReadDirFromReply(uint32 *f_pos,     // IN/OUT: Offset
       st.st_size = attr.size;
       st.st_ino = ino;
       st.st_mode = d_type << 12;
+      if (dirPath != NULL) {
+         HgfsReadDirCacheAttr(dirPath, escName, &attr);
+      }
       result = filldir(vfsDirent, escName, &st, 0);
 
       if (result) {
@@ -541,6 +670,13 @@ HgfsRequestDirEntries(HgfsHandle searchHandle, // IN: Handle to dir
  *       dentries, then readdir should NOT call filldir, and should
  *       return from readdir with a non-error.
  *
+ *    The search read replies carry the attributes of every entry, so
+ *    they are added to the attribute cache on the way. V3 replies pack
+ *    as many entries as fit, which makes listing a directory and then
+ *    stat'ing its entries (ls -l) cost about one round trip per reply
+ *    packet rather than one per entry. While buffered writes are pending
+ *    the sizes in the replies may be stale and the cache is left alone.
+ *
  * Results:
  *    Returns zero if on success, negative error on failure.
  *    (According to /fs/readdir.c, any non-negative return value
@@ -553,7 +689,8 @@ HgfsRequestDirEntries(HgfsHandle searchHandle, // IN: Handle to dir
  */
 
 int
-HgfsReaddir(HgfsHandle handle,        // IN:  Directory handle to read from
+HgfsReaddir(const char *path,         // IN:  Path of the directory
+            HgfsHandle handle,        // IN:  Directory handle to read from
             void *dirent,             // OUT: Buffer to copy dentries into
             fuse_fill_dir_t filldir)  // IN:  Filler function
 {
@@ -581,7 +718,8 @@ HgfsReaddir(HgfsHandle handle,        // IN:  Directory handle to read from
          break;
       }
 
-      result = HgfsReadDirFromReply(&f_pos, dirent, filldir, request, opUsed,
+      result = HgfsReadDirFromReply(HgfsWriteBackPending() ? NULL : path,
+                                    &f_pos, dirent, filldir, request, opUsed,
                                     &done);
 
       LOG(4, ("f_pos = %d\n", f_pos));
@@ -29,6 +29,8 @@
 #include "hgfsUtil.h"
 #include "fsutil.h"
 #include "file.h"
+#include "readahead.h"
+#include "writeback.h"
 #include "vm_assert.h"
 #include "vm_basic_types.h"
 
@@ -427,6 +429,16 @@ retry:
          fi->fh = (uint64_t)replyFile;
          LOG( 4,("Server file handle: %"FMT64"u\n", fi->fh));
 
+         if (fi->flags & O_TRUNC) {
+            HgfsReadAheadInvalidatePath(path);
+         }
+         if ((fi->flags & O_ACCMODE) != O_WRONLY) {
+            HgfsReadAheadOpen(replyFile, path);
+         }
+         if ((fi->flags & O_ACCMODE) != O_RDONLY) {
+            HgfsWriteBackOpen(replyFile, path);
+         }
+
          break;
 
       case -EPROTO:
@@ -511,6 +523,100 @@ HgfsCreate(const char *path,          //IN: Path to a file
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPackReadRequest --
+ *
+ *    Setup the read request, depending on the op version.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsPackReadRequest(HgfsHandle handle,  // IN:  Handle for this file
+                    size_t count,       // IN:  Number of bytes to read
+                    loff_t offset,      // IN:  Offset at which to read
+                    HgfsOp opUsed,      // IN:  Op to use
+                    HgfsReq *req)       // IN/OUT: Packet to write into
+{
+   ASSERT(NULL != req);
+
+   if (opUsed == HGFS_OP_READ_V3) {
+      HgfsRequestReadV3 *requestV3 = HgfsGetRequestPayload(req);
+
+      requestV3->file = handle;
+      requestV3->offset = offset;
+      requestV3->requiredSize = count;
+      requestV3->reserved = 0;
+
+      req->payloadSize = sizeof(*requestV3) + HgfsGetRequestHeaderSize();
+
+   } else {
+      HgfsRequestRead *request;
+
+      request = (HgfsRequestRead *)(HGFS_REQ_PAYLOAD(req));
+      request->file = handle;
+      request->offset = offset;
+      request->requiredSize = count;
+      req->payloadSize = sizeof *request;
+   }
+
+   /* Fill in header here as payloadSize needs to be there. */
+   HgfsPackHeader(req, opUsed);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsUnpackReadReply --
+ *
+ *    Locate the data returned in a successful read reply.
+ *
+ * Results:
+ *    Returns zero on success, or -EPROTO if the server returned more
+ *    than was asked for.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+HgfsUnpackReadReply(HgfsReq *req,          // IN:  Packet with reply inside
+                    HgfsOp opUsed,         // IN:  Op used for the request
+                    size_t count,          // IN:  Number of bytes asked for
+                    char **payload,        // OUT: Data read
+                    uint32 *actualSize)    // OUT: Number of bytes read
+{
+   if (opUsed == HGFS_OP_READ_V3) {
+      HgfsReplyReadV3 * replyV3 = HgfsGetReplyPayload(req);
+
+      *actualSize = replyV3->actualSize;
+      *payload = replyV3->payload;
+
+   } else {
+      *actualSize = ((HgfsReplyRead *)HGFS_REQ_PAYLOAD(req))->actualSize;
+      *payload = ((HgfsReplyRead *)HGFS_REQ_PAYLOAD(req))->payload;
+   }
+
+   /* Sanity check on read size. */
+   if (*actualSize > count) {
+      LOG(4, ("Server reply: read too big!\n"));
+      return -EPROTO;
+   }
+   return 0;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -557,28 +663,7 @@ HgfsDoRead(HgfsHandle handle,  // IN:  Handle for this file
 
  retry:
    opUsed = hgfsVersionRead;
-   if (opUsed == HGFS_OP_READ_V3) {
-      HgfsRequestReadV3 *requestV3 = HgfsGetRequestPayload(req);
-
-      requestV3->file = handle;
-      requestV3->offset = offset;
-      requestV3->requiredSize = count;
-      requestV3->reserved = 0;
-
-      req->payloadSize = sizeof(*requestV3) + HgfsGetRequestHeaderSize();
-
-   } else {
-      HgfsRequestRead *request;
-
-      request = (HgfsRequestRead *)(HGFS_REQ_PAYLOAD(req));
-      request->file = handle;
-      request->offset = offset;
-      request->requiredSize = count;
-      req->payloadSize = sizeof *request;
-   }
-
-   /* Fill in header here as payloadSize needs to be there. */
-   HgfsPackHeader(req, opUsed);
+   HgfsPackReadRequest(handle, count, offset, opUsed, req);
 
    /* Send the request and process the reply. */
    result = HgfsSendRequest(req);
@@ -589,21 +674,8 @@ HgfsDoRead(HgfsHandle handle,  // IN:  Handle for this file
 
       switch (result) {
       case 0:
-         if (opUsed == HGFS_OP_READ_V3) {
-            HgfsReplyReadV3 * replyV3 = HgfsGetReplyPayload(req);
-
-            actualSize = replyV3->actualSize;
-            payload = replyV3->payload;
-
-         } else {
-            actualSize = ((HgfsReplyRead *)HGFS_REQ_PAYLOAD(req))->actualSize;
-            payload = ((HgfsReplyRead *)HGFS_REQ_PAYLOAD(req))->payload;
-         }
-
-         /* Sanity check on read size. */
-         if (actualSize > count) {
-            LOG(4, ("Server reply: read too big!\n"));
-            result = -EPROTO;
+         result = HgfsUnpackReadReply(req, opUsed, count, &payload, &actualSize);
+         if (result != 0) {
             goto out;
          }
 
@@ -653,6 +725,8 @@ out:
  * HgfsRead --
  *
  *    Called whenever a process reads from a file in our filesystem.
+ *    Callers write out the writes buffered for the path first, as the
+ *    buffers may belong to other handles.
  *
  * Results:
  *    Returns the number of bytes read on success, or an error on
@@ -681,6 +755,15 @@ HgfsRead(struct fuse_file_info *fi,  // IN:  File info struct
    LOG(4, ("Entry(0x%"FMT64"x 0x%"FMTSZ"x bytes @ 0x%"FMT64"x)\n",
            fi->fh, count, offset));
 
+   /* Serve what we can from the read-ahead buffer, read the rest here. */
+   result = HgfsReadAheadRead(fi->fh, buffer, count, offset);
+   remainingCount -= result;
+   curOffset += result;
+   buffer += result;
+   if (remainingCount == 0) {
+      goto out;
+   }
+
     do {
       nextCount = (remainingCount > HGFS_LARGE_IO_MAX) ?
                                      HGFS_LARGE_IO_MAX : remainingCount;
@@ -835,9 +918,10 @@ out:
 /*
  *----------------------------------------------------------------------
  *
- * HgfsWrite --
+ * HgfsWriteThrough --
  *
- *    Called whenever a process writes to a file in our filesystem.
+ *    Writes the data to the server, splitting it into as many write
+ *    requests as needed.
  *
  * Results:
  *    Returns the number of bytes written on success, or an error on
@@ -850,10 +934,10 @@ out:
  */
 
 ssize_t
-HgfsWrite(struct fuse_file_info *fi,  // IN: File info structure
-         const char  *buf,            // OUT: User buffer to copy data into
-         size_t count,                // IN:  Number of bytes to read
-         loff_t offset)               // IN:  Offset at which to read
+HgfsWriteThrough(HgfsHandle handle,   // IN: Handle for the file
+                 const char  *buf,    // IN: Buffer containing data
+                 size_t count,        // IN: Number of bytes to write
+                 loff_t offset)       // IN: Offset to begin writing at
 {
    int result;
    const char *buffer = buf;
@@ -862,19 +946,18 @@ HgfsWrite(struct fuse_file_info *fi,  // IN: File info structure
    ssize_t bytesWritten = 0;
 
    ASSERT(NULL != buf);
-   ASSERT(NULL != fi);
 
-   LOG(6, ("Entry(0x%"FMT64"x off bytes 0x%"FMTSZ"x @ 0x%"FMT64"x)\n",
-           fi->fh, count, offset));
+   LOG(6, ("Entry(%u off bytes 0x%"FMTSZ"x @ 0x%"FMT64"x)\n",
+           handle, count, offset));
 
    do {
       nextCount = (remainingCount > HGFS_LARGE_IO_MAX) ?
                                      HGFS_LARGE_IO_MAX : remainingCount;
 
-      LOG(4, ("Issue DoWrite(0x%"FMT64"x 0x%"FMTSZ"x bytes @ 0x%"FMT64"x)\n",
-              fi->fh, nextCount, curOffset));
+      LOG(4, ("Issue DoWrite(%u 0x%"FMTSZ"x bytes @ 0x%"FMT64"x)\n",
+              handle, nextCount, curOffset));
 
-      result = HgfsDoWrite(fi->fh, buffer, nextCount, curOffset);
+      result = HgfsDoWrite(handle, buffer, nextCount, curOffset);
       if (result < 0) {
          bytesWritten = result;
          LOG(4, ("Error: written 0x%"FMTSZ"x bytes DoWrite -> %d\n",
@@ -895,6 +978,46 @@ out:
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWrite --
+ *
+ *    Called whenever a process writes to a file in our filesystem.
+ *    The data goes to the write-back buffer of the file if it has one.
+ *
+ * Results:
+ *    Returns the number of bytes written on success, or an error on
+ *    failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+ssize_t
+HgfsWrite(struct fuse_file_info *fi,  // IN: File info structure
+         const char  *buf,            // OUT: User buffer to copy data into
+         size_t count,                // IN:  Number of bytes to read
+         loff_t offset)               // IN:  Offset at which to read
+{
+   ssize_t result;
+
+   ASSERT(NULL != buf);
+   ASSERT(NULL != fi);
+
+   result = HgfsWriteBackWrite(fi->fh, buf, count, offset);
+   if (result != 0) {
+      LOG(6, ("Buffered(0x%"FMT64"x 0x%"FMTSZ"x bytes @ 0x%"FMT64"x) -> %"FMTSZ"d\n",
+              fi->fh, count, offset, result));
+      return result;
+   }
+
+   return HgfsWriteThrough(fi->fh, buf, count, offset);
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -906,7 +1029,8 @@ out:
  *    Returns zero on success, or a negative error on failure.
  *
  * Side effects:
- *    None
+ *    Handles open on the renamed file, or below the renamed directory,
+ *    are tracked under the new path.
  *
  *----------------------------------------------------------------------
  */
@@ -1075,6 +1199,11 @@ retry:
       LOG(4, ("Send returned error: %d\n", result));
    }
 
+   if (result == 0) {
+      HgfsReadAheadRename(from, to);
+      HgfsWriteBackRename(from, to);
+   }
+
 out:
    HgfsFreeRequest(req);
    LOG(6, ("Exit(%d)\n", result));
@@ -1341,6 +1470,9 @@ HgfsSetattr(const char* path,       //IN: Path to file
       goto out;
    }
 
+   /* Buffered writes must not land after, say, a truncate. */
+   HgfsWriteBackFlushPath(path);
+
 retry:
    /* Fill out the request packet. */
    opUsed = hgfsVersionSetattr;
@@ -1354,6 +1486,12 @@ retry:
       result = HgfsStatusConvertToLinux(replyStatus);
 
       switch (result) {
+      case 0:
+         if (attr->mask & HGFS_ATTR_VALID_SIZE) {
+            HgfsReadAheadInvalidatePath(path);
+         }
+         break;
+
       case -EPROTO:
          /* Retry with older version(s). Set globally. */
          if (opUsed == HGFS_OP_SETATTR_V3) {
@@ -1411,6 +1549,13 @@ HgfsRelease(HgfsHandle handle)  //IN:File handle to close
 
    LOG(6, ("Entry(handle = %u)\n", handle));
 
+   /*
+    * Buffered writes and read-ahead requests on the handle must be done
+    * before it is closed. A write-back error can no longer be reported.
+    */
+   HgfsWriteBackRelease(handle);
+   HgfsReadAheadRelease(handle);
+
    req = HgfsGetNewRequest();
    if (!req) {
       LOG(4, ("Out of memory while getting new request\n"));
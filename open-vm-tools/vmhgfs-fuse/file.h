@@ -41,5 +41,11 @@
 
 /* Public functions (with respect to the entire module). */
 int HgfsRelease(HgfsHandle handle);
+void HgfsPackReadRequest(HgfsHandle handle, size_t count, loff_t offset,
+                         HgfsOp opUsed, HgfsReq *req);
+int HgfsUnpackReadReply(HgfsReq *req, HgfsOp opUsed, size_t count,
+                        char **payload, uint32 *actualSize);
+ssize_t HgfsWriteThrough(HgfsHandle handle, const char *buf,
+                         size_t count, loff_t offset);
 
 #endif // _HGFS_DRIVER_FILE_H_
@@ -47,6 +47,24 @@ typedef struct HgfsFuseState {
 
    GKeyFile *conf;
 
+   /* Sequential read-ahead window per open file in bytes, 0 if disabled. */
+   uint32 readAheadWindow;
+
+   /* Buffer and merge small writes until flush, fsync or close. */
+   Bool writeBack;
+
+   /* Remember for a short while the paths the server reported missing. */
+   Bool negativeCache;
+
+   /* Number of free request buffers kept for reuse. */
+   uint32 requestPool;
+
+   /* Serve the low-level, inode based FUSE interface. */
+   Bool lowLevel;
+
+   /* Number of channels to the host requests are spread over. */
+   uint32 channels;
+
 } HgfsFuseState;
 
 /* Public functions (with respect to the entire module). */
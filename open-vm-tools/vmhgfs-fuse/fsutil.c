@@ -26,6 +26,7 @@
 #include <limits.h>
 #include "module.h"
 #include "cache.h"
+#include "writeback.h"
 
 typedef unsigned short umode_t;
 
@@ -519,6 +520,186 @@ out:
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsGetattrCached --
+ *
+ *    Gets the attributes of a path from the attribute cache, or from the
+ *    server on a miss, updating the cache with the result.
+ *
+ * Results:
+ *    Returns zero on success, or a negative error on failure. -ENOENT
+ *    may come from a negative cache entry.
+ *
+ * Side effects:
+ *    Writes out any buffered writes on the path before asking the server.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HgfsGetattrCached(const char* path,       // IN: path
+                  HgfsAttrInfo *attr)     // OUT: Attr to copy into
+{
+   uint32 generation;
+   int res;
+
+   res = HgfsGetAttrCache(path, attr);
+   LOG(4, ("Retrieve attr from cache. result = %d \n", res));
+   if (res != 0 && res != -ENOENT) {
+      /* The size and times must account for any buffered writes. */
+      HgfsWriteBackFlushPath(path);
+
+      /* Retrieve new complete attribute settings and update the cache. */
+      generation = HgfsGetAttrCacheGeneration(path);
+      res = HgfsPrivateGetattr(HGFS_INVALID_HANDLE, path, attr);
+      LOG(4, ("Retrieve attr from server. result = %d \n", res));
+      if (res == 0 ) {
+         HgfsSetAttrCache(path, attr);
+      } else if (res == -ENOENT) {
+         HgfsSetNegativeAttrCache(path, generation);
+      }
+   }
+   return res;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsAccess --
+ *
+ *    Checks the access of the mask against the attributes of a path, from
+ *    the attribute cache or the server.
+ *
+ * Results:
+ *    Returns zero if allowed, -EACCES if not, or a negative error when the
+ *    attributes cannot be retrieved.
+ *
+ * Side effects:
+ *    As for HgfsGetattrCached.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HgfsAccess(const char *path,  // IN: path
+           int mask)          // IN: access mask
+{
+   HgfsAttrInfo attr = {0};
+   uint32 effectivePermissions;
+   int res;
+
+   res = HgfsGetattrCached(path, &attr);
+   if (res < 0) {
+      return res;
+   }
+
+   if (mask == F_OK) {
+      return 0;  /* assume the above attr retrieval did the validation */
+   }
+
+   if (attr.mask & HGFS_ATTR_VALID_EFFECTIVE_PERMS) {
+      effectivePermissions = attr.effectivePerms;
+   } else {
+      /*
+       * If the server did not return actual effective permissions then
+       * need to calculate ourselves. However we should avoid unnecessary
+       * denial of access so perform optimistic permissions calculation.
+       * It is safe since host enforces necessary restrictions regardless of
+       * the client's decisions.
+       */
+      effectivePermissions = (attr.ownerPerms |
+                              attr.groupPerms |
+                              attr.otherPerms);
+   }
+
+   if ((effectivePermissions & mask) != mask) {
+      return -EACCES;
+   }
+   return 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsAttrToStat --
+ *
+ *    Fills a struct stat from HGFS attributes.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsAttrToStat(const HgfsAttrInfo *attr,  // IN: Attributes
+               struct stat *stbuf)        // OUT: Stat to fill
+{
+   uint32 d_type;
+
+   memset(stbuf, 0, sizeof *stbuf);
+
+   if (attr->mask & HGFS_ATTR_VALID_SPECIAL_PERMS) {
+      stbuf->st_mode |= (attr->specialPerms << 9);
+   }
+   if (attr->mask & HGFS_ATTR_VALID_OWNER_PERMS) {
+      stbuf->st_mode |= (attr->ownerPerms << 6);
+   }
+   if (attr->mask & HGFS_ATTR_VALID_GROUP_PERMS) {
+      stbuf->st_mode |= (attr->groupPerms << 3);
+   }
+   if (attr->mask & HGFS_ATTR_VALID_OTHER_PERMS) {
+      stbuf->st_mode |= (attr->otherPerms);
+   }
+
+   /* Mask the access mode. */
+   switch (attr->type) {
+   case HGFS_FILE_TYPE_SYMLINK:
+      d_type = DT_LNK;
+      break;
+
+   case HGFS_FILE_TYPE_REGULAR:
+      d_type = DT_REG;
+      break;
+
+   case HGFS_FILE_TYPE_DIRECTORY:
+      d_type = DT_DIR;
+      break;
+
+   default:
+      d_type = DT_UNKNOWN;
+      break;
+   }
+
+   stbuf->st_mode |= d_type << 12;
+   stbuf->st_blksize = HGFS_BLOCKSIZE;
+   stbuf->st_blocks = HgfsCalcBlockSize(attr->size);
+   stbuf->st_size = attr->size;
+   stbuf->st_ino = attr->hostFileId;
+   stbuf->st_nlink = 1;
+   stbuf->st_uid = attr->userId;
+   stbuf->st_gid = attr->groupId;
+   stbuf->st_rdev = 0;
+
+   if (attr->mask & HGFS_ATTR_VALID_ACCESS_TIME) {
+      HGFS_SET_TIME(stbuf->st_atime, attr->accessTime);
+   }
+   if (attr->mask & HGFS_ATTR_VALID_WRITE_TIME) {
+      HGFS_SET_TIME(stbuf->st_mtime, attr->writeTime);
+   }
+   if (attr->mask & HGFS_ATTR_VALID_CHANGE_TIME) {
+      HGFS_SET_TIME(stbuf->st_ctime, attr->attrChangeTime);
+   }
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
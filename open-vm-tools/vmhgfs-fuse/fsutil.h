@@ -109,6 +109,18 @@ HgfsPrivateGetattr(HgfsHandle handle,
                    const char* path,
                    HgfsAttrInfo *attr);
 
+int
+HgfsGetattrCached(const char* path,
+                  HgfsAttrInfo *attr);
+
+int
+HgfsAccess(const char *path,
+           int mask);
+
+void
+HgfsAttrToStat(const HgfsAttrInfo *attr,
+               struct stat *stbuf);
+
 int
 HgfsStatusConvertToLinux(HgfsStatus hgfsStatus);
 
@@ -120,7 +132,11 @@ int
 HgfsDirOpen(const char* path, HgfsHandle* handle);
 
 int
-HgfsReaddir(HgfsHandle handle,
+HgfsDirClose(HgfsHandle handle);
+
+int
+HgfsReaddir(const char *path,
+            HgfsHandle handle,
             void *dirent,
             fuse_fill_dir_t filldir);
 
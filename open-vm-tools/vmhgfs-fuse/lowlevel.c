@@ -0,0 +1,1872 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * lowlevel.c --
+ *
+ * Inode based FUSE backend, selected with the mount option lowlevel.
+ *
+ * The high-level FUSE library hands every operation a path which it
+ * rebuilds from its own node tree, and which getAbsPath then copies once
+ * more. Here the kernel talks to us in node ids instead. Each node id
+ * maps to the absolute HGFS path it was looked up by, and carries the
+ * kernel's lookup count so it lives exactly as long as the kernel
+ * references it. Lookups and attributes are answered with entry and
+ * attribute timeouts so that the kernel's dentry and inode caches absorb
+ * repeated lookups of the same names, including names that do not exist.
+ *
+ * The HGFS protocol itself addresses files by path, so the requests sent
+ * to the host are the same as with the high-level backend. An inode whose
+ * path was removed, or replaced by a rename, is detached: it stays valid
+ * for the kernel until forgotten, but operations that need its path fail
+ * with ESTALE, as the path may by now name another file.
+ *
+ * Every inode is linked to the inode of its directory, which is kept
+ * while inodes below it are known, so a rename moves the subtree of the
+ * renamed path without searching all inodes.
+ */
+
+#include <fuse_lowlevel.h>
+
+#include "module.h"
+#include "cache.h"
+#include "filesystem.h"
+#include "file.h"
+#include "readahead.h"
+#include "writeback.h"
+#include "lowlevel.h"
+
+/* Number of hash buckets for each of the two inode maps, power of 2. */
+#define HGFS_LL_BUCKET_COUNT 4096
+
+/* Initial size of the buffer holding a directory listing. */
+#define HGFS_LL_DIR_BUF_SIZE 4096
+
+/*
+ * HgfsInode, a node id known to the kernel
+ */
+
+typedef struct HgfsInode {
+   struct list_head idList;   /* link in the node id hash chain */
+   struct list_head pathList; /* link in the path hash chain, empty if detached */
+   struct list_head childList; /* link in the children of parent */
+   struct list_head children; /* inodes known below this directory */
+   struct HgfsInode *parent;  /* directory inode, NULL if root or detached */
+   fuse_ino_t ino;            /* node id handed to the kernel */
+   uint64 nlookup;            /* lookups the kernel has not forgotten */
+   uint32 pathHash;           /* hash of path */
+   char *path;                /* absolute HGFS path */
+} HgfsInode;
+
+/*
+ * HgfsLLDir, the listing of an open directory. The whole directory is read
+ * when the listing starts and handed out from here in pieces.
+ */
+
+typedef struct HgfsLLDir {
+   fuse_req_t req;            /* request being answered, for sizing */
+   char *buf;                 /* packed fuse dirents */
+   size_t size;               /* bytes used in buf */
+   size_t capacity;           /* bytes allocated for buf */
+   Bool filled;               /* buf holds a listing */
+   int error;                 /* error hit while filling */
+} HgfsLLDir;
+
+/*
+ * Mount options only understood by this backend.
+ */
+
+struct HgfsLLConfig {
+   double entryTimeout;
+   double attrTimeout;
+   double negativeTimeout;
+};
+
+#define HGFS_LL_OPT(t, p) { t, offsetof(struct HgfsLLConfig, p), 0 }
+
+static const struct fuse_opt hgfsLLOpts[] = {
+   HGFS_LL_OPT("entry_timeout=%lf",    entryTimeout),
+   HGFS_LL_OPT("attr_timeout=%lf",     attrTimeout),
+   HGFS_LL_OPT("negative_timeout=%lf", negativeTimeout),
+   FUSE_OPT_END
+};
+
+static struct HgfsLLConfig llConfig;
+
+static pthread_mutex_t inodeLock = PTHREAD_MUTEX_INITIALIZER;
+static struct list_head inodeById[HGFS_LL_BUCKET_COUNT];
+static struct list_head inodeByPath[HGFS_LL_BUCKET_COUNT];
+static fuse_ino_t inodeNext = FUSE_ROOT_ID + 1;
+
+static void *(*llInit)(struct fuse_conn_info *conn);
+static void (*llDestroy)(void *data);
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLHash
+ *
+ *    Computes the FNV-1a hash of a path.
+ *
+ * Results:
+ *    The hash value.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static uint32
+HgfsLLHash(const char *path) //IN: Path
+{
+   uint32 hash = 2166136261U;
+
+   while (*path != '\0') {
+      hash ^= (uint8)*path++;
+      hash *= 16777619U;
+   }
+   return hash;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLFindLocked
+ *
+ *    Looks up an inode by node id. inodeLock must be held.
+ *
+ * Results:
+ *    The inode or NULL.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsInode *
+HgfsLLFindLocked(fuse_ino_t ino) //IN: Node id
+{
+   HgfsInode *inode;
+
+   list_for_each_entry(inode,
+                       &inodeById[ino & (HGFS_LL_BUCKET_COUNT - 1)],
+                       idList) {
+      if (inode->ino == ino) {
+         return inode;
+      }
+   }
+   return NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLFindPathLocked
+ *
+ *    Looks up the current inode of a path. inodeLock must be held.
+ *
+ * Results:
+ *    The inode or NULL.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsInode *
+HgfsLLFindPathLocked(const char *path, //IN: Absolute HGFS path
+                     uint32 hash)      //IN: Hash of path
+{
+   HgfsInode *inode;
+
+   list_for_each_entry(inode,
+                       &inodeByPath[hash & (HGFS_LL_BUCKET_COUNT - 1)],
+                       pathList) {
+      if (inode->pathHash == hash && strcmp(inode->path, path) == 0) {
+         return inode;
+      }
+   }
+   return NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLSetPathLocked
+ *
+ *    Gives an inode a new path and hashes it under that path. The old
+ *    path, if any, is freed. inodeLock must be held.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLSetPathLocked(HgfsInode *inode, //IN: Inode
+                    char *path)       //IN: New path, ownership is taken
+{
+   list_del_init(&inode->pathList);
+   free(inode->path);
+   inode->path = path;
+   inode->pathHash = HgfsLLHash(path);
+   list_add(&inode->pathList,
+            &inodeByPath[inode->pathHash & (HGFS_LL_BUCKET_COUNT - 1)]);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLGetPath
+ *
+ *    Copies the path of a node id, so that it can be used without
+ *    holding inodeLock.
+ *
+ * Results:
+ *    The path, to be freed by the caller, or NULL if the node id is
+ *    unknown or detached, or out of memory.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static char *
+HgfsLLGetPath(fuse_ino_t ino) //IN: Node id
+{
+   HgfsInode *inode;
+   char *path = NULL;
+
+   pthread_mutex_lock(&inodeLock);
+   inode = HgfsLLFindLocked(ino);
+   if (inode != NULL && !list_empty(&inode->pathList)) {
+      path = strdup(inode->path);
+   }
+   pthread_mutex_unlock(&inodeLock);
+   return path;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLGetChildPath
+ *
+ *    Builds the path of a name in a directory.
+ *
+ * Results:
+ *    The path, to be freed by the caller, or NULL if the directory is
+ *    unknown or detached, or out of memory.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static char *
+HgfsLLGetChildPath(fuse_ino_t parent, //IN: Node id of the directory
+                   const char *name)  //IN: Name in the directory
+{
+   HgfsInode *inode;
+   char *path = NULL;
+
+   pthread_mutex_lock(&inodeLock);
+   inode = HgfsLLFindLocked(parent);
+   if (inode != NULL && !list_empty(&inode->pathList)) {
+      size_t len = strlen(inode->path);
+
+      /* The root is "/" or "<base path>/", nothing else ends in '/'. */
+      path = Str_Asprintf(NULL, "%s%s%s", inode->path,
+                          (len > 0 && inode->path[len - 1] == '/') ? "" : "/",
+                          name);
+   }
+   pthread_mutex_unlock(&inodeLock);
+   return path;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLRemember
+ *
+ *    Counts a lookup of a path, creating its inode the first time, and
+ *    fills the entry to return to the kernel.
+ *
+ * Results:
+ *    Returns zero on success, -ESTALE if the directory has been detached
+ *    meanwhile, or -ENOMEM.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsLLRemember(fuse_ino_t parent,             //IN: Node id of the directory
+               const char *path,              //IN: Absolute HGFS path
+               const HgfsAttrInfo *attr,      //IN: Attributes of path
+               struct fuse_entry_param *entry) //OUT: Entry for the kernel
+{
+   uint32 hash = HgfsLLHash(path);
+   HgfsInode *inode;
+   int res = 0;
+
+   pthread_mutex_lock(&inodeLock);
+   inode = HgfsLLFindPathLocked(path, hash);
+   if (inode == NULL) {
+      HgfsInode *dir = HgfsLLFindLocked(parent);
+      char *copy;
+
+      if (dir == NULL || list_empty(&dir->pathList)) {
+         res = -ESTALE;
+         goto out;
+      }
+      copy = strdup(path);
+      inode = malloc(sizeof *inode);
+      if (inode == NULL || copy == NULL) {
+         free(inode);
+         free(copy);
+         res = -ENOMEM;
+         goto out;
+      }
+      inode->ino = inodeNext++;
+      inode->nlookup = 0;
+      inode->path = NULL;
+      INIT_LIST_HEAD(&inode->pathList);
+      INIT_LIST_HEAD(&inode->children);
+      inode->parent = dir;
+      list_add(&inode->childList, &dir->children);
+      list_add(&inode->idList,
+               &inodeById[inode->ino & (HGFS_LL_BUCKET_COUNT - 1)]);
+      HgfsLLSetPathLocked(inode, copy);
+      LOG(4, ("New node id %lu for %s\n", (unsigned long)inode->ino, path));
+   }
+   inode->nlookup++;
+
+   memset(entry, 0, sizeof *entry);
+   entry->ino = inode->ino;
+   /* Node ids are never reused, so the generation can stay zero. */
+   entry->generation = 0;
+   entry->attr_timeout = llConfig.attrTimeout;
+   entry->entry_timeout = llConfig.entryTimeout;
+   HgfsAttrToStat(attr, &entry->attr);
+   entry->attr.st_ino = inode->ino;
+
+out:
+   pthread_mutex_unlock(&inodeLock);
+   return res;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLReleaseLocked
+ *
+ *    Frees an inode once the kernel has forgotten it and no inode below
+ *    it is known, then its directory if that is now unused as well.
+ *    inodeLock must be held.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLReleaseLocked(HgfsInode *inode) //IN: Inode or NULL
+{
+   while (inode != NULL && inode->ino != FUSE_ROOT_ID &&
+          inode->nlookup == 0 && list_empty(&inode->children)) {
+      HgfsInode *parent = inode->parent;
+
+      LOG(4, ("Free node id %lu, %s\n", (unsigned long)inode->ino,
+              inode->path));
+      list_del(&inode->idList);
+      list_del(&inode->pathList);
+      if (parent != NULL) {
+         list_del(&inode->childList);
+      }
+      free(inode->path);
+      free(inode);
+      inode = parent;
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLDetachTreeLocked
+ *
+ *    Detaches an inode and every inode below it, freeing those the
+ *    kernel has already forgotten. inodeLock must be held.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLDetachTreeLocked(HgfsInode *inode) //IN: Inode
+{
+   ASSERT(inode->ino != FUSE_ROOT_ID);
+
+   while (!list_empty(&inode->children)) {
+      HgfsInode *child = list_entry(inode->children.next, HgfsInode,
+                                    childList);
+
+      HgfsLLDetachTreeLocked(child);
+      HgfsLLReleaseLocked(child);
+   }
+   list_del_init(&inode->pathList);
+   if (inode->parent != NULL) {
+      list_del_init(&inode->childList);
+      inode->parent = NULL;
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLDetachLocked
+ *
+ *    Detaches the inode at a path, and those below it, after the path
+ *    was removed or replaced. The inodes stay valid for the kernel until
+ *    they are forgotten, but a new lookup of the path gets a new node id.
+ *    inodeLock must be held.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLDetachLocked(HgfsInode *inode) //IN: Inode
+{
+   HgfsInode *parent = inode->parent;
+
+   LOG(4, ("Detach node id %lu, %s\n", (unsigned long)inode->ino,
+           inode->path));
+   HgfsLLDetachTreeLocked(inode);
+   HgfsLLReleaseLocked(inode);
+   HgfsLLReleaseLocked(parent);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLUnhashPath
+ *
+ *    Detaches the inode currently at a path after the path was removed.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLUnhashPath(const char *path) //IN: Absolute HGFS path
+{
+   HgfsInode *inode;
+
+   pthread_mutex_lock(&inodeLock);
+   inode = HgfsLLFindPathLocked(path, HgfsLLHash(path));
+   if (inode != NULL && inode->ino != FUSE_ROOT_ID) {
+      HgfsLLDetachLocked(inode);
+   }
+   pthread_mutex_unlock(&inodeLock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLMoveTreeLocked
+ *
+ *    Gives an inode a new path and rebuilds the paths of the inodes
+ *    below it on top of it. inodeLock must be held.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLMoveTreeLocked(HgfsInode *inode, //IN: Inode
+                     char *path)       //IN: New path, ownership is taken
+{
+   size_t oldLen = strlen(inode->path);
+   HgfsInode *child;
+   HgfsInode *next;
+
+   HgfsLLSetPathLocked(inode, path);
+   list_for_each_entry_safe(child, next, &inode->children, childList) {
+      char *childPath = Str_Asprintf(NULL, "%s%s", inode->path,
+                                     child->path + oldLen);
+
+      if (childPath == NULL) {
+         /* Better to lose the inode than to leave it at the old path. */
+         HgfsLLDetachTreeLocked(child);
+         HgfsLLReleaseLocked(child);
+         continue;
+      }
+      HgfsLLMoveTreeLocked(child, childPath);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLRenamePaths
+ *
+ *    Moves the inode at a renamed path, and those below it, to the new
+ *    path. An inode that was at the destination has been replaced and is
+ *    detached. Only the inodes below the renamed path are visited.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLRenamePaths(const char *from,     //IN: Old absolute HGFS path
+                  fuse_ino_t newparent, //IN: Node id of the new directory
+                  const char *to)       //IN: New absolute HGFS path
+{
+   HgfsInode *inode;
+
+   pthread_mutex_lock(&inodeLock);
+
+   inode = HgfsLLFindPathLocked(to, HgfsLLHash(to));
+   if (inode != NULL && inode->ino != FUSE_ROOT_ID) {
+      HgfsLLDetachLocked(inode);
+   }
+
+   inode = HgfsLLFindPathLocked(from, HgfsLLHash(from));
+   if (inode != NULL && inode->ino != FUSE_ROOT_ID) {
+      HgfsInode *oldParent = inode->parent;
+      HgfsInode *dir = HgfsLLFindLocked(newparent);
+      char *path = strdup(to);
+
+      if (dir == NULL || list_empty(&dir->pathList) || path == NULL) {
+         /* Better to lose the inode than to leave it at the old path. */
+         free(path);
+         HgfsLLDetachLocked(inode);
+      } else {
+         if (dir != oldParent) {
+            list_move(&inode->childList, &dir->children);
+            inode->parent = dir;
+         }
+         HgfsLLMoveTreeLocked(inode, path);
+         HgfsLLReleaseLocked(oldParent);
+      }
+   }
+
+   pthread_mutex_unlock(&inodeLock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLReplyEntry
+ *
+ *    Answers a lookup or a create type operation with the entry of a
+ *    path. A missing path is answered with a negative entry, which the
+ *    kernel caches for negative_timeout seconds.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLReplyEntry(fuse_req_t req,    //IN: Request
+                 fuse_ino_t parent, //IN: Node id of the directory
+                 const char *path)  //IN: Absolute HGFS path
+{
+   HgfsAttrInfo attr = {0};
+   struct fuse_entry_param entry;
+   int res;
+
+   res = HgfsGetattrCached(path, &attr);
+   if (res == -ENOENT && llConfig.negativeTimeout > 0) {
+      memset(&entry, 0, sizeof entry);
+      entry.entry_timeout = llConfig.negativeTimeout;
+      fuse_reply_entry(req, &entry);
+      return;
+   }
+   if (res == 0) {
+      res = HgfsLLRemember(parent, path, &attr, &entry);
+   }
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   } else {
+      fuse_reply_entry(req, &entry);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLInit/HgfsLLDestroy
+ *
+ *    Session setup and teardown, shared with the high-level backend.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLInit(void *userdata,             //IN: unused
+           struct fuse_conn_info *conn) //IN/OUT: Connection parameters
+{
+   llInit(conn);
+}
+
+static void
+HgfsLLDestroy(void *userdata) //IN: unused
+{
+   llDestroy(NULL);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLLookup
+ *
+ *    Looks up a name in a directory.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLLookup(fuse_req_t req,     //IN: Request
+             fuse_ino_t parent,  //IN: Directory
+             const char *name)   //IN: Name to look up
+{
+   char *path;
+
+   LOG(4, ("Entry(parent = %lu, name = %s)\n", (unsigned long)parent, name));
+   path = HgfsLLGetChildPath(parent, name);
+   if (path == NULL) {
+      fuse_reply_err(req, ESTALE);
+      return;
+   }
+
+   HgfsLLReplyEntry(req, parent, path);
+   free(path);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLForget
+ *
+ *    Drops lookups of a node id. The inode is freed once the kernel has
+ *    forgotten all of them.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLForget(fuse_req_t req,         //IN: Request
+             fuse_ino_t ino,         //IN: Node id
+             unsigned long nlookup)  //IN: Number of lookups to drop
+{
+   HgfsInode *inode;
+
+   pthread_mutex_lock(&inodeLock);
+   inode = HgfsLLFindLocked(ino);
+   if (inode != NULL && ino != FUSE_ROOT_ID) {
+      ASSERT(inode->nlookup >= nlookup);
+      inode->nlookup -= MIN(inode->nlookup, nlookup);
+      HgfsLLReleaseLocked(inode);
+   }
+   pthread_mutex_unlock(&inodeLock);
+   fuse_reply_none(req);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLGetattr
+ *
+ *    Gets the attributes of a node id.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLGetattr(fuse_req_t req,             //IN: Request
+              fuse_ino_t ino,             //IN: Node id
+              struct fuse_file_info *fi)  //IN: unused
+{
+   HgfsAttrInfo attr = {0};
+   struct stat stbuf;
+   char *path;
+   int res;
+
+   path = HgfsLLGetPath(ino);
+   if (path == NULL) {
+      fuse_reply_err(req, ESTALE);
+      return;
+   }
+
+   res = HgfsGetattrCached(path, &attr);
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   } else {
+      HgfsAttrToStat(&attr, &stbuf);
+      stbuf.st_ino = ino;
+      fuse_reply_attr(req, &stbuf, llConfig.attrTimeout);
+   }
+   free(path);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLAccess
+ *
+ *    Checks the access of a node id, see HgfsAccess. Only called when
+ *    the mount does not use default_permissions.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLAccess(fuse_req_t req,  //IN: Request
+             fuse_ino_t ino,  //IN: Node id
+             int mask)        //IN: Access mask
+{
+   char *path;
+
+   path = HgfsLLGetPath(ino);
+   if (path == NULL) {
+      fuse_reply_err(req, ESTALE);
+      return;
+   }
+
+   fuse_reply_err(req, -HgfsAccess(path, mask));
+   free(path);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLSetattr
+ *
+ *    Changes mode, owner, size and times of a node id in one request to
+ *    the server.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLSetattr(fuse_req_t req,             //IN: Request
+              fuse_ino_t ino,             //IN: Node id
+              struct stat *stbuf,         //IN: New attributes
+              int toSet,                  //IN: FUSE_SET_ATTR_* to change
+              struct fuse_file_info *fi)  //IN: unused
+{
+   HgfsAttrInfo attr = {0};
+   uint64 now = HGFS_GET_TIME(time(NULL));
+   char *path;
+   int res;
+
+   LOG(4, ("Entry(ino = %lu, toSet = %#x)\n", (unsigned long)ino, toSet));
+   path = HgfsLLGetPath(ino);
+   if (path == NULL) {
+      fuse_reply_err(req, ESTALE);
+      return;
+   }
+
+   if (toSet & FUSE_SET_ATTR_MODE) {
+      attr.mask |= (HGFS_ATTR_VALID_SPECIAL_PERMS |
+                    HGFS_ATTR_VALID_OWNER_PERMS |
+                    HGFS_ATTR_VALID_GROUP_PERMS |
+                    HGFS_ATTR_VALID_OTHER_PERMS);
+      attr.specialPerms = (stbuf->st_mode & (S_ISUID | S_ISGID | S_ISVTX)) >> 9;
+      attr.ownerPerms = (stbuf->st_mode & S_IRWXU) >> 6;
+      attr.groupPerms = (stbuf->st_mode & S_IRWXG) >> 3;
+      attr.otherPerms = stbuf->st_mode & S_IRWXO;
+   }
+   if (toSet & FUSE_SET_ATTR_UID) {
+      attr.mask |= HGFS_ATTR_VALID_USERID;
+      attr.userId = stbuf->st_uid;
+   }
+   if (toSet & FUSE_SET_ATTR_GID) {
+      attr.mask |= HGFS_ATTR_VALID_GROUPID;
+      attr.groupId = stbuf->st_gid;
+   }
+   if (toSet & (FUSE_SET_ATTR_MODE | FUSE_SET_ATTR_UID | FUSE_SET_ATTR_GID)) {
+      /* Same as chmod and chown of the high-level backend. */
+      attr.mask |= HGFS_ATTR_VALID_ACCESS_TIME;
+      attr.accessTime = attr.attrChangeTime = now;
+   }
+   if (toSet & FUSE_SET_ATTR_SIZE) {
+      attr.mask |= (HGFS_ATTR_VALID_SIZE |
+                    HGFS_ATTR_VALID_WRITE_TIME |
+                    HGFS_ATTR_VALID_ACCESS_TIME |
+                    HGFS_ATTR_VALID_CHANGE_TIME);
+      attr.size = stbuf->st_size;
+      attr.writeTime = attr.accessTime = attr.attrChangeTime = now;
+   }
+   if (toSet & FUSE_SET_ATTR_ATIME_NOW) {
+      attr.mask |= HGFS_ATTR_VALID_ACCESS_TIME;
+      attr.accessTime = now;
+   } else if (toSet & FUSE_SET_ATTR_ATIME) {
+      attr.mask |= HGFS_ATTR_VALID_ACCESS_TIME;
+      attr.accessTime = HgfsConvertToNtTime(stbuf->st_atim.tv_sec,
+                                            stbuf->st_atim.tv_nsec);
+   }
+   if (toSet & FUSE_SET_ATTR_MTIME_NOW) {
+      attr.mask |= HGFS_ATTR_VALID_WRITE_TIME;
+      attr.writeTime = now;
+   } else if (toSet & FUSE_SET_ATTR_MTIME) {
+      attr.mask |= HGFS_ATTR_VALID_WRITE_TIME;
+      attr.writeTime = HgfsConvertToNtTime(stbuf->st_mtim.tv_sec,
+                                           stbuf->st_mtim.tv_nsec);
+   }
+
+   res = HgfsSetattr(path, &attr);
+   if (res < 0) {
+      LOG(4, ("path = %s , HgfsSetattr failed. res = %d\n", path, res));
+      goto exit;
+   }
+
+   /* Retrieve new complete attribute settings and update the cache. */
+   memset(&attr, 0, sizeof attr);
+   res = HgfsPrivateGetattr(HGFS_INVALID_HANDLE, path, &attr);
+   if (res < 0) {
+      LOG(4, ("path = %s , res = %d\n", path, res));
+      goto exit;
+   }
+   HgfsSetAttrCache(path, &attr);
+   free(attr.fileName);
+
+exit:
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   } else {
+      struct stat newStat;
+
+      HgfsAttrToStat(&attr, &newStat);
+      newStat.st_ino = ino;
+      fuse_reply_attr(req, &newStat, llConfig.attrTimeout);
+   }
+   free(path);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLReadlink
+ *
+ *    Reads the target of a symbolic link.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLReadlink(fuse_req_t req,  //IN: Request
+               fuse_ino_t ino)  //IN: Node id
+{
+   HgfsAttrInfo attr = {0};
+   char *path;
+   int res;
+
+   path = HgfsLLGetPath(ino);
+   if (path == NULL) {
+      fuse_reply_err(req, ESTALE);
+      return;
+   }
+
+   /* The attributes fileName field will hold the symlink target name. */
+   res = HgfsPrivateGetattr(HGFS_INVALID_HANDLE, path, &attr);
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   } else if (attr.fileName == NULL) {
+      fuse_reply_err(req, EINVAL);
+   } else {
+      fuse_reply_readlink(req, attr.fileName);
+   }
+   free(attr.fileName);
+   free(path);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLMkdir
+ *
+ *    Creates a directory.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLMkdir(fuse_req_t req,     //IN: Request
+            fuse_ino_t parent,  //IN: Directory
+            const char *name,   //IN: Name of the new directory
+            mode_t mode)        //IN: Mode of the new directory
+{
+   char *path;
+   int res;
+
+   path = HgfsLLGetChildPath(parent, name);
+   if (path == NULL) {
+      fuse_reply_err(req, ESTALE);
+      return;
+   }
+
+   res = HgfsMkdir(path, mode);
+   HgfsInvalidateAttrCache(path);
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   } else {
+      HgfsLLReplyEntry(req, parent, path);
+   }
+   free(path);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLRemove
+ *
+ *    Removes a file or a directory.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLRemove(fuse_req_t req,     //IN: Request
+             fuse_ino_t parent,  //IN: Directory
+             const char *name,   //IN: Name to remove
+             HgfsOp op)          //IN: HGFS_OP_DELETE_FILE or _DIR
+{
+   char *path;
+   int res;
+
+   path = HgfsLLGetChildPath(parent, name);
+   if (path == NULL) {
+      fuse_reply_err(req, ESTALE);
+      return;
+   }
+
+   res = HgfsDelete(path, op);
+   if (res == 0) {
+      HgfsInvalidateAttrCache(path);
+      HgfsLLUnhashPath(path);
+   }
+   fuse_reply_err(req, -res);
+   free(path);
+}
+
+static void
+HgfsLLUnlink(fuse_req_t req,     //IN: Request
+             fuse_ino_t parent,  //IN: Directory
+             const char *name)   //IN: Name to remove
+{
+   HgfsLLRemove(req, parent, name, HGFS_OP_DELETE_FILE);
+}
+
+static void
+HgfsLLRmdir(fuse_req_t req,     //IN: Request
+            fuse_ino_t parent,  //IN: Directory
+            const char *name)   //IN: Name to remove
+{
+   HgfsLLRemove(req, parent, name, HGFS_OP_DELETE_DIR);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLSymlink
+ *
+ *    Creates a symbolic link.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLSymlink(fuse_req_t req,     //IN: Request
+              const char *link,   //IN: Target of the link
+              fuse_ino_t parent,  //IN: Directory
+              const char *name)   //IN: Name of the link
+{
+   char *path;
+   int res;
+
+   path = HgfsLLGetChildPath(parent, name);
+   if (path == NULL) {
+      fuse_reply_err(req, ESTALE);
+      return;
+   }
+
+   res = HgfsSymlink(path, link);
+   HgfsInvalidateNegativeAttrCache(path);
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   } else {
+      HgfsLLReplyEntry(req, parent, path);
+   }
+   free(path);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLRename
+ *
+ *    Renames a file or directory.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLRename(fuse_req_t req,        //IN: Request
+             fuse_ino_t parent,     //IN: Old directory
+             const char *name,      //IN: Old name
+             fuse_ino_t newparent,  //IN: New directory
+             const char *newname)   //IN: New name
+{
+   char *from;
+   char *to;
+   int res;
+
+   from = HgfsLLGetChildPath(parent, name);
+   to = HgfsLLGetChildPath(newparent, newname);
+   if (from == NULL || to == NULL) {
+      res = -ESTALE;
+      goto exit;
+   }
+
+   res = HgfsRename(from, to);
+   if (res == 0) {
+      HgfsInvalidateAttrCache(from);
+      HgfsInvalidateAttrCache(to);
+      HgfsInvalidateNegativeAttrCache(to);
+      HgfsLLRenamePaths(from, newparent, to);
+   }
+
+exit:
+   fuse_reply_err(req, -res);
+   free(from);
+   free(to);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLOpen
+ *
+ *    Opens a file.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLOpen(fuse_req_t req,             //IN: Request
+           fuse_ino_t ino,             //IN: Node id
+           struct fuse_file_info *fi)  //IN/OUT: File info
+{
+   char *path;
+   int res;
+
+   path = HgfsLLGetPath(ino);
+   if (path == NULL) {
+      fuse_reply_err(req, ESTALE);
+      return;
+   }
+
+   res = HgfsOpen(path, fi);
+   if (fi->flags & O_CREAT) {
+      HgfsInvalidateAttrCache(path);
+   }
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   } else if (fuse_reply_open(req, fi) == -ENOENT) {
+      /* The open was interrupted, nobody will release the handle. */
+      HgfsRelease(fi->fh);
+   }
+   free(path);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLCreate
+ *
+ *    Creates and opens a file.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLCreate(fuse_req_t req,             //IN: Request
+             fuse_ino_t parent,          //IN: Directory
+             const char *name,           //IN: Name of the file
+             mode_t mode,                //IN: Mode of the file
+             struct fuse_file_info *fi)  //IN/OUT: File info
+{
+   HgfsAttrInfo attr = {0};
+   struct fuse_entry_param entry;
+   char *path;
+   int res;
+
+   path = HgfsLLGetChildPath(parent, name);
+   if (path == NULL) {
+      fuse_reply_err(req, ESTALE);
+      return;
+   }
+
+   res = HgfsCreate(path, mode, fi);
+   HgfsInvalidateAttrCache(path);
+   if (res < 0) {
+      goto exit;
+   }
+
+   res = HgfsGetattrCached(path, &attr);
+   if (res == 0) {
+      res = HgfsLLRemember(parent, path, &attr, &entry);
+   }
+   if (res < 0) {
+      HgfsRelease(fi->fh);
+      goto exit;
+   }
+
+   if (fuse_reply_create(req, &entry, fi) == -ENOENT) {
+      /* The create was interrupted, nobody will release the handle. */
+      HgfsRelease(fi->fh);
+   }
+
+exit:
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   }
+   free(path);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLRead
+ *
+ *    Reads from an open file.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLRead(fuse_req_t req,             //IN: Request
+           fuse_ino_t ino,             //IN: Node id
+           size_t size,                //IN: Bytes to read
+           off_t off,                  //IN: Offset to read at
+           struct fuse_file_info *fi)  //IN: File info
+{
+   char *buf;
+   ssize_t res;
+
+   buf = malloc(size);
+   if (buf == NULL) {
+      fuse_reply_err(req, ENOMEM);
+      return;
+   }
+
+   /* Buffered writes to the file, through any handle, go out first. */
+   if (HgfsWriteBackPending()) {
+      char *path = HgfsLLGetPath(ino);
+
+      if (path != NULL) {
+         HgfsWriteBackFlushPath(path);
+         free(path);
+      }
+   }
+
+   res = HgfsRead(fi, buf, size, off);
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   } else {
+      fuse_reply_buf(req, buf, res);
+   }
+   free(buf);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLWrite
+ *
+ *    Writes to an open file.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLWrite(fuse_req_t req,             //IN: Request
+            fuse_ino_t ino,             //IN: Node id
+            const char *buf,            //IN: Data to write
+            size_t size,                //IN: Bytes to write
+            off_t off,                  //IN: Offset to write at
+            struct fuse_file_info *fi)  //IN: File info
+{
+   char *path;
+   ssize_t res;
+
+   res = HgfsWrite(fi, buf, size, off);
+
+   path = HgfsLLGetPath(ino);
+   if (path != NULL) {
+      /* Even a failed write may have changed part of the data. */
+      HgfsReadAheadInvalidatePath(path);
+      if (res >= 0) {
+         /* The write may have changed the size and times, see hgfs_write. */
+         HgfsInvalidateAttrCache(path);
+      }
+      free(path);
+   }
+
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   } else {
+      fuse_reply_write(req, res);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLFlush/HgfsLLFsync
+ *
+ *    Write out any buffered writes of an open file.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLFlush(fuse_req_t req,             //IN: Request
+            fuse_ino_t ino,             //IN: Node id
+            struct fuse_file_info *fi)  //IN: File info
+{
+   fuse_reply_err(req, -HgfsWriteBackFlush(fi->fh));
+}
+
+static void
+HgfsLLFsync(fuse_req_t req,             //IN: Request
+            fuse_ino_t ino,             //IN: Node id
+            int datasync,               //IN: unused
+            struct fuse_file_info *fi)  //IN: File info
+{
+   fuse_reply_err(req, -HgfsWriteBackFlush(fi->fh));
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLRelease
+ *
+ *    Closes an open file.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLRelease(fuse_req_t req,             //IN: Request
+              fuse_ino_t ino,             //IN: Node id
+              struct fuse_file_info *fi)  //IN: File info
+{
+   HgfsRelease(fi->fh);
+   fuse_reply_err(req, 0);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLOpendir
+ *
+ *    Opens a directory. The listing is read by the first readdir.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLOpendir(fuse_req_t req,             //IN: Request
+              fuse_ino_t ino,             //IN: Node id
+              struct fuse_file_info *fi)  //OUT: File info
+{
+   HgfsLLDir *dir;
+
+   dir = calloc(1, sizeof *dir);
+   if (dir == NULL) {
+      fuse_reply_err(req, ENOMEM);
+      return;
+   }
+
+   fi->fh = (uintptr_t)dir;
+   if (fuse_reply_open(req, fi) == -ENOENT) {
+      free(dir);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLFillDir
+ *
+ *    fuse_fill_dir_t callback of HgfsReaddir, appends an entry to the
+ *    listing. The offset of each entry is where the next one starts.
+ *
+ * Results:
+ *    0 if the entry was added, 1 to stop the listing.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsLLFillDir(void *buf,                  //IN: HgfsLLDir
+              const char *name,           //IN: Entry name
+              const struct stat *stbuf,   //IN: Entry inode and type
+              off_t off)                  //IN: unused
+{
+   HgfsLLDir *dir = buf;
+   size_t entSize = fuse_add_direntry(dir->req, NULL, 0, name, NULL, 0);
+
+   if (dir->size + entSize > dir->capacity) {
+      size_t capacity = MAX(dir->capacity * 2, HGFS_LL_DIR_BUF_SIZE);
+      char *newBuf;
+
+      capacity = MAX(capacity, dir->size + entSize);
+      newBuf = realloc(dir->buf, capacity);
+      if (newBuf == NULL) {
+         dir->error = -ENOMEM;
+         return 1;
+      }
+      dir->buf = newBuf;
+      dir->capacity = capacity;
+   }
+
+   fuse_add_direntry(dir->req, dir->buf + dir->size,
+                     dir->capacity - dir->size, name, stbuf,
+                     dir->size + entSize);
+   dir->size += entSize;
+   return 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLReaddir
+ *
+ *    Returns the part of a directory listing starting at an offset. The
+ *    listing is read from the server when reading starts at offset 0.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLReaddir(fuse_req_t req,             //IN: Request
+              fuse_ino_t ino,             //IN: Node id
+              size_t size,                //IN: Max bytes to return
+              off_t off,                  //IN: Offset in the listing
+              struct fuse_file_info *fi)  //IN: File info
+{
+   HgfsLLDir *dir = (HgfsLLDir *)(uintptr_t)fi->fh;
+   HgfsHandle handle;
+   char *path;
+   int res;
+
+   if (off == 0 || !dir->filled) {
+      path = HgfsLLGetPath(ino);
+      if (path == NULL) {
+         fuse_reply_err(req, ESTALE);
+         return;
+      }
+
+      dir->req = req;
+      dir->size = 0;
+      dir->error = 0;
+      dir->filled = FALSE;
+
+      res = HgfsDirOpen(path, &handle);
+      if (res == 0) {
+         res = HgfsReaddir(path, handle, dir, HgfsLLFillDir);
+         HgfsDirClose(handle);
+      }
+      free(path);
+
+      if (res == 0) {
+         res = dir->error;
+      }
+      if (res < 0) {
+         fuse_reply_err(req, -res);
+         return;
+      }
+      dir->filled = TRUE;
+   }
+
+   if (off < dir->size) {
+      fuse_reply_buf(req, dir->buf + off, MIN(size, dir->size - off));
+   } else {
+      fuse_reply_buf(req, NULL, 0);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLReleasedir
+ *
+ *    Frees the listing of a directory.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLReleasedir(fuse_req_t req,             //IN: Request
+                 fuse_ino_t ino,             //IN: Node id
+                 struct fuse_file_info *fi)  //IN: File info
+{
+   HgfsLLDir *dir = (HgfsLLDir *)(uintptr_t)fi->fh;
+
+   free(dir->buf);
+   free(dir);
+   fuse_reply_err(req, 0);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLStatfs
+ *
+ *    Stat the host for total and free bytes on disk.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLStatfs(fuse_req_t req,  //IN: Request
+             fuse_ino_t ino)  //IN: Node id
+{
+   struct statvfs stbuf;
+   char *path;
+   int res;
+
+   path = HgfsLLGetPath(ino);
+   if (path == NULL) {
+      fuse_reply_err(req, ESTALE);
+      return;
+   }
+
+   res = HgfsStatfs(path, &stbuf);
+   if (res < 0) {
+      fuse_reply_err(req, -res);
+   } else {
+      fuse_reply_statfs(req, &stbuf);
+   }
+   free(path);
+}
+
+
+static const struct fuse_lowlevel_ops vmhgfsLowLevelOperations = {
+   .init        = HgfsLLInit,
+   .destroy     = HgfsLLDestroy,
+   .lookup      = HgfsLLLookup,
+   .forget      = HgfsLLForget,
+   .getattr     = HgfsLLGetattr,
+   .setattr     = HgfsLLSetattr,
+   .access      = HgfsLLAccess,
+   .readlink    = HgfsLLReadlink,
+   .mkdir       = HgfsLLMkdir,
+   .unlink      = HgfsLLUnlink,
+   .rmdir       = HgfsLLRmdir,
+   .symlink     = HgfsLLSymlink,
+   .rename      = HgfsLLRename,
+   .open        = HgfsLLOpen,
+   .read        = HgfsLLRead,
+   .write       = HgfsLLWrite,
+   .flush       = HgfsLLFlush,
+   .release     = HgfsLLRelease,
+   .fsync       = HgfsLLFsync,
+   .opendir     = HgfsLLOpendir,
+   .readdir     = HgfsLLReaddir,
+   .releasedir  = HgfsLLReleasedir,
+   .statfs      = HgfsLLStatfs,
+   .create      = HgfsLLCreate,
+};
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLInodeInit
+ *
+ *    Sets up the inode maps with the root inode.
+ *
+ * Results:
+ *    Returns zero on success, or -ENOMEM.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsLLInodeInit(void)
+{
+   HgfsInode *root;
+   char *path;
+   unsigned int i;
+
+   for (i = 0; i < HGFS_LL_BUCKET_COUNT; i++) {
+      INIT_LIST_HEAD(&inodeById[i]);
+      INIT_LIST_HEAD(&inodeByPath[i]);
+   }
+
+   /* Same as getAbsPath("/"). */
+   path = Str_Asprintf(NULL, "%s/",
+                       gState->basePathLen > 0 ? gState->basePath : "");
+   root = malloc(sizeof *root);
+   if (path == NULL || root == NULL) {
+      free(path);
+      free(root);
+      return -ENOMEM;
+   }
+
+   root->ino = FUSE_ROOT_ID;
+   root->nlookup = 1;
+   root->path = NULL;
+   root->parent = NULL;
+   INIT_LIST_HEAD(&root->pathList);
+   INIT_LIST_HEAD(&root->childList);
+   INIT_LIST_HEAD(&root->children);
+   list_add(&root->idList, &inodeById[FUSE_ROOT_ID & (HGFS_LL_BUCKET_COUNT - 1)]);
+   HgfsLLSetPathLocked(root, path);
+   return 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLLInodeExit
+ *
+ *    Frees all inodes.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsLLInodeExit(void)
+{
+   HgfsInode *inode;
+   HgfsInode *next;
+   unsigned int i;
+
+   for (i = 0; i < HGFS_LL_BUCKET_COUNT; i++) {
+      list_for_each_entry_safe(inode, next, &inodeById[i], idList) {
+         list_del(&inode->idList);
+         list_del(&inode->pathList);
+         free(inode->path);
+         free(inode);
+      }
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsLowLevelMain
+ *
+ *    Mounts the file system and serves it through the low-level FUSE
+ *    interface until it is unmounted. This replaces fuse_main.
+ *
+ * Results:
+ *    Returns zero on success, 1 on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HgfsLowLevelMain(struct fuse_args *args,                      //IN: Arguments
+                 void *(*init)(struct fuse_conn_info *conn),  //IN: Session setup
+                 void (*destroy)(void *data))                 //IN: Session teardown
+{
+   struct fuse_session *se;
+   struct fuse_chan *ch;
+   char *mountpoint = NULL;
+   int multithreaded;
+   int foreground;
+   int res = -1;
+
+   llInit = init;
+   llDestroy = destroy;
+
+   llConfig.entryTimeout = HGFS_DEFAULT_TTL;
+   llConfig.attrTimeout = HGFS_DEFAULT_TTL;
+   llConfig.negativeTimeout = gState->negativeCache ? HGFS_DEFAULT_TTL : 0;
+   if (fuse_opt_parse(args, &llConfig, hgfsLLOpts, NULL) != 0) {
+      goto exit;
+   }
+
+   if (fuse_parse_cmdline(args, &mountpoint, &multithreaded,
+                          &foreground) != 0) {
+      goto exit;
+   }
+
+   if (HgfsLLInodeInit() != 0) {
+      goto exit;
+   }
+
+   ch = fuse_mount(mountpoint, args);
+   if (ch == NULL) {
+      goto exit;
+   }
+
+   se = fuse_lowlevel_new(args, &vmhgfsLowLevelOperations,
+                          sizeof vmhgfsLowLevelOperations, NULL);
+   if (se != NULL) {
+      if (fuse_set_signal_handlers(se) == 0) {
+         fuse_session_add_chan(se, ch);
+         if (fuse_daemonize(foreground) == 0) {
+            res = multithreaded ? fuse_session_loop_mt(se) :
+                                  fuse_session_loop(se);
+         }
+         fuse_remove_signal_handlers(se);
+         fuse_session_remove_chan(ch);
+      }
+      fuse_session_destroy(se);
+   }
+   fuse_unmount(mountpoint, ch);
+
+exit:
+   HgfsLLInodeExit();
+   free(mountpoint);
+   fuse_opt_free_args(args);
+   return res == 0 ? 0 : 1;
+}
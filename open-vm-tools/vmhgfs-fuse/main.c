@@ -30,6 +30,9 @@
 #include "cache.h"
 #include "filesystem.h"
 #include "file.h"
+#include "lowlevel.h"
+#include "readahead.h"
+#include "writeback.h"
 
 /*
  *----------------------------------------------------------------------
@@ -123,10 +126,8 @@ static int
 hgfs_getattr(const char *path,    //IN: path of a file/directory
              struct stat *stbuf)  //IN/OUT: file/directoy attribute
 {
-   HgfsHandle fileHandle = HGFS_INVALID_HANDLE;
    HgfsAttrInfo newAttr = {0};
    HgfsAttrInfo *attr = &newAttr;
-   uint32 d_type;
    char *abspath = NULL;
    int res;
 
@@ -136,76 +137,13 @@ hgfs_getattr(const char *path,    //IN: path of a file/directory
       goto exit;
    }
 
-   res = HgfsGetAttrCache(abspath, attr);
-   LOG(4, ("Retrieve attr from cache. result = %d \n", res));
-   if (res != 0) {
-      /* Retrieve new complete attribute settings and update the cache. */
-      res = HgfsPrivateGetattr(fileHandle, abspath, attr);
-      LOG(4, ("Retrieve attr from server. result = %d \n", res));
-      if (res == 0 ) {
-         HgfsSetAttrCache(abspath, attr);
-      }
-   }
-
+   res = HgfsGetattrCached(abspath, attr);
    if (res < 0) {
       goto exit;
    }
 
    LOG(4, ("fill stat for %s\n", abspath));
-
-   memset(stbuf, 0, sizeof *stbuf);
-
-   if (attr->mask & HGFS_ATTR_VALID_SPECIAL_PERMS) {
-      stbuf->st_mode |= (attr->specialPerms << 9);
-   }
-   if (attr->mask & HGFS_ATTR_VALID_OWNER_PERMS) {
-      stbuf->st_mode |= (attr->ownerPerms << 6);
-   }
-   if (attr->mask & HGFS_ATTR_VALID_GROUP_PERMS) {
-      stbuf->st_mode |= (attr->groupPerms << 3);
-   }
-   if (attr->mask & HGFS_ATTR_VALID_OTHER_PERMS) {
-      stbuf->st_mode |= (attr->otherPerms);
-   }
-
-   /* Mask the access mode. */
-   switch (attr->type) {
-   case HGFS_FILE_TYPE_SYMLINK:
-      d_type = DT_LNK;
-      break;
-
-   case HGFS_FILE_TYPE_REGULAR:
-      d_type = DT_REG;
-      break;
-
-   case HGFS_FILE_TYPE_DIRECTORY:
-      d_type = DT_DIR;
-      break;
-
-   default:
-      d_type = DT_UNKNOWN;
-      break;
-   }
-
-   stbuf->st_mode |= d_type << 12;
-   stbuf->st_blksize = HGFS_BLOCKSIZE;
-   stbuf->st_blocks = HgfsCalcBlockSize(attr->size);
-   stbuf->st_size = attr->size;
-   stbuf->st_ino = attr->hostFileId;
-   stbuf->st_nlink = 1;
-   stbuf->st_uid = attr->userId;
-   stbuf->st_gid = attr->groupId;
-   stbuf->st_rdev = 0;
-
-   if (attr->mask & HGFS_ATTR_VALID_ACCESS_TIME) {
-      HGFS_SET_TIME(stbuf->st_atime, attr->accessTime);
-   }
-   if (attr->mask & HGFS_ATTR_VALID_WRITE_TIME) {
-      HGFS_SET_TIME(stbuf->st_mtime, attr->writeTime);
-   }
-   if (attr->mask & HGFS_ATTR_VALID_CHANGE_TIME) {
-      HGFS_SET_TIME(stbuf->st_ctime, attr->attrChangeTime);
-   }
+   HgfsAttrToStat(attr, stbuf);
 
 exit:
    LOG(4, ("Exit(%d)\n", res));
@@ -219,10 +157,10 @@ exit:
  *
  * hgfs_access
  *
- *    Dummy routine, not fully implemented.
+ *    Checks the access of a path, see HgfsAccess.
  *
  * Results:
- *    Returns zero.
+ *    Returns zero if allowed, a negative error otherwise.
  *
  * Side effects:
  *    None
@@ -234,10 +172,6 @@ static int
 hgfs_access(const char *path,  //IN: Path to a file.
             int mask)          //IN: Mask
 {
-   HgfsHandle fileHandle = HGFS_INVALID_HANDLE;
-   HgfsAttrInfo newAttr = {0};
-   HgfsAttrInfo *attr = &newAttr;
-   uint32 effectivePermissions;
    char *abspath = NULL;
    int res;
 
@@ -247,44 +181,7 @@ hgfs_access(const char *path,  //IN: Path to a file.
       goto exit;
    }
 
-   res = HgfsGetAttrCache(path, attr);
-   LOG(4, ("Retrieve attr from cache. result = %d \n", res));
-   if (res != 0) {
-      /* Retrieve new complete attribute settings and update the cache. */
-      res = HgfsPrivateGetattr(fileHandle, abspath, attr);
-      LOG(4, ("Retrieve attr from server. result = %d \n", res));
-      if (res == 0 ) {
-         HgfsSetAttrCache(abspath, attr);
-      }
-   }
-
-   if (res < 0) {
-      goto exit;
-   }
-
-   if (mask == F_OK) {
-      res = 0;  /* assume the above attr retrieval did the validation */
-      goto exit;
-   }
-
-   if (attr->mask & HGFS_ATTR_VALID_EFFECTIVE_PERMS) {
-      effectivePermissions = attr->effectivePerms;
-   } else {
-     /*
-      * If the server did not return actual effective permissions then
-      * need to calculate ourselves. However we should avoid unnecessary
-      * denial of access so perform optimistic permissions calculation.
-      * It is safe since host enforces necessary restrictions regardless of
-      * the client's decisions.
-      */
-     effectivePermissions = (attr->ownerPerms |
-                             attr->groupPerms |
-                             attr->otherPerms);
-  }
-
-  if ((effectivePermissions & mask) != mask) {
-     res = -EACCES;
-  }
+   res = HgfsAccess(abspath, mask);
 
 exit:
    LOG(4, ("Exit(%d)\n", res));
@@ -388,7 +285,7 @@ hgfs_readdir(const char *path,          //IN: path to a directory
    }
 
    fi->fh = fileHandle;
-   res = HgfsReaddir(fileHandle, buf, filler);
+   res = HgfsReaddir(abspath, fileHandle, buf, filler);
 
 exit:
    LOG(4, ("Exit(%d)\n", res));
@@ -459,6 +356,7 @@ hgfs_mkdir(const char *path,  //IN: path to a new dir
    }
 
    res = HgfsMkdir(abspath, mode);
+   HgfsInvalidateAttrCache(abspath);
 
 exit:
    LOG(4, ("Exit(%d)\n", res));
@@ -578,6 +476,7 @@ hgfs_symlink(const char *symname,   //IN: symname target
 
    LOG(4, ("symname = %s, abs source = %s)\n", symname, absSource));
    res = HgfsSymlink(absSource, symname);
+   HgfsInvalidateNegativeAttrCache(absSource);
 
 exit:
    LOG(4, ("Exit(%d)\n", res));
@@ -624,6 +523,7 @@ hgfs_rename(const char *from,  //IN: from path name
    if (res == 0) {
       HgfsInvalidateAttrCache(absfrom);
       HgfsInvalidateAttrCache(absto);
+      HgfsInvalidateNegativeAttrCache(absto);
    }
 
 exit:
@@ -1001,6 +901,9 @@ hgfs_open(const char *path,          //IN: path to a file
    }
 
    res = HgfsOpen(abspath, fi);
+   if (fi->flags & O_CREAT) {
+      HgfsInvalidateAttrCache(abspath);
+   }
 
 exit:
    LOG(4, ("Exit(%d)\n", res));
@@ -1040,6 +943,7 @@ hgfs_create(const char *path,          //IN: path to a file
    }
 
    res = HgfsCreate(abspath, mode, fi);
+   HgfsInvalidateAttrCache(abspath);
 
 exit:
    LOG(4, ("Exit(%d)\n", res));
@@ -1088,6 +992,9 @@ hgfs_read(const char *path,          //IN: path to a file
          goto exit;
       }
    }
+
+   /* Buffered writes to the file, through any handle, go out first. */
+   HgfsWriteBackFlushPath(abspath);
    res = HgfsRead(fi, buf, size, offset);
 
 exit:
@@ -1139,6 +1046,8 @@ hgfs_write(const char *path,          //IN: path to a file
    }
 
    res = HgfsWrite(fi, buf, size, offset);
+   /* Even a failed write may have changed part of the data. */
+   HgfsReadAheadInvalidatePath(abspath);
    if (res >= 0) {
       /*
        * Positive result indicates the number of bytes written.
@@ -1192,6 +1101,69 @@ exit:
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_flush
+ *
+ *    Called on each close of a file, writes out any buffered writes.
+ *
+ * Results:
+ *    Returns zero on success, or an error from writing out the data.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+hgfs_flush(const char *path,                //IN: path to a file
+           struct fuse_file_info *fi)       //IN: file info structure
+{
+   int res;
+
+   LOG(4, ("Entry(path = %s, fi->fh = %#"FMT64"x)\n", path, fi->fh));
+
+   res = HgfsWriteBackFlush(fi->fh);
+
+   LOG(4, ("Exit(%d)\n", res));
+   return res;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * hgfs_fsync
+ *
+ *    Synchronize the file contents, writes out any buffered writes.
+ *
+ * Results:
+ *    Returns zero on success, or an error from writing out the data.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+hgfs_fsync(const char *path,                //IN: path to a file
+           int datasync,                    //IN: data only, unused
+           struct fuse_file_info *fi)       //IN: file info structure
+{
+   int res;
+
+   LOG(4, ("Entry(path = %s, fi->fh = %#"FMT64"x)\n", path, fi->fh));
+
+   res = HgfsWriteBackFlush(fi->fh);
+
+   LOG(4, ("Exit(%d)\n", res));
+   return res;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1253,6 +1225,7 @@ static void*
 hgfs_init(struct fuse_conn_info *conn) // IN: unused
 {
    pthread_t purgeCacheThread;
+   pthread_t writeBackThread;
    int dummy;
    int res;
 
@@ -1268,6 +1241,14 @@ hgfs_init(struct fuse_conn_info *conn) // IN: unused
       LOG(4, ("Pthread create fail. error = %d\n", res));
    }
 
+   if (gState->writeBack) {
+      res = pthread_create(&writeBackThread, NULL,
+                           HgfsWriteBackFlusher, &dummy);
+      if (res < 0) {
+         LOG(4, ("Pthread create fail. error = %d\n", res));
+      }
+   }
+
    res = HgfsCreateSession();
    if (res < 0) {
       LOG(4, ("Create session failed. error = %d\n", res));
@@ -1344,7 +1325,9 @@ static struct fuse_operations vmhgfs_operations = {
    .read        = hgfs_read,
    .write       = hgfs_write,
    .statfs      = hgfs_statfs,
+   .flush       = hgfs_flush,
    .release     = hgfs_release,
+   .fsync       = hgfs_fsync,
    .create      = hgfs_create,
    .init        = hgfs_init,
    .destroy     = hgfs_destroy,
@@ -1383,13 +1366,19 @@ main(int argc,       //IN: Argument count
    /* Initialization */
    umask(0);
    HgfsResetOps();
-   res = HgfsTransportInit();
+   HgfsRequestPoolInit(gState->requestPool);
+   res = HgfsTransportInit(gState->channels);
    if (res != 0) {
       fprintf(stderr, "Error %d cannot open connection!\n", res);
       return res;
    }
-   HgfsInitCache();
+   HgfsInitCache(gState->negativeCache);
+   HgfsReadAheadInit(gState->readAheadWindow);
+   HgfsWriteBackInit(gState->writeBack);
 
+   if (gState->lowLevel) {
+      return HgfsLowLevelMain(&args, hgfs_init, hgfs_destroy);
+   }
    return fuse_main(args.argc, args.argv, &vmhgfs_operations, NULL);
 }
 
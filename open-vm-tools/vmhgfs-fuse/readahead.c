@@ -0,0 +1,691 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * readahead.c --
+ *
+ * Sequential read-ahead for open files.
+ *
+ * Every handle opened for reading gets a small state block that tracks
+ * where the next sequential read is expected. Once a handle has been read
+ * sequentially a few times, reads are answered from a ring of chunk sized
+ * READ_V3 requests that are kept in flight ahead of the reader, up to the
+ * configured window. The requests themselves hold the data, so the buffer
+ * is bounded by the window per handle and by a global slot budget.
+ *
+ * Read-ahead only pays off when the requests can be in flight while the
+ * reader goes on, so it is only used on asynchronous channels. On the
+ * backdoor, the only channel shipped, every request completes inside the
+ * send: the readahead_window option has no effect there, and handles are
+ * not tracked at all. The code is kept for asynchronous channels, which
+ * the transport supports and the loopback test (bench -a) exercises.
+ *
+ * Handles are matched to files by the path they were opened with, which
+ * follows renames. Writes through any handle and truncates bump the
+ * generation of every handle open on the path; a handle whose buffered
+ * data belongs to an older generation drops it before serving the next
+ * read.
+ */
+
+#include "module.h"
+#include "file.h"
+#include "transport.h"
+#include "vm_atomic.h"
+#include "readahead.h"
+
+#define HGFS_RA_CHUNK_SIZE HGFS_LARGE_IO_MAX
+#define HGFS_RA_MAX_SLOTS \
+   ((HGFS_READAHEAD_MAX_WINDOW + HGFS_RA_CHUNK_SIZE - 1) / HGFS_RA_CHUNK_SIZE)
+/* Upper bound on chunks buffered over all handles (about 30MB). */
+#define HGFS_RA_MAX_TOTAL_SLOTS 512
+/* Sequential reads seen on a handle before read-ahead starts. */
+#define HGFS_RA_SEQ_THRESHOLD 2
+/* Number of handle hash buckets, must be a power of 2. */
+#define HGFS_RA_BUCKET_COUNT 64
+
+/*
+ * HgfsReadAheadSlot, one chunk requested ahead of the reader
+ */
+
+typedef struct HgfsReadAheadSlot {
+   loff_t offset;      /* file offset of the chunk */
+   HgfsReq *req;       /* request, which also holds the reply data */
+   Bool completed;     /* reply has been collected */
+   int result;         /* reply status as a negative errno */
+   char *data;         /* chunk data inside the reply */
+   uint32 size;        /* bytes of data returned */
+} HgfsReadAheadSlot;
+
+/*
+ * HgfsReadAhead, read-ahead state of one open file handle
+ */
+
+typedef struct HgfsReadAhead {
+   struct list_head list;      /* link in the handle hash chain */
+   HgfsHandle handle;          /* server file handle */
+   char *path;                 /* path the handle was opened with */
+   pthread_mutex_t lock;       /* serializes reads on the handle */
+   Atomic_uint32 generation;   /* bumped on every invalidation */
+   uint32 bufGeneration;       /* generation of the buffered data */
+   loff_t nextOffset;          /* offset a sequential read would use */
+   uint32 seqCount;            /* sequential reads seen in a row */
+   loff_t raOffset;            /* offset of the next chunk to request */
+   Bool eof;                   /* a short chunk has been seen */
+   uint32 head;                /* first slot in use */
+   uint32 count;               /* number of slots in use */
+   HgfsReadAheadSlot slots[HGFS_RA_MAX_SLOTS];
+} HgfsReadAhead;
+
+static pthread_mutex_t raTableLock = PTHREAD_MUTEX_INITIALIZER;
+static struct list_head raTable[HGFS_RA_BUCKET_COUNT];
+static uint32 raWindowSlots;
+static Atomic_uint32 raSlotsInUse;
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReadAheadEnabled
+ *
+ *    Tells whether read-ahead is configured and the channels can have
+ *    requests outstanding.
+ *
+ * Results:
+ *    TRUE if handles are tracked.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static INLINE Bool
+HgfsReadAheadEnabled(void)
+{
+   return raWindowSlots != 0 && HgfsTransportIsAsync();
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReadAheadFindLocked
+ *
+ *    Looks up the read-ahead state of a handle. Called with raTableLock
+ *    held.
+ *
+ * Results:
+ *    The state, or NULL if the handle is not tracked.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsReadAhead *
+HgfsReadAheadFindLocked(HgfsHandle handle) //IN: File handle
+{
+   struct list_head *bucket = &raTable[handle & (HGFS_RA_BUCKET_COUNT - 1)];
+   HgfsReadAhead *ra;
+
+   list_for_each_entry(ra, bucket, list) {
+      if (ra->handle == handle) {
+         return ra;
+      }
+   }
+   return NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReadAheadPop
+ *
+ *    Releases the oldest slot, waiting for its reply if it is still in
+ *    flight. Called with the handle lock held.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsReadAheadPop(HgfsReadAhead *ra) //IN/OUT: Read-ahead state
+{
+   HgfsReadAheadSlot *slot = &ra->slots[ra->head];
+
+   ASSERT(ra->count > 0);
+
+   if (!slot->completed) {
+      HgfsWaitRequest(slot->req);
+   }
+   HgfsFreeRequest(slot->req);
+   Atomic_Dec32(&raSlotsInUse);
+   memset(slot, 0, sizeof *slot);
+
+   ra->head = (ra->head + 1) % HGFS_RA_MAX_SLOTS;
+   ra->count--;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReadAheadDrop
+ *
+ *    Discards everything buffered for the handle.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsReadAheadDrop(HgfsReadAhead *ra) //IN/OUT: Read-ahead state
+{
+   if (ra->count > 0) {
+      LOG(6, ("handle %u: dropping %u chunks\n", ra->handle, ra->count));
+   }
+   while (ra->count > 0) {
+      HgfsReadAheadPop(ra);
+   }
+   ra->head = 0;
+   ra->eof = FALSE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReadAheadSubmit
+ *
+ *    Keeps the window full: sends read requests for the chunks following
+ *    the last one requested, until the window or the global budget is
+ *    used up, or the end of the file has been seen.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsReadAheadSubmit(HgfsReadAhead *ra) //IN/OUT: Read-ahead state
+{
+   while (ra->count < raWindowSlots && !ra->eof) {
+      HgfsReadAheadSlot *slot;
+      HgfsReq *req;
+
+      if (Atomic_ReadInc32(&raSlotsInUse) >= HGFS_RA_MAX_TOTAL_SLOTS) {
+         Atomic_Dec32(&raSlotsInUse);
+         LOG(6, ("Read-ahead budget exhausted\n"));
+         break;
+      }
+
+      req = HgfsGetNewRequest();
+      if (req == NULL) {
+         Atomic_Dec32(&raSlotsInUse);
+         break;
+      }
+
+      HgfsPackReadRequest(ra->handle, HGFS_RA_CHUNK_SIZE, ra->raOffset,
+                          HGFS_OP_READ_V3, req);
+      if (HgfsSubmitRequest(req) != 0) {
+         HgfsFreeRequest(req);
+         Atomic_Dec32(&raSlotsInUse);
+         break;
+      }
+
+      slot = &ra->slots[(ra->head + ra->count) % HGFS_RA_MAX_SLOTS];
+      slot->offset = ra->raOffset;
+      slot->req = req;
+      slot->completed = FALSE;
+      ra->raOffset += HGFS_RA_CHUNK_SIZE;
+      ra->count++;
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReadAheadComplete
+ *
+ *    Collects the reply of the oldest slot. A short chunk marks the end
+ *    of the file, and the chunks requested past it are released.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsReadAheadComplete(HgfsReadAhead *ra) //IN/OUT: Read-ahead state
+{
+   HgfsReadAheadSlot *slot = &ra->slots[ra->head];
+
+   ASSERT(ra->count > 0 && !slot->completed);
+
+   HgfsWaitRequest(slot->req);
+   slot->completed = TRUE;
+   slot->result = HgfsStatusConvertToLinux(HgfsGetReplyStatus(slot->req));
+   if (slot->result == 0) {
+      slot->result = HgfsUnpackReadReply(slot->req, HGFS_OP_READ_V3,
+                                         HGFS_RA_CHUNK_SIZE,
+                                         &slot->data, &slot->size);
+   }
+
+   if (slot->result == 0 && slot->size < HGFS_RA_CHUNK_SIZE) {
+      LOG(6, ("handle %u: end of file at 0x%"FMT64"x\n", ra->handle,
+              slot->offset + slot->size));
+      ra->eof = TRUE;
+
+      /* Release the chunks behind the end of file, newest first. */
+      while (ra->count > 1) {
+         HgfsReadAheadSlot *last;
+
+         ra->count--;
+         last = &ra->slots[(ra->head + ra->count) % HGFS_RA_MAX_SLOTS];
+         if (!last->completed) {
+            HgfsWaitRequest(last->req);
+         }
+         HgfsFreeRequest(last->req);
+         Atomic_Dec32(&raSlotsInUse);
+         memset(last, 0, sizeof *last);
+      }
+      ra->raOffset = slot->offset + HGFS_RA_CHUNK_SIZE;
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReadAheadInvalidateLocked
+ *
+ *    Bumps the generation of every handle open on the path. Called with
+ *    raTableLock held.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsReadAheadInvalidateLocked(const char *path) //IN: Path of the file
+{
+   unsigned int i;
+
+   for (i = 0; i < HGFS_RA_BUCKET_COUNT; i++) {
+      HgfsReadAhead *ra;
+
+      list_for_each_entry(ra, &raTable[i], list) {
+         if (strcmp(ra->path, path) == 0) {
+            Atomic_Inc32(&ra->generation);
+         }
+      }
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReadAheadInit
+ *
+ *    Initializes read-ahead with the window size given at mount time.
+ *    A zero window disables read-ahead, and so does a synchronous
+ *    transport, such as the backdoor. Call after HgfsTransportInit.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsReadAheadInit(uint32 window) //IN: Window size in bytes
+{
+   unsigned int i;
+
+   for (i = 0; i < HGFS_RA_BUCKET_COUNT; i++) {
+      INIT_LIST_HEAD(&raTable[i]);
+   }
+   Atomic_Write32(&raSlotsInUse, 0);
+
+   window = MIN(window, HGFS_READAHEAD_MAX_WINDOW);
+   raWindowSlots = (window + HGFS_RA_CHUNK_SIZE - 1) / HGFS_RA_CHUNK_SIZE;
+   LOG(4, ("Read-ahead window %u bytes, %u chunks\n", window, raWindowSlots));
+   if (raWindowSlots != 0 && !HgfsTransportIsAsync()) {
+      LOG(4, ("Read-ahead unused: the transport is synchronous\n"));
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReadAheadOpen
+ *
+ *    Starts tracking a handle that has been opened for reading.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsReadAheadOpen(HgfsHandle handle, //IN: File handle
+                  const char *path)  //IN: Path of the file
+{
+   HgfsReadAhead *ra;
+
+   if (!HgfsReadAheadEnabled()) {
+      return;
+   }
+
+   ra = calloc(1, sizeof *ra);
+   if (ra == NULL) {
+      return;
+   }
+   ra->path = strdup(path);
+   if (ra->path == NULL) {
+      free(ra);
+      return;
+   }
+   ra->handle = handle;
+   pthread_mutex_init(&ra->lock, NULL);
+
+   pthread_mutex_lock(&raTableLock);
+   ASSERT(HgfsReadAheadFindLocked(handle) == NULL);
+   list_add(&ra->list, &raTable[handle & (HGFS_RA_BUCKET_COUNT - 1)]);
+   pthread_mutex_unlock(&raTableLock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReadAheadRelease
+ *
+ *    Stops tracking a handle. Must be called before the handle is closed
+ *    on the server, as requests on it may still be in flight.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsReadAheadRelease(HgfsHandle handle) //IN: File handle
+{
+   HgfsReadAhead *ra;
+
+   pthread_mutex_lock(&raTableLock);
+   ra = HgfsReadAheadFindLocked(handle);
+   if (ra == NULL) {
+      pthread_mutex_unlock(&raTableLock);
+      return;
+   }
+   list_del_init(&ra->list);
+   /* Readers lock the handle with raTableLock held, so none can follow. */
+   pthread_mutex_lock(&ra->lock);
+   pthread_mutex_unlock(&raTableLock);
+
+   HgfsReadAheadDrop(ra);
+   pthread_mutex_unlock(&ra->lock);
+
+   pthread_mutex_destroy(&ra->lock);
+   free(ra->path);
+   free(ra);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReadAheadRead
+ *
+ *    Serves a read from the read-ahead buffer of the handle, starting or
+ *    extending the read-ahead if the handle is being read sequentially.
+ *
+ * Results:
+ *    The number of bytes copied into buf, which may be less than count
+ *    or zero. The caller reads the remainder from the server.
+ *
+ * Side effects:
+ *    May send read requests for the chunks following offset.
+ *
+ *----------------------------------------------------------------------
+ */
+
+ssize_t
+HgfsReadAheadRead(HgfsHandle handle, //IN: File handle
+                  char *buf,         //OUT: Buffer to copy data into
+                  size_t count,      //IN: Number of bytes to read
+                  loff_t offset)     //IN: Offset at which to read
+{
+   HgfsReadAhead *ra;
+   uint32 generation;
+   size_t served = 0;
+   Bool buffered;
+
+   if (!HgfsReadAheadEnabled() || hgfsVersionRead != HGFS_OP_READ_V3) {
+      return 0;
+   }
+
+   pthread_mutex_lock(&raTableLock);
+   ra = HgfsReadAheadFindLocked(handle);
+   if (ra != NULL) {
+      pthread_mutex_lock(&ra->lock);
+   }
+   pthread_mutex_unlock(&raTableLock);
+   if (ra == NULL) {
+      return 0;
+   }
+
+   generation = Atomic_Read32(&ra->generation);
+   if (generation != ra->bufGeneration) {
+      HgfsReadAheadDrop(ra);
+      ra->bufGeneration = generation;
+   }
+
+   buffered = ra->count > 0 &&
+              offset >= ra->slots[ra->head].offset &&
+              offset < ra->raOffset;
+   if (offset == ra->nextOffset || buffered) {
+      if (ra->seqCount < HGFS_RA_SEQ_THRESHOLD) {
+         ra->seqCount++;
+      }
+   } else {
+      ra->seqCount = 0;
+   }
+   if (!buffered) {
+      HgfsReadAheadDrop(ra);
+      if (ra->seqCount < HGFS_RA_SEQ_THRESHOLD) {
+         goto out;
+      }
+      ra->raOffset = offset;
+   }
+
+   HgfsReadAheadSubmit(ra);
+
+   while (served < count && ra->count > 0) {
+      HgfsReadAheadSlot *slot = &ra->slots[ra->head];
+      loff_t cur = offset + served;
+      size_t chunk;
+
+      if (!slot->completed) {
+         HgfsReadAheadComplete(ra);
+      }
+      if (slot->result != 0) {
+         /* Let the synchronous path retry and report the error. */
+         LOG(4, ("handle %u: chunk 0x%"FMT64"x failed %d\n", ra->handle,
+                 slot->offset, slot->result));
+         HgfsReadAheadDrop(ra);
+         break;
+      }
+
+      ASSERT(cur >= slot->offset);
+      if (cur >= slot->offset + slot->size) {
+         if (ra->eof) {
+            break;
+         }
+         HgfsReadAheadPop(ra);
+         continue;
+      }
+
+      chunk = MIN(count - served, slot->offset + slot->size - cur);
+      memcpy(buf + served, slot->data + (cur - slot->offset), chunk);
+      served += chunk;
+
+      if (cur + chunk == slot->offset + HGFS_RA_CHUNK_SIZE) {
+         HgfsReadAheadPop(ra);
+         HgfsReadAheadSubmit(ra);
+      }
+   }
+
+out:
+   /* The caller reads whatever was not served here. */
+   ra->nextOffset = offset + count;
+   pthread_mutex_unlock(&ra->lock);
+   LOG(8, ("handle %u: served 0x%"FMTSZ"x @ 0x%"FMT64"x\n", handle,
+           served, offset));
+   return served;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReadAheadInvalidatePath
+ *
+ *    Invalidates the data buffered for every handle open on the file,
+ *    after it has been written to or truncated.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsReadAheadInvalidatePath(const char *path) //IN: Path of the file
+{
+   if (!HgfsReadAheadEnabled()) {
+      return;
+   }
+
+   pthread_mutex_lock(&raTableLock);
+   HgfsReadAheadInvalidateLocked(path);
+   pthread_mutex_unlock(&raTableLock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReadAheadRename
+ *
+ *    Updates the path of the handles open on a file or directory that
+ *    has been renamed, including those open below a renamed directory.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsReadAheadRename(const char *from, //IN: Old path
+                    const char *to)   //IN: New path
+{
+   size_t fromLen = strlen(from);
+   size_t toLen = strlen(to);
+   unsigned int i;
+
+   if (!HgfsReadAheadEnabled()) {
+      return;
+   }
+
+   pthread_mutex_lock(&raTableLock);
+   for (i = 0; i < HGFS_RA_BUCKET_COUNT; i++) {
+      HgfsReadAhead *ra;
+
+      list_for_each_entry(ra, &raTable[i], list) {
+         const char *rest = ra->path + fromLen;
+         char *newPath;
+
+         if (strncmp(ra->path, from, fromLen) != 0 ||
+             (*rest != '\0' && *rest != '/')) {
+            continue;
+         }
+         newPath = malloc(toLen + strlen(rest) + 1);
+         if (newPath == NULL) {
+            LOG(4, ("handle %u: cannot follow rename of %s\n", ra->handle,
+                    ra->path));
+            continue;
+         }
+         memcpy(newPath, to, toLen);
+         strcpy(newPath + toLen, rest);
+         LOG(6, ("handle %u: %s renamed to %s\n", ra->handle, ra->path,
+                 newPath));
+         free(ra->path);
+         ra->path = newPath;
+      }
+   }
+   pthread_mutex_unlock(&raTableLock);
+}
@@ -0,0 +1,40 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * readahead.h --
+ *
+ * Declarations of the sequential read-ahead functions.
+ */
+
+#ifndef _HGFS_DRIVER_READAHEAD_H_
+#define _HGFS_DRIVER_READAHEAD_H_
+
+/* Default and maximum read-ahead window per open file, in bytes. */
+#define HGFS_READAHEAD_DEFAULT_WINDOW (1024 * 1024)
+#define HGFS_READAHEAD_MAX_WINDOW (8 * 1024 * 1024)
+
+void HgfsReadAheadInit(uint32 window);
+void HgfsReadAheadOpen(HgfsHandle handle, const char *path);
+void HgfsReadAheadRelease(HgfsHandle handle);
+ssize_t HgfsReadAheadRead(HgfsHandle handle, char *buf,
+                          size_t count, loff_t offset);
+void HgfsReadAheadInvalidatePath(const char *path);
+void HgfsReadAheadRename(const char *from, const char *to);
+
+#endif // _HGFS_DRIVER_READAHEAD_H_
@@ -29,17 +29,205 @@
 #include "transport.h"
 #include "fsutil.h"
 #include "vm_assert.h"
+#include "vm_atomic.h"
 
 static HgfsHandle hgfsIdCounter;
 pthread_mutex_t hgfsIdLock = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * Pool of free request structures. Every request carries a packet buffer
+ * of HGFS_LARGE_PACKET_MAX bytes, so freed requests are kept here, up to
+ * the high-water mark, for reuse by the next operation instead of going
+ * back to malloc. A high-water mark of 0 disables the pool.
+ */
+#define HGFS_REQ_POOL_LOG_INTERVAL 4096
+
+static struct list_head hgfsReqPool = LIST_HEAD_INIT(hgfsReqPool);
+static pthread_mutex_t hgfsReqPoolLock = PTHREAD_MUTEX_INITIALIZER;
+static uint32 hgfsReqPoolHighWater;
+static HgfsRequestPoolStats hgfsReqPoolStats;
+
+/*
+ * In front of the shared list, each thread keeps a few freed requests of
+ * its own. An operation frees its request on the FUSE thread that will
+ * allocate the next one, so that mostly takes neither the pool lock nor
+ * malloc. The requests of an exiting thread go back to the shared list.
+ * The caches are not counted against the high-water mark.
+ */
+#define HGFS_REQ_POOL_THREAD_CACHE 2
+
+typedef struct HgfsReqThreadCache {
+   uint32 count;
+   HgfsReq *reqs[HGFS_REQ_POOL_THREAD_CACHE];
+} HgfsReqThreadCache;
+
+static pthread_key_t hgfsReqCacheKey;
+static Bool hgfsReqCacheEnabled;
+static Atomic_uint64 hgfsReqCacheHits;
+static Atomic_uint32 hgfsReqCacheFree;
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReqThreadCacheExit --
+ *
+ *    Thread exit destructor of a request cache: hands its requests to
+ *    the shared list, or frees them if the list is full.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsReqThreadCacheExit(void *data) // IN: HgfsReqThreadCache
+{
+   HgfsReqThreadCache *cache = data;
+
+   while (cache->count > 0) {
+      HgfsReq *req = cache->reqs[--cache->count];
+
+      Atomic_Dec32(&hgfsReqCacheFree);
+      pthread_mutex_lock(&hgfsReqPoolLock);
+      if (hgfsReqPoolStats.free < hgfsReqPoolHighWater) {
+         list_add(&req->list, &hgfsReqPool);
+         hgfsReqPoolStats.free++;
+         req = NULL;
+      } else {
+         hgfsReqPoolStats.released++;
+      }
+      pthread_mutex_unlock(&hgfsReqPoolLock);
+
+      if (req != NULL) {
+         pthread_cond_destroy(&req->replyCond);
+         free(req);
+      }
+   }
+   free(cache);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReqThreadCacheGet --
+ *
+ *    Returns the request cache of the calling thread, allocating it if
+ *    asked to.
+ *
+ * Results:
+ *    The cache, or NULL if there is none.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsReqThreadCache *
+HgfsReqThreadCacheGet(Bool create) // IN: Allocate the cache if missing
+{
+   HgfsReqThreadCache *cache;
+
+   if (!hgfsReqCacheEnabled) {
+      return NULL;
+   }
+   cache = pthread_getspecific(hgfsReqCacheKey);
+   if (cache == NULL && create) {
+      cache = calloc(1, sizeof *cache);
+      if (cache != NULL && pthread_setspecific(hgfsReqCacheKey, cache) != 0) {
+         free(cache);
+         cache = NULL;
+      }
+   }
+   return cache;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsRequestPoolInit --
+ *
+ *    Sets the high-water mark of the request pool and pre-allocates
+ *    that many requests. Called before any request is allocated.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsRequestPoolInit(uint32 highWater) // IN: Max number of free requests
+{
+   highWater = MIN(highWater, HGFS_REQUEST_POOL_MAX);
+
+   if (highWater > 0 && !hgfsReqCacheEnabled) {
+      hgfsReqCacheEnabled =
+         pthread_key_create(&hgfsReqCacheKey, HgfsReqThreadCacheExit) == 0;
+   }
+
+   pthread_mutex_lock(&hgfsReqPoolLock);
+   hgfsReqPoolHighWater = highWater;
+   while (hgfsReqPoolStats.free < highWater) {
+      HgfsReq *req = (HgfsReq*)malloc(sizeof(HgfsReq));
+
+      if (req == NULL) {
+         break;
+      }
+      pthread_cond_init(&req->replyCond, NULL);
+      list_add(&req->list, &hgfsReqPool);
+      hgfsReqPoolStats.free++;
+   }
+   pthread_mutex_unlock(&hgfsReqPoolLock);
+   LOG(4, ("Request pool of %u, %u pre-allocated\n", highWater,
+           hgfsReqPoolStats.free));
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsGetRequestPoolStats --
+ *
+ *    Returns the request pool counters.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsGetRequestPoolStats(HgfsRequestPoolStats *stats) // OUT: Pool counters
+{
+   pthread_mutex_lock(&hgfsReqPoolLock);
+   *stats = hgfsReqPoolStats;
+   pthread_mutex_unlock(&hgfsReqPoolLock);
+   stats->hits += Atomic_Read64(&hgfsReqCacheHits);
+   stats->free += Atomic_Read32(&hgfsReqCacheFree);
+}
+
 
 /*
  *----------------------------------------------------------------------
  *
  * HgfsGetNewRequest --
  *
- *    Get a new request structure off the free list and initialize it.
+ *    Get a new request structure off the thread cache or the free list
+ *    and initialize it. Falls back to malloc when the pool is empty.
  *
  * Results:
  *    On success the new struct is returned with all fields
@@ -54,12 +242,41 @@ pthread_mutex_t hgfsIdLock = PTHREAD_MUTEX_INITIALIZER;
 HgfsReq *
 HgfsGetNewRequest(void)
 {
+   HgfsReqThreadCache *cache = HgfsReqThreadCacheGet(FALSE);
    HgfsReq *req = NULL;
+   uint64 total;
+
+   if (cache != NULL && cache->count > 0) {
+      req = cache->reqs[--cache->count];
+      Atomic_Dec32(&hgfsReqCacheFree);
+      Atomic_Inc64(&hgfsReqCacheHits);
+   } else {
+      pthread_mutex_lock(&hgfsReqPoolLock);
+      if (!list_empty(&hgfsReqPool)) {
+         req = list_entry(hgfsReqPool.next, HgfsReq, list);
+         list_del(&req->list);
+         hgfsReqPoolStats.free--;
+         hgfsReqPoolStats.hits++;
+      } else {
+         hgfsReqPoolStats.misses++;
+      }
+      total = hgfsReqPoolStats.hits + hgfsReqPoolStats.misses;
+      if (hgfsReqPoolHighWater > 0 && total % HGFS_REQ_POOL_LOG_INTERVAL == 0) {
+         LOG(4, ("Request pool: %"FMT64"u shared hits, %"FMT64"u misses, "
+                 "%"FMT64"u released, %u free\n", hgfsReqPoolStats.hits,
+                 hgfsReqPoolStats.misses, hgfsReqPoolStats.released,
+                 hgfsReqPoolStats.free));
+      }
+      pthread_mutex_unlock(&hgfsReqPoolLock);
+   }
 
-   req = (HgfsReq*)malloc(sizeof(HgfsReq));
    if (req == NULL) {
-      LOG(4, ("Can't allocate memory.\n"));
-      return NULL;
+      req = (HgfsReq*)malloc(sizeof(HgfsReq));
+      if (req == NULL) {
+         LOG(4, ("Can't allocate memory.\n"));
+         return NULL;
+      }
+      pthread_cond_init(&req->replyCond, NULL);
    }
    INIT_LIST_HEAD(&req->list);
    req->payloadSize = 0;
@@ -326,12 +543,74 @@ HgfsSendRequest(HgfsReq *req)       // IN/OUT: Outgoing request
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsSubmitRequest --
+ *
+ *    Send out an HGFS request via transport layer without waiting for
+ *    the reply. Used to keep several requests in flight; each request
+ *    submitted successfully must be passed to HgfsWaitRequest.
+ *
+ * Results:
+ *    Returns zero on success, negative number on error.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HgfsSubmitRequest(HgfsReq *req)       // IN/OUT: Outgoing request
+{
+   int ret;
+
+   ASSERT(req);
+   ASSERT(req->payloadSize <= HGFS_LARGE_PACKET_MAX);
+
+   req->state = HGFS_REQ_STATE_UNSENT;
+
+   LOG(8, ("Submitting request id %d\n", req->id));
+   ret = HgfsTransportSubmitRequest(req);
+   LOG(8, ("Request submitted, return %d\n", ret));
+   return ret;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWaitRequest --
+ *
+ *    Wait for the reply to a request sent with HgfsSubmitRequest.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsWaitRequest(HgfsReq *req)       // IN/OUT: Submitted request
+{
+   ASSERT(req);
+
+   HgfsTransportWaitRequest(req);
+   LOG(8, ("Request id %d finished\n", req->id));
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
  * HgfsFreeRequest --
  *
- *    Free an HGFS request.
+ *    Free an HGFS request, or return it to the thread cache, or to the
+ *    pool if the pool is below its high-water mark.
  *
  * Results:
  *    None
@@ -345,7 +624,33 @@ HgfsSendRequest(HgfsReq *req)       // IN/OUT: Outgoing request
 void
 HgfsFreeRequest(HgfsReq *req) // IN: Request to free
 {
-   free(req);
+   HgfsReqThreadCache *cache;
+
+   if (req == NULL) {
+      return;
+   }
+
+   cache = HgfsReqThreadCacheGet(TRUE);
+   if (cache != NULL && cache->count < HGFS_REQ_POOL_THREAD_CACHE) {
+      cache->reqs[cache->count++] = req;
+      Atomic_Inc32(&hgfsReqCacheFree);
+      return;
+   }
+
+   pthread_mutex_lock(&hgfsReqPoolLock);
+   if (hgfsReqPoolStats.free < hgfsReqPoolHighWater) {
+      list_add(&req->list, &hgfsReqPool);
+      hgfsReqPoolStats.free++;
+      req = NULL;
+   } else {
+      hgfsReqPoolStats.released++;
+   }
+   pthread_mutex_unlock(&hgfsReqPoolLock);
+
+   if (req != NULL) {
+      pthread_cond_destroy(&req->replyCond);
+      free(req);
+   }
 }
 
 
@@ -418,8 +723,9 @@ out:
  *
  * HgfsCompleteReq --
  *
- *    Copies the reply packet into the request structure and wakes up
- *    the associated client.
+ *    Copies the reply packet into the request structure and marks it
+ *    completed. Waking up a client waiting on an asynchronous channel
+ *    is left to the transport.
  *
  * Results:
  *    None
@@ -442,7 +748,4 @@ HgfsCompleteReq(HgfsReq *req,       // IN: Request
    memcpy(HGFS_REQ_PAYLOAD(req), reply, replySize);
    req->payloadSize = replySize;
    req->state = HGFS_REQ_STATE_COMPLETED;
-   if (!list_empty(&req->list)) {
-      list_del_init(&req->list);
-   }
 }
@@ -30,6 +30,7 @@
 //#include "driver-config.h"
 
 #include <linux/list.h>
+#include <pthread.h>
 //#include "compat_sched.h"
 //#include "compat_spinlock.h"
 //#include "compat_wait.h"
@@ -89,10 +90,11 @@ typedef struct HgfsReq {
    struct list_head list;
 
    /*
-    * When clients wait for the reply to a request, they'll wait on this
-    * wait queue.
+    * When clients wait for the reply to a request sent over an asynchronous
+    * channel, they'll wait on this condition with the transport's pending
+    * requests lock held.
     */
-   //wait_queue_head_t queue;
+   pthread_cond_t replyCond;
 
    /* Current state of the request. */
    HgfsState state;
@@ -100,6 +102,9 @@ typedef struct HgfsReq {
    /* ID of this request */
    HgfsHandle id;
 
+   /* Index of the transport channel the request was submitted on. */
+   uint32 channel;
+
    /* Total size of the payload.*/
    size_t payloadSize;
 
@@ -110,7 +115,23 @@ typedef struct HgfsReq {
    char packet[HGFS_LARGE_PACKET_MAX + HGFS_CLIENT_CMD_LEN];
 } HgfsReq;
 
+/* Default and maximum number of free requests kept for reuse. */
+#define HGFS_REQUEST_POOL_DEFAULT 32
+#define HGFS_REQUEST_POOL_MAX 1024
+
+/*
+ * Request pool counters.
+ */
+typedef struct HgfsRequestPoolStats {
+   uint64 hits;        /* Requests taken from the pool or a thread cache */
+   uint64 misses;      /* Requests allocated because the pool was empty */
+   uint64 released;    /* Requests freed because the pool was full */
+   uint32 free;        /* Requests currently in the pool and caches */
+} HgfsRequestPoolStats;
+
 /* Public functions (with respect to the entire module). */
+void HgfsRequestPoolInit(uint32 highWater);
+void HgfsGetRequestPoolStats(HgfsRequestPoolStats *stats);
 HgfsReq *HgfsGetNewRequest(void);
 HgfsStatus HgfsPackHeader(HgfsReq *req, HgfsOp opUsed);
 HgfsStatus HgfsUnpackHeader(void *serverReply,
@@ -129,6 +150,8 @@ void* HgfsGetReplyPayload(HgfsReq *req);
 size_t HgfsGetReplyHeaderSize(void);
 size_t HgfsGetRequestHeaderSize(void);
 int HgfsSendRequest(HgfsReq *req);
+int HgfsSubmitRequest(HgfsReq *req);
+void HgfsWaitRequest(HgfsReq *req);
 void HgfsFreeRequest(HgfsReq *req);
 HgfsStatus HgfsGetReplyStatus(HgfsReq *req);
 void HgfsCompleteReq(HgfsReq *req,
@@ -24,9 +24,21 @@
  * actual transport channels (backdoor, tcp, vsock, ...).
  *
  * The sends happen in the process context, where as a thread
- * handles the asynchronous replies. A queue of pending replies is
- * maintained and is protected by a lock. The channel opens and close
- * is protected by a mutex.
+ * handles the asynchronous replies. A table of pending replies is
+ * maintained and is protected by a lock.
+ *
+ * Requests are spread over a small array of independent channels so
+ * that concurrent callers do not queue up behind one connection. Each
+ * request goes to the channel with the fewest requests in flight,
+ * starting the search at a rotating index. Each channel has its own
+ * mutex protecting its open, send and reset, and is reopened on its
+ * own when a send on it fails.
+ *
+ * The pending table is a slot array indexed by the low bits of the
+ * request id; the remaining bits act as a generation tag, so a reply is
+ * matched to its request by a single slot probe and an id compare. Two
+ * pending requests whose ids differ by a multiple of the table size
+ * cannot share a slot; the later one goes on a short overflow list.
  */
 
 
@@ -37,18 +49,29 @@
 #include "request.h"
 #include "transport.h"
 #include "vm_assert.h"
-
-static HgfsTransportChannel *gHgfsActiveChannel;     /* Current active channel. */
-static pthread_mutex_t gHgfsActiveChannelLock;       /* Current active channel lock. */
-static Bool gHgfsActiveChannelLockInited;
-
-static struct list_head gHgfsPendingRequests;        /* Pending requests queue. */
-static pthread_mutex_t gHgfsPendingRequestsLock;     /* Pending requests queue lock. */
+#include "vm_atomic.h"
+
+typedef struct HgfsTransportSlot {
+   HgfsTransportChannel *channel;   /* Channel, NULL if not open. */
+   pthread_mutex_t lock;            /* Protects channel open, send, reset. */
+   Atomic_uint32 outstanding;       /* Requests submitted, not yet waited. */
+} HgfsTransportSlot;
+
+static HgfsTransportSlot gHgfsChannels[HGFS_TRANSPORT_MAX_CHANNELS];
+static uint32 gHgfsChannelCount;                     /* Slots in use. */
+static uint32 gHgfsChannelLocksInited;               /* Slot locks inited. */
+static Atomic_uint32 gHgfsChannelNext;               /* Rotating start slot. */
+static Bool gHgfsChannelAsync;                       /* Channels reply async. */
+
+#define HGFS_PENDING_SLOT_COUNT 1024                 /* Must be a power of 2. */
+#define HgfsPendingSlot(id) ((id) & (HGFS_PENDING_SLOT_COUNT - 1))
+
+static HgfsReq *gHgfsPendingSlots[HGFS_PENDING_SLOT_COUNT]; /* Pending requests table. */
+static struct list_head gHgfsPendingRequests;        /* Pending slot collisions. */
+static uint32 gHgfsPendingCount;                     /* Requests in table or list. */
+static pthread_mutex_t gHgfsPendingRequestsLock;     /* Pending requests lock. */
 static Bool gHgfsPendingRequestsLockInited;
 
-
-#define HgfsRequestId(req) ((HgfsRequest *)req)->id
-
 static void HgfsTransportChannelClose(HgfsTransportChannel **channel);
 
 /*
@@ -63,7 +86,8 @@ static void HgfsTransportChannelClose(HgfsTransportChannel **channel);
  *     Open a new workable channel.
  *
  * Results:
- *     0 on success and the new channel, otherwise -ENOTCONN and NULL.
+ *     0 on success and the new channel, otherwise -ENOTCONN or -ENOMEM
+ *     and NULL.
  *
  * Side effects:
  *     None
@@ -84,6 +108,8 @@ HgfsTransportChannelOpen(HgfsTransportChannel **channel) // IN: active channel
          result = -ENOTCONN;
          *channel = NULL;
       }
+   } else {
+      result = -ENOMEM;
    }
 
    return result;
@@ -153,12 +179,130 @@ HgfsTransportChannelReset(HgfsTransportChannel **channel) // IN: active channel
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsTransportPickChannel --
+ *
+ *     Choose the channel for the next request: the one with the fewest
+ *     requests in flight, ties going to the first one found from a
+ *     rotating start index.
+ *
+ * Results:
+ *     Index of the channel.
+ *
+ * Side effects:
+ *     None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static uint32
+HgfsTransportPickChannel(void)
+{
+   uint32 start;
+   uint32 best;
+   uint32 bestLoad;
+   uint32 i;
+
+   if (gHgfsChannelCount == 1) {
+      return 0;
+   }
+
+   start = Atomic_ReadInc32(&gHgfsChannelNext);
+   best = start % gHgfsChannelCount;
+   bestLoad = Atomic_Read32(&gHgfsChannels[best].outstanding);
+   for (i = 1; i < gHgfsChannelCount && bestLoad > 0; i++) {
+      uint32 index = (start + i) % gHgfsChannelCount;
+      uint32 load = Atomic_Read32(&gHgfsChannels[index].outstanding);
+
+      if (load < bestLoad) {
+         best = index;
+         bestLoad = load;
+      }
+   }
+   return best;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsTransportReplyId --
+ *
+ *     Extract the request id from a reply packet, which carries either
+ *     the new HgfsHeader or the old HgfsReply header.
+ *
+ * Results:
+ *     The request id.
+ *
+ * Side effects:
+ *     None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsHandle
+HgfsTransportReplyId(const char *packet,   // IN: reply packet
+                     size_t packetSize)    // IN: packet size
+{
+   const HgfsHeader *header = (const HgfsHeader *)packet;
+
+   if (packetSize >= sizeof *header && header->dummy == HGFS_OP_NEW_HEADER) {
+      return header->requestId;
+   }
+   return ((const HgfsReply *)packet)->id;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsTransportLookupRequestLocked --
+ *
+ *     Find the pending request with the given id and remove it from the
+ *     pending table. Called with gHgfsPendingRequestsLock held.
+ *
+ * Results:
+ *     The request, or NULL if no request with this id is pending.
+ *
+ * Side effects:
+ *     None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsReq *
+HgfsTransportLookupRequestLocked(HgfsHandle id)   // IN: request id
+{
+   HgfsReq *req = gHgfsPendingSlots[HgfsPendingSlot(id)];
+   struct list_head *cur;
+
+   if (req != NULL && req->id == id) {
+      gHgfsPendingSlots[HgfsPendingSlot(id)] = NULL;
+      gHgfsPendingCount--;
+      return req;
+   }
+
+   list_for_each(cur, &gHgfsPendingRequests) {
+      req = list_entry(cur, HgfsReq, list);
+      if (req->id == id) {
+         list_del_init(&req->list);
+         gHgfsPendingCount--;
+         return req;
+      }
+   }
+
+   return NULL;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
  * HgfsTransportEnqueueRequest --
  *
- *     Add the request to the gHgfsPendingRequests queue.
+ *     Add the request to the pending requests table.
  *
  *
  * Side effects:
@@ -170,10 +314,20 @@ HgfsTransportChannelReset(HgfsTransportChannel **channel) // IN: active channel
 static void
 HgfsTransportEnqueueRequest(HgfsReq *req)   // IN: Request to add
 {
+   HgfsReq **slot;
+
    ASSERT(req);
 
    pthread_mutex_lock(&gHgfsPendingRequestsLock);
-   list_add_tail(&req->list, &gHgfsPendingRequests);
+   slot = &gHgfsPendingSlots[HgfsPendingSlot(req->id)];
+   ASSERT(*slot != req && list_empty(&req->list));
+   if (*slot == NULL) {
+      *slot = req;
+   } else {
+      LOG(6, ("Slot of req id %d taken by %d.\n", req->id, (*slot)->id));
+      list_add_tail(&req->list, &gHgfsPendingRequests);
+   }
+   gHgfsPendingCount++;
    pthread_mutex_unlock(&gHgfsPendingRequestsLock);
 }
 
@@ -183,7 +337,8 @@ HgfsTransportEnqueueRequest(HgfsReq *req)   // IN: Request to add
  *
  * HgfsTransportDequeueRequest --
  *
- *     Removes the request from the gHgfsPendingRequests queue.
+ *     Removes the request from the pending requests table if it is
+ *     still there.
  *
  * Results:
  *     None
@@ -197,11 +352,47 @@ HgfsTransportEnqueueRequest(HgfsReq *req)   // IN: Request to add
 static void
 HgfsTransportDequeueRequest(HgfsReq *req)   // IN: Request to dequeue
 {
+   HgfsReq **slot;
+
    ASSERT(req);
 
    pthread_mutex_lock(&gHgfsPendingRequestsLock);
-   if (!list_empty(&req->list)) {
+   slot = &gHgfsPendingSlots[HgfsPendingSlot(req->id)];
+   if (*slot == req) {
+      *slot = NULL;
+      gHgfsPendingCount--;
+   } else if (!list_empty(&req->list)) {
       list_del_init(&req->list);
+      gHgfsPendingCount--;
+   }
+   pthread_mutex_unlock(&gHgfsPendingRequestsLock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsTransportWaitReply --
+ *
+ *     Wait for the reply of a request submitted to an asynchronous
+ *     channel. Synchronous channels complete the request in the send
+ *     call, in which case this returns immediately.
+ *
+ * Results:
+ *     None
+ *
+ * Side effects:
+ *     None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsTransportWaitReply(HgfsReq *req)   // IN: Request sent
+{
+   pthread_mutex_lock(&gHgfsPendingRequestsLock);
+   while (req->state == HGFS_REQ_STATE_SUBMITTED) {
+      pthread_cond_wait(&req->replyCond, &gHgfsPendingRequestsLock);
    }
    pthread_mutex_unlock(&gHgfsPendingRequestsLock);
 }
@@ -232,34 +423,29 @@ void
 HgfsTransportProcessPacket(char *receivedPacket,    //IN: received packet
                            size_t receivedSize)     //IN: packet size
 {
-   struct list_head *cur, *next;
    HgfsHandle id;
-   Bool found = FALSE;
+   HgfsReq *req;
 
    /* Got the reply. */
 
    ASSERT(receivedPacket != NULL && receivedSize > 0);
-   id = HgfsRequestId(receivedPacket);
+   id = HgfsTransportReplyId(receivedPacket, receivedSize);
    LOG(8, ("Entered.\n"));
    LOG(6, ("Req id: %d\n", id));
    /*
-    * Search through gHgfsPendingRequests queue for the matching id and wake up
-    * the associated waiting process. Delete the req from the queue.
+    * Look up the pending request with the matching id and wake up the
+    * associated waiting process. Delete the req from the table.
     */
    pthread_mutex_lock(&gHgfsPendingRequestsLock);
-   list_for_each_safe(cur, next, &gHgfsPendingRequests) {
-      HgfsReq *req;
-      req = list_entry(cur, HgfsReq, list);
-      if (req->id == id) {
-         ASSERT(req->state == HGFS_REQ_STATE_SUBMITTED);
-         HgfsCompleteReq(req, receivedPacket, receivedSize);
-         found = TRUE;
-         break;
-      }
+   req = HgfsTransportLookupRequestLocked(id);
+   if (req != NULL) {
+      ASSERT(req->state == HGFS_REQ_STATE_SUBMITTED);
+      HgfsCompleteReq(req, receivedPacket, receivedSize);
+      pthread_cond_signal(&req->replyCond);
    }
    pthread_mutex_unlock(&gHgfsPendingRequestsLock);
 
-   if (!found) {
+   if (req == NULL) {
       LOG(4, ("No matching id, dropping reply.\n"));
    }
    LOG(8, ("Exited.\n"));
@@ -287,16 +473,35 @@ void
 HgfsTransportBeforeExitingRecvThread(void)
 {
    struct list_head *cur, *next;
+   HgfsReply reply;
+   unsigned int i;
+
+   reply.status = HGFS_STATUS_GENERIC_ERROR;
 
-   /* Walk through gHgfsPendingRequests queue and reply them with error. */
+   /* Walk through the pending requests table and reply them with error. */
    pthread_mutex_lock(&gHgfsPendingRequestsLock);
+   for (i = 0; i < HGFS_PENDING_SLOT_COUNT && gHgfsPendingCount > 0; i++) {
+      HgfsReq *req = gHgfsPendingSlots[i];
+
+      if (req != NULL) {
+         LOG(6, ("Injecting error reply to req id: %d\n", req->id));
+         gHgfsPendingSlots[i] = NULL;
+         gHgfsPendingCount--;
+         reply.id = req->id;
+         HgfsCompleteReq(req, (char *)&reply, sizeof reply);
+         pthread_cond_signal(&req->replyCond);
+      }
+   }
    list_for_each_safe(cur, next, &gHgfsPendingRequests) {
       HgfsReq *req;
-      HgfsReply reply;
 
       req = list_entry(cur, HgfsReq, list);
       LOG(6, ("Injecting error reply to req id: %d\n", req->id));
+      list_del_init(&req->list);
+      gHgfsPendingCount--;
+      reply.id = req->id;
       HgfsCompleteReq(req, (char *)&reply, sizeof reply);
+      pthread_cond_signal(&req->replyCond);
    }
    pthread_mutex_unlock(&gHgfsPendingRequestsLock);
 }
@@ -305,9 +510,11 @@ HgfsTransportBeforeExitingRecvThread(void)
 /*
  *----------------------------------------------------------------------
  *
- * HgfsTransportSendRequest --
+ * HgfsTransportSubmitRequest --
  *
- *     Sends the request via channel communication.
+ *     Sends the request via channel communication without waiting for
+ *     the reply. Every successfully submitted request must be passed to
+ *     HgfsTransportWaitRequest before it is freed.
  *
  * Results:
  *     Zero on success, non-zero error on failure.
@@ -319,33 +526,38 @@ HgfsTransportBeforeExitingRecvThread(void)
  */
 
 int
-HgfsTransportSendRequest(HgfsReq *req)   // IN: Request to send
+HgfsTransportSubmitRequest(HgfsReq *req)   // IN: Request to send
 {
+   HgfsTransportSlot *slot;
    int ret;
    ASSERT(req);
    ASSERT(req->state == HGFS_REQ_STATE_UNSENT);
    ASSERT(req->payloadSize <= HGFS_LARGE_PACKET_MAX);
 
-   pthread_mutex_lock(&gHgfsActiveChannelLock);
+   req->channel = HgfsTransportPickChannel();
+   slot = &gHgfsChannels[req->channel];
+   Atomic_Inc32(&slot->outstanding);
+
+   pthread_mutex_lock(&slot->lock);
 
    /* Try opening the channel. */
-   if (NULL == gHgfsActiveChannel) {
-      ret = HgfsTransportChannelOpen(&gHgfsActiveChannel);
+   if (NULL == slot->channel) {
+      ret = HgfsTransportChannelOpen(&slot->channel);
       if (ret != 0) {
          goto exit;
       }
    }
 
-   ASSERT(gHgfsActiveChannel->ops.send);
+   ASSERT(slot->channel->ops.send);
 
    HgfsTransportEnqueueRequest(req);
 
-   ret = gHgfsActiveChannel->ops.send(gHgfsActiveChannel, req);
+   ret = slot->channel->ops.send(slot->channel, req);
    if (ret < 0) {
-      LOG(4, ("Send failed, status = %d. Try reopening the channel ...\n",
-              ret));
-      if (HgfsTransportChannelReset(&gHgfsActiveChannel)) {
-         ret = gHgfsActiveChannel->ops.send(gHgfsActiveChannel, req);
+      LOG(4, ("Send on channel %u failed, status = %d. "
+              "Try reopening the channel ...\n", req->channel, ret));
+      if (HgfsTransportChannelReset(&slot->channel)) {
+         ret = slot->channel->ops.send(slot->channel, req);
       }
    }
 
@@ -354,10 +566,96 @@ exit:
           req->state == HGFS_REQ_STATE_SUBMITTED ||
           req->state == HGFS_REQ_STATE_UNSENT);
 
-   pthread_mutex_unlock(&gHgfsActiveChannelLock);
+   pthread_mutex_unlock(&slot->lock);
 
-   if (ret < 0) {
+   if (ret != 0) {
       HgfsTransportDequeueRequest(req);
+      Atomic_Dec32(&slot->outstanding);
+   }
+
+   return ret;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsTransportWaitRequest --
+ *
+ *     Waits for the reply to a request submitted with
+ *     HgfsTransportSubmitRequest and removes it from the pending table.
+ *
+ * Results:
+ *     None
+ *
+ * Side effects:
+ *     None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsTransportWaitRequest(HgfsReq *req)   // IN: Request submitted
+{
+   ASSERT(req);
+
+   HgfsTransportWaitReply(req);
+   HgfsTransportDequeueRequest(req);
+   Atomic_Dec32(&gHgfsChannels[req->channel].outstanding);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsTransportIsAsync --
+ *
+ *     Tells whether the channels deliver replies asynchronously, that is
+ *     whether a submitted request can be outstanding while its sender
+ *     goes on. Requests on a synchronous channel, like the backdoor, are
+ *     complete when HgfsTransportSubmitRequest returns.
+ *
+ * Results:
+ *     TRUE if the channels are asynchronous.
+ *
+ * Side effects:
+ *     None
+ *
+ *----------------------------------------------------------------------
+ */
+
+Bool
+HgfsTransportIsAsync(void)
+{
+   return gHgfsChannelAsync;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsTransportSendRequest --
+ *
+ *     Sends the request via channel communication and waits for the
+ *     reply if the channel delivers it asynchronously.
+ *
+ * Results:
+ *     Zero on success, non-zero error on failure.
+ *
+ * Side effects:
+ *     None
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HgfsTransportSendRequest(HgfsReq *req)   // IN: Request to send
+{
+   int ret;
+
+   ret = HgfsTransportSubmitRequest(req);
+   if (ret == 0) {
+      HgfsTransportWaitRequest(req);
    }
 
    return ret;
@@ -369,10 +667,11 @@ exit:
  *
  * HgfsTransportInit --
  *
- *     Initialize the transport.
+ *     Initialize the transport with up to HGFS_TRANSPORT_MAX_CHANNELS
+ *     channels.
  *
- *     Starts the reply thread, for handling incoming packets on the
- *     connected socket.
+ *     Opens the first channel to make sure the host can be reached. The
+ *     others are opened when first picked for a request.
  *
  * Results:
  *     Zero on success and negative error on failure.
@@ -384,14 +683,18 @@ exit:
  */
 
 int
-HgfsTransportInit(void)
+HgfsTransportInit(uint32 channels)   // IN: number of channels
 {
-   int res;
+   int res = 0;
 
-   gHgfsActiveChannel = NULL;
+   gHgfsChannelCount = MAX(1, MIN(channels, HGFS_TRANSPORT_MAX_CHANNELS));
+   gHgfsChannelLocksInited = 0;
+   Atomic_Write32(&gHgfsChannelNext, 0);
+   gHgfsChannelAsync = FALSE;
    gHgfsPendingRequestsLockInited = FALSE;
-   gHgfsActiveChannelLockInited = FALSE;
+   memset(gHgfsPendingSlots, 0, sizeof gHgfsPendingSlots);
    INIT_LIST_HEAD(&gHgfsPendingRequests);
+   gHgfsPendingCount = 0;
 
    res = pthread_mutex_init(&gHgfsPendingRequestsLock, NULL);
    if (res != 0) {
@@ -400,14 +703,26 @@ HgfsTransportInit(void)
    }
    gHgfsPendingRequestsLockInited = TRUE;
 
-   res = pthread_mutex_init(&gHgfsActiveChannelLock, NULL);
-   if (res != 0) {
-      res = -res;
-      goto exit;
+   for (; gHgfsChannelLocksInited < gHgfsChannelCount;
+        gHgfsChannelLocksInited++) {
+      HgfsTransportSlot *slot = &gHgfsChannels[gHgfsChannelLocksInited];
+
+      slot->channel = NULL;
+      Atomic_Write32(&slot->outstanding, 0);
+      res = pthread_mutex_init(&slot->lock, NULL);
+      if (res != 0) {
+         res = -res;
+         goto exit;
+      }
    }
-   gHgfsActiveChannelLockInited = TRUE;
+   LOG(4, ("Using %u channels.\n", gHgfsChannelCount));
 
-   res = HgfsTransportChannelOpen(&gHgfsActiveChannel);
+   res = HgfsTransportChannelOpen(&gHgfsChannels[0].channel);
+   if (res == 0) {
+      gHgfsChannelAsync = gHgfsChannels[0].channel->async;
+      LOG(4, ("Channel %s is %s.\n", gHgfsChannels[0].channel->name,
+              gHgfsChannelAsync ? "asynchronous" : "synchronous"));
+   }
 
 exit:
    if (res != 0) {
@@ -438,16 +753,17 @@ HgfsTransportExit(void)
 {
    LOG(8, ("Entered.\n"));
 
-   if (gHgfsActiveChannelLockInited) {
-      pthread_mutex_lock(&gHgfsActiveChannelLock);
-      HgfsTransportChannelClose(&gHgfsActiveChannel);
-      pthread_mutex_unlock(&gHgfsActiveChannelLock);
+   while (gHgfsChannelLocksInited > 0) {
+      HgfsTransportSlot *slot = &gHgfsChannels[--gHgfsChannelLocksInited];
+
+      pthread_mutex_lock(&slot->lock);
+      HgfsTransportChannelClose(&slot->channel);
+      pthread_mutex_unlock(&slot->lock);
 
-      pthread_mutex_destroy(&gHgfsActiveChannelLock);
-      gHgfsActiveChannelLockInited = FALSE;
+      pthread_mutex_destroy(&slot->lock);
    }
 
-   ASSERT(list_empty(&gHgfsPendingRequests));
+   ASSERT(gHgfsPendingCount == 0 && list_empty(&gHgfsPendingRequests));
 
    if (gHgfsPendingRequestsLockInited) {
       pthread_mutex_destroy(&gHgfsPendingRequestsLock);
@@ -34,6 +34,11 @@ typedef enum {
 
 /*
  * There are the operations a channel should implement.
+ *
+ * A synchronous channel completes the request inside send. A channel
+ * whose replies arrive asynchronously marks the request
+ * HGFS_REQ_STATE_SUBMITTED before the packet goes out, and later hands
+ * each reply to HgfsTransportProcessPacket, which wakes up the sender.
  */
 struct HgfsTransportChannel;
 typedef struct HgfsTransportChannelOps {
@@ -49,13 +54,25 @@ typedef struct HgfsTransportChannel {
    HgfsTransportChannelOps ops;    /* Channel ops. */
    HgfsChannelStatus status;       /* Connection status. */
    void *priv;                     /* Channel private data. */
+   Bool async;                     /* Replies arrive after send returns. */
    pthread_mutex_t connLock;       /* Protect _this_ struct. */
 } HgfsTransportChannel;
 
+/*
+ * Channels used when not configured: one host connection, as before the
+ * channels were added. More are only worth it when the host serves the
+ * connections concurrently.
+ */
+#define HGFS_TRANSPORT_DEFAULT_CHANNELS 1
+#define HGFS_TRANSPORT_MAX_CHANNELS 16
+
 /* Public functions (with respect to the entire module). */
-int HgfsTransportInit(void);
+int HgfsTransportInit(uint32 channels);
 void HgfsTransportExit(void);
 int HgfsTransportSendRequest(HgfsReq *req);
+int HgfsTransportSubmitRequest(HgfsReq *req);
+void HgfsTransportWaitRequest(HgfsReq *req);
+Bool HgfsTransportIsAsync(void);
 void HgfsTransportProcessPacket(char *receivedPacket,
                                 size_t receivedSize);
 void HgfsTransportBeforeExitingRecvThread(void);
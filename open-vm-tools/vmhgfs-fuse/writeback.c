@@ -0,0 +1,752 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * writeback.c --
+ *
+ * Write-back buffering for open files, enabled with the "writeback"
+ * mount option.
+ *
+ * Every handle opened for writing gets a buffer of one maximum sized
+ * write packet. Adjacent writes are appended to it and sent as a single
+ * WRITE_V3 once the buffer is full, a write does not follow on from the
+ * buffered data, or the buffer has been dirty for HGFS_WB_MAX_AGE
+ * seconds. Buffers are also written out on flush (every close), fsync
+ * and release, and before anything that must observe the file contents:
+ * reads, getattr of the path and setattr. Those go by path, since the
+ * reading handle is usually not the one holding the buffer; handles
+ * opened read-only are not tracked here at all.
+ *
+ * A write through one handle first writes out the buffers of the other
+ * handles open on the same path, so that older data cannot land on top
+ * of newer data.
+ *
+ * An error from a write-out that no caller waits for is kept on the
+ * handle and returned, once, by the next write, flush or fsync.
+ *
+ * wbTableLock is never held while waiting for a handle lock, which may
+ * be held across a write-out: the state is reference counted instead.
+ */
+
+#include "module.h"
+#include "cache.h"
+#include "file.h"
+#include "readahead.h"
+#include "vm_atomic.h"
+#include "writeback.h"
+
+#define HGFS_WB_BUFFER_SIZE HGFS_LARGE_IO_MAX
+/* Seconds a buffer may stay dirty before the flusher writes it out. */
+#define HGFS_WB_MAX_AGE 1
+#define HGFS_WB_FLUSHER_SLEEP_TIME 1
+/* Number of handle hash buckets, must be a power of 2. */
+#define HGFS_WB_BUCKET_COUNT 64
+/* Handles written out per hash bucket visited. */
+#define HGFS_WB_FLUSH_BATCH 64
+
+/*
+ * HgfsWriteBack, write-back state of one open file handle
+ */
+
+typedef struct HgfsWriteBack {
+   struct list_head list;      /* link in the handle hash chain */
+   HgfsHandle handle;          /* server file handle */
+   unsigned int refCount;      /* the table and lookups, under wbTableLock */
+   pthread_mutex_t pathLock;   /* protects path, with wbTableLock to change */
+   char *path;                 /* path the handle was opened with */
+   pthread_mutex_t lock;       /* protects the fields below */
+   Bool released;              /* no longer in the table */
+   char *buf;                  /* buffered data, allocated on first use */
+   loff_t offset;              /* file offset of the buffered data */
+   size_t size;                /* bytes buffered */
+   time_t dirtyTime;           /* when the buffer became dirty */
+   int error;                  /* deferred write-out error */
+} HgfsWriteBack;
+
+static Bool wbEnabled;
+static pthread_mutex_t wbTableLock = PTHREAD_MUTEX_INITIALIZER;
+static struct list_head wbTable[HGFS_WB_BUCKET_COUNT];
+static Atomic_uint32 wbDirtyCount;
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWriteBackFindLocked
+ *
+ *    Looks up the write-back state of a handle. Called with wbTableLock
+ *    held.
+ *
+ * Results:
+ *    The state, or NULL if the handle is not tracked.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsWriteBack *
+HgfsWriteBackFindLocked(HgfsHandle handle) //IN: File handle
+{
+   struct list_head *bucket = &wbTable[handle & (HGFS_WB_BUCKET_COUNT - 1)];
+   HgfsWriteBack *wb;
+
+   list_for_each_entry(wb, bucket, list) {
+      if (wb->handle == handle) {
+         return wb;
+      }
+   }
+   return NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWriteBackUnlock
+ *
+ *    Unlocks the write-back state of a handle and drops the reference
+ *    taken on it, freeing it if that was the last one.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsWriteBackUnlock(HgfsWriteBack *wb) //IN: Write-back state
+{
+   Bool last;
+
+   pthread_mutex_unlock(&wb->lock);
+
+   pthread_mutex_lock(&wbTableLock);
+   last = --wb->refCount == 0;
+   pthread_mutex_unlock(&wbTableLock);
+
+   if (last) {
+      ASSERT(wb->released);
+      pthread_mutex_destroy(&wb->lock);
+      pthread_mutex_destroy(&wb->pathLock);
+      free(wb->buf);
+      free(wb->path);
+      free(wb);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWriteBackLookup
+ *
+ *    Looks up the write-back state of a handle and locks it. Unlock it
+ *    with HgfsWriteBackUnlock.
+ *
+ * Results:
+ *    The locked state, or NULL if the handle is not tracked.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsWriteBack *
+HgfsWriteBackLookup(HgfsHandle handle) //IN: File handle
+{
+   HgfsWriteBack *wb;
+
+   pthread_mutex_lock(&wbTableLock);
+   wb = HgfsWriteBackFindLocked(handle);
+   if (wb != NULL) {
+      wb->refCount++;
+   }
+   pthread_mutex_unlock(&wbTableLock);
+
+   if (wb == NULL) {
+      return NULL;
+   }
+
+   pthread_mutex_lock(&wb->lock);
+   if (wb->released) {
+      HgfsWriteBackUnlock(wb);
+      return NULL;
+   }
+   return wb;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWriteBackWriteOut
+ *
+ *    Sends the buffered data to the server. Called with the handle lock
+ *    held.
+ *
+ * Results:
+ *    Zero on success, or a negative error. The buffer is emptied either
+ *    way.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsWriteBackWriteOut(HgfsWriteBack *wb) //IN/OUT: Write-back state
+{
+   ssize_t result;
+
+   if (wb->size == 0) {
+      return 0;
+   }
+
+   LOG(6, ("handle %u: writing 0x%"FMTSZ"x bytes @ 0x%"FMT64"x\n",
+           wb->handle, wb->size, wb->offset));
+   result = HgfsWriteThrough(wb->handle, wb->buf, wb->size, wb->offset);
+   if (result >= 0 && (size_t)result < wb->size) {
+      LOG(4, ("handle %u: short write 0x%"FMTSZ"x of 0x%"FMTSZ"x\n",
+              wb->handle, result, wb->size));
+      result = -EIO;
+   }
+
+   wb->size = 0;
+   Atomic_Dec32(&wbDirtyCount);
+   pthread_mutex_lock(&wb->pathLock);
+   HgfsInvalidateAttrCache(wb->path);
+   HgfsReadAheadInvalidatePath(wb->path);
+   pthread_mutex_unlock(&wb->pathLock);
+
+   return result < 0 ? result : 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWriteBackDefer
+ *
+ *    Writes out the buffer of a handle on behalf of nobody in particular,
+ *    keeping any error for the next write, flush or fsync.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsWriteBackDefer(HgfsHandle handle,  //IN: File handle
+                   time_t dirtyBefore) //IN: Skip buffers dirtied since
+{
+   HgfsWriteBack *wb = HgfsWriteBackLookup(handle);
+
+   if (wb == NULL) {
+      return;
+   }
+   if (wb->size > 0 && wb->dirtyTime <= dirtyBefore) {
+      int result = HgfsWriteBackWriteOut(wb);
+
+      if (result < 0 && wb->error == 0) {
+         wb->error = result;
+      }
+   }
+   HgfsWriteBackUnlock(wb);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWriteBackDeferAll
+ *
+ *    Writes out the buffers of every handle open on the path, or of all
+ *    handles if path is NULL, that were dirtied no later than
+ *    dirtyBefore, except the buffer of the handle skip. Walks the table
+ *    one bucket at a time so that no lock is held across more than one
+ *    write-out.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsWriteBackDeferAll(const char *path,   //IN: Path of the file or NULL
+                      time_t dirtyBefore, //IN: Skip buffers dirtied since
+                      HgfsHandle skip)    //IN: Handle to skip or invalid
+{
+   unsigned int i;
+
+   for (i = 0; i < HGFS_WB_BUCKET_COUNT; i++) {
+      HgfsHandle handles[HGFS_WB_FLUSH_BATCH];
+      unsigned int count = 0;
+      unsigned int j;
+      HgfsWriteBack *wb;
+
+      pthread_mutex_lock(&wbTableLock);
+      list_for_each_entry(wb, &wbTable[i], list) {
+         if (count < ARRAYSIZE(handles) && wb->handle != skip &&
+             (path == NULL || strcmp(wb->path, path) == 0)) {
+            handles[count++] = wb->handle;
+         }
+      }
+      pthread_mutex_unlock(&wbTableLock);
+
+      for (j = 0; j < count; j++) {
+         HgfsWriteBackDefer(handles[j], dirtyBefore);
+      }
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWriteBackInit
+ *
+ *    Initializes write-back buffering.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsWriteBackInit(Bool enabled) //IN: Whether to buffer writes
+{
+   unsigned int i;
+
+   for (i = 0; i < HGFS_WB_BUCKET_COUNT; i++) {
+      INIT_LIST_HEAD(&wbTable[i]);
+   }
+   Atomic_Write32(&wbDirtyCount, 0);
+   wbEnabled = enabled;
+   LOG(4, ("Write-back %s\n", enabled ? "enabled" : "disabled"));
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWriteBackOpen
+ *
+ *    Starts tracking a handle that has been opened for writing.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsWriteBackOpen(HgfsHandle handle, //IN: File handle
+                  const char *path)  //IN: Path of the file
+{
+   HgfsWriteBack *wb;
+
+   if (!wbEnabled) {
+      return;
+   }
+
+   wb = calloc(1, sizeof *wb);
+   if (wb == NULL) {
+      return;
+   }
+   wb->path = strdup(path);
+   if (wb->path == NULL) {
+      free(wb);
+      return;
+   }
+   wb->handle = handle;
+   wb->refCount = 1;
+   pthread_mutex_init(&wb->pathLock, NULL);
+   pthread_mutex_init(&wb->lock, NULL);
+
+   pthread_mutex_lock(&wbTableLock);
+   ASSERT(HgfsWriteBackFindLocked(handle) == NULL);
+   list_add(&wb->list, &wbTable[handle & (HGFS_WB_BUCKET_COUNT - 1)]);
+   pthread_mutex_unlock(&wbTableLock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWriteBackRelease
+ *
+ *    Writes out the buffer of a handle and stops tracking it. Must be
+ *    called before the handle is closed on the server.
+ *
+ * Results:
+ *    Zero on success, or the first error not yet reported.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HgfsWriteBackRelease(HgfsHandle handle) //IN: File handle
+{
+   HgfsWriteBack *wb;
+   int result;
+
+   pthread_mutex_lock(&wbTableLock);
+   wb = HgfsWriteBackFindLocked(handle);
+   if (wb == NULL) {
+      pthread_mutex_unlock(&wbTableLock);
+      return 0;
+   }
+   /* The reference of the table is now ours. */
+   list_del_init(&wb->list);
+   pthread_mutex_unlock(&wbTableLock);
+
+   /* Lookups that found the handle before see that it is gone. */
+   pthread_mutex_lock(&wb->lock);
+   wb->released = TRUE;
+   result = HgfsWriteBackWriteOut(wb);
+   if (wb->error != 0) {
+      result = wb->error;
+   }
+   HgfsWriteBackUnlock(wb);
+
+   if (result < 0) {
+      LOG(4, ("handle %u: write-back failed %d\n", handle, result));
+   }
+   return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWriteBackWrite
+ *
+ *    Buffers a write if it can be merged with, or start, the buffered
+ *    data of the handle. Writes at least as large as the buffer are left
+ *    to the caller once the buffer has been written out.
+ *
+ * Results:
+ *    count if the data was buffered, zero if the caller should write it
+ *    through, or a negative error (possibly one deferred from an earlier
+ *    write-out).
+ *
+ * Side effects:
+ *    May write out the buffer.
+ *
+ *----------------------------------------------------------------------
+ */
+
+ssize_t
+HgfsWriteBackWrite(HgfsHandle handle, //IN: File handle
+                   const char *buf,   //IN: Data to write
+                   size_t count,      //IN: Number of bytes to write
+                   loff_t offset)     //IN: Offset at which to write
+{
+   HgfsWriteBack *wb;
+   ssize_t result = count;
+
+   if (!wbEnabled || count == 0) {
+      return 0;
+   }
+
+   wb = HgfsWriteBackLookup(handle);
+   if (wb == NULL) {
+      return 0;
+   }
+
+   /*
+    * Write out the buffers of other handles of the file first, unlocked
+    * since they may be waiting for this one to do the same.
+    */
+   if (Atomic_Read32(&wbDirtyCount) > (wb->size > 0 ? 1 : 0)) {
+      char *path;
+
+      pthread_mutex_lock(&wb->pathLock);
+      path = strdup(wb->path);
+      pthread_mutex_unlock(&wb->pathLock);
+      HgfsWriteBackUnlock(wb);
+
+      if (path == NULL) {
+         return -ENOMEM;
+      }
+      HgfsWriteBackDeferAll(path, time(NULL), handle);
+      free(path);
+
+      wb = HgfsWriteBackLookup(handle);
+      if (wb == NULL) {
+         return 0;
+      }
+   }
+
+   if (wb->error != 0) {
+      result = wb->error;
+      wb->error = 0;
+      goto out;
+   }
+
+   if (wb->size > 0 &&
+       (offset != wb->offset + wb->size ||
+        wb->size + count > HGFS_WB_BUFFER_SIZE)) {
+      int res = HgfsWriteBackWriteOut(wb);
+
+      if (res < 0) {
+         result = res;
+         goto out;
+      }
+   }
+
+   if (wb->size == 0) {
+      if (count >= HGFS_WB_BUFFER_SIZE) {
+         result = 0;
+         goto out;
+      }
+      if (wb->buf == NULL) {
+         wb->buf = malloc(HGFS_WB_BUFFER_SIZE);
+         if (wb->buf == NULL) {
+            result = 0;
+            goto out;
+         }
+      }
+      wb->offset = offset;
+      wb->dirtyTime = time(NULL);
+      Atomic_Inc32(&wbDirtyCount);
+   }
+
+   memcpy(wb->buf + wb->size, buf, count);
+   wb->size += count;
+
+   if (wb->size == HGFS_WB_BUFFER_SIZE) {
+      int res = HgfsWriteBackWriteOut(wb);
+
+      if (res < 0) {
+         result = res;
+      }
+   }
+
+out:
+   HgfsWriteBackUnlock(wb);
+   return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWriteBackFlush
+ *
+ *    Writes out the buffer of a handle, for flush and fsync.
+ *
+ * Results:
+ *    Zero on success, or the first error not yet reported.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HgfsWriteBackFlush(HgfsHandle handle) //IN: File handle
+{
+   HgfsWriteBack *wb;
+   int result;
+
+   if (!wbEnabled) {
+      return 0;
+   }
+
+   wb = HgfsWriteBackLookup(handle);
+   if (wb == NULL) {
+      return 0;
+   }
+
+   result = HgfsWriteBackWriteOut(wb);
+   if (wb->error != 0) {
+      result = wb->error;
+      wb->error = 0;
+   }
+   HgfsWriteBackUnlock(wb);
+
+   return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWriteBackFlushPath
+ *
+ *    Writes out the buffers of every handle open on the path. Errors are
+ *    kept on the handles.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsWriteBackFlushPath(const char *path) //IN: Path of the file
+{
+   if (!wbEnabled || Atomic_Read32(&wbDirtyCount) == 0) {
+      return;
+   }
+
+   HgfsWriteBackDeferAll(path, time(NULL), HGFS_INVALID_HANDLE);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWriteBackPending
+ *
+ *    Checks whether any handle holds buffered writes, in which case the
+ *    sizes and times reported by the server may be stale.
+ *
+ * Results:
+ *    TRUE if some buffer is dirty, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+Bool
+HgfsWriteBackPending(void)
+{
+   return wbEnabled && Atomic_Read32(&wbDirtyCount) > 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWriteBackRename
+ *
+ *    Updates the path of the handles open on a file or directory that
+ *    has been renamed, including those open below a renamed directory,
+ *    so that flushes by path still find them.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsWriteBackRename(const char *from, //IN: Old path
+                    const char *to)   //IN: New path
+{
+   size_t fromLen = strlen(from);
+   unsigned int i;
+
+   if (!wbEnabled) {
+      return;
+   }
+
+   pthread_mutex_lock(&wbTableLock);
+   for (i = 0; i < HGFS_WB_BUCKET_COUNT; i++) {
+      HgfsWriteBack *wb;
+
+      list_for_each_entry(wb, &wbTable[i], list) {
+         const char *rest = wb->path + fromLen;
+         char *path;
+
+         if (strncmp(wb->path, from, fromLen) != 0 ||
+             (*rest != '\0' && *rest != '/')) {
+            continue;
+         }
+         path = Str_Asprintf(NULL, "%s%s", to, rest);
+         if (path == NULL) {
+            LOG(4, ("handle %u: cannot follow rename of %s\n", wb->handle,
+                    wb->path));
+            continue;
+         }
+         /* Not the handle lock, which a write-out may hold for long. */
+         pthread_mutex_lock(&wb->pathLock);
+         free(wb->path);
+         wb->path = path;
+         pthread_mutex_unlock(&wb->pathLock);
+      }
+   }
+   pthread_mutex_unlock(&wbTableLock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsWriteBackFlusher
+ *
+ *    Thread routine writing out the buffers that have been dirty for
+ *    longer than HGFS_WB_MAX_AGE seconds.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void*
+HgfsWriteBackFlusher(void* unused) //IN: Thread argument
+{
+   while (1) {
+      sleep(HGFS_WB_FLUSHER_SLEEP_TIME);
+      if (Atomic_Read32(&wbDirtyCount) > 0) {
+         HgfsWriteBackDeferAll(NULL, time(NULL) - HGFS_WB_MAX_AGE,
+                               HGFS_INVALID_HANDLE);
+      }
+   }
+   return NULL;
+}
@@ -0,0 +1,39 @@
+/*********************************************************
+ * Copyright (C) 2026 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * writeback.h --
+ *
+ * Declarations of the write-back buffer functions.
+ */
+
+#ifndef _HGFS_DRIVER_WRITEBACK_H_
+#define _HGFS_DRIVER_WRITEBACK_H_
+
+void HgfsWriteBackInit(Bool enabled);
+void HgfsWriteBackOpen(HgfsHandle handle, const char *path);
+int HgfsWriteBackRelease(HgfsHandle handle);
+ssize_t HgfsWriteBackWrite(HgfsHandle handle, const char *buf,
+                           size_t count, loff_t offset);
+int HgfsWriteBackFlush(HgfsHandle handle);
+void HgfsWriteBackFlushPath(const char *path);
+void HgfsWriteBackRename(const char *from, const char *to);
+Bool HgfsWriteBackPending(void);
+void* HgfsWriteBackFlusher(void *);
+
+#endif // _HGFS_DRIVER_WRITEBACK_H_